@@ -0,0 +1,446 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CompressedWaveform
+ */
+#include "../scopehal/scopehal.h"
+#include "CompressedWaveform.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+///@brief Maximum number of distinct values we'll put in an analog palette before giving up
+static const size_t MAX_PALETTE_SIZE = 65536;
+
+///@brief Number of entries in the lookup caches used when building the palette
+static const size_t CACHE_SIZE = 4096;
+
+/**
+	@brief Hashes a float bit pattern to a lookup cache index
+ */
+static inline size_t CacheHash(uint32_t bits)
+{
+	return (bits * 2654435761u) >> 20;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bit packing helpers
+
+/**
+	@brief Writes up to 56 bits into a zero-initialized buffer at an arbitrary bit position
+
+	The buffer must have at least 8 bytes of space past the byte containing bitpos.
+ */
+static inline void PutBits(uint8_t* buf, size_t bitpos, uint64_t value)
+{
+	uint8_t* p = buf + (bitpos >> 3);
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	word |= value << (bitpos & 7);
+	memcpy(p, &word, sizeof(word));
+}
+
+/**
+	@brief Reads up to 56 bits from an arbitrary bit position in a buffer
+
+	The buffer must have at least 8 bytes of space past the byte containing bitpos.
+ */
+static inline uint64_t GetBits(const uint8_t* buf, size_t bitpos, unsigned width)
+{
+	uint64_t word;
+	memcpy(&word, buf + (bitpos >> 3), sizeof(word));
+	return (word >> (bitpos & 7)) & ( (1ULL << width) - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+CompressedWaveform::CompressedWaveform()
+	: m_type(TYPE_UNIFORM_ANALOG)
+	, m_length(0)
+	, m_timescale(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+	, m_triggerPhase(0)
+	, m_flags(0)
+	, m_revision(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Delta coding
+
+/**
+	@brief Delta codes a sequence of integers and bit-packs the result
+
+	@param len	Number of values
+	@param get	Functor returning the int64_t value at a given index
+	@param out	Output buffer (appended to)
+ */
+template<class F>
+void CompressedWaveform::PackDeltas(size_t len, F get, vector<uint8_t>& out)
+{
+	uint64_t zz[BLOCK_SIZE];
+	int64_t prev = 0;
+	for(size_t base=0; base < len; base += BLOCK_SIZE)
+	{
+		size_t n = min(BLOCK_SIZE, len - base);
+
+		//Calculate zigzag encoded deltas, and OR them together to find the largest bit set
+		uint64_t all = 0;
+		for(size_t i=0; i<n; i++)
+		{
+			int64_t cur = get(base + i);
+			int64_t delta = static_cast<int64_t>(static_cast<uint64_t>(cur) - static_cast<uint64_t>(prev));
+			prev = cur;
+
+			zz[i] = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+			all |= zz[i];
+		}
+
+		unsigned width = 0;
+		while( (width < 64) && (all >> width) )
+			width ++;
+
+		//Block header is just the bit width. If it's zero, the whole block is identical to the previous value
+		out.push_back(width);
+		if(width == 0)
+			continue;
+
+		//Make space for the block plus padding for 64-bit writes off the end
+		size_t nbytes = (n*width + 7) / 8;
+		size_t start = out.size();
+		out.resize(start + nbytes + 8, 0);
+		uint8_t* p = out.data() + start;
+
+		if(width <= 56)
+		{
+			for(size_t i=0; i<n; i++)
+				PutBits(p, i*width, zz[i]);
+		}
+		else
+		{
+			for(size_t i=0; i<n; i++)
+			{
+				PutBits(p, i*width, zz[i] & 0xffffffff);
+				PutBits(p, i*width + 32, zz[i] >> 32);
+			}
+		}
+
+		out.resize(start + nbytes);
+	}
+
+	//Trailing padding so the decoder can always do 64-bit reads
+	out.resize(out.size() + 8, 0);
+}
+
+/**
+	@brief Decodes a sequence of integers written by PackDeltas()
+
+	@param in	Input buffer
+	@param len	Number of values
+	@param set	Functor called with the index and int64_t value of each decoded sample
+ */
+template<class F>
+void CompressedWaveform::UnpackDeltas(const uint8_t* in, size_t len, F set)
+{
+	int64_t prev = 0;
+	for(size_t base=0; base < len; base += BLOCK_SIZE)
+	{
+		size_t n = min(BLOCK_SIZE, len - base);
+		unsigned width = *in;
+		in ++;
+
+		if(width == 0)
+		{
+			for(size_t i=0; i<n; i++)
+				set(base + i, prev);
+			continue;
+		}
+
+		if(width <= 56)
+		{
+			for(size_t i=0; i<n; i++)
+			{
+				uint64_t zz = GetBits(in, i*width, width);
+				uint64_t delta = (zz >> 1) ^ (~(zz & 1) + 1);
+				prev = static_cast<int64_t>(static_cast<uint64_t>(prev) + delta);
+				set(base + i, prev);
+			}
+		}
+		else
+		{
+			for(size_t i=0; i<n; i++)
+			{
+				uint64_t zz = GetBits(in, i*width, 32) | (GetBits(in, i*width + 32, width - 32) << 32);
+				uint64_t delta = (zz >> 1) ^ (~(zz & 1) + 1);
+				prev = static_cast<int64_t>(static_cast<uint64_t>(prev) + delta);
+				set(base + i, prev);
+			}
+		}
+
+		in += (n*width + 7) / 8;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compression
+
+/**
+	@brief Creates a compressed copy of a waveform
+
+	The original waveform is not modified.
+
+	@return The compressed waveform, or nullptr if the waveform type is not supported or the data is not compressible
+ */
+CompressedWaveform* CompressedWaveform::Compress(WaveformBase* wfm)
+{
+	auto uanalog = dynamic_cast<UniformAnalogWaveform*>(wfm);
+	auto sanalog = dynamic_cast<SparseAnalogWaveform*>(wfm);
+	auto udigital = dynamic_cast<UniformDigitalWaveform*>(wfm);
+	auto sdigital = dynamic_cast<SparseDigitalWaveform*>(wfm);
+	auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+
+	//TODO: support protocol waveforms, eyes, etc
+	if(!uanalog && !sanalog && !udigital && !sdigital)
+		return nullptr;
+
+	wfm->PrepareForCpuAccess();
+	size_t len = wfm->size();
+
+	auto ret = new CompressedWaveform;
+	ret->m_length = len;
+	ret->m_timescale = wfm->m_timescale;
+	ret->m_startTimestamp = wfm->m_startTimestamp;
+	ret->m_startFemtoseconds = wfm->m_startFemtoseconds;
+	ret->m_triggerPhase = wfm->m_triggerPhase;
+	ret->m_flags = wfm->m_flags;
+	ret->m_revision = wfm->m_revision;
+
+	size_t originalSize = 0;
+	if(uanalog || sanalog)
+	{
+		ret->m_type = uanalog ? TYPE_UNIFORM_ANALOG : TYPE_SPARSE_ANALOG;
+		const float* samples = uanalog ? uanalog->m_samples.GetCpuPointer() : sanalog->m_samples.GetCpuPointer();
+		originalSize = len * sizeof(float);
+
+		//Find the distinct values in the waveform (by bit pattern, so we're exact even for -0 etc).
+		//Most lookups hit in a small direct-mapped cache in front of the hash set.
+		//The cache is seeded with the first sample, so that one has to be checked for NaN up front:
+		//anything which hits in the cache skips the check below.
+		unordered_set<uint32_t> values;
+		uint32_t cache[CACHE_SIZE];
+		if(len)
+		{
+			if(isnan(samples[0]))
+			{
+				delete ret;
+				return nullptr;
+			}
+
+			memcpy(&cache[0], &samples[0], sizeof(uint32_t));
+			for(size_t i=1; i<CACHE_SIZE; i++)
+				cache[i] = cache[0];
+			values.emplace(cache[0]);
+		}
+		for(size_t i=0; i<len; i++)
+		{
+			uint32_t bits;
+			memcpy(&bits, &samples[i], sizeof(bits));
+			auto h = CacheHash(bits);
+			if(cache[h] == bits)
+				continue;
+			cache[h] = bits;
+
+			//NaNs can't be sorted, and too many distinct values means this probably isn't ADC data
+			if(isnan(samples[i]))
+			{
+				delete ret;
+				return nullptr;
+			}
+			values.emplace(bits);
+			if(values.size() > MAX_PALETTE_SIZE)
+			{
+				delete ret;
+				return nullptr;
+			}
+		}
+
+		//Sort the palette by voltage so nearby ADC codes get nearby indexes
+		vector<uint32_t> sorted(values.begin(), values.end());
+		sort(sorted.begin(), sorted.end(), [](uint32_t a, uint32_t b)
+			{
+				float fa;
+				float fb;
+				memcpy(&fa, &a, sizeof(fa));
+				memcpy(&fb, &b, sizeof(fb));
+				if(fa != fb)
+					return fa < fb;
+				return a < b;
+			});
+
+		unordered_map<uint32_t, int64_t> indexes;
+		ret->m_palette.resize(sorted.size());
+		for(size_t i=0; i<sorted.size(); i++)
+		{
+			memcpy(&ret->m_palette[i], &sorted[i], sizeof(float));
+			indexes[sorted[i]] = i;
+		}
+
+		//Delta code the palette indexes
+		uint32_t cacheBits[CACHE_SIZE];
+		int64_t cacheIndex[CACHE_SIZE];
+		if(len)
+		{
+			for(size_t i=0; i<CACHE_SIZE; i++)
+			{
+				cacheBits[i] = cache[0];
+				cacheIndex[i] = indexes[cache[0]];
+			}
+		}
+		PackDeltas(len, [&](size_t i)
+			{
+				uint32_t bits;
+				memcpy(&bits, &samples[i], sizeof(bits));
+				auto h = CacheHash(bits);
+				if(cacheBits[h] != bits)
+				{
+					cacheBits[h] = bits;
+					cacheIndex[h] = indexes[bits];
+				}
+				return cacheIndex[h];
+			},
+			ret->m_samples);
+	}
+	else
+	{
+		ret->m_type = udigital ? TYPE_UNIFORM_DIGITAL : TYPE_SPARSE_DIGITAL;
+		const bool* samples = udigital ? udigital->m_samples.GetCpuPointer() : sdigital->m_samples.GetCpuPointer();
+		originalSize = len * sizeof(bool);
+
+		PackDeltas(len, [&](size_t i) { return samples[i] ? 1 : 0; }, ret->m_samples);
+	}
+
+	if(sparse)
+	{
+		const int64_t* offsets = sparse->m_offsets.GetCpuPointer();
+		const int64_t* durations = sparse->m_durations.GetCpuPointer();
+		originalSize += len * 2 * sizeof(int64_t);
+
+		PackDeltas(len, [&](size_t i) { return offsets[i]; }, ret->m_offsets);
+		PackDeltas(len, [&](size_t i) { return durations[i]; }, ret->m_durations);
+	}
+
+	//Don't bother keeping it if we didn't save anything
+	if(ret->GetMemoryUsage() >= originalSize)
+	{
+		delete ret;
+		return nullptr;
+	}
+
+	ret->m_samples.shrink_to_fit();
+	ret->m_offsets.shrink_to_fit();
+	ret->m_durations.shrink_to_fit();
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decompression
+
+/**
+	@brief Creates a new waveform containing the uncompressed data
+
+	The caller is responsible for deleting the returned waveform.
+ */
+WaveformBase* CompressedWaveform::Decompress() const
+{
+	WaveformBase* wfm = nullptr;
+	UniformAnalogWaveform* uanalog = nullptr;
+	SparseAnalogWaveform* sanalog = nullptr;
+	UniformDigitalWaveform* udigital = nullptr;
+	SparseDigitalWaveform* sdigital = nullptr;
+	SparseWaveformBase* sparse = nullptr;
+	switch(m_type)
+	{
+		case TYPE_UNIFORM_ANALOG:
+			wfm = uanalog = new UniformAnalogWaveform;
+			break;
+
+		case TYPE_SPARSE_ANALOG:
+			wfm = sparse = sanalog = new SparseAnalogWaveform;
+			break;
+
+		case TYPE_UNIFORM_DIGITAL:
+			wfm = udigital = new UniformDigitalWaveform;
+			break;
+
+		case TYPE_SPARSE_DIGITAL:
+		default:
+			wfm = sparse = sdigital = new SparseDigitalWaveform;
+			break;
+	}
+
+	wfm->m_timescale = m_timescale;
+	wfm->m_startTimestamp = m_startTimestamp;
+	wfm->m_startFemtoseconds = m_startFemtoseconds;
+	wfm->m_triggerPhase = m_triggerPhase;
+	wfm->m_flags = m_flags;
+	wfm->m_revision = m_revision;
+
+	wfm->Resize(m_length);
+	wfm->PrepareForCpuAccess();
+
+	if(uanalog || sanalog)
+	{
+		float* samples = uanalog ? uanalog->m_samples.GetCpuPointer() : sanalog->m_samples.GetCpuPointer();
+		const float* palette = m_palette.data();
+		UnpackDeltas(m_samples.data(), m_length, [&](size_t i, int64_t v) { samples[i] = palette[v]; });
+	}
+	else
+	{
+		bool* samples = udigital ? udigital->m_samples.GetCpuPointer() : sdigital->m_samples.GetCpuPointer();
+		UnpackDeltas(m_samples.data(), m_length, [&](size_t i, int64_t v) { samples[i] = (v != 0); });
+	}
+
+	if(sparse)
+	{
+		int64_t* offsets = sparse->m_offsets.GetCpuPointer();
+		int64_t* durations = sparse->m_durations.GetCpuPointer();
+		UnpackDeltas(m_offsets.data(), m_length, [&](size_t i, int64_t v) { offsets[i] = v; });
+		UnpackDeltas(m_durations.data(), m_length, [&](size_t i, int64_t v) { durations[i] = v; });
+	}
+
+	wfm->MarkModifiedFromCpu();
+	return wfm;
+}
@@ -0,0 +1,128 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CompressedWaveform
+ */
+#ifndef CompressedWaveform_h
+#define CompressedWaveform_h
+
+#include <vector>
+
+/**
+	@brief Losslessly compressed copy of a waveform, for keeping old history in memory more compactly
+
+	Analog samples are mapped onto a sorted palette of the distinct voltages present in the waveform. Since most
+	waveforms came from an ADC with 8-12 bits of resolution, this recovers the original ADC code (minus any codes which
+	were never used) exactly and without needing to know the gain and offset the driver used to convert it.
+
+	The palette indices, as well as sparse offsets and durations, are then delta coded and stored as zigzag encoded
+	integers bit-packed in blocks of BLOCK_SIZE. Each block uses the smallest bit width able to hold every delta in
+	it, so slowly varying or oversampled signals typically need only a few bits per sample.
+ */
+class CompressedWaveform
+{
+public:
+	static CompressedWaveform* Compress(WaveformBase* wfm);
+
+	WaveformBase* Decompress() const;
+
+	/**
+		@brief Returns the size of the compressed data, in bytes
+	 */
+	size_t GetMemoryUsage() const
+	{
+		return m_palette.size() * sizeof(float) +
+			m_samples.size() + m_offsets.size() + m_durations.size() + sizeof(CompressedWaveform);
+	}
+
+	/**
+		@brief Returns the number of samples in the waveform
+	 */
+	size_t size() const
+	{ return m_length; }
+
+	///@brief Number of values in each bit-packed block
+	static const size_t BLOCK_SIZE = 128;
+
+protected:
+	CompressedWaveform();
+
+	template<class F>
+	static void PackDeltas(size_t len, F get, std::vector<uint8_t>& out);
+
+	template<class F>
+	static void UnpackDeltas(const uint8_t* in, size_t len, F set);
+
+	///@brief Types of waveform we know how to compress
+	enum WaveformType
+	{
+		TYPE_UNIFORM_ANALOG,
+		TYPE_SPARSE_ANALOG,
+		TYPE_UNIFORM_DIGITAL,
+		TYPE_SPARSE_DIGITAL
+	} m_type;
+
+	///@brief Number of samples in the waveform
+	size_t m_length;
+
+	///@brief Timescale of the original waveform
+	int64_t m_timescale;
+
+	///@brief Start time of the original waveform (integer part)
+	int64_t m_startTimestamp;
+
+	///@brief Start time of the original waveform (fractional part)
+	int64_t m_startFemtoseconds;
+
+	///@brief Trigger phase of the original waveform
+	int64_t m_triggerPhase;
+
+	///@brief Flags of the original waveform
+	uint8_t m_flags;
+
+	///@brief Revision number of the original waveform
+	uint64_t m_revision;
+
+	///@brief Sorted list of distinct sample values (analog only)
+	std::vector<float> m_palette;
+
+	///@brief Packed palette indices (analog) or sample values (digital)
+	std::vector<uint8_t> m_samples;
+
+	///@brief Packed sample offsets (sparse only)
+	std::vector<uint8_t> m_offsets;
+
+	///@brief Packed sample durations (sparse only)
+	std::vector<uint8_t> m_durations;
+};
+
+#endif
@@ -0,0 +1,501 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CpuRasterizer
+ */
+#include "../scopehal/scopehal.h"
+#include "CpuRasterizer.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//Must match waveform-compute.glsl
+#define MAX_HEIGHT		2048
+#define ROWS_PER_BLOCK	64
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Span fill kernels
+
+static void AddSpan(float* p, size_t n, float alpha)
+{
+	for(size_t i=0; i<n; i++)
+		p[i] += alpha;
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+static void AddSpanAVX2(float* p, size_t n, float alpha)
+{
+	__m256 valpha = _mm256_set1_ps(alpha);
+
+	size_t i = 0;
+	for(; i+8 <= n; i += 8)
+		_mm256_storeu_ps(p + i, _mm256_add_ps(_mm256_loadu_ps(p + i), valpha));
+
+	for(; i<n; i++)
+		p[i] += alpha;
+}
+
+__attribute__((target("avx512f")))
+static void AddSpanAVX512F(float* p, size_t n, float alpha)
+{
+	__m512 valpha = _mm512_set1_ps(alpha);
+
+	size_t i = 0;
+	for(; i+16 <= n; i += 16)
+		_mm512_storeu_ps(p + i, _mm512_add_ps(_mm512_loadu_ps(p + i), valpha));
+
+	//Masked tail
+	if(i < n)
+	{
+		__mmask16 mask = (1 << (n - i)) - 1;
+		__m512 v = _mm512_maskz_loadu_ps(mask, p + i);
+		_mm512_mask_storeu_ps(p + i, mask, _mm512_add_ps(v, valpha));
+	}
+}
+#endif /* __x86_64__ */
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+CpuRasterizer::CpuRasterizer()
+	: m_digital(false)
+	, m_histogram(false)
+	, m_zeroHold(false)
+	, m_dense(true)
+	, m_analogSamples(nullptr)
+	, m_digitalSamples(nullptr)
+	, m_offsets(nullptr)
+	, m_durations(nullptr)
+	, m_indexes(nullptr)
+	, m_addSpan(AddSpan)
+{
+	#ifdef __x86_64__
+		if(g_hasAvx512F)
+			m_addSpan = AddSpanAVX512F;
+		else if(g_hasAvx2)
+			m_addSpan = AddSpanAVX2;
+	#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup shared by the GPU and CPU render paths
+
+/**
+	@brief Calculates the per-sample intensity for a waveform at the current zoom level
+
+	As we zoom out more, alpha is reduced to get proper intensity grading.
+
+	@param data				The waveform being drawn. If drawing a decimated copy, pass the full waveform so switching
+							between levels doesn't change the brightness.
+	@param pixelsPerXUnit	Horizontal scale
+	@param traceAlpha		Intensity preference set by the user
+ */
+float CpuRasterizer::GetScaledAlpha(WaveformBase* data, double pixelsPerXUnit, float traceAlpha)
+{
+	auto sdata = dynamic_cast<SparseWaveformBase*>(data);
+	auto udata = dynamic_cast<UniformWaveformBase*>(data);
+	auto end = data->size() - 1;
+	int64_t firstOff = GetOffsetScaled(sdata, udata, 0);
+	int64_t lastOff = GetOffsetScaled(sdata, udata, end);
+	float capture_len = lastOff - firstOff;
+	float avg_sample_len = capture_len / data->size();
+	float samplesPerPixel = 1.0 / (pixelsPerXUnit * avg_sample_len);
+	float alpha_scaled = traceAlpha / sqrt(samplesPerPixel);
+	return min(1.0f, alpha_scaled) * 2;
+}
+
+/**
+	@brief Fills out the push constants for drawing a waveform, with persistence off
+
+	@param data					The waveform being drawn
+	@param xAxisOffset			Timestamp of the left edge of the window
+	@param pixelsPerXUnit		Horizontal scale
+	@param pixelsPerYAxisUnit	Vertical scale (ignored for digital waveforms, which fill the window height)
+	@param yAxisOffset			Vertical offset of the stream (ignored for digital waveforms)
+	@param w					Width of the window
+	@param h					Height of the window
+	@param alpha				Per-sample intensity, from GetScaledAlpha()
+ */
+ConfigPushConstants CpuRasterizer::GetConfig(
+	WaveformBase* data,
+	int64_t xAxisOffset,
+	double pixelsPerXUnit,
+	float pixelsPerYAxisUnit,
+	float yAxisOffset,
+	uint32_t w,
+	uint32_t h,
+	float alpha)
+{
+	int64_t innerxoff = xAxisOffset / data->m_timescale;
+	int64_t fractional_offset = xAxisOffset % data->m_timescale;
+	int64_t offset_samples = (xAxisOffset - data->m_triggerPhase) / data->m_timescale;
+
+	ConfigPushConstants config;
+	config.innerXoff = -innerxoff;
+	config.windowHeight = h;
+	config.windowWidth = w;
+	config.memDepth = data->size();
+	config.offset_samples = offset_samples - 2;
+	config.alpha = alpha;
+	config.xoff = (data->m_triggerPhase - fractional_offset) * pixelsPerXUnit;
+	config.xscale = data->m_timescale * pixelsPerXUnit;
+	if(dynamic_cast<UniformDigitalWaveform*>(data) || dynamic_cast<SparseDigitalWaveform*>(data))
+	{
+		config.yoff = 0;
+		config.yscale = h - 1;
+		config.ybase = 0;
+	}
+	else
+	{
+		config.yscale = pixelsPerYAxisUnit;
+		config.yoff = yAxisOffset;
+		config.ybase = h * 0.5f;
+	}
+	config.persistScale = 0;
+	return config;
+}
+
+/**
+	@brief Finds the first element of a sorted array which is >= a value, starting at a known lower bound
+
+	Probes exponentially further from the starting point before binary searching, so a series of searches for
+	increasing values walks the array in O(log distance) steps each rather than O(log len).
+
+	@param buf		The array
+	@param len		Number of elements in the array
+	@param start	Index which is known to be <= the result
+	@param value	Value to search for
+
+	@return Index of the first element >= value, or len if there is none
+ */
+static size_t GallopForGequal(const int64_t* buf, size_t len, size_t start, int64_t value)
+{
+	if( (start >= len) || (buf[start] >= value) )
+		return start;
+
+	//buf[lo] < value, and buf[hi] >= value (or hi == len)
+	size_t lo = start;
+	size_t step = 1;
+	size_t hi = start + step;
+	while( (hi < len) && (buf[hi] < value) )
+	{
+		lo = hi;
+		step *= 2;
+		hi = start + step;
+	}
+	hi = min(hi, len);
+
+	return lower_bound(buf + lo + 1, buf + hi, value) - buf;
+}
+
+/**
+	@brief Finds the first sample of a sparse waveform in each pixel column, on the CPU
+
+	@param data				The waveform being drawn
+	@param xAxisOffset		Timestamp of the left edge of the window
+	@param pixelsPerXUnit	Horizontal scale
+	@param indexes			Output buffer, one entry per pixel column
+	@param w				Width of the window
+ */
+void CpuRasterizer::GetSparseIndexes(
+	SparseWaveformBase* data,
+	int64_t xAxisOffset,
+	double pixelsPerXUnit,
+	uint32_t* indexes,
+	size_t w)
+{
+	int64_t offset_samples = (xAxisOffset - data->m_triggerPhase) / data->m_timescale;
+	double xscale = data->m_timescale * pixelsPerXUnit;
+
+	//The columns are in increasing time order, so each search can start where the last one left off
+	data->m_offsets.PrepareForCpuAccess();
+	auto offsets = data->m_offsets.GetCpuPointer();
+	size_t len = data->size();
+	size_t start = 0;
+	for(size_t i=0; i<w; i++)
+	{
+		int64_t target = floor(i / xscale) + offset_samples;
+		start = GallopForGequal(offsets, len, start, target);
+		indexes[i] = start;
+	}
+}
+
+/**
+	@brief Points the rasterizer at a waveform's samples, and sets m_digital and m_dense to match it
+
+	m_zeroHold must be set first, since durations are only fetched if it is. m_indexes has to be filled in separately
+	for sparse waveforms (see GetSparseIndexes()).
+ */
+void CpuRasterizer::SetWaveform(WaveformBase* data)
+{
+	auto sdata = dynamic_cast<SparseWaveformBase*>(data);
+	auto uadata = dynamic_cast<UniformAnalogWaveform*>(data);
+	auto sadata = dynamic_cast<SparseAnalogWaveform*>(data);
+	auto uddata = dynamic_cast<UniformDigitalWaveform*>(data);
+	auto sddata = dynamic_cast<SparseDigitalWaveform*>(data);
+
+	m_digital = (uddata || sddata);
+	m_dense = (sdata == nullptr);
+	if(uadata)
+	{
+		uadata->m_samples.PrepareForCpuAccess();
+		m_analogSamples = uadata->m_samples.GetCpuPointer();
+	}
+	if(sadata)
+	{
+		sadata->m_samples.PrepareForCpuAccess();
+		m_analogSamples = sadata->m_samples.GetCpuPointer();
+	}
+	if(uddata)
+	{
+		uddata->m_samples.PrepareForCpuAccess();
+		m_digitalSamples = uddata->m_samples.GetCpuPointer();
+	}
+	if(sddata)
+	{
+		sddata->m_samples.PrepareForCpuAccess();
+		m_digitalSamples = sddata->m_samples.GetCpuPointer();
+	}
+	if(sdata)
+	{
+		sdata->m_offsets.PrepareForCpuAccess();
+		m_offsets = sdata->m_offsets.GetCpuPointer();
+		if(m_zeroHold)
+		{
+			sdata->m_durations.PrepareForCpuAccess();
+			m_durations = sdata->m_durations.GetCpuPointer();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rasterization
+
+/**
+	@brief Rasterizes the waveform into an fp32 intensity buffer
+
+	@param config	Same push constants as would be passed to the shader
+	@param out		Output buffer, windowWidth * windowHeight pixels in row major order. Must contain the previous
+					image if persistence is enabled (config.persistScale != 0).
+ */
+void CpuRasterizer::Rasterize(const ConfigPushConstants& config, float* out)
+{
+	//Same limits as the shader
+	if(config.windowHeight > MAX_HEIGHT)
+		return;
+	bool useNext = m_histogram || !m_zeroHold;
+	if(config.memDepth < (useNext ? 2 : 1))
+		return;
+
+	#pragma omp parallel
+	{
+		vector<float> working(config.windowHeight);
+
+		#pragma omp for schedule(dynamic, 16)
+		for(uint32_t x=0; x<config.windowWidth; x++)
+			RasterizeColumn(config, out, x, working.data());
+	}
+}
+
+/**
+	@brief Gets the X position of a sample, in the same units as the shader's FetchX()
+ */
+float CpuRasterizer::FetchX(const ConfigPushConstants& config, uint32_t i)
+{
+	if(m_dense)
+		return static_cast<float>(static_cast<int64_t>(i) + config.innerXoff);
+	else
+		return static_cast<float>(m_offsets[i] + config.innerXoff);
+}
+
+/**
+	@brief Gets the Y position of a sample, in pixels
+ */
+float CpuRasterizer::FetchY(const ConfigPushConstants& config, uint32_t i)
+{
+	if(m_digital)
+		return (m_digitalSamples[i] ? 1 : 0) * config.yscale + config.ybase;
+	else
+		return (m_analogSamples[i] + config.yoff) * config.yscale + config.ybase;
+}
+
+/**
+	@brief Rasterizes a single pixel column, mirroring one workgroup of the shader
+
+	The shader processes samples in blocks of ROWS_PER_BLOCK and only checks whether it's done at the end of each
+	block, so we do the same to get identical output.
+
+	@param config	Push constants
+	@param out		Output buffer
+	@param x		The column
+	@param working	Scratch buffer of windowHeight floats
+ */
+void CpuRasterizer::RasterizeColumn(const ConfigPushConstants& config, float* out, uint32_t x, float* working)
+{
+	uint32_t w = config.windowWidth;
+	uint32_t h = config.windowHeight;
+	bool useNext = m_histogram || !m_zeroHold;
+	uint32_t lastSample = config.memDepth - (useNext ? 1 : 0);
+	float fx = x;
+
+	//Clear (or persistence load) working buffer
+	if(config.persistScale == 0)
+		memset(working, 0, h * sizeof(float));
+	else
+	{
+		for(uint32_t y=0; y<h; y++)
+			working[y] = out[w*y + x] * config.persistScale;
+	}
+
+	//Find the first sample
+	bool done = false;
+	uint32_t istart;
+	if(m_dense)
+	{
+		istart = static_cast<uint32_t>(floor(fx / config.xscale)) + config.offset_samples;
+		uint32_t iend = static_cast<uint32_t>(floor((fx + 1) / config.xscale)) + config.offset_samples;
+		if(iend == 0)
+			done = true;
+	}
+	else
+	{
+		istart = m_indexes[x];
+		if( ( (x + 1) < w) && (m_indexes[x + 1] == 0) )
+			done = true;
+	}
+
+	int blockmin[ROWS_PER_BLOCK];
+	int blockmax[ROWS_PER_BLOCK];
+	bool updating[ROWS_PER_BLOCK];
+	for(uint32_t base = istart; ; base += ROWS_PER_BLOCK)
+	{
+		for(uint32_t k=0; k<ROWS_PER_BLOCK; k++)
+		{
+			uint32_t i = base + k;
+			updating[k] = false;
+			if(i >= lastSample)
+			{
+				done = true;
+				continue;
+			}
+
+			//Fetch coordinates
+			float leftx = FetchX(config, i) * config.xscale + config.xoff;
+			float lefty = FetchY(config, i);
+			float rightx;
+			float righty;
+			if(useNext)
+			{
+				rightx = FetchX(config, i+1) * config.xscale + config.xoff;
+				righty = FetchY(config, i+1);
+			}
+			else
+			{
+				float duration = m_dense ? 1 : static_cast<float>(m_durations[i]);
+				rightx = leftx + duration * config.xscale;
+				righty = lefty;
+			}
+
+			//Skip offscreen samples
+			if( (rightx >= fx) && (leftx <= fx + 1) )
+			{
+				//To start, assume we're drawing the entire segment
+				float starty = lefty;
+				float endy = righty;
+
+				if(m_histogram)
+				{
+					starty = 0;
+					endy = lefty;
+				}
+				else if(m_digital)
+				{
+					//If we are very near the right edge, draw vertical line, otherwise a single pixel
+					if(fabs(rightx - fx) <= 1)
+						endy = righty;
+					else
+						endy = lefty;
+				}
+
+				//Interpolate analog signals if either end is outside our column
+				else if(!m_zeroHold)
+				{
+					float slope = (righty - lefty) / (rightx - leftx);
+					if(leftx < fx)
+						starty = lefty + (fx - leftx) * slope;
+					if(rightx > fx + 1)
+						endy = lefty + (fx + 1 - leftx) * slope;
+				}
+
+				//Clip to window size in case anything is partially offscreen
+				if( !( (starty < 0) && (endy < 0) ) && !( (starty >= h) && (endy >= h) ) )
+				{
+					float hmax = h - 1;
+					starty = max(min(starty, hmax), 0.0f);
+					endy = max(min(endy, hmax), 0.0f);
+
+					updating[k] = true;
+					blockmin[k] = static_cast<int>(min(starty, endy));
+					blockmax[k] = static_cast<int>(max(starty, endy));
+				}
+			}
+
+			//Check if we're at the end of the pixel
+			if(rightx > fx + 1)
+				done = true;
+		}
+
+		//Draw everything from this block, in order
+		for(uint32_t k=0; k<ROWS_PER_BLOCK; k++)
+		{
+			if(!updating[k])
+				continue;
+
+			size_t len = blockmax[k] - blockmin[k] + 1;
+			if(m_histogram)
+				fill(working + blockmin[k], working + blockmin[k] + len, config.alpha);
+			else
+				m_addSpan(working + blockmin[k], len, config.alpha);
+		}
+
+		if(done)
+			break;
+	}
+
+	//Copy working buffer to output
+	for(uint32_t y=0; y<h; y++)
+		out[w*y + x] = working[y];
+}
@@ -0,0 +1,127 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CpuRasterizer
+ */
+#ifndef CpuRasterizer_h
+#define CpuRasterizer_h
+
+/**
+	@brief Push constants for waveform-compute.glsl
+ */
+struct ConfigPushConstants
+{
+	int64_t innerXoff;
+	uint32_t windowHeight;
+	uint32_t windowWidth;
+	uint32_t memDepth;
+	uint32_t offset_samples;
+	float alpha;
+	float xoff;
+	float xscale;
+	float ybase;
+	float yscale;
+	float yoff;
+	float persistScale;
+};
+
+/**
+	@brief Software implementation of waveform-compute.glsl
+
+	Produces the same fp32 intensity buffer as the GPU rasterizer, for machines where the Vulkan implementation is too
+	slow (e.g. a software renderer), or as a reference to check the shaders against.
+
+	Columns are split across threads with OpenMP, and the vertical spans are filled with AVX2 or AVX-512 if the CPU
+	supports them.
+ */
+class CpuRasterizer
+{
+public:
+	CpuRasterizer();
+
+	///@brief Set to true for digital waveforms (samples in m_digitalSamples rather than m_analogSamples)
+	bool m_digital;
+
+	///@brief Set to true to fill the area under the waveform (equivalent to HISTOGRAM_PATH)
+	bool m_histogram;
+
+	///@brief Set to true for waveforms drawn without interpolation (equivalent to NO_INTERPOLATION)
+	bool m_zeroHold;
+
+	///@brief Set to true for uniform waveforms, which have no offsets or index buffer (equivalent to DENSE_PACK)
+	bool m_dense;
+
+	///@brief Analog sample values
+	const float* m_analogSamples;
+
+	///@brief Digital sample values
+	const bool* m_digitalSamples;
+
+	///@brief Sample timestamps (sparse waveforms only)
+	const int64_t* m_offsets;
+
+	///@brief Sample durations (sparse zero-hold waveforms only)
+	const int64_t* m_durations;
+
+	///@brief Index of the first sample in each pixel column (sparse waveforms only)
+	const uint32_t* m_indexes;
+
+	void SetWaveform(WaveformBase* data);
+	void Rasterize(const ConfigPushConstants& config, float* out);
+
+	static float GetScaledAlpha(WaveformBase* data, double pixelsPerXUnit, float traceAlpha);
+	static ConfigPushConstants GetConfig(
+		WaveformBase* data,
+		int64_t xAxisOffset,
+		double pixelsPerXUnit,
+		float pixelsPerYAxisUnit,
+		float yAxisOffset,
+		uint32_t w,
+		uint32_t h,
+		float alpha);
+	static void GetSparseIndexes(
+		SparseWaveformBase* data,
+		int64_t xAxisOffset,
+		double pixelsPerXUnit,
+		uint32_t* indexes,
+		size_t w);
+
+protected:
+	void RasterizeColumn(const ConfigPushConstants& config, float* out, uint32_t x, float* working);
+	float FetchX(const ConfigPushConstants& config, uint32_t i);
+	float FetchY(const ConfigPushConstants& config, uint32_t i);
+
+	///@brief Adds a constant to a run of floats (picked at construction time based on available instruction sets)
+	void (*m_addSpan)(float* p, size_t n, float alpha);
+};
+
+#endif
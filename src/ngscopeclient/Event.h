@@ -103,6 +103,21 @@ public:
 		m_ready = false;
 	}
 
+	/**
+		@brief Blocks until the event is signaled or the timeout expires
+
+		@return True if the event was signaled, false if we timed out
+	 */
+	template<class Rep, class Period>
+	bool BlockWithTimeout(const std::chrono::duration<Rep, Period>& timeout)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if(!m_cond.wait_for(lock, timeout, [&]{ return m_ready.load(); }))
+			return false;
+		m_ready = false;
+		return true;
+	}
+
 	/**
 		@brief Checks if the event is signaled, and returns immediately without blocking regardless of event state.
 
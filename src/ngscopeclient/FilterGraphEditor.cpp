@@ -576,6 +576,8 @@ bool FilterGraphEditor::DoRender()
 	ax::NodeEditor::SetCurrentEditor(m_context);
 	ax::NodeEditor::Begin("Filter Graph", ImVec2(0, 0));
 
+	UpdateCriticalPath();
+
 	//Make nodes for all groups
 	RefreshGroupPorts();
 	for(auto it : m_groups)
@@ -623,6 +625,9 @@ bool FilterGraphEditor::DoRender()
 		DoInternalLinksForGroup(it.first);
 
 	//Add links from each input to the stream it's fed by
+	//(highlighting the critical path, if we're profiling)
+	auto criticalColor = ImGui::ColorConvertU32ToFloat4(
+		m_session.GetPreferences().GetColor("Appearance.Filter Graph.critical_path_color"));
 	set<ax::NodeEditor::LinkId, lessID<ax::NodeEditor::LinkId> > freshLinks;
 	for(auto f : nodes)
 	{
@@ -635,7 +640,12 @@ bool FilterGraphEditor::DoRender()
 				auto dstid = GetSinkPinForLink(stream, pair<FlowGraphNode*, size_t>(f, i));
 				auto linkid = GetID(pair<ax::NodeEditor::PinId, ax::NodeEditor::PinId>(srcid, dstid));
 				freshLinks.emplace(linkid);
-				ax::NodeEditor::Link(linkid, srcid, dstid);
+
+				FlowGraphNode* src = stream.m_channel;
+				if(m_criticalLinks.find(pair<FlowGraphNode*, FlowGraphNode*>(src, f)) != m_criticalLinks.end())
+					ax::NodeEditor::Link(linkid, srcid, dstid, criticalColor, 3);
+				else
+					ax::NodeEditor::Link(linkid, srcid, dstid);
 			}
 		}
 	}
@@ -1054,6 +1064,28 @@ void FilterGraphEditor::DoInternalLinksForGroup(shared_ptr<FilterGraphGroup> gro
 	}
 }
 
+/**
+	@brief Finds the critical path through the filter graph for highlighting, if the profiler overlay is on
+ */
+void FilterGraphEditor::UpdateCriticalPath()
+{
+	m_criticalNodes.clear();
+	m_criticalLinks.clear();
+
+	if(!m_session.GetFilterProfiler().IsOverlayEnabled())
+		return;
+
+	double length;
+	double total;
+	auto path = m_session.GetFilterCriticalPath(length, total);
+	for(size_t i=0; i<path.size(); i++)
+	{
+		m_criticalNodes.emplace(path[i]);
+		if(i > 0)
+			m_criticalLinks.emplace(path[i-1], path[i]);
+	}
+}
+
 /**
 	@brief Delete old properties dialogs for no-longer-extant nodes
  */
@@ -1493,6 +1525,7 @@ void FilterGraphEditor::HandleLinkCreationRequests(Filter*& fReconfigure)
 						{
 							//Hook it up
 							inputPort.first->SetInput(inputPort.second, stream);
+							m_session.OnFilterGraphChanged();
 
 							//Update names, if needed
 							fReconfigure = dynamic_cast<Filter*>(inputPort.first);
@@ -1689,6 +1722,7 @@ void FilterGraphEditor::CreateChannelMenu()
 			if(ImGui::MenuItem(s.GetName().c_str()))
 			{
 				m_createInput.first->SetInput(m_createInput.second, s);
+				m_session.OnFilterGraphChanged();
 
 				auto trig = dynamic_cast<Trigger*>(m_createInput.first);
 				if(trig)
@@ -1733,6 +1767,7 @@ void FilterGraphEditor::CreateChannelMenu()
 
 				//Once the filter exists, hook it up
 				m_createInput.first->SetInput(m_createInput.second, StreamDescriptor(f, 0));
+				m_session.OnFilterGraphChanged();
 
 				auto trig = dynamic_cast<Trigger*>(m_createInput.first);
 				if(trig)
@@ -1867,6 +1902,7 @@ void FilterGraphEditor::HandleLinkDeletionRequests(Filter*& fReconfigure)
 							group->m_hierInputLinkMap.erase(lid);
 
 							sink.first->SetInput(sink.second, StreamDescriptor(nullptr, 0), true);
+							m_session.OnFilterGraphChanged();
 							fReconfigure = dynamic_cast<Filter*>(sink.first);
 							break;
 						}
@@ -1883,6 +1919,7 @@ void FilterGraphEditor::HandleLinkDeletionRequests(Filter*& fReconfigure)
 				m_linkMap.erase(pins);
 				auto inputPort = m_inputIDMap[CanonicalizePin(pins.second)];
 				inputPort.first->SetInput(inputPort.second, StreamDescriptor(nullptr, 0), true);
+				m_session.OnFilterGraphChanged();
 
 				fReconfigure = dynamic_cast<Filter*>(inputPort.first);
 			}
@@ -2234,6 +2271,34 @@ void FilterGraphEditor::DoNodeForChannel(InstrumentChannel* channel, shared_ptr<
 		textpos + ImVec2( (iconwidth - captionsize.x)/2, 0),
 		textColor,
 		blocktype.c_str());
+
+	//Outline the node if it's on the critical path
+	if(m_criticalNodes.find(channel) != m_criticalNodes.end())
+	{
+		bgList->AddRect(
+			pos,
+			pos + size,
+			prefs.GetColor("Appearance.Filter Graph.critical_path_color"),
+			rounding,
+			ImDrawFlags_None,
+			3);
+	}
+
+	//Draw execution time under the node if profiling
+	auto& profiler = m_session.GetFilterProfiler();
+	FilterProfile profile;
+	if(f && profiler.IsOverlayEnabled() && profiler.GetProfile(f, profile))
+	{
+		Unit fs(Unit::UNIT_FS);
+		string timeText =
+			fs.PrettyPrint(profile.m_lastTime * FS_PER_SECOND) + " (" + (profile.m_gpu ? "GPU" : "CPU") + ")";
+		bgList->AddText(
+			textfont,
+			textfontsize,
+			ImVec2(pos.x, pos.y + size.y + ImGui::GetStyle().ItemSpacing.y),
+			textColor,
+			timeText.c_str());
+	}
 }
 
 void FilterGraphEditor::RenderForceVector(ImDrawList* list, ImVec2 pos, ImVec2 size, ImVec2 vec)
@@ -203,6 +203,7 @@ protected:
 		std::vector<ImVec2>& forces);
 
 	void ClearOldPropertiesDialogs();
+	void UpdateCriticalPath();
 
 	void NodeIcon(InstrumentChannel* chan, ImVec2 iconpos, ImVec2 iconsize, ImDrawList* list);
 
@@ -296,6 +297,12 @@ protected:
 	///@brief Map of filter types to class names
 	std::map<std::type_index, std::string> m_filterIconMap;
 
+	///@brief Nodes on the critical path of the filter graph (only valid while profiling)
+	std::set<FlowGraphNode*> m_criticalNodes;
+
+	///@brief Links (source, sink) on the critical path of the filter graph (only valid while profiling)
+	std::set<std::pair<FlowGraphNode*, FlowGraphNode*>> m_criticalLinks;
+
 	//DEBUG: forces for display
 	std::map<
 		ax::NodeEditor::NodeId,
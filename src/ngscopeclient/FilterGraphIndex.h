@@ -0,0 +1,111 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterGraphIndex
+ */
+#ifndef FilterGraphIndex_h
+#define FilterGraphIndex_h
+
+#include <map>
+#include <set>
+#include <vector>
+
+/**
+	@brief Reverse edge index of a filter graph (node to the nodes consuming it), for finding influence cones quickly
+
+	Session keeps one of these for the flow graph, rebuilding it only when the topology changes. It's a template so it
+	can be tested and benchmarked on a synthetic graph; T needs GetInputCount(), and GetInput() returning something
+	with an m_channel pointer convertible to T*.
+ */
+template<class T>
+class FilterGraphIndex
+{
+public:
+
+	/**
+		@brief Rebuilds the index from scratch
+
+		@param nodes	All nodes in the graph
+	 */
+	void Rebuild(const std::set<T*>& nodes)
+	{
+		m_consumers.clear();
+		for(auto node : nodes)
+		{
+			for(size_t i=0; i<node->GetInputCount(); i++)
+			{
+				T* chan = node->GetInput(i).m_channel;
+				if(chan)
+					m_consumers[chan].push_back(node);
+			}
+		}
+	}
+
+	/**
+		@brief Finds every node downstream of a set of nodes, with a single breadth-first walk of the reverse edges
+
+		@param sources	Nodes to start from
+
+		@return All nodes which directly or indirectly consume one of the sources. The sources themselves are only
+				included if they're downstream of another source.
+	 */
+	std::set<T*> GetConsumersOf(const std::set<T*>& sources) const
+	{
+		std::set<T*> ret;
+		std::vector<T*> frontier(sources.begin(), sources.end());
+		while(!frontier.empty())
+		{
+			auto node = frontier.back();
+			frontier.pop_back();
+
+			auto it = m_consumers.find(node);
+			if(it == m_consumers.end())
+				continue;
+			for(auto consumer : it->second)
+			{
+				if(ret.emplace(consumer).second)
+					frontier.push_back(consumer);
+			}
+		}
+		return ret;
+	}
+
+	void clear()
+	{ m_consumers.clear(); }
+
+protected:
+
+	///@brief Every node which has a given node as one of its inputs
+	std::map<T*, std::vector<T*>> m_consumers;
+};
+
+#endif
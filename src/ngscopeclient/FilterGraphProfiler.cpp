@@ -0,0 +1,337 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterGraphProfiler
+ */
+#include "ngscopeclient.h"
+#include "FilterGraphProfiler.h"
+#include "HistoryManager.h"
+#include "JsonUtil.h"
+
+using namespace std;
+
+///@brief Weight of the newest sample in the smoothed filter run time
+#define FILTER_PROFILE_SMOOTHING 0.1
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+FilterGraphProfiler::FilterGraphProfiler()
+	: m_enabled(false)
+	, m_overlay(false)
+	, m_runCount(0)
+	, m_parallelism(0)
+	, m_tStart(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Turns profiling on or off
+
+	Turning it on discards any statistics from the last time it was on.
+ */
+void FilterGraphProfiler::SetEnabled(bool enabled)
+{
+	if(enabled && !m_enabled)
+		Clear();
+	m_enabled = enabled;
+}
+
+/**
+	@brief Discards all statistics collected so far
+ */
+void FilterGraphProfiler::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_profiles.clear();
+	m_trace.clear();
+	m_threadIDs.clear();
+	m_parallelism = 0;
+	m_tStart = GetTime();
+}
+
+/**
+	@brief Discards statistics for any filters which no longer exist
+
+	@param nodes	All nodes currently in the filter graph
+ */
+void FilterGraphProfiler::Prune(const set<FlowGraphNode*>& nodes)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto it = m_profiles.begin(); it != m_profiles.end(); )
+	{
+		if(nodes.find(it->first) == nodes.end())
+			it = m_profiles.erase(it);
+		else
+			it ++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Data collection
+
+/**
+	@brief Returns true if a waveform's samples are only valid in GPU memory, i.e. it was produced by a shader
+ */
+static bool IsGpuOnly(WaveformBase* wfm)
+{
+	auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm);
+	if(ua)
+		return ua->m_samples.IsCpuBufferStale();
+	auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm);
+	if(sa)
+		return sa->m_samples.IsCpuBufferStale();
+	auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm);
+	if(ud)
+		return ud->m_samples.IsCpuBufferStale();
+	auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm);
+	if(sd)
+		return sd->m_samples.IsCpuBufferStale();
+	return false;
+}
+
+/**
+	@brief Records a single run of a filter
+
+	Must be called right after the filter runs, with filter data still locked, so its inputs and outputs are the ones
+	it just used.
+
+	@param f		The filter
+	@param tstart	Time the run started
+	@param tend		Time the run finished
+ */
+void FilterGraphProfiler::Record(Filter* f, double tstart, double tend)
+{
+	double dt = tend - tstart;
+
+	size_t insamples = 0;
+	for(size_t i=0; i<f->GetInputCount(); i++)
+	{
+		auto data = f->GetInput(i).GetData();
+		if(data)
+			insamples += data->size();
+	}
+
+	size_t outsamples = 0;
+	size_t outbytes = 0;
+	bool gpu = false;
+	for(size_t i=0; i<f->GetStreamCount(); i++)
+	{
+		auto data = f->GetData(i);
+		if(!data)
+			continue;
+		outsamples += data->size();
+		outbytes += HistoryPoint::GetWaveformMemoryUsage(data);
+		gpu |= IsGpuOnly(data);
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+
+	auto& p = m_profiles[f];
+	p.m_name = f->GetDisplayName();
+	p.m_type = f->GetProtocolDisplayName();
+	p.m_lastTime = dt;
+	if(p.m_runCount == 0)
+		p.m_averageTime = dt;
+	else
+		p.m_averageTime = p.m_averageTime * (1 - FILTER_PROFILE_SMOOTHING) + dt * FILTER_PROFILE_SMOOTHING;
+	p.m_maxTime = max(p.m_maxTime, dt);
+	p.m_totalTime += dt;
+	p.m_gpu = gpu;
+	p.m_inputSamples = insamples;
+	p.m_outputSamples = outsamples;
+	p.m_outputBytes = outbytes;
+	p.m_runCount ++;
+
+	if(p.m_history.size() < FILTER_PROFILE_HISTORY)
+		p.m_history.push_back(dt * 1e3);
+	else
+	{
+		p.m_history[p.m_historyPos] = dt * 1e3;
+		p.m_historyPos = (p.m_historyPos + 1) % FILTER_PROFILE_HISTORY;
+	}
+
+	//Save the event for trace export
+	auto tid = this_thread::get_id();
+	auto it = m_threadIDs.find(tid);
+	if(it == m_threadIDs.end())
+		it = m_threadIDs.emplace(tid, m_threadIDs.size()).first;
+
+	FilterTraceEvent e;
+	e.m_name = p.m_name;
+	e.m_start = tstart - m_tStart;
+	e.m_duration = dt;
+	e.m_thread = it->second;
+	m_trace.push_back(e);
+	while(m_trace.size() > FILTER_PROFILE_MAX_EVENTS)
+		m_trace.pop_front();
+}
+
+/**
+	@brief Decides whether the next profiled graph run should be a normal one, rather than timing each filter
+
+	Every other run is a normal one.
+ */
+bool FilterGraphProfiler::IsParallelPass()
+{
+	return (m_runCount ++) & 1;
+}
+
+/**
+	@brief Records a normal (parallel) run of a set of filters, for measuring achieved parallelism
+
+	Nothing is recorded unless every filter in the set has been timed individually at least once.
+
+	@param nodes	The nodes which were run
+	@param wallTime	Time the whole run took, in seconds
+ */
+void FilterGraphProfiler::RecordParallelRun(const set<FlowGraphNode*>& nodes, double wallTime)
+{
+	if(wallTime <= 0)
+		return;
+
+	lock_guard<mutex> lock(m_mutex);
+
+	double total = 0;
+	for(auto node : nodes)
+	{
+		if(dynamic_cast<Filter*>(node) == nullptr)
+			continue;
+
+		auto it = m_profiles.find(node);
+		if(it == m_profiles.end())
+			return;
+		total += it->second.m_averageTime;
+	}
+	if(total <= 0)
+		return;
+
+	double parallelism = total / wallTime;
+	if(m_parallelism == 0)
+		m_parallelism = parallelism;
+	else
+		m_parallelism = m_parallelism * (1 - FILTER_PROFILE_SMOOTHING) + parallelism * FILTER_PROFILE_SMOOTHING;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets a snapshot of the statistics for every filter
+ */
+map<FlowGraphNode*, FilterProfile> FilterGraphProfiler::GetProfiles()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_profiles;
+}
+
+/**
+	@brief Gets a snapshot of the statistics for a single filter
+
+	@param node		The filter
+	@param profile	Filled out with the filter's statistics
+
+	@return True if the filter has run since profiling started, false if we have no data for it
+ */
+bool FilterGraphProfiler::GetProfile(FlowGraphNode* node, FilterProfile& profile)
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_profiles.find(node);
+	if(it == m_profiles.end())
+		return false;
+	profile = it->second;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Export
+
+/**
+	@brief Writes all recorded filter runs to a file in Chrome trace event format
+
+	The file can be opened in chrome://tracing, Perfetto, or similar tools.
+
+	@param path	Path to the output file
+
+	@return True on success, false if the file couldn't be written
+ */
+bool FilterGraphProfiler::ExportChromeTrace(const string& path)
+{
+	list<FilterTraceEvent> trace;
+	size_t nthreads;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		trace = m_trace;
+		nthreads = m_threadIDs.size();
+	}
+
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Failed to open %s for writing\n", path.c_str());
+		return false;
+	}
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+
+	//Name the threads so the viewer has something more useful than a number to show
+	for(size_t i=0; i<nthreads; i++)
+	{
+		fprintf(fp,
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"Filter thread %zu\"}},\n",
+			i,
+			i);
+	}
+
+	//Timestamps are in microseconds
+	bool first = true;
+	for(auto& e : trace)
+	{
+		if(!first)
+			fprintf(fp, ",\n");
+		first = false;
+
+		fprintf(fp,
+			"{\"name\":\"%s\",\"cat\":\"filter\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			JsonEscape(e.m_name).c_str(),
+			e.m_thread,
+			e.m_start * 1e6,
+			e.m_duration * 1e6);
+	}
+
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,192 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterGraphProfiler
+ */
+#ifndef FilterGraphProfiler_h
+#define FilterGraphProfiler_h
+
+///@brief Number of past execution times kept for each filter
+#define FILTER_PROFILE_HISTORY 128
+
+///@brief Maximum number of events kept for trace export
+#define FILTER_PROFILE_MAX_EVENTS 100000
+
+/**
+	@brief Performance statistics for a single filter
+ */
+class FilterProfile
+{
+public:
+	FilterProfile()
+	: m_lastTime(0)
+	, m_averageTime(0)
+	, m_maxTime(0)
+	, m_totalTime(0)
+	, m_gpu(false)
+	, m_inputSamples(0)
+	, m_outputSamples(0)
+	, m_outputBytes(0)
+	, m_runCount(0)
+	, m_historyPos(0)
+	{}
+
+	///@brief Display name of the filter as of the last run
+	std::string m_name;
+
+	///@brief Protocol name of the filter
+	std::string m_type;
+
+	///@brief Wall clock time of the last run, in seconds
+	double m_lastTime;
+
+	///@brief Smoothed wall clock time, in seconds
+	double m_averageTime;
+
+	///@brief Longest run seen, in seconds
+	double m_maxTime;
+
+	///@brief Total time spent in the filter since profiling started, in seconds
+	double m_totalTime;
+
+	///@brief True if the last run left its output on the GPU only (i.e. it took the GPU path)
+	bool m_gpu;
+
+	///@brief Total number of input samples consumed by the last run
+	size_t m_inputSamples;
+
+	///@brief Total number of output samples produced by the last run
+	size_t m_outputSamples;
+
+	///@brief Size of the output waveforms produced by the last run, in bytes
+	size_t m_outputBytes;
+
+	///@brief Number of times the filter has run since profiling started
+	int64_t m_runCount;
+
+	///@brief Ring buffer of recent run times, in milliseconds
+	std::vector<float> m_history;
+
+	///@brief Next position to write in m_history
+	size_t m_historyPos;
+};
+
+/**
+	@brief A single filter run, for trace export
+ */
+class FilterTraceEvent
+{
+public:
+	///@brief Display name of the filter
+	std::string m_name;
+
+	///@brief Start time, in seconds since profiling started
+	double m_start;
+
+	///@brief Duration, in seconds
+	double m_duration;
+
+	///@brief Index of the thread which ran the filter
+	int m_thread;
+};
+
+/**
+	@brief Collects per-filter execution statistics
+
+	Profiling is off by default. While it's on, the session alternates between running filters one at a time (see
+	Session::RunFilters()) so each one can be timed individually, and running them normally. Comparing the sum of the
+	individual times to the wall time of the normal runs tells us how much parallelism the executor achieved.
+ */
+class FilterGraphProfiler
+{
+public:
+	FilterGraphProfiler();
+
+	///@brief Returns true if filter runs are being profiled
+	bool IsEnabled()
+	{ return m_enabled; }
+
+	void SetEnabled(bool enabled);
+
+	///@brief Returns true if timings should be shown on nodes in the filter graph editor
+	bool IsOverlayEnabled()
+	{ return m_overlay; }
+
+	///@brief Turns the filter graph editor overlay on or off
+	void SetOverlayEnabled(bool overlay)
+	{ m_overlay = overlay; }
+
+	void Record(Filter* f, double tstart, double tend);
+	bool IsParallelPass();
+	void RecordParallelRun(const std::set<FlowGraphNode*>& nodes, double wallTime);
+	void Prune(const std::set<FlowGraphNode*>& nodes);
+	void Clear();
+
+	std::map<FlowGraphNode*, FilterProfile> GetProfiles();
+	bool GetProfile(FlowGraphNode* node, FilterProfile& profile);
+
+	bool ExportChromeTrace(const std::string& path);
+
+	///@brief Returns the smoothed ratio of summed filter times to wall time for normal (parallel) graph runs
+	double GetAchievedParallelism()
+	{ return m_parallelism; }
+
+protected:
+	///@brief Mutex controlling access to everything but the flags
+	std::mutex m_mutex;
+
+	///@brief True if profiling is on
+	std::atomic<bool> m_enabled;
+
+	///@brief True if timings should be shown in the filter graph editor
+	std::atomic<bool> m_overlay;
+
+	///@brief Number of profiled graph runs so far, used to alternate between timed and normal runs
+	std::atomic<uint64_t> m_runCount;
+
+	///@brief Smoothed achieved parallelism
+	std::atomic<double> m_parallelism;
+
+	///@brief Time profiling was last started or cleared, used as the zero point for the trace
+	double m_tStart;
+
+	///@brief Statistics for each filter which has run since profiling started
+	std::map<FlowGraphNode*, FilterProfile> m_profiles;
+
+	///@brief Recent filter runs, oldest first
+	std::list<FilterTraceEvent> m_trace;
+
+	///@brief Small integer IDs for each thread which has run a filter, since thread::id isn't printable as a number
+	std::map<std::thread::id, int> m_threadIDs;
+};
+
+#endif
@@ -0,0 +1,500 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HeadlessRenderer
+ */
+#include "ngscopeclient.h"
+#include "HeadlessRenderer.h"
+#include "Session.h"
+#include "WaveformArea.h"
+#include "CpuRasterizer.h"
+#include "JsonUtil.h"
+#include <png.h>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Initialize the renderer
+
+	@param width	Width of each output image
+	@param height	Height of each output image
+ */
+HeadlessRenderer::HeadlessRenderer(size_t width, size_t height)
+	: m_width(width)
+	, m_height(height)
+	, m_digitalHeight(24)
+	, m_traceAlpha(0.75)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Top level
+
+/**
+	@brief Loads a session, renders all of its waveform areas, and writes the report
+
+	Images are named after the session file, waveform group and area index. The report is the session file name with
+	a .json extension.
+
+	@param sessionPath	Path to the .scopesession file
+	@param outDir		Directory to write output to (must exist)
+
+	@return True on success, false on error
+ */
+bool HeadlessRenderer::Render(const string& sessionPath, const string& outDir)
+{
+	double tstart = GetTime();
+	LogNotice("Rendering %s\n", sessionPath.c_str());
+	LogIndenter li;
+
+	string base = sessionPath.substr(0, sessionPath.length() - strlen(".scopesession"));
+	string datadir = base + "_data";
+	string prefix = outDir + "/" + base.substr(base.find_last_of("/\\") + 1);
+
+	Session session(nullptr);
+	vector<string> images;
+	try
+	{
+		auto docs = YAML::LoadAllFromFile(sessionPath);
+		if(docs.size() != 1)
+		{
+			LogError("Expected one YAML document in \"%s\", found %zu\n", sessionPath.c_str(), docs.size());
+			return false;
+		}
+		auto& node = docs[0];
+
+		//Always load offline, there's no one around to confirm reconnecting to hardware.
+		//This also evaluates the filter graph on the most recent waveform.
+		if(!session.PreLoadFromYaml(node, datadir, false) || !session.LoadFromYaml(node, datadir, false))
+		{
+			session.ClearBackgroundThreads();
+			return false;
+		}
+
+		int version = 0;
+		if(node["version"])
+			version = node["version"].as<int>();
+
+		auto ui = node["ui_config"];
+		if(version < 2)
+			LogWarning("Session file is from an older version, re-save it to render waveform areas\n");
+		else
+		{
+			//Same layout as MainWindow::LoadUIConfiguration()
+			auto areas = ui["areas"];
+			for(auto it : ui["groups"])
+			{
+				auto gn = it.second;
+
+				float pixelsPerXUnit = gn["pixelsPerXUnit"].as<float>();
+				int64_t xAxisOffset = gn["xAxisOffset"].as<long long>();
+				if(!gn["timebaseResolution"] || (gn["timebaseResolution"].as<string>() != "fs"))
+				{
+					pixelsPerXUnit /= 1000;
+					xAxisOffset *= 1000;
+				}
+
+				//Group names may contain anything, keep file names sane
+				string gname = gn["name"].as<string>();
+				for(auto& c : gname)
+				{
+					if(!isalnum(c) && (c != '-') && (c != '_'))
+						c = '_';
+				}
+
+				size_t narea = 0;
+				for(auto at : gn["areas"])
+				{
+					auto aid = at.second["id"].as<int>();
+					string path = prefix + "_" + gname + "_" + to_string(narea) + ".png";
+					if(RenderArea(session, areas[string("area") + to_string(aid)], pixelsPerXUnit, xAxisOffset, path))
+					{
+						images.push_back(path);
+						narea ++;
+					}
+				}
+			}
+		}
+
+		bool ok = WriteReport(session, ui, sessionPath, images, prefix + ".json");
+		session.ClearBackgroundThreads();
+
+		LogNotice("Wrote %zu images in %.2f ms\n", images.size(), (GetTime() - tstart) * 1000);
+		return ok;
+	}
+	catch(const YAML::Exception& ex)
+	{
+		LogError("Could not load \"%s\": %s\n", sessionPath.c_str(), ex.what());
+		session.ClearBackgroundThreads();
+		return false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rendering
+
+/**
+	@brief Renders one waveform area to a PNG file
+
+	Analog waveforms fill the whole image. Digital waveforms are stacked at the bottom, as in the GUI.
+
+	@param session			The session being rendered
+	@param areaNode			Saved configuration for the area
+	@param pixelsPerXUnit	X axis scale of the parent group
+	@param xAxisOffset		X axis offset of the parent group
+	@param path				Path to the output file
+
+	@return True if an image was written
+ */
+bool HeadlessRenderer::RenderArea(
+	Session& session,
+	const YAML::Node& areaNode,
+	float pixelsPerXUnit,
+	int64_t xAxisOffset,
+	const string& path)
+{
+	//Find the streams to draw
+	vector<StreamDescriptor> streams;
+	for(auto jt : areaNode["streams"])
+	{
+		auto chan = static_cast<OscilloscopeChannel*>(session.m_idtable[jt.second["channel"].as<int>()]);
+		if(chan)
+			streams.push_back(StreamDescriptor(chan, jt.second["stream"].as<int>()));
+	}
+	if(streams.empty())
+		return false;
+
+	//Y axis scale is set by the first analog stream in the area
+	float pixelsPerYAxisUnit = 1;
+	for(auto s : streams)
+	{
+		if(s.GetType() == Stream::STREAM_TYPE_ANALOG)
+		{
+			pixelsPerYAxisUnit = m_height / s.GetVoltageRange();
+			break;
+		}
+	}
+
+	//Draw each stream and blend onto a black background
+	vector<uint8_t> rgba(m_width * m_height * 4, 0);
+	for(size_t i=0; i<m_width * m_height; i++)
+		rgba[i*4 + 3] = 0xff;
+	vector<float> pixels;
+	size_t digitalBottom = m_height;
+	for(auto s : streams)
+	{
+		if(s.GetType() == Stream::STREAM_TYPE_ANALOG)
+		{
+			if(RasterizeStream(s, pixelsPerYAxisUnit, pixelsPerXUnit, xAxisOffset, m_height, pixels))
+				Composite(rgba, pixels, s.m_channel->m_displaycolor, 0, m_height);
+		}
+		else if(s.GetType() == Stream::STREAM_TYPE_DIGITAL)
+		{
+			if(digitalBottom < m_digitalHeight)
+				continue;
+			digitalBottom -= m_digitalHeight;
+			if(RasterizeStream(s, 0, pixelsPerXUnit, xAxisOffset, m_digitalHeight, pixels))
+				Composite(rgba, pixels, s.m_channel->m_displaycolor, digitalBottom, m_digitalHeight);
+		}
+		else
+			LogDebug("Skipping %s (not an analog or digital waveform)\n", s.GetName().c_str());
+	}
+
+	return WritePNG(path, rgba, m_width, m_height);
+}
+
+/**
+	@brief Rasterizes a single stream into an fp32 intensity buffer
+
+	Mirrors WaveformArea::RasterizeAnalogOrDigitalWaveform(), without persistence.
+
+	@param stream				The stream to draw
+	@param pixelsPerYAxisUnit	Vertical scale (ignored for digital waveforms)
+	@param pixelsPerXUnit		Horizontal scale
+	@param xAxisOffset			Timestamp of the left edge of the image
+	@param h					Height of the buffer
+	@param pixels				Output buffer, resized to m_width * h
+
+	@return True if anything was drawn
+ */
+bool HeadlessRenderer::RasterizeStream(
+	StreamDescriptor stream,
+	float pixelsPerYAxisUnit,
+	float pixelsPerXUnit,
+	int64_t xAxisOffset,
+	size_t h,
+	vector<float>& pixels)
+{
+	auto data = stream.GetData();
+	if( (data == nullptr) || data->empty() )
+		return false;
+
+	auto sdata = dynamic_cast<SparseWaveformBase*>(data);
+	auto uadata = dynamic_cast<UniformAnalogWaveform*>(data);
+	auto sadata = dynamic_cast<SparseAnalogWaveform*>(data);
+	auto uddata = dynamic_cast<UniformDigitalWaveform*>(data);
+	auto sddata = dynamic_cast<SparseDigitalWaveform*>(data);
+	if(!uadata && !sadata && !uddata && !sddata)
+		return false;
+
+	//Same intensity scaling and shader configuration as the GUI
+	size_t w = m_width;
+	float alpha = CpuRasterizer::GetScaledAlpha(data, pixelsPerXUnit, m_traceAlpha);
+	auto config = CpuRasterizer::GetConfig(
+		data, xAxisOffset, pixelsPerXUnit, pixelsPerYAxisUnit, stream.GetOffset(), w, h, alpha);
+
+	CpuRasterizer raster;
+	raster.m_zeroHold = (uadata || sadata) && (stream.GetFlags() & Stream::STREAM_DO_NOT_INTERPOLATE);
+	raster.SetWaveform(data);
+
+	//Sparse waveforms need the first sample in each pixel column
+	vector<uint32_t> indexes;
+	if(sdata)
+	{
+		indexes.resize(w);
+		CpuRasterizer::GetSparseIndexes(sdata, xAxisOffset, pixelsPerXUnit, indexes.data(), w);
+		raster.m_indexes = indexes.data();
+	}
+
+	pixels.resize(w * h);
+	raster.Rasterize(config, pixels.data());
+	return true;
+}
+
+/**
+	@brief Tone maps an fp32 intensity buffer and blends it over the output image
+
+	Same tone curve as WaveformToneMap.glsl.
+
+	@param rgba		The output image
+	@param pixels	Rasterized waveform, m_width pixels wide
+	@param color	Display color of the channel
+	@param ystart	First row of the output image to draw to
+	@param h		Height of the rasterized waveform
+ */
+void HeadlessRenderer::Composite(
+	vector<uint8_t>& rgba,
+	const vector<float>& pixels,
+	const string& color,
+	size_t ystart,
+	size_t h)
+{
+	auto c = ImGui::ColorConvertU32ToFloat4(ColorFromString(color));
+
+	#pragma omp parallel for
+	for(size_t y=0; y<h; y++)
+	{
+		for(size_t x=0; x<m_width; x++)
+		{
+			//Logarithmic shading
+			float v = min(max(pow(pixels[y*m_width + x], 1.0f / 4), 0.0f), 2.0f);
+			if(v <= 0)
+				continue;
+
+			//Supersaturated pixels are fully opaque and get more intense
+			float r = c.x;
+			float g = c.y;
+			float b = c.z;
+			float a = v;
+			if(v > 1)
+			{
+				r = min(r * v, 1.0f);
+				g = min(g * v, 1.0f);
+				b = min(b * v, 1.0f);
+				a = 1;
+			}
+
+			//Rasterized waveforms have Y increasing upwards, but image rows go top to bottom
+			uint8_t* p = &rgba[((ystart + (h - 1 - y))*m_width + x) * 4];
+			p[0] = static_cast<uint8_t>(p[0]*(1-a) + r*a*255);
+			p[1] = static_cast<uint8_t>(p[1]*(1-a) + g*a*255);
+			p[2] = static_cast<uint8_t>(p[2]*(1-a) + b*a*255);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+/**
+	@brief Writes an RGBA8888 image to a PNG file
+ */
+bool HeadlessRenderer::WritePNG(const string& path, const vector<uint8_t>& rgba, size_t w, size_t h)
+{
+	auto png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if(!png)
+	{
+		LogError("Failed to create PNG write struct\n");
+		return false;
+	}
+	auto info = png_create_info_struct(png);
+	if(!info)
+	{
+		png_destroy_write_struct(&png, nullptr);
+		LogError("Failed to create PNG info struct\n");
+		return false;
+	}
+
+	FILE* fp = fopen(path.c_str(), "wb");
+	if(!fp)
+	{
+		png_destroy_write_struct(&png, &info);
+		LogError("Failed to open \"%s\" for writing\n", path.c_str());
+		return false;
+	}
+
+	//Build the row pointers before the setjmp, since longjmp skips the destructors of anything created after it
+	vector<png_bytep> rows(h);
+	for(size_t y=0; y<h; y++)
+		rows[y] = const_cast<png_bytep>(&rgba[y*w*4]);
+
+	//libpng reports errors (e.g. out of disk space) by longjmp'ing back here
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(fp);
+		remove(path.c_str());
+		LogError("Failed to write \"%s\"\n", path.c_str());
+		return false;
+	}
+
+	png_init_io(png, fp);
+
+	//Fast compression, we're writing a lot of these
+	png_set_compression_level(png, 1);
+	png_set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+	png_write_image(png, rows.data());
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+
+	//Buffered data is only flushed here, so this is where a full disk shows up
+	if(fclose(fp) != 0)
+	{
+		remove(path.c_str());
+		LogError("Failed to write \"%s\" (%s)\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	LogDebug("Wrote %s\n", path.c_str());
+	return true;
+}
+
+/**
+	@brief Writes the list of images and measurement values to a JSON file
+
+	Measurements are the streams shown in the measurements dialog when the session was saved. If there were none,
+	every scalar filter output is written instead.
+ */
+bool HeadlessRenderer::WriteReport(
+	Session& session,
+	const YAML::Node& uiConfig,
+	const string& sessionPath,
+	const vector<string>& images,
+	const string& path)
+{
+	//Figure out what to report (same format as MainWindow::LoadUIConfiguration())
+	vector<StreamDescriptor> measurements;
+	auto mnode = uiConfig["measurements"];
+	if(mnode)
+	{
+		for(auto m : mnode)
+		{
+			int index;
+			int stream;
+			auto sin = m.as<string>();
+			if(2 != sscanf(sin.c_str(), "%d/%d", &index, &stream))
+			{
+				index = atoi(sin.c_str());
+				stream = 0;
+			}
+
+			auto chan = static_cast<OscilloscopeChannel*>(session.m_idtable[index]);
+			if(chan)
+				measurements.push_back(StreamDescriptor(chan, stream));
+		}
+	}
+	else
+	{
+		for(auto f : Filter::GetAllInstances())
+		{
+			for(size_t i=0; i<f->GetStreamCount(); i++)
+			{
+				if(f->GetType(i) == Stream::STREAM_TYPE_ANALOG_SCALAR)
+					measurements.push_back(StreamDescriptor(f, i));
+			}
+		}
+	}
+
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+	{
+		LogError("Failed to open \"%s\" for writing\n", path.c_str());
+		return false;
+	}
+
+	fprintf(fp, "{\n\"session\":\"%s\",\n\"images\":[", JsonEscape(sessionPath).c_str());
+	for(size_t i=0; i<images.size(); i++)
+		fprintf(fp, "%s\n\t\"%s\"", (i == 0) ? "" : ",", JsonEscape(images[i]).c_str());
+	fprintf(fp, "\n],\n\"measurements\":[");
+	for(size_t i=0; i<measurements.size(); i++)
+	{
+		auto s = measurements[i];
+		auto value = s.GetScalarValue();
+		auto unit = s.GetYAxisUnits();
+
+		//JSON has no representation for NaN or infinity
+		string num = "null";
+		if(isfinite(value))
+		{
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "%.17g", value);
+			num = tmp;
+		}
+
+		fprintf(fp, "%s\n\t{\"name\":\"%s\",\"value\":%s,\"unit\":\"%s\",\"text\":\"%s\"}",
+			(i == 0) ? "" : ",",
+			JsonEscape(s.GetName()).c_str(),
+			num.c_str(),
+			JsonEscape(unit.ToString()).c_str(),
+			JsonEscape(unit.PrettyPrint(value)).c_str());
+	}
+	fprintf(fp, "\n]\n}\n");
+	fclose(fp);
+	return true;
+}
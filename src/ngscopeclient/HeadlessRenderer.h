@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HeadlessRenderer
+ */
+#ifndef HeadlessRenderer_h
+#define HeadlessRenderer_h
+
+class Session;
+
+/**
+	@brief Renders saved sessions to image files without a window
+
+	Used for the --headless command line mode, for batch generation of reports from saved sessions on a machine with
+	no display. Each session is loaded offline, with no MainWindow, and the filter graph is evaluated on the most
+	recent waveform. Then every waveform area in the saved UI configuration is rasterized and tone mapped in software
+	(using the same math as the compute shaders) and written out as a PNG. Measurement values are written to a JSON
+	file alongside the images.
+
+	Only analog and digital waveforms are drawn; eye patterns, spectrograms, protocol overlays etc. are skipped.
+ */
+class HeadlessRenderer
+{
+public:
+	HeadlessRenderer(size_t width, size_t height);
+
+	bool Render(const std::string& sessionPath, const std::string& outDir);
+
+protected:
+	bool RenderArea(
+		Session& session,
+		const YAML::Node& areaNode,
+		float pixelsPerXUnit,
+		int64_t xAxisOffset,
+		const std::string& path);
+	bool RasterizeStream(StreamDescriptor stream, float pixelsPerYAxisUnit, float pixelsPerXUnit, int64_t xAxisOffset,
+		size_t h, std::vector<float>& pixels);
+	void Composite(
+		std::vector<uint8_t>& rgba,
+		const std::vector<float>& pixels,
+		const std::string& color,
+		size_t ystart,
+		size_t h);
+	bool WritePNG(const std::string& path, const std::vector<uint8_t>& rgba, size_t w, size_t h);
+	bool WriteReport(
+		Session& session,
+		const YAML::Node& uiConfig,
+		const std::string& sessionPath,
+		const std::vector<std::string>& images,
+		const std::string& path);
+
+	///@brief Width of each output image, in pixels
+	size_t m_width;
+
+	///@brief Height of each output image, in pixels
+	size_t m_height;
+
+	///@brief Height of each digital waveform
+	size_t m_digitalHeight;
+
+	///@brief Trace intensity (same default as the GUI)
+	float m_traceAlpha;
+};
+
+#endif
@@ -85,6 +85,8 @@ HistoryDialog::HistoryDialog(HistoryManager& mgr, Session& session, MainWindow&
 	, m_selectionChanged(false)
 	, m_selectedMarker(nullptr)
 {
+	Unit bytes(Unit::UNIT_BYTES);
+	m_maxBytes = bytes.PrettyPrintInt64(m_mgr.m_maxBytes);
 }
 
 HistoryDialog::~HistoryDialog()
@@ -115,6 +117,45 @@ bool HistoryDialog::DoRender()
 		"Adjust the cap on total history depth, in waveforms.\n"
 		"Large history depths can use significant amounts of RAM with deep memory.");
 
+	Unit bytes(Unit::UNIT_BYTES);
+	if(UnitInputWithImplicitApply("Memory Limit", m_maxBytes, m_mgr.m_maxBytes, bytes))
+	{
+		//Get under the new limit now, rather than waiting for the next acquisition
+		shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+		m_mgr.EvictOldHistory();
+	}
+	HelpMarker(
+		"Adjust the cap on total size of waveform data in history, in bytes.\n"
+		"Once this is exceeded, the oldest un-pinned waveforms are discarded even if the depth limit\n"
+		"has not been reached. Set to zero for no limit.");
+
+	string usage = bytes.PrettyPrint(m_mgr.GetMemoryUsage(), 4);
+	ImGui::BeginDisabled();
+		ImGui::InputText("Memory Used", &usage);
+	ImGui::EndDisabled();
+	HelpMarker("Total size of all waveform data currently stored in history");
+
+	ImGui::Checkbox("Compress", &m_mgr.m_compressHistory);
+	HelpMarker(
+		"When the memory limit is reached, losslessly compress the oldest waveforms\n"
+		"before spilling or discarding anything. Compressed waveforms are expanded when selected.\n\n"
+		"Works best on data from 8-12 bit ADCs.");
+
+	ImGui::Checkbox("Spill to Disk", &m_mgr.m_spillToDisk);
+	HelpMarker(
+		"When the memory limit is reached, move the oldest waveforms to a temporary directory on disk\n"
+		"instead of discarding them. Spilled waveforms are loaded back into memory when selected.\n\n"
+		"The depth limit still applies to waveforms on disk.");
+
+	if(m_mgr.m_spillToDisk)
+	{
+		string spilled = bytes.PrettyPrint(m_mgr.GetSpilledSize(), 4);
+		ImGui::BeginDisabled();
+			ImGui::InputText("On Disk", &spilled);
+		ImGui::EndDisabled();
+		HelpMarker("Total size of waveform data currently paged out to disk");
+	}
+
 	if(ImGui::BeginTable("history", 3, flags))
 	{
 		ImGui::TableSetupScrollFreeze(0, 1); //Header row does not scroll
@@ -277,7 +318,7 @@ bool HistoryDialog::DoRender()
 			//(manual delete applies even if we have markers or a pin)
 			m_session.RemoveMarkers((*itDelete)->m_time);
 			m_session.RemovePackets((*itDelete)->m_time);
-			m_mgr.m_history.erase(itDelete);
+			m_mgr.erase(itDelete);
 
 			if(deletedSelection)
 			{
@@ -80,6 +80,9 @@ protected:
 
 	///@brief The currently selected marker
 	Marker* m_selectedMarker;
+
+	///@brief Text box content for the history memory limit
+	std::string m_maxBytes;
 };
 
 #endif
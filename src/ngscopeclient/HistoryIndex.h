@@ -0,0 +1,216 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistoryIndex
+ */
+#ifndef HistoryIndex_h
+#define HistoryIndex_h
+
+#include <list>
+#include <map>
+
+/**
+	@brief An insertion-ordered list of values, indexed by timestamp
+
+	Lookup, insertion, and removal by timestamp are all O(log n), and iteration is in insertion order. Each entry
+	also carries a size in bytes, with the total kept up to date as entries are added, removed, or resized so it can
+	be read in constant time.
+
+	This is what HistoryManager uses to store its history points. It's a template so it can be tested without
+	needing real waveforms.
+ */
+template<class T>
+class HistoryIndex
+{
+public:
+	typedef typename std::list<T>::iterator iterator;
+	typedef typename std::list<T>::reverse_iterator reverse_iterator;
+
+	HistoryIndex()
+	: m_totalBytes(0)
+	, m_nextSequence(0)
+	{}
+
+	/**
+		@brief Appends a value, unless there's already one with the same timestamp
+
+		@param key		Timestamp of the value
+		@param value	The value to add
+		@param bytes	Size of the value, in bytes
+
+		@return True if the value was added, false if the timestamp was already present
+	 */
+	bool push_back(TimePoint key, const T& value, size_t bytes = 0)
+	{
+		auto ret = m_index.emplace(key, Entry());
+		if(!ret.second)
+			return false;
+
+		m_values.push_back(value);
+		auto& entry = ret.first->second;
+		entry.m_it = std::prev(m_values.end());
+		entry.m_bytes = bytes;
+		entry.m_sequence = m_nextSequence ++;
+		m_totalBytes += bytes;
+		return true;
+	}
+
+	/**
+		@brief Removes the value with a given timestamp
+
+		@return Iterator to the value following the removed one (or end() if there was no such value)
+	 */
+	iterator erase(TimePoint key)
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end())
+			return m_values.end();
+
+		m_totalBytes -= it->second.m_bytes;
+		auto next = m_values.erase(it->second.m_it);
+		m_index.erase(it);
+		return next;
+	}
+
+	///@brief Removes all values
+	void clear()
+	{
+		m_values.clear();
+		m_index.clear();
+		m_totalBytes = 0;
+	}
+
+	/**
+		@brief Looks up the value with a given timestamp
+
+		@return Iterator to the value, or end() if there is none
+	 */
+	iterator find(TimePoint key)
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end())
+			return m_values.end();
+		return it->second.m_it;
+	}
+
+	///@brief Returns true if we have a value with the given timestamp
+	bool contains(TimePoint key) const
+	{ return m_index.find(key) != m_index.end(); }
+
+	/**
+		@brief Gets the position of a value in insertion order
+
+		Sequence numbers are never reused, so they stay valid (and in order) as values are removed.
+
+		@return The sequence number, or UINT64_MAX if we have no value with the given timestamp
+	 */
+	uint64_t GetSequence(TimePoint key) const
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end())
+			return UINT64_MAX;
+		return it->second.m_sequence;
+	}
+
+	///@brief Gets the size of the value with a given timestamp, in bytes (zero if we have no such value)
+	size_t GetBytes(TimePoint key) const
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end())
+			return 0;
+		return it->second.m_bytes;
+	}
+
+	///@brief Updates the size of the value with a given timestamp
+	void SetBytes(TimePoint key, size_t bytes)
+	{
+		auto it = m_index.find(key);
+		if(it == m_index.end())
+			return;
+		m_totalBytes = m_totalBytes - it->second.m_bytes + bytes;
+		it->second.m_bytes = bytes;
+	}
+
+	///@brief Returns the total size of all values, in bytes
+	size_t GetTotalBytes() const
+	{ return m_totalBytes; }
+
+	iterator begin()
+	{ return m_values.begin(); }
+
+	iterator end()
+	{ return m_values.end(); }
+
+	reverse_iterator rbegin()
+	{ return m_values.rbegin(); }
+
+	reverse_iterator rend()
+	{ return m_values.rend(); }
+
+	size_t size() const
+	{ return m_values.size(); }
+
+	bool empty() const
+	{ return m_values.empty(); }
+
+protected:
+
+	/**
+		@brief Index entry for a single value
+	 */
+	class Entry
+	{
+	public:
+		///@brief Position of the value in m_values
+		iterator m_it;
+
+		///@brief Size of the value, in bytes
+		size_t m_bytes;
+
+		///@brief Position of the value in insertion order
+		uint64_t m_sequence;
+	};
+
+	///@brief The values, in insertion order
+	std::list<T> m_values;
+
+	///@brief Index of values by timestamp
+	std::map<TimePoint, Entry> m_index;
+
+	///@brief Total size of all values, in bytes
+	size_t m_totalBytes;
+
+	///@brief Sequence number for the next value to be added
+	uint64_t m_nextSequence;
+};
+
+#endif
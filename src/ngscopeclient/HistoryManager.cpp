@@ -35,9 +35,58 @@
 #include "ngscopeclient.h"
 #include "HistoryManager.h"
 #include "Session.h"
+#include "pthread_compat.h"
+
+#include <filesystem>
+
+extern std::shared_mutex g_vulkanActivityMutex;
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SpilledWaveform
+
+/**
+	@brief Creates an empty waveform of the appropriate type, with all of our metadata filled out
+
+	@return The new waveform, or nullptr if the data type is not recognized
+ */
+WaveformBase* SpilledWaveform::CreateWaveform() const
+{
+	bool dense = (m_format == "densev1");
+
+	WaveformBase* cap = nullptr;
+	if(m_datatype == "analog")
+	{
+		if(dense)
+			cap = new UniformAnalogWaveform;
+		else
+			cap = new SparseAnalogWaveform;
+	}
+	else if(m_datatype == "digital")
+	{
+		if(dense)
+			cap = new UniformDigitalWaveform;
+		else
+			cap = new SparseDigitalWaveform;
+	}
+	else if(m_datatype == "can")
+		cap = new CANWaveform;
+	else
+	{
+		LogError("Unrecognized waveform datatype %s\n", m_datatype.c_str());
+		return nullptr;
+	}
+
+	cap->m_timescale = m_timescale;
+	cap->m_triggerPhase = m_triggerPhase;
+	cap->m_flags = m_flags;
+	cap->m_startTimestamp = m_startTimestamp;
+	cap->m_startFemtoseconds = m_startFemtoseconds;
+
+	return cap;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // HistoryPoint
 
@@ -45,11 +94,22 @@ HistoryPoint::HistoryPoint()
 	: m_time(0, 0)
 	, m_pinned(false)
 	, m_nickname("")
+	, m_memoryUsage(0)
+	, m_spillPending(false)
+	, m_compressionPending(false)
+	, m_incompressible(false)
 {
 }
 
 HistoryPoint::~HistoryPoint()
 {
+	//Clean up any data we paged out to disk
+	if(!m_spillPath.empty())
+	{
+		error_code ec;
+		filesystem::remove_all(m_spillPath, ec);
+	}
+
 	for(auto it : m_history)
 	{
 		auto scope = it.first;
@@ -60,8 +120,9 @@ HistoryPoint::~HistoryPoint()
 
 			//Add known waveform types to pool for reuse
 			//Delete anything else
-			//TODO: this assumes the waveforms are currently configured for GPU-local or mirrored memory.
-			//This will have to change when we start paging old waveforms out to disk.
+			//Spilled or compressed waveforms are null here, their in-memory copies were freed at that time.
+			//Waveforms which were paged back in or decompressed were allocated by us rather than the driver, with
+			//default memory hints, which is what the driver would have gotten if the pool had been empty.
 			if(dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr)
 				scope->AddWaveformToAnalogPool(wfm);
 			else if(dynamic_cast<SparseDigitalWaveform*>(wfm) != nullptr)
@@ -93,6 +154,356 @@ bool HistoryPoint::IsInUse()
 	return false;
 }
 
+/**
+	@brief Returns the total size of all waveform data in this history point, in bytes
+
+	History waveforms are never modified once they've been added, so the result is computed once and cached.
+
+	Points waiting to be paged out by the spill thread are counted as if they had already been spilled. Points waiting
+	to be compressed must not be measured, since the spill thread may be replacing their waveforms.
+ */
+size_t HistoryPoint::GetMemoryUsage()
+{
+	if(m_spillPending)
+		return 0;
+	if(m_memoryUsage != 0)
+		return m_memoryUsage;
+
+	size_t total = 0;
+	for(auto& it : m_history)
+	{
+		for(auto& jt : it.second)
+			total += GetWaveformMemoryUsage(jt.second);
+	}
+	for(auto& it : m_compressed)
+	{
+		for(auto& jt : it.second)
+			total += jt.second->GetMemoryUsage();
+	}
+
+	m_memoryUsage = total;
+	return total;
+}
+
+/**
+	@brief Returns the memory actually allocated for a buffer, on both the CPU and GPU side, in bytes
+ */
+template<class T>
+static size_t GetBufferMemoryUsage(const AcceleratorBuffer<T>& buf)
+{
+	return buf.GetCpuMemoryBytes() + buf.GetGpuMemoryBytes();
+}
+
+/**
+	@brief Returns the memory allocated for the sample data (and timestamps, if sparse) of a single waveform, in bytes
+
+	This is the real allocation size of each buffer, including spare capacity and any copy on the GPU, not just the
+	number of samples times the sample size.
+
+	Protocol decodes other than CAN have symbol types we can't see from here. Their offset and duration buffers are
+	still counted exactly, and the symbols are assumed to be no bigger than the offsets (most are one or two words).
+ */
+size_t HistoryPoint::GetWaveformMemoryUsage(WaveformBase* wfm)
+{
+	if(wfm == nullptr)
+		return 0;
+
+	size_t bytes = 0;
+	auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+	if(sparse)
+	{
+		bytes += GetBufferMemoryUsage(sparse->m_offsets);
+		bytes += GetBufferMemoryUsage(sparse->m_durations);
+	}
+
+	if(auto ua = dynamic_cast<UniformAnalogWaveform*>(wfm))
+		bytes += GetBufferMemoryUsage(ua->m_samples);
+	else if(auto sa = dynamic_cast<SparseAnalogWaveform*>(wfm))
+		bytes += GetBufferMemoryUsage(sa->m_samples);
+	else if(auto ud = dynamic_cast<UniformDigitalWaveform*>(wfm))
+		bytes += GetBufferMemoryUsage(ud->m_samples);
+	else if(auto sd = dynamic_cast<SparseDigitalWaveform*>(wfm))
+		bytes += GetBufferMemoryUsage(sd->m_samples);
+	else if(auto can = dynamic_cast<CANWaveform*>(wfm))
+		bytes += GetBufferMemoryUsage(can->m_samples);
+	else if(sparse)
+		bytes += GetBufferMemoryUsage(sparse->m_offsets);
+
+	return bytes;
+}
+
+/**
+	@brief Marks this point as waiting to be paged out to disk by the spill thread
+
+	Must be called from the GUI thread. Any waveform data which is only valid on the GPU is copied back to the CPU
+	now, so the spill thread can write it out without touching the GPU.
+
+	@return True if the point was marked, false if it's already spilled or waiting for the spill thread
+ */
+bool HistoryPoint::PrepareForSpill()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	if(m_spillPending || m_compressionPending || IsSpilled())
+		return false;
+
+	for(auto& it : m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			if(jt.second)
+				jt.second->PrepareForCpuAccess();
+		}
+	}
+
+	m_spillPending = true;
+	return true;
+}
+
+/**
+	@brief Marks this point as waiting to be compressed by the spill thread
+
+	Unlike PrepareForSpill(), nothing is copied back from the GPU here. The spill thread does that itself as part of
+	compressing each waveform, so the GUI thread never waits on it.
+
+	@return True if the point was marked, false if it's already compressed, spilled, or waiting for the spill thread
+ */
+bool HistoryPoint::PrepareForCompression()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	if(m_spillPending || m_compressionPending || IsSpilled() || IsCompressed() || m_incompressible)
+		return false;
+
+	m_compressionPending = true;
+	return true;
+}
+
+/**
+	@brief Cancels a pending spill or compression, if the spill thread hasn't started on us yet
+
+	If the spill thread is already working on us, this blocks until it's done.
+ */
+void HistoryPoint::CancelBackgroundWork()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	m_spillPending = false;
+	m_compressionPending = false;
+}
+
+/**
+	@brief Pages our waveform data out to disk and frees the in-memory copies
+
+	This is normally called from the spill thread, after PrepareForSpill() was called from the GUI thread.
+	Waveform types which don't have a file format yet (protocol decodes, eye patterns, etc) are left in memory.
+
+	@param session	The session (used for serialization)
+	@param dir		Directory to store the waveforms in. Will be created if it doesn't exist.
+
+	@return True on success. If false, nothing was freed and the point is still fully resident in memory.
+ */
+bool HistoryPoint::SpillToDisk(Session& session, const string& dir)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	if(IsSpilled())
+		return true;
+
+	LogTrace("Spilling history from time %s to %s\n", m_time.PrettyPrint().c_str(), dir.c_str());
+
+	//Compressed data has to be expanded before we can write it out
+	Decompress();
+
+	error_code ec;
+	filesystem::create_directories(dir, ec);
+	if(ec)
+	{
+		LogError("Couldn't create history spill directory %s\n", dir.c_str());
+		return false;
+	}
+
+	//Write everything out before freeing anything, so a failure halfway through doesn't leave us inconsistent
+	map<shared_ptr<Oscilloscope>, SpilledWaveformHistory> spilled;
+	size_t nstream = 0;
+	bool ok = true;
+	for(auto& it : m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			auto wfm = jt.second;
+			if(wfm == nullptr)
+				continue;
+
+			SpilledWaveform sw;
+			sw.m_path = dir + "/stream_" + to_string(nstream) + ".bin";
+			sw.m_timescale = wfm->m_timescale;
+			sw.m_triggerPhase = wfm->m_triggerPhase;
+			sw.m_flags = wfm->m_flags;
+			sw.m_startTimestamp = wfm->m_startTimestamp;
+			sw.m_startFemtoseconds = wfm->m_startFemtoseconds;
+			sw.m_memoryUsage = GetWaveformMemoryUsage(wfm);
+
+			if( (dynamic_cast<UniformAnalogWaveform*>(wfm) != nullptr) ||
+				(dynamic_cast<SparseAnalogWaveform*>(wfm) != nullptr) )
+			{
+				sw.m_datatype = "analog";
+			}
+			else if( (dynamic_cast<UniformDigitalWaveform*>(wfm) != nullptr) ||
+				(dynamic_cast<SparseDigitalWaveform*>(wfm) != nullptr) )
+			{
+				sw.m_datatype = "digital";
+			}
+			else if(dynamic_cast<CANWaveform*>(wfm) != nullptr)
+				sw.m_datatype = "can";
+
+			//Other waveform types can't be serialized yet, keep them in memory
+			else
+			{
+				LogDebug("Not spilling %s at %s: unsupported waveform type\n",
+					jt.first.GetName().c_str(), m_time.PrettyPrint().c_str());
+				continue;
+			}
+			nstream ++;
+
+			auto sparse = dynamic_cast<SparseWaveformBase*>(wfm);
+			auto uniform = dynamic_cast<UniformWaveformBase*>(wfm);
+			if(sparse)
+			{
+				sw.m_format = "sparsev2";
+				ok = session.SerializeSparseWaveform(sparse, sw.m_path);
+			}
+			else
+			{
+				sw.m_format = "densev1";
+				ok = session.SerializeUniformWaveform(uniform, sw.m_path);
+			}
+			if(!ok)
+				break;
+
+			spilled[it.first][jt.first] = sw;
+		}
+
+		if(!ok)
+			break;
+	}
+
+	if(!ok || spilled.empty())
+	{
+		filesystem::remove_all(dir, ec);
+		return false;
+	}
+
+	//Everything is safely on disk, free the in-memory copies
+	for(auto& it : spilled)
+	{
+		auto& hist = m_history[it.first];
+		for(auto& jt : it.second)
+		{
+			delete hist[jt.first];
+			hist[jt.first] = nullptr;
+		}
+	}
+
+	m_spilled = spilled;
+	m_spillPath = dir;
+	m_memoryUsage = 0;
+	return true;
+}
+
+/**
+	@brief Replaces our waveform data with compressed copies, if it's smaller
+
+	Waveforms of unsupported types, or which don't compress, are left as is. If nothing compressed, the point is marked
+	incompressible so it isn't queued for compression again.
+
+	This is normally called from the spill thread, after PrepareForCompression() was called from the GUI thread.
+
+	@return True if at least one waveform was compressed
+ */
+bool HistoryPoint::Compress()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	bool compressedSomething = false;
+	for(auto& it : m_history)
+	{
+		for(auto& jt : it.second)
+		{
+			if(jt.second == nullptr)
+				continue;
+
+			auto cw = CompressedWaveform::Compress(jt.second);
+			if(!cw)
+				continue;
+
+			m_compressed[it.first][jt.first] = shared_ptr<CompressedWaveform>(cw);
+			delete jt.second;
+			jt.second = nullptr;
+			compressedSomething = true;
+		}
+	}
+
+	m_memoryUsage = 0;
+	if(!compressedSomething)
+		m_incompressible = true;
+	return compressedSomething;
+}
+
+/**
+	@brief Expands any compressed waveform data back to normal waveforms
+ */
+void HistoryPoint::Decompress()
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	if(!IsCompressed())
+		return;
+
+	LogTrace("Decompressing history from time %s\n", m_time.PrettyPrint().c_str());
+
+	for(auto& it : m_compressed)
+	{
+		auto& hist = m_history[it.first];
+		for(auto& jt : it.second)
+			hist[jt.first] = jt.second->Decompress();
+	}
+
+	m_compressed.clear();
+	m_memoryUsage = 0;
+}
+
+/**
+	@brief Loads any waveform data that was previously paged out to disk (or not yet loaded from a saved session)
+ */
+void HistoryPoint::PageIn(Session& session)
+{
+	lock_guard<recursive_mutex> lock(m_mutex);
+	if(!IsSpilled())
+		return;
+
+	LogTrace("Paging in history from time %s\n", m_time.PrettyPrint().c_str());
+	LogIndenter li;
+
+	for(auto& it : m_spilled)
+	{
+		auto& hist = m_history[it.first];
+		for(auto& jt : it.second)
+		{
+			auto& sw = jt.second;
+			auto cap = sw.CreateWaveform();
+			if(cap)
+				cap = session.LoadWaveformFromFile(cap, sw.m_format, sw.m_path);
+			hist[jt.first] = cap;
+		}
+	}
+
+	m_spilled.clear();
+	m_memoryUsage = 0;
+
+	//Only clean up files we created. If we were lazily loaded from a session, the data belongs to the session.
+	if(!m_spillPath.empty())
+	{
+		error_code ec;
+		filesystem::remove_all(m_spillPath, ec);
+		m_spillPath = "";
+	}
+}
+
 /**
 	@brief Update all instruments in the specified session with our saved historical data
  */
@@ -104,6 +515,14 @@ void HistoryPoint::LoadHistoryToSession(Session& session)
 	//We don't want to keep capturing if we're trying to look at a historical waveform. That would be a bit silly.
 	session.StopTrigger();
 
+	//Don't let the spill thread free our waveforms out from under the instruments
+	lock_guard<recursive_mutex> lock(m_mutex);
+	CancelBackgroundWork();
+
+	//If our data was paged out to disk or compressed, bring it back first
+	PageIn(session);
+	Decompress();
+
 	//Go over each scope in the session and load the relevant history
 	//We do this rather than just looping over the scopes in the history so that we can handle missing data.
 	auto scopes = session.GetScopes();
@@ -149,6 +568,9 @@ void HistoryPoint::LoadHistoryToSession(Session& session)
 			}
 		}
 	}
+
+	//We may have been paged back in or decompressed, let the history manager know our size changed
+	session.GetHistory().OnPointLoaded(m_time);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -156,12 +578,133 @@ void HistoryPoint::LoadHistoryToSession(Session& session)
 
 HistoryManager::HistoryManager(Session& session)
 	: m_maxDepth(10)
+	, m_maxBytes(4LL * 1024 * 1024 * 1024)
+	, m_spillToDisk(false)
+	, m_compressHistory(false)
 	, m_session(session)
+	, m_nextSpillID(0)
+	, m_spillThreadStopping(false)
+	, m_compressionInputBytes(0)
+	, m_compressionOutputBytes(0)
 {
 }
 
 HistoryManager::~HistoryManager()
 {
+	clear();
+}
+
+/**
+	@brief Deletes all history, and any waveform data we've spilled to disk
+ */
+void HistoryManager::clear()
+{
+	//Make sure nothing is still being written into the spill directory before we delete it
+	StopSpillThread();
+
+	m_history.clear();
+	m_compressCandidates.clear();
+	m_residentPoints.clear();
+
+	if(!m_spillDir.empty())
+	{
+		error_code ec;
+		filesystem::remove_all(m_spillDir, ec);
+		m_spillDir = "";
+	}
+}
+
+/**
+	@brief Removes a single point from history
+
+	@param it	Iterator to the point to remove
+
+	@return Iterator to the point following the removed one
+ */
+list<shared_ptr<HistoryPoint>>::iterator HistoryManager::erase(list<shared_ptr<HistoryPoint>>::iterator it)
+{
+	//No point writing it out if it's going away
+	auto point = *it;
+	point->CancelBackgroundWork();
+
+	auto seq = m_history.GetSequence(point->m_time);
+	m_compressCandidates.erase(seq);
+	m_residentPoints.erase(seq);
+	return m_history.erase(point->m_time);
+}
+
+/**
+	@brief Updates the size of a point in the index, and which eviction candidate lists it's in, to match its state
+
+	Must be called from the GUI thread whenever a point is added or its storage changes outside of EvictOldHistory(),
+	and the point must not be waiting for the spill thread.
+ */
+void HistoryManager::UpdateCandidates(shared_ptr<HistoryPoint> point)
+{
+	auto seq = m_history.GetSequence(point->m_time);
+	m_history.SetBytes(point->m_time, point->GetMemoryUsage());
+
+	bool resident = !point->IsSpillPending() && !point->IsSpilled();
+	if(resident)
+		m_residentPoints[seq] = point;
+	else
+		m_residentPoints.erase(seq);
+
+	if(resident && !point->IsCompressed() && !point->IsIncompressible())
+		m_compressCandidates[seq] = point;
+	else
+		m_compressCandidates.erase(seq);
+}
+
+/**
+	@brief Called when a point has been loaded into the session, since it may have been paged in or decompressed
+
+	@param t	Timestamp of the point
+ */
+void HistoryManager::OnPointLoaded(TimePoint t)
+{
+	auto it = m_history.find(t);
+	if(it != m_history.end())
+		UpdateCandidates(*it);
+}
+
+/**
+	@brief Gets the path to our spill directory, creating it if necessary
+
+	@return The path, or an empty string if the directory could not be created
+ */
+string HistoryManager::GetSpillDirectory()
+{
+	if(!m_spillDir.empty())
+		return m_spillDir;
+
+	error_code ec;
+	auto base = filesystem::temp_directory_path(ec) / ("ngscopeclient_spill_" + to_string(time(nullptr)));
+	if(ec)
+	{
+		LogError("Couldn't find temporary directory for history spill\n");
+		return "";
+	}
+
+	//Make sure we don't collide with another instance
+	for(int i=0; ; i++)
+	{
+		string path = base.string() + "_" + to_string(i);
+		if(filesystem::create_directory(path, ec))
+		{
+			LogTrace("History spill directory is %s\n", path.c_str());
+			m_spillDir = path;
+			break;
+		}
+
+		if(ec)
+		{
+			LogError("Couldn't create history spill directory %s\n", path.c_str());
+			return "";
+		}
+	}
+
+	return m_spillDir;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -186,6 +729,88 @@ bool HistoryManager::empty()
 	return true;
 }
 
+/**
+	@brief Returns the total size of all waveform data in history, in bytes
+
+	Points waiting to be written out by the spill thread are counted as already spilled.
+ */
+size_t HistoryManager::GetMemoryUsage()
+{
+	return m_history.GetTotalBytes();
+}
+
+/**
+	@brief Returns the total in-memory size of all waveform data which is currently paged out to disk, in bytes
+ */
+size_t HistoryManager::GetSpilledSize()
+{
+	size_t total = 0;
+	for(auto& pt : m_history)
+	{
+		//Points waiting for the spill thread aren't on disk yet, and their spilled list may be changing
+		if(pt->IsSpillPending())
+			continue;
+
+		for(auto& it : pt->m_spilled)
+		{
+			for(auto& jt : it.second)
+				total += jt.second.m_memoryUsage;
+		}
+	}
+	return total;
+}
+
+/**
+	@brief Adjusts the history limits so that everything currently in history fits
+
+	This is normally called after loading a session, so that the first new acquisition doesn't immediately purge a
+	large chunk of the data we just loaded.
+ */
+void HistoryManager::SetMaxToCurrentDepth()
+{
+	m_maxDepth = m_history.size();
+
+	int64_t usage = GetMemoryUsage();
+	if( (m_maxBytes != 0) && (usage > m_maxBytes) )
+		m_maxBytes = usage;
+}
+
+/**
+	@brief Adds a history point whose waveform data is already on disk, without loading it into memory
+
+	This is used for opening saved sessions lazily. The waveforms are loaded from disk when the point is selected.
+
+	@param scope	The instrument the waveforms came from
+	@param tp		Timestamp of the point
+	@param hist		Location and metadata of each waveform
+	@param pin		True to pin the point
+	@param nick		Nickname of the point
+ */
+void HistoryManager::AddSpilledHistory(
+	shared_ptr<Oscilloscope> scope,
+	TimePoint tp,
+	const SpilledWaveformHistory& hist,
+	bool pin,
+	string nick)
+{
+	if(HasHistory(tp))
+		return;
+
+	auto pt = make_shared<HistoryPoint>();
+	m_history.push_back(tp, pt);
+	pt->m_time = tp;
+	pt->m_pinned = pin;
+	pt->m_nickname = nick;
+
+	//Streams are null until paged in
+	auto& whist = pt->m_history[scope];
+	for(auto& it : hist)
+		whist[it.first] = nullptr;
+	pt->m_spilled[scope] = hist;
+	pt->m_saved[scope] = hist;
+	UpdateCandidates(pt);
+}
+
 /**
 	@brief Loads an empty history (no data) to the current session
 
@@ -222,13 +847,64 @@ void HistoryManager::LoadEmptyHistoryToSession(Session& session)
 						Set false when loading waveforms from a sessio
 	@param pin			True to pin into history
 	@param nick			Nickname
+
+	@return The new history point, or nullptr if we already had one for the same timestamp
  */
-void HistoryManager::AddHistory(
+shared_ptr<HistoryPoint> HistoryManager::AddHistory(
 	const vector<shared_ptr<Oscilloscope>>& scopes,
 	bool deleteOld,
 	bool pin,
 	string nick,
 	TimePoint refTimeIfNoWaveforms)
+{
+	return AddHistory(CreateHistoryPoint(scopes, pin, nick, refTimeIfNoWaveforms), deleteOld);
+}
+
+/**
+	@brief Adds a history point created by CreateHistoryPoint() to the history
+
+	@param pt			The point to add
+	@param deleteOld	True to delete old data that rolled off the end of the history buffer
+
+	@return The point, or nullptr if we already had one for the same timestamp
+ */
+shared_ptr<HistoryPoint> HistoryManager::AddHistory(shared_ptr<HistoryPoint> pt, bool deleteOld)
+{
+	//If we already have a history point for the same exact timestamp, do nothing
+	//Either a bug or we're in append mode.
+	//The existing point (or the channel) still owns the waveforms, so make sure we don't free them.
+	if(HasHistory(pt->m_time))
+	{
+		pt->m_history.clear();
+		return nullptr;
+	}
+
+	//All good, add it
+	m_history.push_back(pt->m_time, pt);
+	UpdateCandidates(pt);
+
+	if(deleteOld)
+		EvictOldHistory();
+
+	return pt;
+}
+
+/**
+	@brief Snapshots the waveforms currently attached to a set of instruments into a new history point
+
+	The point is not added to the history; call AddHistory() to do that. Since this doesn't touch the history
+	manager's state, it's safe to call from any thread as long as the waveform data mutex is held.
+
+	@param scopes		The instruments to add
+	@param pin			True to pin into history
+	@param nick			Nickname
+	@param refTimeIfNoWaveforms	Timestamp to use if none of the instruments have any waveforms
+ */
+shared_ptr<HistoryPoint> HistoryManager::CreateHistoryPoint(
+	const vector<shared_ptr<Oscilloscope>>& scopes,
+	bool pin,
+	string nick,
+	TimePoint refTimeIfNoWaveforms)
 {
 	bool foundTimestamp = false;
 	TimePoint tp(0,0);
@@ -260,14 +936,7 @@ void HistoryManager::AddHistory(
 	if(!foundTimestamp)
 		tp = refTimeIfNoWaveforms;
 
-	//If we already have a history point for the same exact timestamp, do nothing
-	//Either a bug or we're in append mode
-	if(HasHistory(tp))
-		return;
-
-	//All good. Generate a new history point and add it
 	auto pt = make_shared<HistoryPoint>();
-	m_history.push_back(pt);
 	pt->m_time = tp;
 	pt->m_pinned = pin;
 	pt->m_nickname = nick;
@@ -289,42 +958,314 @@ void HistoryManager::AddHistory(
 		pt->m_history[scope] = hist;
 	}
 
-	//TODO: check history size in MB/GB etc
-	//TODO: convert older stuff to disk, free GPU memory, etc?
-	if(deleteOld)
+	return pt;
+}
+
+/**
+	@brief Deletes the oldest history points until we're under both the depth and memory size limits
+
+	If compression and/or spilling are enabled, points over the memory limit are compressed and then paged out to disk
+	rather than deleted. Both are done by the spill thread; this function only queues the points.
+
+	Pinned points, points with markers, and points whose waveforms are currently loaded into an instrument are never
+	deleted. If all of the remaining points fall into one of those categories, we may end up over the limit.
+
+	Compression, spilling, and deleting to get under the memory limit each walk a list of candidates, oldest first,
+	rather than the whole history. Points drop out of those lists as soon as they're dealt with, so the only ones
+	visited more than once are those we can't touch right now (in use, pinned, etc).
+ */
+void HistoryManager::EvictOldHistory()
+{
+	ReleaseSpilled();
+
+	auto overSize = [&]()
+		{ return (m_maxBytes > 0) && (m_history.GetTotalBytes() > (size_t)m_maxBytes); };
+
+	//Over the memory limit? Compressing old points is cheapest, so try that first.
+	//The actual compression happens in the spill thread. Until it's done, the point is counted at the size we expect
+	//it to shrink to, based on how well everything before it compressed. Its real size is filled in once it's back.
+	if(m_compressHistory && overSize())
 	{
-		while(m_history.size() > (size_t) m_maxDepth)
+		auto ratio = GetCompressionRatioEstimate();
+		for(auto it = m_compressCandidates.begin(); (it != m_compressCandidates.end()) && overSize(); )
 		{
-			bool deletedSomething = false;
-
-			//Delete first un-pinned entry
-			for(auto it = m_history.begin(); it != m_history.end(); it++)
+			auto point = it->second;
+			if(point->IsInUse() || !point->PrepareForCompression())
 			{
-				auto& point = (*it);
-				if(point->m_pinned)
-					continue;
-				if(!m_session.GetMarkers(point->m_time).empty())
-					continue;
+				it++;
+				continue;
+			}
+			QueueCompression(point);
 
-				//With multiple trigger groups at different rates, we might have the most recent trigger for a scope
-				//roll to the start of the history queue. Don't delete that!!
-				if(point->IsInUse())
-					continue;
+			m_history.SetBytes(point->m_time, (size_t)(m_history.GetBytes(point->m_time) * ratio));
+			it = m_compressCandidates.erase(it);
+		}
+	}
 
-				m_session.RemoveMarkers(point->m_time);
-				m_session.RemovePackets(point->m_time);
-				m_history.erase(it);
-				deletedSomething = true;
+	//Still over? Try moving the oldest points to disk before we start deleting anything.
+	//Pinned points can be spilled too since we're not actually throwing them away.
+	//The actual writing happens in the spill thread, but the memory is counted as freed as soon as it's queued.
+	if(m_spillToDisk && overSize())
+	{
+		for(auto it = m_residentPoints.begin(); (it != m_residentPoints.end()) && overSize(); )
+		{
+			auto point = it->second;
+			if(point->IsInUse() || !point->PrepareForSpill())
+			{
+				it++;
+				continue;
+			}
+			if(!QueueSpill(point))
 				break;
+
+			m_history.SetBytes(point->m_time, 0);
+			m_compressCandidates.erase(it->first);
+			it = m_residentPoints.erase(it);
+		}
+	}
+
+	//Over the depth limit, delete the oldest points regardless of where their data is
+	for(auto it = m_history.begin(); (it != m_history.end()) && (m_history.size() > (size_t)m_maxDepth); )
+	{
+		auto point = *it;
+		if(!CanEvict(point))
+		{
+			it++;
+			continue;
+		}
+
+		m_session.RemoveMarkers(point->m_time);
+		m_session.RemovePackets(point->m_time);
+		it = erase(it);
+	}
+
+	//Over the size limit, deleting spilled points doesn't free any memory, so only consider resident ones
+	for(auto it = m_residentPoints.begin(); (it != m_residentPoints.end()) && overSize(); )
+	{
+		//erase() removes the point from m_residentPoints, so move on before deleting it
+		auto point = it->second;
+		it++;
+		if(!CanEvict(point))
+			continue;
+
+		m_session.RemoveMarkers(point->m_time);
+		m_session.RemovePackets(point->m_time);
+		erase(m_history.find(point->m_time));
+	}
+}
+
+/**
+	@brief Checks if a point may be deleted to make room for new history
+ */
+bool HistoryManager::CanEvict(shared_ptr<HistoryPoint> point)
+{
+	if(point->m_pinned)
+		return false;
+	if(!m_session.GetMarkers(point->m_time).empty())
+		return false;
+
+	//With multiple trigger groups at different rates, we might have the most recent trigger for a scope
+	//roll to the start of the history queue. Don't delete that!!
+	if(point->IsInUse())
+		return false;
+
+	//Don't make the GUI thread wait for the spill thread, leave points being worked on until next time
+	if(point->IsBackgroundWorkPending())
+		return false;
+
+	return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Spilling to disk
+
+/**
+	@brief Queues a point, already marked by HistoryPoint::PrepareForSpill(), to be written out by the spill thread
+
+	Must be called from the GUI thread. The spill thread is started if it isn't already running.
+
+	@return True if the point was queued, false (and the spill cancelled) if the spill directory is unavailable
+ */
+bool HistoryManager::QueueSpill(shared_ptr<HistoryPoint> point)
+{
+	auto dir = GetSpillDirectory();
+	if(dir.empty())
+	{
+		point->CancelBackgroundWork();
+		return false;
+	}
+
+	if(!m_spillThread)
+	{
+		m_spillThreadStopping = false;
+		m_spillThread = make_unique<thread>(&HistoryManager::SpillThread, this);
+	}
+
+	{
+		lock_guard<mutex> lock(m_spillMutex);
+		m_spillQueue.push_back(make_pair(point, dir + "/point_" + to_string(m_nextSpillID ++)));
+	}
+	m_spillEvent.Signal();
+	return true;
+}
+
+/**
+	@brief Queues a point, already marked by HistoryPoint::PrepareForCompression(), to be compressed by the spill thread
+
+	Must be called from the GUI thread. The spill thread is started if it isn't already running.
+ */
+void HistoryManager::QueueCompression(shared_ptr<HistoryPoint> point)
+{
+	if(!m_spillThread)
+	{
+		m_spillThreadStopping = false;
+		m_spillThread = make_unique<thread>(&HistoryManager::SpillThread, this);
+	}
+
+	{
+		lock_guard<mutex> lock(m_spillMutex);
+		m_spillQueue.push_back(make_pair(point, ""));
+	}
+	m_spillEvent.Signal();
+}
+
+/**
+	@brief Returns the expected ratio of compressed to uncompressed size, based on everything compressed so far
+ */
+double HistoryManager::GetCompressionRatioEstimate()
+{
+	size_t in = m_compressionInputBytes;
+	size_t out = m_compressionOutputBytes;
+
+	//Nothing to go on yet, assume a typical 2:1
+	if(in == 0)
+		return 0.5;
+	return min(1.0, (double)out / in);
+}
+
+/**
+	@brief Cancels everything waiting in the spill queue and stops the spill thread
+
+	Blocks until the point currently being written (if any) is done. Must be called from the GUI thread.
+ */
+void HistoryManager::StopSpillThread()
+{
+	if(!m_spillThread)
+		return;
+
+	list<pair<shared_ptr<HistoryPoint>, string>> pending;
+	{
+		lock_guard<mutex> lock(m_spillMutex);
+		pending.splice(pending.end(), m_spillQueue);
+	}
+	for(auto& it : pending)
+		it.first->CancelBackgroundWork();
+
+	m_spillThreadStopping = true;
+	m_spillEvent.Signal();
+	m_spillThread->join();
+	m_spillThread = nullptr;
+
+	ReleaseSpilled();
+}
+
+/**
+	@brief Accounts for points the spill thread is done with, then drops our references to them
+
+	This must happen in the GUI thread, since if the point was deleted from history in the meantime, destroying it
+	returns its waveforms to the instrument's waveform pool.
+
+	If a write failed, spilling is turned off so we don't keep hammering a full or broken disk. Old history will be
+	deleted instead, as if spilling had never been enabled.
+ */
+void HistoryManager::ReleaseSpilled()
+{
+	list<pair<shared_ptr<HistoryPoint>, bool>> done;
+	{
+		lock_guard<mutex> lock(m_spillMutex);
+		done.splice(done.end(), m_spillCompleted);
+	}
+
+	for(auto& it : done)
+	{
+		auto point = it.first;
+		if(!it.second && m_spillToDisk)
+		{
+			LogError("Failed to spill history to disk, falling back to deleting old history\n");
+			m_spillToDisk = false;
+		}
+
+		//Skip points which have been deleted, or queued again after a cancelled spill
+		auto hit = m_history.find(point->m_time);
+		if( (hit == m_history.end()) || (*hit != point) || point->IsBackgroundWorkPending() )
+			continue;
+
+		//Some waveforms may have been left in memory or not compressed, or the spill may have failed or been cancelled
+		UpdateCandidates(point);
+	}
+}
+
+/**
+	@brief Thread function: compresses queued points, or writes them to disk, until told to stop
+ */
+void HistoryManager::SpillThread()
+{
+	pthread_setname_np_compat("HistorySpill");
+
+	while(!m_spillThreadStopping)
+	{
+		m_spillEvent.Block();
+
+		while(true)
+		{
+			shared_ptr<HistoryPoint> point;
+			string dir;
+			{
+				lock_guard<mutex> lock(m_spillMutex);
+				if(m_spillQueue.empty())
+					break;
+				point = m_spillQueue.front().first;
+				dir = m_spillQueue.front().second;
+				m_spillQueue.pop_front();
 			}
 
-			//If nothing deleted, all remaining items are pinned. Stop.
-			if(!deletedSomething)
-				break;
+			//Skip the point if it was loaded into the session or deleted since it was queued
+			bool ok = true;
+			{
+				lock_guard<recursive_mutex> lock(point->m_mutex);
+				if(point->IsCompressionPending())
+				{
+					//Compressing may need to copy waveforms back from the GPU
+					shared_lock<shared_mutex> lock2(g_vulkanActivityMutex);
+
+					m_compressionInputBytes += point->GetMemoryUsage();
+					point->Compress();
+					m_compressionOutputBytes += point->GetMemoryUsage();
+
+					point->CancelBackgroundWork();
+				}
+				else if(point->IsSpillPending())
+				{
+					ok = point->SpillToDisk(m_session, dir);
+					if(!ok)
+						LogWarning("Failed to spill history from time %s to disk\n", point->m_time.PrettyPrint().c_str());
+
+					//Done either way, the GUI thread owns the point again
+					point->CancelBackgroundWork();
+				}
+			}
+
+			//Hand our reference over, so the point is never destroyed in this thread
+			lock_guard<mutex> lock(m_spillMutex);
+			m_spillCompleted.push_back(make_pair(std::move(point), ok));
 		}
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lookup
+
 /**
 	@brief Gets the timestamp of the most recent waveform
  */
@@ -341,13 +1282,11 @@ TimePoint HistoryManager::GetMostRecentPoint()
  */
 shared_ptr<HistoryPoint> HistoryManager::GetHistory(TimePoint t)
 {
-	for(auto it : m_history)
-	{
-		if(it->m_time == t)
-			return it;
-	}
+	auto it = m_history.find(t);
+	if(it == m_history.end())
+		return nullptr;
 
-	return nullptr;
+	return *it;
 }
 
 /**
@@ -355,11 +1294,5 @@ shared_ptr<HistoryPoint> HistoryManager::GetHistory(TimePoint t)
  */
 bool HistoryManager::HasHistory(TimePoint t)
 {
-	for(auto it : m_history)
-	{
-		if(it->m_time == t)
-			return true;
-	}
-
-	return false;
+	return m_history.contains(t);
 }
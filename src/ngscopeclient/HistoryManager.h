@@ -36,10 +36,58 @@
 #define HistoryManager_h
 
 #include "Marker.h"
+#include "CompressedWaveform.h"
+#include "HistoryIndex.h"
+#include "Event.h"
 
 //Waveform history for a single instrument
 typedef std::map<StreamDescriptor, WaveformBase*> WaveformHistory;
 
+/**
+	@brief A single waveform which is not resident in memory
+
+	The sample data is either in a file in the spill directory, or in the data directory of a saved session which was
+	opened without loading all of the waveforms.
+ */
+class SpilledWaveform
+{
+public:
+	WaveformBase* CreateWaveform() const;
+
+	///@brief Path to the sample data
+	std::string m_path;
+
+	///@brief File format ID ("sparsev1", "sparsev2", or "densev1", same as in saved sessions)
+	std::string m_format;
+
+	///@brief Sample type ("analog", "digital", or "can")
+	std::string m_datatype;
+
+	///@brief Timescale of the waveform
+	int64_t m_timescale;
+
+	///@brief Trigger phase of the waveform
+	int64_t m_triggerPhase;
+
+	///@brief Waveform flags
+	uint8_t m_flags;
+
+	///@brief Start time of the waveform (integer part)
+	int64_t m_startTimestamp;
+
+	///@brief Start time of the waveform (fractional part)
+	int64_t m_startFemtoseconds;
+
+	///@brief Size of the waveform when resident in memory
+	size_t m_memoryUsage;
+};
+
+//Spilled waveforms for a single instrument
+typedef std::map<StreamDescriptor, SpilledWaveform> SpilledWaveformHistory;
+
+//Compressed waveforms for a single instrument
+typedef std::map<StreamDescriptor, std::shared_ptr<CompressedWaveform> > CompressedWaveformHistory;
+
 /**
 	@brief A single point of waveform history
  */
@@ -51,6 +99,47 @@ public:
 
 	bool IsInUse();
 
+	size_t GetMemoryUsage();
+
+	static size_t GetWaveformMemoryUsage(WaveformBase* wfm);
+
+	bool PrepareForSpill();
+	bool PrepareForCompression();
+	void CancelBackgroundWork();
+	bool SpillToDisk(Session& session, const std::string& dir);
+	void PageIn(Session& session);
+
+	///@brief Returns true if our waveform data has been paged out to disk
+	bool IsSpilled()
+	{ return !m_spilled.empty(); }
+
+	///@brief Returns true if we're queued to be paged out to disk by the history manager's spill thread
+	bool IsSpillPending()
+	{ return m_spillPending; }
+
+	///@brief Returns true if we're queued to be compressed by the history manager's spill thread
+	bool IsCompressionPending()
+	{ return m_compressionPending; }
+
+	///@brief Returns true if the spill thread owns our waveform data, for either spilling or compression
+	bool IsBackgroundWorkPending()
+	{ return m_spillPending || m_compressionPending; }
+
+	///@brief Returns true if we tried compressing our waveform data, and none of it got any smaller
+	bool IsIncompressible()
+	{ return m_incompressible; }
+
+	///@brief Returns true if our waveform data is on disk in a saved session, rather than in our spill directory
+	bool IsBackedBySession()
+	{ return IsSpilled() && m_spillPath.empty(); }
+
+	bool Compress();
+	void Decompress();
+
+	///@brief Returns true if some or all of our waveform data is stored in compressed form
+	bool IsCompressed()
+	{ return !m_compressed.empty(); }
+
 	///@brief Timestamp of the point
 	TimePoint m_time;
 
@@ -63,7 +152,48 @@ public:
 	///@brief Waveform data
 	std::map<std::shared_ptr<Oscilloscope>, WaveformHistory> m_history;
 
+	///@brief Waveform data which has been paged out to disk (waveforms in m_history are null while spilled)
+	std::map<std::shared_ptr<Oscilloscope>, SpilledWaveformHistory> m_spilled;
+
+	///@brief Waveform data which has been compressed (waveforms in m_history are null while compressed)
+	std::map<std::shared_ptr<Oscilloscope>, CompressedWaveformHistory> m_compressed;
+
+	/**
+		@brief Copies of our waveforms which already exist in a saved session on disk
+
+		These don't need to be written out again when the session is next saved, they can just be linked or copied.
+	 */
+	std::map<std::shared_ptr<Oscilloscope>, SpilledWaveformHistory> m_saved;
+
+	/**
+		@brief Mutex controlling changes to how our waveform data is stored (compressing, spilling, paging in, etc)
+
+		Only needed when accessing the data from a thread other than the GUI thread, e.g. for saving in the background.
+	 */
+	std::recursive_mutex m_mutex;
+
 	void LoadHistoryToSession(Session& session);
+
+protected:
+	///@brief Cached total size of our waveform data, in bytes (0 if not yet computed)
+	std::atomic<size_t> m_memoryUsage;
+
+	///@brief Directory our spilled waveforms are stored in (empty if not spilled, or if backed by a saved session)
+	std::string m_spillPath;
+
+	/**
+		@brief True if we're waiting to be written out by the spill thread
+
+		While this is set, only the spill thread may modify our waveform data. Clearing it (with m_mutex held) cancels
+		the spill if it hasn't started yet.
+	 */
+	std::atomic<bool> m_spillPending;
+
+	///@brief True if we're waiting to be compressed by the spill thread (same rules as m_spillPending)
+	std::atomic<bool> m_compressionPending;
+
+	///@brief True if we were compressed and nothing got smaller, so there's no point trying again
+	std::atomic<bool> m_incompressible;
 };
 
 /**
@@ -75,19 +205,35 @@ public:
 	HistoryManager(Session& session);
 	~HistoryManager();
 
-	void AddHistory(
+	std::shared_ptr<HistoryPoint> AddHistory(
 		const std::vector<std::shared_ptr<Oscilloscope>>& scopes,
 		bool deleteOld = true,
 		bool pin = false,
 		std::string nick = "",
 		TimePoint refTimeIfNoWaveforms = TimePoint(0, 0));
 
+	std::shared_ptr<HistoryPoint> AddHistory(std::shared_ptr<HistoryPoint> pt, bool deleteOld = true);
+
+	static std::shared_ptr<HistoryPoint> CreateHistoryPoint(
+		const std::vector<std::shared_ptr<Oscilloscope>>& scopes,
+		bool pin = false,
+		std::string nick = "",
+		TimePoint refTimeIfNoWaveforms = TimePoint(0, 0));
+
+	void AddSpilledHistory(
+		std::shared_ptr<Oscilloscope> scope,
+		TimePoint tp,
+		const SpilledWaveformHistory& hist,
+		bool pin = false,
+		std::string nick = "");
+
 	void LoadEmptyHistoryToSession(Session& session);
 
 	bool empty();
 
-	void SetMaxToCurrentDepth()
-	{ m_maxDepth = m_history.size(); }
+	void SetMaxToCurrentDepth();
+
+	size_t GetMemoryUsage();
 
 	std::shared_ptr<HistoryPoint> GetHistory(TimePoint t);
 
@@ -95,16 +241,95 @@ public:
 
 	TimePoint GetMostRecentPoint();
 
-	void clear()
-	{ m_history.clear(); }
+	void clear();
+
+	std::list<std::shared_ptr<HistoryPoint>>::iterator erase(std::list<std::shared_ptr<HistoryPoint>>::iterator it);
 
-	std::list<std::shared_ptr<HistoryPoint>> m_history;
+	size_t GetSpilledSize();
+
+	void OnPointLoaded(TimePoint t);
+	void EvictOldHistory();
+
+	/**
+		@brief All history points, in the order they were added, indexed by timestamp
+
+		Do not add or remove points directly, as this will desync the eviction candidate lists. Use AddHistory() and
+		erase() instead.
+	 */
+	HistoryIndex<std::shared_ptr<HistoryPoint>> m_history;
 
 	///@brief has to be an int for imgui compatibility
 	int m_maxDepth;
 
+	///@brief Cap on total size of waveform data in history, in bytes (0 for no limit)
+	int64_t m_maxBytes;
+
+	///@brief True to page old waveforms out to disk, rather than deleting them, when over the memory limit
+	bool m_spillToDisk;
+
+	///@brief True to compress old waveforms when over the memory limit, before spilling or deleting anything
+	bool m_compressHistory;
+
 protected:
+	bool CanEvict(std::shared_ptr<HistoryPoint> point);
+	void UpdateCandidates(std::shared_ptr<HistoryPoint> point);
+	std::string GetSpillDirectory();
+	bool QueueSpill(std::shared_ptr<HistoryPoint> point);
+	void QueueCompression(std::shared_ptr<HistoryPoint> point);
+	double GetCompressionRatioEstimate();
+	void StopSpillThread();
+	void ReleaseSpilled();
+	void SpillThread();
+
 	Session& m_session;
+
+	/**
+		@brief Points which are in memory and not compressed, by sequence number in m_history
+
+		These are the candidates for compression when we're over the memory limit.
+	 */
+	std::map<uint64_t, std::shared_ptr<HistoryPoint>> m_compressCandidates;
+
+	/**
+		@brief Points which are in memory (possibly compressed), by sequence number in m_history
+
+		These are the candidates for spilling to disk, or deleting, when we're over the memory limit.
+	 */
+	std::map<uint64_t, std::shared_ptr<HistoryPoint>> m_residentPoints;
+
+	///@brief Temporary directory for waveforms paged out of memory (empty if not yet created)
+	std::string m_spillDir;
+
+	///@brief Number used to generate a unique name for the next spilled history point
+	size_t m_nextSpillID;
+
+	///@brief Thread which compresses old points and writes spilled ones to disk (null if not yet started)
+	std::unique_ptr<std::thread> m_spillThread;
+
+	///@brief Mutex controlling access to the spill queues
+	std::mutex m_spillMutex;
+
+	/**
+		@brief Points waiting for the spill thread, and the directory to write each one to
+
+		Points with an empty directory are to be compressed in memory rather than written out.
+	 */
+	std::list<std::pair<std::shared_ptr<HistoryPoint>, std::string>> m_spillQueue;
+
+	///@brief Points the spill thread is done with, and whether writing them out succeeded
+	std::list<std::pair<std::shared_ptr<HistoryPoint>, bool>> m_spillCompleted;
+
+	///@brief Signaled when a point is added to the spill queue, or the spill thread should exit
+	Event m_spillEvent;
+
+	///@brief Set to make the spill thread exit
+	std::atomic<bool> m_spillThreadStopping;
+
+	///@brief Total size of everything the spill thread has compressed, before compression
+	std::atomic<size_t> m_compressionInputBytes;
+
+	///@brief Total size of everything the spill thread has compressed, after compression
+	std::atomic<size_t> m_compressionOutputBytes;
 };
 
 #endif
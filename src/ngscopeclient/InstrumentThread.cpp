@@ -36,6 +36,7 @@
 #include "pthread_compat.h"
 #include "Session.h"
 #include "LoadChannel.h"
+#include "PollScheduler.h"
 
 using namespace std;
 
@@ -64,28 +65,53 @@ void InstrumentThread(InstrumentThreadArgs args)
 	auto meterstate = args.meterstate;
 	auto bertstate = args.bertstate;
 	auto psustate = args.psustate;
+	auto wake = args.wakeEvent;
+	auto scheduler = args.pollScheduler;
+	auto qpolicy = args.queuePolicy;
 
 	while(!*args.shuttingDown)
 	{
+		scheduler->BeginPoll();
+
 		//Flush any pending commands
 		inst->GetTransport()->FlushCommandQueue();
 
 		//Scope processing
+		bool polled = true;
+		bool acquired = false;
 		if(scope)
 		{
-			//If the queue is too big, stop grabbing data
+			//If the queue is full, decide what to do about it
 			size_t npending = scope->GetPendingWaveformCount();
-			if(npending > 5)
+			auto policy = qpolicy->GetPolicy();
+			bool full = qpolicy->IsFull(npending);
+
+			//When dropping old waveforms, keep acquiring and let the waveform thread throw away the excess.
+			//Still stop at twice the limit, so memory usage stays bounded if the waveform thread stalls.
+			if(full && (policy == WaveformQueuePolicy::POLICY_DROP_OLDEST) )
+				full = qpolicy->IsFull(npending / 2);
+
+			//Dropping the newest waveform only works if the instrument is free running and re-arming it throws away
+			//the capture. A single trigger has to be kept, and a streaming instrument is partway through appending
+			//to it. Hold off until there's room instead, like POLICY_BLOCK does.
+			if( (policy == WaveformQueuePolicy::POLICY_DROP_NEWEST) &&
+				(qpolicy->m_oneShot || scope->IsAppendingToWaveform()) )
 			{
-				LogTrace("Queue is too big, sleeping\n");
-				this_thread::sleep_for(chrono::milliseconds(5));
+				policy = WaveformQueuePolicy::POLICY_BLOCK;
 			}
 
-			//If trigger isn't armed, don't even bother polling for a while.
-			else if(!scope->IsTriggerArmed())
+			//If trigger isn't armed, don't even bother polling until it is (arming the trigger wakes us)
+			if(!scope->IsTriggerArmed())
 			{
 				//LogTrace("Scope isn't armed, sleeping\n");
-				this_thread::sleep_for(chrono::milliseconds(5));
+				polled = false;
+			}
+
+			//Stop grabbing data until the waveform thread drains the queue (it'll wake us)
+			else if(full && (policy != WaveformQueuePolicy::POLICY_DROP_NEWEST) )
+			{
+				LogTrace("Queue is too big, sleeping\n");
+				polled = false;
 			}
 
 			//Grab data if it's ready
@@ -94,7 +120,23 @@ void InstrumentThread(InstrumentThreadArgs args)
 			{
 				auto stat = scope->PollTrigger();
 				if(stat == Oscilloscope::TRIGGER_MODE_TRIGGERED)
-					scope->AcquireData();
+				{
+					//No room for the new waveform, so discard it and re-arm without downloading anything.
+					//(only free running instruments get here, so re-arming doesn't change the trigger mode)
+					if(full)
+					{
+						LogTrace("Queue is too big, dropping waveform\n");
+						scope->Start();
+						qpolicy->m_droppedNewest ++;
+					}
+
+					else
+					{
+						scope->AcquireData();
+						session->OnWaveformAcquired();
+						acquired = true;
+					}
+				}
 			}
 		}
 
@@ -113,10 +155,21 @@ void InstrumentThread(InstrumentThreadArgs args)
 				if(!pchan)
 					continue;
 
-				psustate->m_channelVoltage[i] = pchan->GetVoltageMeasured();
-				psustate->m_channelCurrent[i] = pchan->GetCurrentMeasured();
-				psustate->m_channelConstantCurrent[i] = psu->IsPowerConstantCurrent(i);
-				psustate->m_channelFuseTripped[i] = psu->GetPowerOvercurrentShutdownTripped(i);
+				float v = pchan->GetVoltageMeasured();
+				float c = pchan->GetCurrentMeasured();
+				bool cc = psu->IsPowerConstantCurrent(i);
+				bool tripped = psu->GetPowerOvercurrentShutdownTripped(i);
+				if( scheduler->IsSignificantChange(psustate->m_channelVoltage[i], v) ||
+					scheduler->IsSignificantChange(psustate->m_channelCurrent[i], c) ||
+					(cc != psustate->m_channelConstantCurrent[i]) ||
+					(tripped != psustate->m_channelFuseTripped[i]) )
+				{
+					acquired = true;
+				}
+				psustate->m_channelVoltage[i] = v;
+				psustate->m_channelCurrent[i] = c;
+				psustate->m_channelConstantCurrent[i] = cc;
+				psustate->m_channelFuseTripped[i] = tripped;
 
 				session->MarkChannelDirty(pchan);
 			}
@@ -128,8 +181,15 @@ void InstrumentThread(InstrumentThreadArgs args)
 			{
 				auto lchan = dynamic_cast<LoadChannel*>(load->GetChannel(i));
 
-				loadstate->m_channelVoltage[i] = lchan->GetScalarValue(LoadChannel::STREAM_VOLTAGE_MEASURED);
-				loadstate->m_channelCurrent[i] = lchan->GetScalarValue(LoadChannel::STREAM_CURRENT_MEASURED);
+				float v = lchan->GetScalarValue(LoadChannel::STREAM_VOLTAGE_MEASURED);
+				float c = lchan->GetScalarValue(LoadChannel::STREAM_CURRENT_MEASURED);
+				if( scheduler->IsSignificantChange(loadstate->m_channelVoltage[i], v) ||
+					scheduler->IsSignificantChange(loadstate->m_channelCurrent[i], c) )
+				{
+					acquired = true;
+				}
+				loadstate->m_channelVoltage[i] = v;
+				loadstate->m_channelCurrent[i] = c;
 
 				session->MarkChannelDirty(lchan);
 			}
@@ -140,8 +200,15 @@ void InstrumentThread(InstrumentThreadArgs args)
 			auto chan = dynamic_cast<MultimeterChannel*>(meter->GetChannel(meter->GetCurrentMeterChannel()));
 			if(chan)
 			{
-				meterstate->m_primaryMeasurement = chan->GetPrimaryValue();
-				meterstate->m_secondaryMeasurement = chan->GetSecondaryValue();
+				float primary = chan->GetPrimaryValue();
+				float secondary = chan->GetSecondaryValue();
+				if( scheduler->IsSignificantChange(meterstate->m_primaryMeasurement, primary) ||
+					scheduler->IsSignificantChange(meterstate->m_secondaryMeasurement, secondary) )
+				{
+					acquired = true;
+				}
+				meterstate->m_primaryMeasurement = primary;
+				meterstate->m_secondaryMeasurement = secondary;
 				meterstate->m_firstUpdateDone = true;
 
 				session->MarkChannelDirty(chan);
@@ -194,8 +261,22 @@ void InstrumentThread(InstrumentThreadArgs args)
 		//TODO: does this make sense to do in the instrument thread?
 		session->RefreshDirtyFiltersNonblocking();
 
-		//Rate limit to 100 Hz to avoid saturating CPU with polls
+		//If the scope isn't ready for more data, wait until it is (or until we have to flush commands again)
+		if(!polled)
+		{
+			wake->BlockWithTimeout(chrono::duration<double>(scheduler->GetMaxInterval()));
+			continue;
+		}
+
+		//Decide when to poll next based on how busy the instrument is
+		scheduler->EndPoll(acquired);
+
+		//If we just got a waveform, go straight back and look for the next trigger
+		if(scope && acquired)
+			continue;
+
+		//Wait until the next poll is due
 		//(this also provides a yield point for the gui thread to get mutex ownership etc)
-		this_thread::sleep_for(chrono::milliseconds(10));
+		wake->BlockWithTimeout(chrono::duration<double>(scheduler->GetInterval()));
 	}
 }
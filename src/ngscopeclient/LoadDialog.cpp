@@ -168,7 +168,10 @@ void LoadDialog::ChannelSettings(size_t channel)
 	Unit ohms(Unit::UNIT_OHMS);
 
 	if(ImGui::Checkbox("Load Enable", &m_channelUIState[channel].m_loadEnabled))
+	{
 		m_load->SetLoadActive(channel, m_channelUIState[channel].m_loadEnabled);
+		m_session->WakeInstrument(m_load);
+	}
 
 	ImGui::SetNextItemOpen(true, ImGuiCond_Appearing);
 	if(ImGui::TreeNode("Configuration"))
@@ -179,6 +182,7 @@ void LoadDialog::ChannelSettings(size_t channel)
 			m_channelUIState[channel].m_voltageRangeIndex))
 		{
 			m_load->SetLoadVoltageRange(channel, m_channelUIState[channel].m_voltageRangeIndex);
+			m_session->WakeInstrument(m_load);
 		}
 		HelpMarker("Maximum operating voltage for the load");
 
@@ -188,6 +192,7 @@ void LoadDialog::ChannelSettings(size_t channel)
 			m_channelUIState[channel].m_currentRangeIndex))
 		{
 			m_load->SetLoadCurrentRange(channel, m_channelUIState[channel].m_currentRangeIndex);
+			m_session->WakeInstrument(m_load);
 		}
 		HelpMarker("Maximum operating current for the load");
 
@@ -207,6 +212,7 @@ void LoadDialog::ChannelSettings(size_t channel)
 			m_channelUIState[channel].m_loadEnabled = false;
 
 			m_load->SetLoadMode(channel, m_channelUIState[channel].m_mode);
+			m_session->WakeInstrument(m_load);
 
 			//Refresh set point with hardware config for the new mode
 			m_channelUIState[channel].RefreshSetPoint();
@@ -258,7 +264,10 @@ void LoadDialog::ChannelSettings(size_t channel)
 				break;
 		}
 		if(applySetPoint)
+		{
 			m_load->SetLoadSetPoint(channel, m_channelUIState[channel].m_committedSetPoint);
+			m_session->WakeInstrument(m_load);
+		}
 
 		HelpMarker("Set point for the load.\n\nChanges are not pushed to hardware until you click Apply.");
 
@@ -40,6 +40,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 
 #include "DemoOscilloscope.h"
 #include "RemoteBridgeOscilloscope.h"
@@ -61,6 +62,7 @@
 #include "FunctionGeneratorDialog.h"
 #include "HistoryDialog.h"
 #include "LoadDialog.h"
+#include "LoadProgressDialog.h"
 #include "LogViewerDialog.h"
 #include "ManageInstrumentsDialog.h"
 #include "MeasurementsDialog.h"
@@ -72,10 +74,13 @@
 #include "PreferenceDialog.h"
 #include "ProtocolAnalyzerDialog.h"
 #include "RFGeneratorDialog.h"
+#include "SaveProgressDialog.h"
 #include "SCPIConsoleDialog.h"
+#include "SessionSaveTask.h"
 #include "ScopeDeskewWizard.h"
 #include "TimebasePropertiesDialog.h"
 #include "TriggerPropertiesDialog.h"
+#include "WaveformRecorder.h"
 
 #include <imgui_markdown.h>
 
@@ -94,6 +99,7 @@
 using namespace std;
 
 extern Event g_rerenderRequestedEvent;
+extern Event g_waveformThreadWakeEvent;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
@@ -198,9 +204,20 @@ void MainWindow::CloseSession()
 
 	SaveRecentInstrumentList();
 
+	//Let any save in progress finish, since it needs the session's history
+	if(m_saveTask)
+	{
+		LogTrace("Waiting for background save to finish\n");
+		m_saveTask->Wait();
+		FinishSave();
+	}
+
 	//Close background threads in our session before destroying views
 	m_session.ClearBackgroundThreads();
 
+	//Finish writing any recording in progress
+	DoStopRecording();
+
 	//Destroy waveform views
 	LogTrace("Clearing views\n");
 	for(auto g : m_waveformGroups)
@@ -227,6 +244,8 @@ void MainWindow::CloseSession()
 	m_graphEditorGroups.clear();
 	m_fileBrowser = nullptr;
 	m_measurementsDialog = nullptr;
+	m_saveProgressDialog = nullptr;
+	m_loadProgressDialog = nullptr;
 	m_notesDialog = nullptr;
 	m_meterDialogs.clear();
 	m_psuDialogs.clear();
@@ -523,7 +542,8 @@ void MainWindow::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 
 void MainWindow::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
-	vector<shared_ptr<DisplayedChannel> >& channels)
+	vector<shared_ptr<DisplayedChannel> >& channels,
+	const set<FlowGraphNode*>& skip)
 {
 	bool clear = m_clearPersistence.exchange(false);
 	vector<shared_ptr<WaveformGroup>> groups;
@@ -532,7 +552,29 @@ void MainWindow::RenderWaveformTextures(
 		groups = m_waveformGroups;
 	}
 	for(auto group : groups)
-		group->RenderWaveformTextures(cmdbuf, channels, clear);
+		group->RenderWaveformTextures(cmdbuf, channels, clear, skip);
+}
+
+/**
+	@brief Rebuilds the min/max pyramids of any displayed waveforms which have changed
+
+	Called from the waveform thread, with the waveform data locked.
+
+	@param skip	Nodes whose trigger group is still busy, so their data can't be read yet
+ */
+void MainWindow::UpdateWaveformMipmaps(const set<FlowGraphNode*>& skip)
+{
+	vector<shared_ptr<WaveformGroup>> groups;
+	{
+		lock_guard<recursive_mutex> lock2(m_waveformGroupsMutex);
+		groups = m_waveformGroups;
+	}
+	for(auto group : groups)
+	{
+		auto areas = group->GetWaveformAreas();
+		for(auto a : areas)
+			a->UpdateWaveformMipmaps(skip);
+	}
 }
 
 void MainWindow::RenderUI()
@@ -587,6 +629,11 @@ void MainWindow::RenderUI()
 			it.second->OnWaveformLoaded(t);
 	}
 
+	//If the recorder couldn't write to disk, stop recording now and tell the user, rather than silently dropping data
+	auto recorder = m_session.GetRecorder();
+	if(recorder && recorder->HasFailed())
+		DoStopRecording();
+
 	//Menu for main window
 	MainMenu();
 	Toolbar();
@@ -596,7 +643,25 @@ void MainWindow::RenderUI()
 
 	//Waveform groups
 	{
-		shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+		//Only hold off the trigger groups feeding something we're actually displaying,
+		//so a busy group doesn't stall the whole GUI when none of its data is on screen
+		set<FlowGraphNode*> displayedNodes;
+		{
+			lock_guard<recursive_mutex> lock(m_waveformGroupsMutex);
+			for(auto g : m_waveformGroups)
+			{
+				for(auto area : g->GetWaveformAreas())
+				{
+					for(size_t i=0; i<area->GetStreamCount(); i++)
+						displayedNodes.emplace(area->GetStream(i).m_channel);
+				}
+			}
+		}
+		auto displayedGroups = m_session.GetTriggerGroupsFeeding(displayedNodes);
+
+		shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+		shared_lock<ProfiledSharedMutex> lock3(m_session.GetFilterDataMutex());
+		TriggerGroupDataLock lock4(displayedGroups);
 		lock_guard<recursive_mutex> lock2(m_waveformGroupsMutex);
 
 		for(size_t i=0; i<m_waveformGroups.size(); i++)
@@ -630,6 +695,14 @@ void MainWindow::RenderUI()
 		m_pendingChannelDisplayRequests.clear();
 	}
 
+	//Check if a background save finished
+	if(m_saveTask && m_saveTask->IsDone())
+		FinishSave();
+
+	//Check if a background load finished decoding waveforms
+	if(m_session.IsWaveformLoadDone())
+		FinishLoadSession();
+
 	//Dialog boxes
 	set< shared_ptr<Dialog> > dlgsToClose;
 	for(auto& dlg : m_dialogs)
@@ -686,7 +759,10 @@ void MainWindow::RenderUI()
 	RenderLoadWarningPopup();
 
 	if(m_needRender)
+	{
 		g_rerenderRequestedEvent.Signal();
+		g_waveformThreadWakeEvent.Signal();
+	}
 
 	//DEBUG: draw the demo windows
 	if(m_showDemo)
@@ -1110,6 +1186,10 @@ void MainWindow::OnDialogClosed(const std::shared_ptr<Dialog>& dlg)
 	}
 	if(m_measurementsDialog == dlg)
 		m_measurementsDialog = nullptr;
+	if(m_saveProgressDialog == dlg)
+		m_saveProgressDialog = nullptr;
+	if(m_loadProgressDialog == dlg)
+		m_loadProgressDialog = nullptr;
 	if(m_manageInstrumentsDialog == dlg)
 		m_manageInstrumentsDialog = nullptr;
 
@@ -1651,16 +1731,11 @@ void MainWindow::RenderLoadWarningPopup()
 		{
 			//Continue with the load
 			//always loading online if we are warning, offline loads can't warn)
-			if(LoadSessionFromYaml(m_fileBeingLoaded[0], m_sessionDataDir, true))
-			{
-				m_recentFiles[m_sessionFileName] = time(nullptr);
-				SaveRecentFileList();
-			}
-			else
-				CloseSession();
+			//Do not print any error message; LoadSessionFromYaml() is responsible for calling ShowErrorPopup()
+			//if something goes wrong there.
+			LoadSessionFromYaml(m_fileBeingLoaded[0], m_sessionDataDir, true);
 
 			m_showingLoadWarnings = false;
-			m_fileLoadInProgress = false;
 
 			ImGui::CloseCurrentPopup();
 		}
@@ -1740,6 +1815,7 @@ Filter* MainWindow::CreateFilter(
 
 	//Give it an initial name, may change later
 	f->SetDefaultName();
+	m_session.OnFilterGraphChanged();
 
 	//Find a home for each of its streams
 	if(addToArea)
@@ -1960,9 +2036,12 @@ void MainWindow::FindAreaForStream(WaveformArea* area, StreamDescriptor stream)
  */
 void MainWindow::OnFilterReconfigured(Filter* f)
 {
+	//Inputs may have been rerouted
+	m_session.OnFilterGraphChanged();
+
 	//Remove any saved configuration, eye patterns, etc
 	{
-		lock_guard lock(m_session.GetWaveformDataMutex());
+		lock_guard lock(m_session.GetFilterDataMutex());
 		f->ClearSweeps();
 	}
 
@@ -2018,6 +2097,21 @@ void MainWindow::OnSaveAs()
 		true);
 }
 
+/**
+	@brief Handler for file | start recording menu. Spawns the browser dialog
+ */
+void MainWindow::OnStartRecording()
+{
+	m_fileBrowserMode = BROWSE_RECORD_SESSION;
+	m_fileBrowser = MakeFileBrowser(
+		this,
+		".",
+		"Record Session",
+		"Session files (*.scopesession)",
+		"*.scopesession",
+		true);
+}
+
 /**
 	@brief Runs the file browser dialog
  */
@@ -2039,6 +2133,10 @@ void MainWindow::RenderFileBrowser()
 				case BROWSE_SAVE_SESSION:
 					DoSaveFile(m_fileBrowser->GetFileName());
 					break;
+
+				case BROWSE_RECORD_SESSION:
+					DoStartRecording(m_fileBrowser->GetFileName());
+					break;
 			}
 		}
 
@@ -2086,20 +2184,10 @@ void MainWindow::DoOpenFile(const string& sessionPath, bool online)
 		else
 		{
 			//Preload completed with no warnings, or loading offline? Commit now
+			//Do not print any error message; LoadSessionFromYaml() is responsible for calling ShowErrorPopup()
+			//if something goes wrong there.
 			if(!online || (m_session.GetWarnings().empty() && m_session.m_setupNotes.empty()) )
-			{
-				if(LoadSessionFromYaml(m_fileBeingLoaded[0], m_sessionDataDir, online))
-				{
-					m_recentFiles[sessionPath] = time(nullptr);
-					SaveRecentFileList();
-				}
-
-				//Loading failed, clean up any half-loaded stuff
-				//Do not print any error message; LoadSessionFromYaml() is responsible for calling ShowErrorPopup()
-				//if something goes wrong there.
-				else
-					CloseSession();
-			}
+				LoadSessionFromYaml(m_fileBeingLoaded[0], m_sessionDataDir, online);
 
 			//Preload generated warnings, pop up confirmation dialog
 			else
@@ -2168,6 +2256,9 @@ bool MainWindow::PreLoadSessionFromYaml(const YAML::Node& node, const string& da
 
 	You must call PreLoadSessionFromYaml before calling this function.
 
+	Waveform data is decoded in the background while a progress dialog is shown; FinishLoadSession() is called from
+	the main loop once it's done.
+
 	@param node		Root YAML node of the file
 	@param dataDir	Path to the _data directory associated with the session
 	@param online	True if we should reconnect to instruments
@@ -2176,13 +2267,39 @@ bool MainWindow::PreLoadSessionFromYaml(const YAML::Node& node, const string& da
  */
 bool MainWindow::LoadSessionFromYaml(const YAML::Node& node, const string& dataDir, bool online)
 {
-	if(!m_session.LoadFromYaml(node, dataDir, online))
+	if(!m_session.StartLoadFromYaml(node, dataDir, online))
 	{
 		//If loading fails, clean up any incomplete half-loaded stuff that might be in a bad state
 		CloseSession();
+		m_fileLoadInProgress = false;
 		return false;
 	}
 
+	m_fileLoadInProgress = true;
+	m_loadProgressDialog = make_shared<LoadProgressDialog>(m_session, m_sessionFileName);
+	AddDialog(m_loadProgressDialog);
+	return true;
+}
+
+/**
+	@brief Adds the decoded waveforms to the session once a background load completes
+ */
+void MainWindow::FinishLoadSession()
+{
+	if(m_loadProgressDialog)
+	{
+		m_dialogs.erase(m_loadProgressDialog);
+		m_loadProgressDialog = nullptr;
+	}
+	m_fileLoadInProgress = false;
+
+	if(!m_session.FinishLoadFromYaml())
+	{
+		//If loading fails, clean up any incomplete half-loaded stuff that might be in a bad state
+		CloseSession();
+		return;
+	}
+
 	//Update all of our instrument dialogs as needed
 	for(auto it : m_psuDialogs)
 	{
@@ -2211,11 +2328,14 @@ bool MainWindow::LoadSessionFromYaml(const YAML::Node& node, const string& dataD
 
 	//Load ImGui configuration
 	LogTrace("Loading ImGui configuration\n");
-	string ipath = dataDir + "/imgui.ini";
+	string ipath = m_sessionDataDir + "/imgui.ini";
 	ImGui::LoadIniSettingsFromDisk(ipath.c_str());
 
+	//Add to recent files list
+	m_recentFiles[m_sessionFileName] = time(nullptr);
+	SaveRecentFileList();
+
 	LogTrace("Load completed successfully\n");
-	return true;
 }
 
 bool MainWindow::LoadUIConfiguration(int version, const YAML::Node& node)
@@ -2587,7 +2707,7 @@ bool MainWindow::LoadDialogs(const YAML::Node& node)
 	auto metrics = node["metrics"];
 	if(metrics && metrics.as<bool>())
 	{
-		m_metricsDialog = make_shared<MetricsDialog>(&m_session);
+		m_metricsDialog = make_shared<MetricsDialog>(&m_session, this);
 		AddDialog(m_metricsDialog);
 	}
 
@@ -2647,53 +2767,203 @@ bool MainWindow::LoadDialogs(const YAML::Node& node)
 
 /**
 	@brief Actually save a file (may be triggered by file|save or file|save as)
+
+	The session configuration is serialized immediately, then waveform data is written in the background.
+	Everything goes into a staging directory which replaces the old data directory once the save completes.
  */
 void MainWindow::DoSaveFile(const string& sessionPath)
 {
-	//Stop the trigger so we don't have data races if a waveform comes in mid-save
-	m_session.StopTrigger();
+	if(m_session.IsLoadInProgress())
+	{
+		ShowErrorPopup(
+			"Load in progress",
+			"The session is still being loaded. Wait for the load to finish before saving.");
+		return;
+	}
 
-	//Saving the file conflicts with all other waveform data operations
-	lock_guard<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	if(m_saveTask)
+	{
+		ShowErrorPopup(
+			"Save in progress",
+			"The session is already being saved. Wait for the save to finish, or cancel it, before saving again.");
+		return;
+	}
 
 	//Get the data directory for the session
 	string base = sessionPath.substr(0, sessionPath.length() - strlen(".scopesession"));
 	string datadir = base + "_data";
+	string stagingdir = datadir + ".saving";
+
+	auto recorder = m_session.GetRecorder();
+	if(recorder && (recorder->GetDataDir() == datadir))
+	{
+		ShowErrorPopup(
+			"Recording in progress",
+			"Waveforms are currently being recorded to this session. Stop recording before saving over it.");
+		return;
+	}
 	LogDebug("Saving session file \"%s\" (data directory %s)\n", sessionPath.c_str(), datadir.c_str());
 
-	//Serialize the session
-	YAML::Node node{};
-	if(!SaveSessionToYaml(node, datadir))
+	//Clean up anything left over from an interrupted save
+	error_code ec;
+	filesystem::remove_all(stagingdir, ec);
+
+	{
+		//Snapshotting the session conflicts with all other waveform data operations, but doesn't take long
+		lock_guard<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+		lock_guard<ProfiledSharedMutex> lock2(m_session.GetFilterDataMutex());
+
+		//Serialize the session
+		YAML::Node node{};
+		if(!SaveSessionToYaml(node, stagingdir))
+		{
+			filesystem::remove_all(stagingdir, ec);
+			return;
+		}
+
+		//Save the lab notes
+		SaveLabNotes(stagingdir);
+
+		m_saveTask = m_session.CreateSaveTask(node, sessionPath, datadir, stagingdir);
+	}
+
+	//Write the waveforms in the background
+	m_saveTask->Start();
+	m_saveProgressDialog = make_shared<SaveProgressDialog>(m_saveTask);
+	AddDialog(m_saveProgressDialog);
+}
+
+/**
+	@brief Cleans up after a background save completes (successfully or not)
+ */
+void MainWindow::FinishSave()
+{
+	auto task = m_saveTask;
+	m_saveTask = nullptr;
+	task->Wait();
+
+	if(m_saveProgressDialog)
+	{
+		m_dialogs.erase(m_saveProgressDialog);
+		m_saveProgressDialog = nullptr;
+	}
+
+	if(task->IsCanceled())
+	{
+		LogDebug("Save canceled\n");
+		task->Discard();
 		return;
+	}
 
-	//Write the generated YAML to disk
-	ofstream outfs(sessionPath);
-	if(!outfs)
+	if(!task->Commit())
+	{
+		ShowErrorPopup("Save failed", task->GetError());
+		return;
+	}
+
+	//Add to recent files list
+	m_sessionFileName = task->GetSessionPath();
+	m_sessionDataDir = task->GetDataDir();
+	m_recentFiles[m_sessionFileName] = time(nullptr);
+	SaveRecentFileList();
+}
+
+/**
+	@brief Starts recording every acquired waveform to a new session on disk
+
+	The current session configuration is saved immediately, then waveforms are appended as they arrive until recording
+	is stopped. Existing history is not included.
+ */
+void MainWindow::DoStartRecording(const string& sessionPath)
+{
+	//Get the data directory for the session
+	string base = sessionPath.substr(0, sessionPath.length() - strlen(".scopesession"));
+	string datadir = base + "_data";
+
+	//Lazily loaded history may be reading from the open session's files, so don't clobber them
+	if(datadir == m_sessionDataDir)
 	{
 		ShowErrorPopup(
-			"Cannot open file",
-			string("Failed to open output session file \"") + sessionPath + "\" for writing");
+			"Cannot record",
+			"Cannot record over the currently open session. Choose a different file name.");
 		return;
 	}
 
-	outfs << node;
-	outfs.close();
+	LogDebug("Recording to session file \"%s\" (data directory %s)\n", sessionPath.c_str(), datadir.c_str());
 
-	if(!outfs)
+	//Start from an empty data directory so we don't mix in waveforms from whatever was there before.
+	//Don't delete anything that's already there, it may well be another session the user wants to keep.
+	error_code ec;
+	if(filesystem::exists(datadir, ec) && !filesystem::is_empty(datadir, ec))
 	{
 		ShowErrorPopup(
-			"Write failed",
-			string("Failed to write session file \"") + sessionPath + "\"");
+			"Cannot record",
+			string("The data directory \"") + datadir + "\" already exists and is not empty.\n\n" +
+			"Choose a different file name, or delete the existing session first.");
+		return;
 	}
 
-	//Save the lab notes
-	SaveLabNotes(datadir);
+	{
+		lock_guard<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+		lock_guard<ProfiledSharedMutex> lock2(m_session.GetFilterDataMutex());
 
-	//Add to recent files list
-	m_sessionFileName = sessionPath;
-	m_sessionDataDir = datadir;
-	m_recentFiles[sessionPath] = time(nullptr);
+		//Serialize the session
+		YAML::Node node{};
+		if(!SaveSessionToYaml(node, datadir))
+			return;
+
+		//Save the lab notes
+		SaveLabNotes(datadir);
+
+		ofstream outfs(sessionPath);
+		outfs << node;
+		outfs.close();
+		if(!outfs)
+		{
+			ShowErrorPopup(
+				"Write failed",
+				string("Failed to write session file \"") + sessionPath + "\"");
+			return;
+		}
+
+		if(!m_session.StartRecording(datadir))
+		{
+			ShowErrorPopup(
+				"Cannot record",
+				string("Failed to start recording to \"") + datadir + "\"");
+			return;
+		}
+	}
+
+	m_recordingFileName = sessionPath;
+}
+
+/**
+	@brief Stops recording, waiting for everything already acquired to be written out
+
+	Also called automatically once the recorder has failed to write to disk, so the user finds out right away.
+ */
+void MainWindow::DoStopRecording()
+{
+	auto recorder = m_session.GetRecorder();
+	if(!recorder)
+		return;
+	bool failed = recorder->HasFailed();
+
+	m_session.StopRecording();
+
+	if(failed)
+	{
+		ShowErrorPopup(
+			"Recording failed",
+			string("Failed to write waveform data to \"") + recorder->GetDataDir() + "\". "
+			"Recording has been stopped, and is incomplete.");
+	}
+
+	//The recording is a normal session, so it can be reopened later
+	m_recentFiles[m_recordingFileName] = time(nullptr);
 	SaveRecentFileList();
+	m_recordingFileName = "";
 }
 
 /**
@@ -2806,8 +3076,9 @@ bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir)
 		version unspecified (treated as version 0): original string concatenation based glscopeclient impl
 		version 1: yaml-cpp glscopeclient
 		version 2: initial ngscopeclient
+		version 3: sparse waveforms always stored as sparsev2
 	 */
-	node["version"] = 2;
+	node["version"] = 3;
 
 	//Save the session state
 	node["metadata"]  = m_session.SerializeMetadata();
@@ -2819,8 +3090,8 @@ bool MainWindow::SaveSessionToYaml(YAML::Node& node, const string& dataDir)
 	//Save UI widgets
 	node["ui_config"] = SerializeUIConfiguration();
 
-	//TODO: waveform data
-	if(!m_session.SerializeWaveforms(dataDir))
+	//Filter waveforms are saved now, history is saved in the background
+	if(!m_session.SerializeFilterWaveforms(dataDir))
 		return false;
 
 	//Save ImGui configuration
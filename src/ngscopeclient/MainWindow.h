@@ -147,7 +147,9 @@ public:
 
 	void RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
-		std::vector<std::shared_ptr<DisplayedChannel> >& channels);
+		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
+		const std::set<FlowGraphNode*>& skip);
+	void UpdateWaveformMipmaps(const std::set<FlowGraphNode*>& skip);
 
 	void SetNeedRender()
 	{ m_needRender = true; }
@@ -373,6 +375,12 @@ protected:
 	///@brief Measurements dialog
 	std::shared_ptr<MeasurementsDialog> m_measurementsDialog;
 
+	///@brief Progress of the current background save
+	std::shared_ptr<Dialog> m_saveProgressDialog;
+
+	///@brief Progress of the current session load
+	std::shared_ptr<Dialog> m_loadProgressDialog;
+
 	void OnDialogClosed(const std::shared_ptr<Dialog>& dlg);
 
 	///@brief Pending requests to split waveform groups
@@ -413,6 +421,7 @@ protected:
 	void DoOpenFile(const std::string& sessionPath, bool online);
 	bool PreLoadSessionFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
 	bool LoadSessionFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
+	void FinishLoadSession();
 public:
 	bool LoadUIConfiguration(int version, const YAML::Node& node);
 
@@ -425,6 +434,10 @@ public:
 protected:
 	void OnSaveAs();
 	void DoSaveFile(const std::string& sessionPath);
+	void FinishSave();
+	void OnStartRecording();
+	void DoStartRecording(const std::string& sessionPath);
+	void DoStopRecording();
 	bool SaveSessionToYaml(YAML::Node& node, const std::string& dataDir);
 	void SaveLabNotes(const std::string& dataDir);
 	void LoadLabNotes(const std::string& dataDir);
@@ -438,7 +451,8 @@ protected:
 	enum
 	{
 		BROWSE_OPEN_SESSION,
-		BROWSE_SAVE_SESSION
+		BROWSE_SAVE_SESSION,
+		BROWSE_RECORD_SESSION
 	} m_fileBrowserMode;
 
 	///@brief Browser for pending file loads
@@ -450,12 +464,18 @@ protected:
 	///@brief True if we're actively loading a file
 	bool m_fileLoadInProgress;
 
+	///@brief Session save running in the background (null if not saving)
+	std::shared_ptr<SessionSaveTask> m_saveTask;
+
 	///@brief Current session file path
 	std::string m_sessionFileName;
 
 	///@brief Current session data directory
 	std::string m_sessionDataDir;
 
+	///@brief Session file being recorded to (empty if not recording)
+	std::string m_recordingFileName;
+
 public:
 	std::string GetDataDir()
 	{ return m_sessionDataDir; }
@@ -163,6 +163,23 @@ void MainWindow::FileMenu()
 
 		ImGui::Separator();
 
+		if(m_session.IsRecording())
+		{
+			if(ImGui::MenuItem("Stop Recording"))
+				DoStopRecording();
+		}
+		else
+		{
+			if(hasFileBrowser)
+				ImGui::BeginDisabled();
+			if(ImGui::MenuItem("Record to Disk..."))
+				OnStartRecording();
+			if(hasFileBrowser)
+				ImGui::EndDisabled();
+		}
+
+		ImGui::Separator();
+
 		if(ImGui::MenuItem("Close"))
 			QueueCloseSession();
 
@@ -1344,7 +1361,7 @@ void MainWindow::WindowMenu()
 
 		if(ImGui::MenuItem("Performance Metrics"))
 		{
-			m_metricsDialog = make_shared<MetricsDialog>(&m_session);
+			m_metricsDialog = make_shared<MetricsDialog>(&m_session, this);
 			AddDialog(m_metricsDialog);
 		}
 
@@ -35,6 +35,7 @@
 
 #include "ngscopeclient.h"
 #include "MetricsDialog.h"
+#include "WaveformRecorder.h"
 #include "Session.h"
 
 using namespace std;
@@ -42,9 +43,10 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-MetricsDialog::MetricsDialog(Session* session)
+MetricsDialog::MetricsDialog(Session* session, MainWindow* parent)
 	: Dialog("Performance Metrics", "Metrics", ImVec2(300, 400))
 	, m_session(session)
+	, m_parent(parent)
 {
 	m_displayRefreshRate = 0;
 
@@ -64,6 +66,26 @@ MetricsDialog::~MetricsDialog()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Rendering
 
+bool MetricsDialog::Render()
+{
+	RunFileDialog();
+	return Dialog::Render();
+}
+
+void MetricsDialog::RunFileDialog()
+{
+	if(!m_fileDialog)
+		return;
+
+	m_fileDialog->Render();
+
+	if(m_fileDialog->IsClosedOK())
+		m_session->GetFilterProfiler().ExportChromeTrace(m_fileDialog->GetFileName());
+
+	if(m_fileDialog->IsClosed())
+		m_fileDialog = nullptr;
+}
+
 /**
 	@brief Renders the dialog and handles UI events
 
@@ -114,6 +136,18 @@ bool MetricsDialog::DoRender()
 			"necessarily execute every frame. It runs asynchronously and is not locked to the display framerate."
 			);
 
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(m_session->GetRasterizeCacheHits()) + " / " +
+				counts.PrettyPrint(m_session->GetRasterizeCacheMisses());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Rasterize skipped / run", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of times a waveform's rasterization was skipped because its data, zoom, size, and display settings "
+			"were unchanged since it was last drawn, versus the number of times it was actually rasterized."
+			);
+
 		ImGui::BeginDisabled();
 			str = fs.PrettyPrint(m_session->GetToneMapTime());
 			ImGui::SetNextItemWidth(width);
@@ -164,9 +198,58 @@ bool MetricsDialog::DoRender()
 			ImGui::InputText("Exec time", &str);
 		ImGui::EndDisabled();
 
-		HelpMarker("Update time for the last evaluation of the filter graph");
+		HelpMarker("Update time for the last full or dirty-filter evaluation of the filter graph");
+
+		for(auto group : m_session->GetTriggerGroups())
+		{
+			ImGui::PushID(group.get());
+			ImGui::BeginDisabled();
+				str = fs.PrettyPrint(group->GetFilterGraphExecTime());
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText(("Exec time (" + group->GetDescription() + ")").c_str(), &str);
+			ImGui::EndDisabled();
+			ImGui::PopID();
+
+			HelpMarker("Update time for the last run of the filters downstream of this trigger group");
+		}
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(m_session->GetLastFilterConeSize()) + " / " +
+				counts.PrettyPrint(m_session->GetLastFilterGraphSize());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Nodes run", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of graph nodes run by the most recent trigger group update, out of the total in the graph.\n\n"
+			"Only nodes downstream of channels which actually got new data are run.");
+
+		ImGui::BeginDisabled();
+			str = counts.PrettyPrint(m_session->GetFilterConeCacheHits()) + " / " +
+				counts.PrettyPrint(m_session->GetFilterConeCacheMisses());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Cone cache hits / misses", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Number of trigger group updates which reused the set of nodes to run from a previous update, vs "
+			"having to search the filter graph for it.\n\n"
+			"The cache is flushed whenever filters are created, deleted, or rewired.");
+
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetDirtyConeTime());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Dirty search time", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time spent finding the filters downstream of channels updated outside of a trigger event "
+			"(e.g. power supply or multimeter readings) during the most recent refresh.");
 	}
 
+	if(ImGui::CollapsingHeader("Filter profiler"))
+		DoFilterProfiler();
+
 	if(ImGui::CollapsingHeader("Acquisition"))
 	{
 		ImGui::BeginDisabled();
@@ -182,12 +265,38 @@ bool MetricsDialog::DoRender()
 			"are likely the bottleneck."
 			);
 
+		ImGui::BeginDisabled();
+			str = fs.PrettyPrint(m_session->GetDisplayLatency());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Display latency", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Time from the most recent waveform finishing downloading from the instrument to it being handed to "
+			"the display.\n\n"
+			"This includes filter graph execution and waveform rendering, plus any time spent waiting in queues."
+			);
+
+		ImGui::BeginDisabled();
+			str = hz.PrettyPrint(m_session->GetWaveformThreadWakeupRate());
+			ImGui::SetNextItemWidth(width);
+			ImGui::InputText("Idle wakeups", &str);
+		ImGui::EndDisabled();
+
+		HelpMarker(
+			"Rate at which the waveform processing thread wakes up while waiting for data.\n\n"
+			"The thread sleeps until an instrument delivers a waveform, so this should be low (around 10 Hz) "
+			"when nothing is being acquired."
+			);
+
 		//Category for each scope
 		auto scopes = m_session->GetScopes();
 		for(auto s : scopes)
 		{
 			if(ImGui::TreeNode(s->m_nickname.c_str()))
 			{
+				auto state = m_session->GetInstrumentConnectionState(s);
+
 				ImGui::BeginDisabled();
 					str = counts.PrettyPrint(s->GetPendingWaveformCount());
 					ImGui::SetNextItemWidth(width);
@@ -196,16 +305,189 @@ bool MetricsDialog::DoRender()
 
 				HelpMarker(
 					"Number of waveforms queued for processing.\n\n"
-					"This value should normally be 0 or 1, and is capped at 5.\n"
-					"If it is consistently at or near 5, waveform processing and/or rendering is unable to keep "
-					"up with the instrument."
+					"This value should normally be 0 or 1, and is limited by the queue depth and size set in the "
+					"preferences.\n"
+					"If it is consistently at or near the limit, waveform processing and/or rendering is unable to "
+					"keep up with the instrument."
 					);
 
+				if(state)
+				{
+					auto& qpolicy = state->m_queuePolicy;
+					Unit bytes(Unit::UNIT_BYTES);
+
+					ImGui::BeginDisabled();
+						str = counts.PrettyPrint(qpolicy.GetMaxDepth());
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Queue limit", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker(
+						"Maximum number of waveforms which may be queued.\n\n"
+						"This is the smaller of the configured queue depth, and the configured queue size divided by "
+						"the waveform size.");
+
+					ImGui::BeginDisabled();
+						str = bytes.PrettyPrint(qpolicy.m_waveformSize);
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Waveform size", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker("Size of the most recent waveform (all channels)");
+
+					ImGui::BeginDisabled();
+						str = counts.PrettyPrint(qpolicy.m_droppedOldest);
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Dropped (oldest)", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker(
+						"Number of queued waveforms discarded to make room for newer ones.\n\n"
+						"Only nonzero with the \"Drop oldest\" overflow policy.");
+
+					ImGui::BeginDisabled();
+						str = counts.PrettyPrint(qpolicy.m_droppedNewest);
+						ImGui::SetNextItemWidth(width);
+						ImGui::InputText("Dropped (newest)", &str);
+					ImGui::EndDisabled();
+
+					HelpMarker(
+						"Number of triggers discarded without downloading because the queue was full.\n\n"
+						"Only nonzero with the \"Drop newest\" overflow policy.");
+				}
+
 				ImGui::TreePop();
 			}
 		}
 	}
 
+	if(ImGui::CollapsingHeader("Instruments"))
+	{
+		Unit pct(Unit::UNIT_PERCENT);
+
+		//Polling statistics for each instrument
+		auto insts = m_session->GetInstruments();
+		for(auto inst : insts)
+		{
+			auto state = m_session->GetInstrumentConnectionState(inst);
+			if(!state)
+				continue;
+			auto& sched = state->m_pollScheduler;
+
+			if(ImGui::TreeNode(inst->m_nickname.c_str()))
+			{
+				ImGui::BeginDisabled();
+					str = hz.PrettyPrint(sched.GetPollRate());
+					ImGui::SetNextItemWidth(width);
+					ImGui::InputText("Poll rate", &str);
+				ImGui::EndDisabled();
+
+				HelpMarker(
+					"Rate at which the instrument is being polled for new data.\n\n"
+					"This adapts to how often new data arrives, within the limits set in the preferences.");
+
+				ImGui::BeginDisabled();
+					str = fs.PrettyPrint(sched.GetInterval() * FS_PER_SECOND);
+					ImGui::SetNextItemWidth(width);
+					ImGui::InputText("Poll interval", &str);
+				ImGui::EndDisabled();
+
+				HelpMarker("Current time the polling thread waits between polls");
+
+				ImGui::BeginDisabled();
+					str = fs.PrettyPrint(sched.GetResponseTime() * FS_PER_SECOND);
+					ImGui::SetNextItemWidth(width);
+					ImGui::InputText("Response time", &str);
+				ImGui::EndDisabled();
+
+				HelpMarker("Average time each poll takes, including downloading any new data");
+
+				ImGui::BeginDisabled();
+					str = pct.PrettyPrint(sched.GetUtilization());
+					ImGui::SetNextItemWidth(width);
+					ImGui::InputText("Transport utilization", &str);
+				ImGui::EndDisabled();
+
+				HelpMarker(
+					"Fraction of the time the connection to the instrument is busy with polling.\n\n"
+					"If this is close to 100%, the instrument or its connection is the bottleneck.");
+
+				ImGui::TreePop();
+			}
+		}
+	}
+
+	if(ImGui::CollapsingHeader("Locks"))
+	{
+		DoLockStats(m_session->GetWaveformDataMutex(), width);
+		DoLockStats(m_session->GetFilterDataMutex(), width);
+
+		//Each trigger group's data has its own lock too
+		auto groups = m_session->GetTriggerGroups();
+		for(auto group : groups)
+		{
+			ImGui::PushID(group.get());
+			DoLockStats(group->GetDataMutex(), width, group->GetDescription());
+			ImGui::PopID();
+		}
+	}
+
+	//Only show this tab while recording
+	auto recorder = m_session->GetRecorder();
+	if(recorder)
+	{
+		if(ImGui::CollapsingHeader("Recording"))
+		{
+			Unit bytes(Unit::UNIT_BYTES);
+
+			ImGui::BeginDisabled();
+				str = counts.PrettyPrint(recorder->GetPointsWritten());
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText("Waveforms written", &str);
+			ImGui::EndDisabled();
+
+			HelpMarker("Number of acquisitions written to disk since recording started");
+
+			ImGui::BeginDisabled();
+				str = bytes.PrettyPrint(recorder->GetBytesWritten());
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText("Data written", &str);
+			ImGui::EndDisabled();
+
+			HelpMarker("Total size of waveform data written to disk since recording started");
+
+			ImGui::BeginDisabled();
+				str = counts.PrettyPrint(recorder->GetQueueDepth()) + " (" +
+					bytes.PrettyPrint(recorder->GetQueuedBytes()) + ")";
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText("Queued", &str);
+			ImGui::EndDisabled();
+
+			HelpMarker(
+				"Acquisitions waiting to be written to disk.\n\n"
+				"If this stays at the limit set in preferences, the disk is unable to keep up and acquisition is "
+				"being paused to let it catch up.");
+
+			ImGui::BeginDisabled();
+				str = bytes.PrettyPrint(recorder->GetAverageRate()) + "/s";
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText("Record rate", &str);
+			ImGui::EndDisabled();
+
+			HelpMarker("Average rate waveform data has been recorded since recording started");
+
+			ImGui::BeginDisabled();
+				str = bytes.PrettyPrint(recorder->GetThroughput()) + "/s";
+				ImGui::SetNextItemWidth(width);
+				ImGui::InputText("Disk throughput", &str);
+			ImGui::EndDisabled();
+
+			HelpMarker(
+				"Sustained write throughput of the recorder, counting only time spent actually writing.\n\n"
+				"If the record rate approaches this value, the disk is the bottleneck.");
+		}
+	}
+
 	//Only show this tab if available
 	if(g_hasMemoryBudget)
 	{
@@ -295,5 +577,273 @@ bool MetricsDialog::DoRender()
 	return true;
 }
 
+/**
+	@brief Shows hold and wait times for one of the session's locks
+
+	@param lock		The lock
+	@param width	Width of the text boxes
+	@param label	Label for the tree node (defaults to the lock's name)
+ */
+void MetricsDialog::DoLockStats(ProfiledSharedMutex& lock, float width, const string& label)
+{
+	Unit counts(Unit::UNIT_COUNTS);
+	Unit fs(Unit::UNIT_FS);
+	string str;
+
+	if(!ImGui::TreeNode(label.empty() ? lock.GetName().c_str() : label.c_str()))
+		return;
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(lock.GetExclusiveHoldTime() * FS_PER_SECOND);
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Exclusive hold", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Smoothed time the lock is held exclusively (while writing) each time it's taken.\n\n"
+		"Readers of the data protected by this lock have to wait this long if they arrive during a write.");
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(lock.GetPeakExclusiveHoldTime() * FS_PER_SECOND);
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Peak exclusive hold", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker("Longest time the lock was held exclusively in the last second or so");
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(lock.GetExclusiveWaitTime() * FS_PER_SECOND);
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Exclusive wait", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker("Smoothed time writers spend waiting to get the lock");
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(lock.GetSharedWaitTime() * FS_PER_SECOND);
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Shared wait", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Smoothed time readers (rendering, the user interface, etc) spend waiting to get the lock.\n\n"
+		"If this is large, writers are holding the lock for too long.");
+
+	ImGui::BeginDisabled();
+		str = counts.PrettyPrint(lock.GetExclusiveCount()) + " / " + counts.PrettyPrint(lock.GetSharedCount());
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Exclusive / shared", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker("Total number of times the lock has been taken for writing and for reading");
+
+	ImGui::TreePop();
+}
+
+/**
+	@brief Compares two filter profiles by the value in one column of the profiler table
+ */
+static bool ProfileLess(const FilterProfile& a, const FilterProfile& b, int col)
+{
+	switch(col)
+	{
+		case 0:	return a.m_name < b.m_name;
+		case 1:	return a.m_type < b.m_type;
+		case 3:	return a.m_averageTime < b.m_averageTime;
+		case 4:	return a.m_maxTime < b.m_maxTime;
+		case 5:	return a.m_gpu < b.m_gpu;
+		case 6:	return a.m_inputSamples < b.m_inputSamples;
+		case 7:	return a.m_outputSamples < b.m_outputSamples;
+		case 8:	return a.m_outputBytes < b.m_outputBytes;
+
+		case 2:
+		default:
+			return a.m_lastTime < b.m_lastTime;
+	}
+}
+
+/**
+	@brief Shows per-filter execution statistics
+ */
+void MetricsDialog::DoFilterProfiler()
+{
+	auto& profiler = m_session->GetFilterProfiler();
+
+	bool enabled = profiler.IsEnabled();
+	if(ImGui::Checkbox("Enable", &enabled))
+		profiler.SetEnabled(enabled);
+	HelpMarker(
+		"Time each filter individually every time the filter graph runs.\n\n"
+		"While profiling, filters are run one at a time rather than in parallel, so the filter graph as a whole "
+		"will be slower than normal.");
+
+	bool overlay = profiler.IsOverlayEnabled();
+	if(ImGui::Checkbox("Show in filter graph", &overlay))
+		profiler.SetOverlayEnabled(overlay);
+	HelpMarker("Show the most recent run time of each filter under its node in the filter graph editor");
+
+	if(ImGui::Button("Clear"))
+		profiler.Clear();
+	ImGui::SameLine();
+	if(ImGui::Button("Export trace...") && !m_fileDialog)
+	{
+		m_fileDialog = MakeFileBrowser(
+			m_parent,
+			".",
+			"Export Trace",
+			"Chrome trace files (*.json)",
+			"*.json",
+			true);
+	}
+	HelpMarker(
+		"Save every filter run recorded so far as a Chrome trace event file, "
+		"for viewing in chrome://tracing, Perfetto, etc.");
+
+	auto profiles = profiler.GetProfiles();
+	if(profiles.empty())
+	{
+		if(enabled)
+			ImGui::TextUnformatted("No filters have run yet");
+		return;
+	}
+
+	//Summary of the graph as a whole
+	Unit fs(Unit::UNIT_FS);
+	Unit counts(Unit::UNIT_COUNTS);
+	float width = 10 * ImGui::GetFontSize();
+	string str;
+	char tmp[32];
+
+	double pathLength;
+	double total;
+	auto path = m_session->GetFilterCriticalPath(pathLength, total);
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(total * FS_PER_SECOND);
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Total filter time", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker("Sum of the average run times of every filter in the graph");
+
+	ImGui::BeginDisabled();
+		str = fs.PrettyPrint(pathLength * FS_PER_SECOND) + " (" + counts.PrettyPrint(path.size()) + " nodes)";
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Critical path", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Total run time of the slowest chain of filters which each depend on the previous one.\n\n"
+		"The filter graph can never run faster than this, no matter how many CPU cores are available. "
+		"The path is highlighted in the filter graph editor when \"Show in filter graph\" is checked.");
+
+	ImGui::BeginDisabled();
+		snprintf(tmp, sizeof(tmp), "%.2fx", (pathLength > 0) ? total / pathLength : 0);
+		str = tmp;
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Available parallelism", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Total filter time divided by critical path time.\n\n"
+		"This is the most speedup the filter graph could get from running filters in parallel. If it's close to 1, "
+		"adding cores won't help and the graph (or the filters on the critical path) needs to be restructured.");
+
+	ImGui::BeginDisabled();
+		double achieved = profiler.GetAchievedParallelism();
+		snprintf(tmp, sizeof(tmp), "%.2fx", achieved);
+		str = tmp;
+		ImGui::SetNextItemWidth(width);
+		ImGui::InputText("Achieved parallelism", &str);
+	ImGui::EndDisabled();
+
+	HelpMarker(
+		"Sum of the filter run times divided by the wall clock time of normal (unprofiled) graph runs.\n\n"
+		"If this is well below the available parallelism, the executor isn't keeping enough cores busy.");
+
+	static ImGuiTableFlags flags =
+		ImGuiTableFlags_Resizable |
+		ImGuiTableFlags_BordersOuter |
+		ImGuiTableFlags_BordersV |
+		ImGuiTableFlags_RowBg |
+		ImGuiTableFlags_Sortable |
+		ImGuiTableFlags_ScrollX;
+
+	float fontWidth = ImGui::GetFontSize();
+	if(!ImGui::BeginTable("filterprofile", 10, flags))
+		return;
+
+	ImGui::TableSetupColumn("Filter", ImGuiTableColumnFlags_WidthFixed, 8*fontWidth);
+	ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, 8*fontWidth);
+	ImGui::TableSetupColumn(
+		"Last", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending,
+		5*fontWidth);
+	ImGui::TableSetupColumn("Average", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 5*fontWidth);
+	ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 5*fontWidth);
+	ImGui::TableSetupColumn("Path", ImGuiTableColumnFlags_WidthFixed, 3*fontWidth);
+	ImGui::TableSetupColumn("In", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 5*fontWidth);
+	ImGui::TableSetupColumn("Out", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 5*fontWidth);
+	ImGui::TableSetupColumn("Bytes", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 5*fontWidth);
+	ImGui::TableSetupColumn("History (ms)", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort, 10*fontWidth);
+	ImGui::TableHeadersRow();
+
+	//Sort by whichever column the user picked
+	vector<FilterProfile> rows;
+	for(auto& it : profiles)
+		rows.push_back(it.second);
+	auto specs = ImGui::TableGetSortSpecs();
+	if(specs && (specs->SpecsCount > 0))
+	{
+		auto col = specs->Specs[0].ColumnIndex;
+		bool ascending = (specs->Specs[0].SortDirection == ImGuiSortDirection_Ascending);
+		stable_sort(rows.begin(), rows.end(), [col, ascending](const FilterProfile& a, const FilterProfile& b)
+			{ return ascending ? ProfileLess(a, b, col) : ProfileLess(b, a, col); });
+	}
+
+	Unit sa(Unit::UNIT_SAMPLEDEPTH);
+	Unit bytes(Unit::UNIT_BYTES);
+	for(size_t i=0; i<rows.size(); i++)
+	{
+		auto& p = rows[i];
+		ImGui::PushID(i);
+		ImGui::TableNextRow();
+
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(p.m_name.c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(p.m_type.c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(fs.PrettyPrint(p.m_lastTime * FS_PER_SECOND).c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(fs.PrettyPrint(p.m_averageTime * FS_PER_SECOND).c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(fs.PrettyPrint(p.m_maxTime * FS_PER_SECOND).c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(p.m_gpu ? "GPU" : "CPU");
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(sa.PrettyPrint(p.m_inputSamples).c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(sa.PrettyPrint(p.m_outputSamples).c_str());
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(bytes.PrettyPrint(p.m_outputBytes).c_str());
+
+		//Recent run times, oldest first
+		ImGui::TableNextColumn();
+		ImGui::PlotHistogram(
+			"##history",
+			p.m_history.data(),
+			p.m_history.size(),
+			p.m_historyPos,
+			nullptr,
+			0,
+			FLT_MAX,
+			ImVec2(10*fontWidth, ImGui::GetTextLineHeight()));
+
+		ImGui::PopID();
+	}
+
+	ImGui::EndTable();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // UI event handlers
@@ -36,18 +36,33 @@
 #define MetricsDialog_h
 
 #include "Dialog.h"
+#include "FileBrowser.h"
+
+class MainWindow;
+class ProfiledSharedMutex;
 
 class MetricsDialog : public Dialog
 {
 public:
-	MetricsDialog(Session* session);
+	MetricsDialog(Session* session, MainWindow* parent);
 	virtual ~MetricsDialog();
 
+	virtual bool Render();
 	virtual bool DoRender();
 
 protected:
+	void DoLockStats(ProfiledSharedMutex& lock, float width, const std::string& label = "");
+	void DoFilterProfiler();
+	void RunFileDialog();
+
 	Session* m_session;
 
+	///@brief Top level window, for the file browser
+	MainWindow* m_parent;
+
+	///@brief Browser for picking where to export a filter trace
+	std::shared_ptr<FileBrowser> m_fileDialog;
+
 	int m_displayRefreshRate;
 };
 
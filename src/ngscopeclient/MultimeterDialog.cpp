@@ -137,7 +137,10 @@ bool MultimeterDialog::DoRender()
 	if(ImGui::CollapsingHeader("Configuration", ImGuiTreeNodeFlags_DefaultOpen))
 	{
 		if(ImGui::Checkbox("Autorange", &m_autorange))
+		{
 			m_meter->SetMeterAutoRange(m_autorange);
+			m_session->WakeInstrument(m_meter);
+		}
 		HelpMarker("Enables automatic selection of meter scale ranges.");
 
 		//Channel selector (hide if we have only one channel)
@@ -145,7 +148,10 @@ bool MultimeterDialog::DoRender()
 		{
 			ImGui::SetNextItemWidth(valueWidth);
 			if(Combo("Channel", m_channelNames, m_selectedChannel))
+			{
 				m_meter->SetCurrentMeterChannel(m_selectedChannel);
+				m_session->WakeInstrument(m_meter);
+			}
 
 			HelpMarker("Select which input channel is being monitored.");
 		}
@@ -161,7 +167,10 @@ bool MultimeterDialog::DoRender()
 			ImGui::BeginDisabled();
 		ImGui::SetNextItemWidth(valueWidth);
 		if(Combo("Secondary Mode", m_secondaryModeNames, m_secondaryModeSelector))
+		{
 			m_meter->SetSecondaryMeterMode(m_secondaryModes[m_secondaryModeSelector]);
+			m_session->WakeInstrument(m_meter);
+		}
 		if(m_secondaryModeNames.empty())
 			ImGui::EndDisabled();
 
@@ -206,6 +215,7 @@ void MultimeterDialog::OnPrimaryModeChanged()
 {
 	//Push the new mode to the meter
 	m_meter->SetMeterMode(m_primaryModes[m_primaryModeSelector]);
+	m_session->WakeInstrument(m_meter);
 
 	//Redo the list of available secondary meter modes
 	RefreshSecondaryModeList();
@@ -0,0 +1,157 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PollScheduler
+ */
+#include "ngscopeclient.h"
+#include "PollScheduler.h"
+
+using namespace std;
+
+///@brief Weight of the newest sample in the smoothed response time and utilization
+#define POLL_SMOOTHING 0.1
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+PollScheduler::PollScheduler()
+	: m_minInterval(0.01)
+	, m_maxInterval(0.01)
+	, m_maxUtilization(1)
+	, m_changeThreshold(0)
+	, m_interval(0.01)
+	, m_responseTime(0)
+	, m_utilization(0)
+	, m_tPollStart(0)
+	, m_tLastPollStart(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Sets the limits on the poll interval
+
+	@param minInterval		Shortest allowed time between polls, in seconds
+	@param maxInterval		Longest allowed time between polls, in seconds
+	@param maxUtilization	Maximum fraction of the transport's time to spend polling (1 for no limit)
+ */
+void PollScheduler::SetLimits(double minInterval, double maxInterval, double maxUtilization)
+{
+	m_minInterval = max(minInterval, 0.0);
+	m_maxInterval = max(maxInterval, m_minInterval.load());
+	m_maxUtilization = min(max(maxUtilization, 0.01), 1.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scheduling
+
+/**
+	@brief Call at the start of each poll of the instrument
+ */
+void PollScheduler::BeginPoll()
+{
+	m_tPollStart = GetTime();
+}
+
+/**
+	@brief Call at the end of each poll of the instrument, to update the statistics and pick the next interval
+
+	@param gotData	True if the poll returned new data
+ */
+void PollScheduler::EndPoll(bool gotData)
+{
+	double now = GetTime();
+	double busy = now - m_tPollStart;
+
+	{
+		lock_guard<mutex> lock(m_rateMutex);
+		m_pollRate.Tick();
+	}
+
+	//Smoothed response time and utilization
+	m_responseTime = m_responseTime * (1 - POLL_SMOOTHING) + busy * POLL_SMOOTHING;
+	if(m_tLastPollStart > 0)
+	{
+		double period = m_tPollStart - m_tLastPollStart;
+		if(period > 0)
+			m_utilization = m_utilization * (1 - POLL_SMOOTHING) + min(busy / period, 1.0) * POLL_SMOOTHING;
+	}
+	m_tLastPollStart = m_tPollStart;
+
+	//Speed up while data is arriving, back off gradually when it isn't
+	double minInterval = m_minInterval;
+	double maxInterval = m_maxInterval;
+	double interval = m_interval;
+	if(gotData)
+		interval *= 0.5;
+	else
+		interval = max(interval * 1.25, 1e-4);
+
+	//Don't poll so fast that we hog the transport.
+	//If a poll takes t seconds and we can use fraction u of the transport, we need to wait t*(1/u - 1) in between.
+	double maxUtilization = m_maxUtilization;
+	if(maxUtilization < 1)
+		minInterval = max(minInterval, m_responseTime * (1 / maxUtilization - 1));
+
+	m_interval = min(max(interval, minInterval), max(maxInterval, minInterval));
+}
+
+/**
+	@brief Decides whether a scalar reading has changed enough to count as new data
+
+	Readings from meters, power supplies, etc. are rarely exactly the same twice, so comparing them exactly would keep
+	the poll interval at its minimum forever. Instead, a reading only counts as changed if it moved by more than the
+	change threshold, relative to the larger of the two values.
+
+	@param oldValue	Previous reading
+	@param newValue	Current reading
+ */
+bool PollScheduler::IsSignificantChange(double oldValue, double newValue)
+{
+	//Going to or from NaN (no reading) is always a change
+	if(isnan(oldValue) || isnan(newValue))
+		return isnan(oldValue) != isnan(newValue);
+
+	double delta = fabs(newValue - oldValue);
+	return delta > m_changeThreshold * max(fabs(oldValue), fabs(newValue));
+}
+
+/**
+	@brief Returns the achieved poll rate, in Hz
+ */
+double PollScheduler::GetPollRate()
+{
+	lock_guard<mutex> lock(m_rateMutex);
+	return m_pollRate.GetAverageHz();
+}
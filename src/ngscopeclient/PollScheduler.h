@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PollScheduler
+ */
+#ifndef PollScheduler_h
+#define PollScheduler_h
+
+#include "../xptools/HzClock.h"
+
+/**
+	@brief Decides how often an instrument thread should poll its instrument
+
+	The interval adapts to the data rate: every poll which returns new data (a trigger, a changed reading, etc) halves
+	it, down to the configured minimum, and every poll which doesn't lengthens it, up to the configured maximum. On top
+	of that, the interval is never allowed to get so short that polling uses more than the configured fraction of the
+	transport's time, based on how long each poll actually takes.
+
+	Limits are set from the GUI thread and everything else runs in the instrument thread, except for the statistics
+	which may be read from anywhere.
+ */
+class PollScheduler
+{
+public:
+	PollScheduler();
+
+	void SetLimits(double minInterval, double maxInterval, double maxUtilization);
+
+	///@brief Sets the fractional change in a scalar reading which counts as new data
+	void SetChangeThreshold(double threshold)
+	{ m_changeThreshold = std::max(threshold, 0.0); }
+
+	bool IsSignificantChange(double oldValue, double newValue);
+
+	void BeginPoll();
+	void EndPoll(bool gotData);
+
+	///@brief Returns the time to wait before the next poll, in seconds
+	double GetInterval()
+	{ return m_interval; }
+
+	///@brief Returns the longest time we should ever go between polls, in seconds
+	double GetMaxInterval()
+	{ return m_maxInterval; }
+
+	///@brief Returns the smoothed time each poll takes, in seconds
+	double GetResponseTime()
+	{ return m_responseTime; }
+
+	///@brief Returns the smoothed fraction of time the transport is busy with polls
+	double GetUtilization()
+	{ return m_utilization; }
+
+	double GetPollRate();
+
+protected:
+	///@brief Minimum time between polls, in seconds
+	std::atomic<double> m_minInterval;
+
+	///@brief Maximum time between polls, in seconds (unless the utilization limit requires more)
+	std::atomic<double> m_maxInterval;
+
+	///@brief Maximum fraction of the transport's time we're allowed to spend polling
+	std::atomic<double> m_maxUtilization;
+
+	///@brief Fractional change in a scalar reading which counts as new data
+	std::atomic<double> m_changeThreshold;
+
+	///@brief Current time between polls, in seconds
+	std::atomic<double> m_interval;
+
+	///@brief Smoothed poll response time, in seconds
+	std::atomic<double> m_responseTime;
+
+	///@brief Smoothed transport utilization
+	std::atomic<double> m_utilization;
+
+	///@brief Start time of the current poll
+	double m_tPollStart;
+
+	///@brief Start time of the previous poll (0 if none)
+	double m_tLastPollStart;
+
+	///@brief Mutex controlling access to m_pollRate
+	std::mutex m_rateMutex;
+
+	///@brief Achieved poll rate
+	HzClock m_pollRate;
+};
+
+#endif
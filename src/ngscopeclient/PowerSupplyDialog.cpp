@@ -125,7 +125,10 @@ bool PowerSupplyDialog::DoRender()
 		if(ImGui::CollapsingHeader("Global", ImGuiTreeNodeFlags_DefaultOpen))
 		{
 			if(ImGui::Checkbox("Output Enable", &m_masterEnable))
+			{
 				m_psu->SetMasterPowerEnable(m_masterEnable);
+				m_session->WakeInstrument(m_psu);
+			}
 
 			HelpMarker(
 				"Top level output enable, gating all outputs from the PSU.\n"
@@ -202,7 +205,10 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 		if(m_psu->SupportsIndividualOutputSwitching())
 		{
 			if(ImGui::Checkbox("Output Enable", &m_channelUIState[i].m_outputEnabled))
+			{
 				m_psu->SetPowerChannelActive(i, m_channelUIState[i].m_outputEnabled);
+				m_session->WakeInstrument(m_psu);
+			}
 			if(shdn)
 			{
 				//TODO: preference for configuring this?
@@ -230,7 +236,10 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 				if(ocp)
 				{
 					if(ImGui::Checkbox("Overcurrent Shutdown", &m_channelUIState[i].m_overcurrentShutdownEnabled))
+					{
 						m_psu->SetPowerOvercurrentShutdownEnabled(i, m_channelUIState[i].m_overcurrentShutdownEnabled);
+						m_session->WakeInstrument(m_psu);
+					}
 					HelpMarker(
 						"When enabled, the channel will shut down on overcurrent rather than switching to constant current mode.\n"
 						"\n"
@@ -241,7 +250,10 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 				if(ss)
 				{
 					if(ImGui::Checkbox("Soft Start", &m_channelUIState[i].m_softStartEnabled))
+					{
 						m_psu->SetSoftStartEnabled(i, m_channelUIState[i].m_softStartEnabled);
+						m_session->WakeInstrument(m_psu);
+					}
 
 					HelpMarker(
 						"Deliberately limit the rise time of the output in order to reduce inrush current when driving "
@@ -252,6 +264,7 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 						"Ramp time", m_channelUIState[i].m_setSSRamp, m_channelUIState[i].m_committedSSRamp, fs))
 					{
 						m_psu->SetSoftStartRampTime(i, m_channelUIState[i].m_committedSSRamp);
+						m_session->WakeInstrument(m_psu);
 					}
 					HelpMarker(
 						"Transition time between off and on state when using soft start\n\n"
@@ -276,6 +289,7 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 					"Voltage", m_channelUIState[i].m_setVoltage, m_channelUIState[i].m_committedSetVoltage, volts))
 				{
 					m_psu->SetPowerVoltage(i, m_channelUIState[i].m_committedSetVoltage);
+					m_session->WakeInstrument(m_psu);
 				}
 				HelpMarker("Target voltage to be supplied to the load.\n\nChanges are not pushed to hardware until you click Apply.");
 
@@ -284,6 +298,7 @@ void PowerSupplyDialog::ChannelSettings(int i, float v, float a, float etime)
 					"Current", m_channelUIState[i].m_setCurrent, m_channelUIState[i].m_committedSetCurrent, amps))
 				{
 					m_psu->SetPowerCurrent(i, m_channelUIState[i].m_committedSetCurrent);
+					m_session->WakeInstrument(m_psu);
 				}
 				HelpMarker("Maximum current to be supplied to the load.\n\nChanges are not pushed to hardware until you click Apply.");
 
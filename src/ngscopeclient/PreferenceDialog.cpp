@@ -176,6 +176,7 @@ void PreferenceDialog::ProcessCategory(PreferenceCategory& cat)
 void PreferenceDialog::ProcessPreference(Preference& pref)
 {
 	string label = pref.GetLabel() + "###" + pref.GetIdentifier();
+	string oldValue = pref.ToString();
 
 	switch(pref.GetType())
 	{
@@ -318,5 +319,9 @@ void PreferenceDialog::ProcessPreference(Preference& pref)
 			break;
 	}
 
+	//Let the session know it may need to apply the new value
+	if(pref.ToString() != oldValue)
+		m_prefs.MarkChanged();
+
 	HelpMarker(pref.GetDescription());
 }
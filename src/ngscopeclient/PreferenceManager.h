@@ -46,6 +46,7 @@ class PreferenceManager
 public:
     PreferenceManager()
         : m_treeRoot{ "" }
+        , m_changeCount(0)
     {
         DeterminePath();
         InitializeDefaults();
@@ -72,6 +73,14 @@ public:
     std::string GetConfigDirectory()
     { return m_configDir; }
 
+	///@brief Notes that a preference was changed, so anything caching preference values knows to update
+	void MarkChanged()
+	{ m_changeCount ++; }
+
+	///@brief Returns a counter which is incremented every time a preference is changed
+	uint64_t GetChangeCount() const
+	{ return m_changeCount; }
+
     // Value retrieval methods
     int64_t GetInt(const std::string& path) const;
     int64_t GetEnumRaw(const std::string& path) const;
@@ -99,6 +108,9 @@ private:
     PreferenceCategory m_treeRoot;
     std::string m_filePath;
     std::string m_configDir;
+
+	///@brief Number of times preferences have been changed since startup
+	uint64_t m_changeCount;
 };
 
 #endif // PreferenceManager_h
@@ -30,9 +30,110 @@
 #include "PreferenceManager.h"
 #include "PreferenceTypes.h"
 #include "ngscopeclient.h"
+#include "WaveformQueuePolicy.h"
+
+/**
+	@brief Adds the poll rate limits for one type of instrument
+
+	@param polling			The "Acquisition.Polling" category
+	@param name				Name of the new category
+	@param noun				How to refer to one instrument of this type in descriptions ("a multimeter")
+	@param minInterval		Default minimum poll interval, in fs
+	@param maxInterval		Default maximum poll interval, in fs
+	@param maxUtilization	Default maximum transport utilization, as a fraction
+ */
+static void AddPollingCategory(
+	PreferenceCategory& polling,
+	const std::string& name,
+	const std::string& noun,
+	double minInterval,
+	double maxInterval,
+	double maxUtilization)
+{
+	auto& cat = polling.AddCategory(name);
+		cat.AddPreference(
+			Preference::Real("min_interval", minInterval)
+			.Label("Minimum poll interval")
+			.Unit(Unit::UNIT_FS)
+			.Description(
+				"Shortest time to wait between polls of " + noun + ".\n\n"
+				"The poll interval shrinks towards this value while new data is arriving."));
+		cat.AddPreference(
+			Preference::Real("max_interval", maxInterval)
+			.Label("Maximum poll interval")
+			.Unit(Unit::UNIT_FS)
+			.Description(
+				"Longest time to wait between polls of " + noun + ".\n\n"
+				"The poll interval grows towards this value while nothing is changing."));
+		cat.AddPreference(
+			Preference::Real("max_utilization", maxUtilization)
+			.Label("Maximum transport utilization")
+			.Unit(Unit::UNIT_PERCENT)
+			.Description(
+				"Maximum fraction of the time the connection to " + noun + " may be busy with polling.\n\n"
+				"Slow instruments are polled less often to stay under this limit, leaving time for other commands."));
+}
 
 void PreferenceManager::InitializeDefaults()
 {
+	auto& acquisition = this->m_treeRoot.AddCategory("Acquisition");
+		acquisition.AddPreference(
+			Preference::Int("pipeline_depth", 2)
+			.Label("Pipeline depth")
+			.Description(
+				"Maximum number of acquisitions which may be processed ahead of the user interface.\n\n"
+				"With a depth of 1, each acquisition is fully displayed before the filter graph starts on the next one. "
+				"Higher values let the filter graph and rendering overlap with the user interface, increasing the "
+				"maximum waveform rate at the cost of some memory and display latency.")
+			.Unit(Unit::UNIT_COUNTS));
+		auto& polling = acquisition.AddCategory("Polling");
+			polling.AddPreference(
+				Preference::Real("change_threshold", 0.001)
+				.Label("Reading change threshold")
+				.Unit(Unit::UNIT_PERCENT)
+				.Description(
+					"How much a reading from a multimeter, power supply, or load has to change to count as new data.\n\n"
+					"Polling speeds up while readings are changing, so setting this too low makes noisy readings "
+					"keep the poll rate at its maximum."));
+			AddPollingCategory(polling, "Oscilloscopes", "an oscilloscope", 0, FS_PER_SECOND / 100, 1.0);
+			AddPollingCategory(polling, "Loads", "an electronic load", FS_PER_SECOND / 100, FS_PER_SECOND / 5, 0.5);
+			AddPollingCategory(polling, "Multimeters", "a multimeter", FS_PER_SECOND / 100, FS_PER_SECOND / 5, 0.5);
+			AddPollingCategory(
+				polling, "Other instruments", "other instruments", FS_PER_SECOND / 100, FS_PER_SECOND / 10, 0.5);
+			AddPollingCategory(
+				polling, "Power supplies", "a power supply", FS_PER_SECOND / 100, FS_PER_SECOND / 5, 0.5);
+		auto& queuing = acquisition.AddCategory("Queue");
+			queuing.AddPreference(
+				Preference::Int("max_count", 16)
+				.Label("Maximum queue depth")
+				.Description(
+					"Maximum number of waveforms from each oscilloscope which may be waiting to be processed.")
+				.Unit(Unit::UNIT_COUNTS));
+			queuing.AddPreference(
+				Preference::Int("max_size", 1024LL * 1024 * 1024)
+				.Label("Maximum queue size")
+				.Description(
+					"Maximum amount of waveform data from each oscilloscope which may be waiting to be processed.\n\n"
+					"This is estimated from the size of the most recent waveform, so deep captures are queued less "
+					"deeply than shallow ones.")
+				.Unit(Unit::UNIT_BYTES));
+			queuing.AddPreference(
+				Preference::Enum("overflow_policy", WaveformQueuePolicy::POLICY_BLOCK)
+				.Label("Overflow policy")
+				.Description(
+					"What to do when an oscilloscope acquires waveforms faster than they can be processed.\n\n"
+					"Block: stop downloading waveforms until the queue drains. Every waveform downloaded is "
+					"processed, but triggers are missed while the queue is full.\n\n"
+					"Drop oldest: keep downloading, and discard the oldest queued waveforms so the display stays "
+					"current.\n\n"
+					"Drop newest: keep the instrument triggering, but discard new waveforms without downloading them "
+					"until there's room in the queue.\n\n"
+					"Oscilloscopes in a trigger group with other oscilloscopes always block.")
+				.EnumValue("Block", WaveformQueuePolicy::POLICY_BLOCK)
+				.EnumValue("Drop oldest", WaveformQueuePolicy::POLICY_DROP_OLDEST)
+				.EnumValue("Drop newest", WaveformQueuePolicy::POLICY_DROP_NEWEST)
+				);
+
 	auto& appearance = this->m_treeRoot.AddCategory("Appearance");
 
 		auto& consts = appearance.AddCategory("Constellations");
@@ -159,6 +260,11 @@ void PreferenceManager::InitializeDefaults()
 				Preference::Color("icon_caption_color", ColorFromString("#ffffff"))
 				.Label("Icon color")
 				.Description("Color for icon captions"));
+			graph.AddPreference(
+				Preference::Color("critical_path_color", ColorFromString("#ff8000"))
+				.Label("Critical path color")
+				.Description(
+					"Color for highlighting the slowest chain of dependent filters, when filter profiling is enabled"));
 
 		auto& general = appearance.AddCategory("General");
 			general.AddPreference(
@@ -287,6 +393,16 @@ void PreferenceManager::InitializeDefaults()
 					.Label("Data font")
 					.Description("Font used for packet data hex dumps"));
 
+		auto& rendering = appearance.AddCategory("Rendering");
+			rendering.AddPreference(
+				Preference::Bool("cpu_rasterizer", false)
+				.Label("Software rasterizer")
+				.Description(
+					"Rasterize analog and digital waveforms on the CPU instead of with compute shaders.\n\n"
+					"This is usually slower, but may help on systems with a software Vulkan implementation "
+					"or a very weak GPU."
+					));
+
 		auto& timeline = appearance.AddCategory("Timeline");
 			timeline.AddPreference(
 				Preference::Color("axis_color", ColorFromString("#ffffff"))
@@ -358,11 +474,35 @@ void PreferenceManager::InitializeDefaults()
 				));
 
 	auto& files = this->m_treeRoot.AddCategory("Files");
+		files.AddPreference(
+			Preference::Bool("lazy_load", true)
+			.Label("Lazy load waveform history")
+			.Description(
+				"When opening a session, only load the most recent waveform into memory.\n\n"
+				"Older waveforms are read from disk when selected in the history view. This makes large sessions open "
+				"much faster, but the session's data directory must remain available while it is open.\n\n"
+				"Sessions containing filters which accumulate data across waveforms (eye patterns, protocol decodes, "
+				"histograms, etc.) are always loaded in full."
+				));
 		files.AddPreference(
 			Preference::Int("max_recent_files", 10)
 			.Label("Max recent files")
 			.Description("Maximum number of recent .scopesession file paths to save in history")
 			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Int("record_queue_depth", 8)
+			.Label("Recording queue depth")
+			.Description(
+				"Maximum number of acquisitions waiting to be written to disk while recording.\n\n"
+				"If the disk can't keep up and the queue fills, acquisition is paused until it catches up.")
+			.Unit(Unit::UNIT_COUNTS));
+		files.AddPreference(
+			Preference::Int("record_queue_size", 1024LL * 1024 * 1024)
+			.Label("Recording queue size")
+			.Description(
+				"Maximum amount of waveform data waiting to be written to disk while recording.\n\n"
+				"If the disk can't keep up and the queue fills, acquisition is paused until it catches up.")
+			.Unit(Unit::UNIT_BYTES));
 
 	auto& misc = this->m_treeRoot.AddCategory("Miscellaneous");
 		auto& menus = misc.AddCategory("Menus");
@@ -0,0 +1,143 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ProfiledSharedMutex
+ */
+#include "ngscopeclient.h"
+#include "ProfiledSharedMutex.h"
+
+using namespace std;
+
+///@brief Weight of the newest sample in the smoothed hold and wait times
+#define LOCK_SMOOTHING 0.05
+
+///@brief Length of the window over which peak hold times are measured, in seconds
+#define LOCK_PEAK_WINDOW 1.0
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ProfiledSharedMutex::ProfiledSharedMutex(const string& name)
+	: m_name(name)
+	, m_tLocked(0)
+	, m_exclusiveHold(0)
+	, m_exclusiveWait(0)
+	, m_sharedWait(0)
+	, m_peakHold(0)
+	, m_tPeakWindow(0)
+	, m_lastPeakHold(0)
+	, m_exclusiveCount(0)
+	, m_sharedCount(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Exclusive locking
+
+void ProfiledSharedMutex::lock()
+{
+	double tstart = GetTime();
+	m_mutex.lock();
+	m_tLocked = GetTime();
+
+	m_exclusiveWait = m_exclusiveWait * (1 - LOCK_SMOOTHING) + (m_tLocked - tstart) * LOCK_SMOOTHING;
+	m_exclusiveCount ++;
+}
+
+bool ProfiledSharedMutex::try_lock()
+{
+	if(!m_mutex.try_lock())
+		return false;
+
+	m_tLocked = GetTime();
+	m_exclusiveWait = m_exclusiveWait * (1 - LOCK_SMOOTHING);
+	m_exclusiveCount ++;
+	return true;
+}
+
+void ProfiledSharedMutex::unlock()
+{
+	//Update statistics before releasing the lock, since the next owner will overwrite m_tLocked
+	double now = GetTime();
+	double held = now - m_tLocked;
+	m_exclusiveHold = m_exclusiveHold * (1 - LOCK_SMOOTHING) + held * LOCK_SMOOTHING;
+
+	if( (now - m_tPeakWindow) > LOCK_PEAK_WINDOW)
+	{
+		m_lastPeakHold = m_peakHold.load();
+		m_peakHold = held;
+		m_tPeakWindow = now;
+	}
+	else if(held > m_peakHold)
+		m_peakHold = held;
+
+	m_mutex.unlock();
+}
+
+/**
+	@brief Returns the longest time an exclusive lock was held during the last second or so, in seconds
+ */
+double ProfiledSharedMutex::GetPeakExclusiveHoldTime()
+{
+	//If nobody has taken the lock in a while, the window is stale
+	if( (GetTime() - m_tPeakWindow) > 2*LOCK_PEAK_WINDOW)
+		return 0;
+
+	return max(m_peakHold.load(), m_lastPeakHold.load());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shared locking
+
+void ProfiledSharedMutex::lock_shared()
+{
+	double tstart = GetTime();
+	m_mutex.lock_shared();
+
+	//Other readers may be updating this at the same time, but losing the odd sample doesn't matter
+	m_sharedWait = m_sharedWait * (1 - LOCK_SMOOTHING) + (GetTime() - tstart) * LOCK_SMOOTHING;
+	m_sharedCount ++;
+}
+
+bool ProfiledSharedMutex::try_lock_shared()
+{
+	if(!m_mutex.try_lock_shared())
+		return false;
+
+	m_sharedCount ++;
+	return true;
+}
+
+void ProfiledSharedMutex::unlock_shared()
+{
+	m_mutex.unlock_shared();
+}
@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ProfiledSharedMutex
+ */
+#ifndef ProfiledSharedMutex_h
+#define ProfiledSharedMutex_h
+
+/**
+	@brief A std::shared_mutex which keeps track of how long it's held and how long threads wait for it
+
+	Meets the SharedMutex requirements, so it can be used with lock_guard, unique_lock and shared_lock as a drop-in
+	replacement for std::shared_mutex.
+
+	Hold times are only measured for exclusive locks, since shared locks may have many holders at once.
+ */
+class ProfiledSharedMutex
+{
+public:
+	ProfiledSharedMutex(const std::string& name);
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	void lock_shared();
+	bool try_lock_shared();
+	void unlock_shared();
+
+	///@brief Returns the human readable name of the lock
+	const std::string& GetName()
+	{ return m_name; }
+
+	///@brief Returns the smoothed time an exclusive lock is held, in seconds
+	double GetExclusiveHoldTime()
+	{ return m_exclusiveHold; }
+
+	///@brief Returns the smoothed time spent waiting for an exclusive lock, in seconds
+	double GetExclusiveWaitTime()
+	{ return m_exclusiveWait; }
+
+	///@brief Returns the smoothed time spent waiting for a shared lock, in seconds
+	double GetSharedWaitTime()
+	{ return m_sharedWait; }
+
+	double GetPeakExclusiveHoldTime();
+
+	///@brief Returns the total number of times the lock has been acquired exclusively
+	int64_t GetExclusiveCount()
+	{ return m_exclusiveCount; }
+
+	///@brief Returns the total number of times the lock has been acquired shared
+	int64_t GetSharedCount()
+	{ return m_sharedCount; }
+
+protected:
+	///@brief The actual lock
+	std::shared_mutex m_mutex;
+
+	///@brief Human readable name of the lock
+	std::string m_name;
+
+	///@brief Time the current exclusive lock was acquired (only touched by the exclusive owner)
+	double m_tLocked;
+
+	///@brief Smoothed exclusive hold time, in seconds
+	std::atomic<double> m_exclusiveHold;
+
+	///@brief Smoothed exclusive wait time, in seconds
+	std::atomic<double> m_exclusiveWait;
+
+	///@brief Smoothed shared wait time, in seconds
+	std::atomic<double> m_sharedWait;
+
+	///@brief Longest exclusive hold time in the current peak window, in seconds
+	std::atomic<double> m_peakHold;
+
+	///@brief Start of the current peak window
+	std::atomic<double> m_tPeakWindow;
+
+	///@brief Longest exclusive hold time in the previous peak window, in seconds
+	std::atomic<double> m_lastPeakHold;
+
+	///@brief Number of exclusive acquisitions
+	std::atomic<int64_t> m_exclusiveCount;
+
+	///@brief Number of shared acquisitions
+	std::atomic<int64_t> m_sharedCount;
+};
+
+#endif
@@ -282,7 +282,8 @@ bool ScopeDeskewWizard::DoRender()
 				//Record the current waveform timestamp on each channel (if any)
 				//so we can check if new data has shown up
 				{
-					shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+					shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+					TriggerGroupDataLock lock3(m_session);
 					auto data = m_primaryStream.GetData();
 					if(data)
 					{
@@ -462,7 +463,8 @@ void ScopeDeskewWizard::DoMainProcessingFlow()
 	{
 		case STATE_ACQUIRE:
 			{
-				shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+				shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+				TriggerGroupDataLock lock3(m_session);
 
 				//Make sure we have a waveform
 				auto data = m_primaryStream.GetData();
@@ -596,7 +598,8 @@ void ScopeDeskewWizard::StartCorrelation()
 
 void ScopeDeskewWizard::DoProcessWaveformSparse(SparseAnalogWaveform* ppri, SparseAnalogWaveform* psec)
 {
-	shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+	TriggerGroupDataLock lock3(m_session);
 
 	//Calculate cross-correlation between the primary and secondary waveforms at up to +/- half the waveform length
 	int64_t len = ppri->size();
@@ -768,7 +771,8 @@ void ScopeSyncWizard::DoProcessWaveformDensePackedEqualRateGeneric()
 */
 void ScopeDeskewWizard::DoProcessWaveformUniformUnequalRate(UniformAnalogWaveform* ppri, UniformAnalogWaveform* psec)
 {
-	shared_lock<shared_mutex> lock(m_session.GetWaveformDataMutex());
+	shared_lock<ProfiledSharedMutex> lock(m_session.GetWaveformDataMutex());
+	TriggerGroupDataLock lock3(m_session);
 
 	double start = GetTime();
 
@@ -35,6 +35,10 @@
 #include "ngscopeclient.h"
 #include "ngscopeclient-version.h"
 #include "Session.h"
+#include "SparseWaveformFormat.h"
+#include "SessionSaveTask.h"
+#include "WaveformRecorder.h"
+#include "pthread_compat.h"
 #include "../scopeprotocols/ExportFilter.h"
 #include "MainWindow.h"
 #include "BERTDialog.h"
@@ -46,9 +50,18 @@
 
 #include "../scopehal/LeCroyOscilloscope.h"
 #include "../scopehal/MockOscilloscope.h"
+#include "../scopeprotocols/AverageFilter.h"
+#include "../scopeprotocols/ConstellationFilter.h"
+#include "../scopeprotocols/EnvelopeFilter.h"
 #include "../scopeprotocols/EyePattern.h"
+#include "../scopeprotocols/HistogramFilter.h"
+#include "../scopeprotocols/MaximumFilter.h"
+#include "../scopeprotocols/MinimumFilter.h"
+#include "../scopeprotocols/TrendFilter.h"
+#include "../scopeprotocols/Waterfall.h"
 
 #include <fstream>
+#include <filesystem>
 #include <cinttypes>
 
 #ifdef _WIN32
@@ -65,6 +78,7 @@ extern Event g_rerenderDoneEvent;
 extern Event g_refilterRequestedEvent;
 extern Event g_partialRefilterRequestedEvent;
 extern Event g_refilterDoneEvent;
+extern Event g_waveformThreadWakeEvent;
 
 extern std::shared_mutex g_vulkanActivityMutex;
 
@@ -75,6 +89,8 @@ using namespace std;
 
 Session::Session(MainWindow* wnd)
 	: m_fileLoadVersion(0)
+	, m_waveformDataMutex("Waveform data")
+	, m_filterDataMutex("Filter data")
 	, m_mainWindow(wnd)
 	, m_shuttingDown(false)
 	, m_modifiedSinceLastSave(false)
@@ -84,7 +100,28 @@ Session::Session(MainWindow* wnd)
 	, m_triggerOneShot(false)
 	, m_graphExecutor(/*8*/1)
 	, m_lastFilterGraphExecTime(0)
+	, m_filterGraphVersion(0)
+	, m_graphNodesValid(false)
+	, m_graphNodesVersion(0)
+	, m_graphNodesFilterCount(0)
+	, m_graphNodesGeneration(0)
+	, m_filterGraphIndexGeneration(0)
+	, m_filterConeHits(0)
+	, m_filterConeMisses(0)
+	, m_lastFilterConeSize(0)
+	, m_lastFilterGraphSize(0)
+	, m_lastDirtyConeTime(0)
+	, m_rasterizeCacheHits(0)
+	, m_rasterizeCacheMisses(0)
+	, m_waveformLoadDone(0)
+	, m_waveformLoadTotal(0)
+	, m_tLastAcquired(0)
+	, m_displayLatency(0)
 	, m_history(*this)
+	, m_waveformThreadHeld(false)
+	, m_pipelineDepth(2)
+	, m_acquisitionPreferencesDirty(true)
+	, m_acquisitionPreferencesVersion(0)
 	, m_multiScope(false)
 	, m_nextMarkerNum(1)
 {
@@ -123,6 +160,7 @@ void Session::ClearBackgroundThreads()
 	g_waveformReadyEvent.Clear();
 	g_rerenderDoneEvent.Clear();
 	g_waveformProcessedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 
 	//Shut down instrument threads
 	for(auto it : m_instrumentStates)
@@ -155,11 +193,18 @@ void Session::Clear()
 	LogTrace("Clearing session\n");
 	LogIndenter li;
 
+	//Stop decoding waveforms for a half finished load, nothing is going to use them
+	DiscardPendingLoad();
+
 	//This includes its own mutex lock on waveform data
 	//and can't happen after we hold the lock
 	ClearBackgroundThreads();
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	//Finish writing anything the recorder has queued before we tear down the history it refers to
+	StopRecording();
+
+	lock_guard<ProfiledSharedMutex> lock(m_waveformDataMutex);
+	lock_guard<ProfiledSharedMutex> lock3(m_filterDataMutex);
 
 	//HACK: for now, export filters keep an open reference to themselves to avoid memory leaks
 	//Free this refererence now.
@@ -179,6 +224,12 @@ void Session::Clear()
 	//Clear history before destroying scopes.
 	//This ordering is important since waveforms removed from history get pushed into the WaveformPool of the scopes,
 	//so the scopes must not have been destroyed yet.
+	//Same goes for acquisitions which haven't made it to history yet.
+	m_currentAcquisition = PendingAcquisition();
+	{
+		lock_guard<mutex> lock3(m_pendingAcquisitionMutex);
+		m_pendingAcquisitions.clear();
+	}
 	m_history.clear();
 
 	//Delete scopes once we've terminated the threads
@@ -206,8 +257,7 @@ void Session::Clear()
 
 	//Remove all trigger groups
 	m_triggerGroups.clear();
-	m_recentlyTriggeredScopes.clear();
-	m_recentlyTriggeredGroups.clear();
+	m_acquisitionPreferencesDirty = true;
 
 	//We SHOULD not have any filters at this point.
 	//But there have been reports that some stick around. If this happens, print an error message.
@@ -221,6 +271,7 @@ void Session::Clear()
 	//Reset state
 	m_triggerOneShot = false;
 	m_multiScope = false;
+	OnFilterGraphChanged();
 }
 
 vector<TimePoint> Session::GetMarkerTimes()
@@ -298,6 +349,16 @@ bool Session::PreLoadFromYaml(const YAML::Node& node, const std::string& /*dataD
 		m_fileLoadVersion = 0;
 	}
 
+	//Refuse files from a newer ngscopeclient, rather than failing partway through loading the waveform data
+	if(m_fileLoadVersion > 3)
+	{
+		ShowErrorPopup(
+			"File load error",
+			"The session file is format version " + to_string(m_fileLoadVersion) +
+			", which is newer than this version of ngscopeclient supports.");
+		return false;
+	}
+
 	//Preload our instruments
 	if(!PreLoadInstruments(m_fileLoadVersion, node["instruments"], online))
 		return false;
@@ -308,6 +369,8 @@ bool Session::PreLoadFromYaml(const YAML::Node& node, const std::string& /*dataD
 /**
 	@brief Deserialize a YAML::Node (and associated data directory) to the current session
 
+	This blocks until the whole session, including all waveform data, is loaded.
+
 	@param node		Root YAML node of the file
 	@param dataDir	Path to the _data directory associated with the session
 	@param online	True if we should reconnect to instruments
@@ -315,6 +378,26 @@ bool Session::PreLoadFromYaml(const YAML::Node& node, const std::string& /*dataD
 	@return			True if successful, false on error
  */
 bool Session::LoadFromYaml(const YAML::Node& node, const string& dataDir, bool online)
+{
+	if(!StartLoadFromYaml(node, dataDir, online))
+		return false;
+	return FinishLoadFromYaml();
+}
+
+/**
+	@brief Starts deserializing a YAML::Node (and associated data directory) to the current session
+
+	Instruments, filters, and UI configuration are loaded immediately. Waveform data is decoded in a background thread;
+	progress can be monitored with GetWaveformLoadDone() and GetWaveformLoadTotal(). Once IsWaveformLoadDone() returns
+	true, call FinishLoadFromYaml() from the GUI thread to add the waveforms to the session.
+
+	@param node		Root YAML node of the file
+	@param dataDir	Path to the _data directory associated with the session
+	@param online	True if we should reconnect to instruments
+
+	@return			True if successful, false on error
+ */
+bool Session::StartLoadFromYaml(const YAML::Node& node, const string& dataDir, bool online)
 {
 	LogTrace("Loading saved session from YAML node\n");
 	LogIndenter li;
@@ -325,14 +408,51 @@ bool Session::LoadFromYaml(const YAML::Node& node, const string& dataDir, bool o
 		return false;
 	if(!LoadInstrumentInputs(m_fileLoadVersion, node["instruments"]))
 		return false;
-	if(!m_mainWindow->LoadUIConfiguration(m_fileLoadVersion, node["ui_config"]))
+	if(m_mainWindow && !m_mainWindow->LoadUIConfiguration(m_fileLoadVersion, node["ui_config"]))
 		return false;
 	if(!LoadTriggerGroups(node["triggergroups"]))
 		return false;
-	if(!LoadWaveformData(m_fileLoadVersion, dataDir))
+	if(!StartWaveformDataLoad(m_fileLoadVersion, dataDir))
+		return false;
+
+	m_pendingLoad->m_node = node;
+	return true;
+}
+
+/**
+	@brief Finishes a load started by StartLoadFromYaml()
+
+	Blocks until the waveform data is decoded (if it isn't already), then adds it to the session.
+
+	@return			True if successful, false on error
+ */
+bool Session::FinishLoadFromYaml()
+{
+	if(!m_pendingLoad)
 		return false;
 
+	auto load = std::move(m_pendingLoad);
+	if(load->m_thread)
+		load->m_thread->join();
+
+	//Attach filter waveforms *before* scope data
+	//(we don't want any filters to be updated from nonexistent inputs and change state prior to getting output loaded)
+	for(auto& job : load->m_filterJobs)
+		job.m_chan->SetData(job.m_cap, job.m_stream);
+
+	for(auto& scope : load->m_scopes)
+		CommitWaveformDataForScope(scope, load->m_refreshPerPoint);
+
+	//Evaluate the filter graph once, on the most recent waveform
+	if(!load->m_refreshPerPoint && !m_history.empty())
+		RefreshAllFilters();
+
+	LogTrace("Waveform data loaded in %.2f ms\n", (GetTime() - load->m_tstart) * 1000);
+
+	m_history.SetMaxToCurrentDepth();
+
 	//Markers
+	auto& node = load->m_node;
 	auto markers = node["ui_config"]["markers"];
 	if(markers)
 	{
@@ -348,23 +468,37 @@ bool Session::LoadFromYaml(const YAML::Node& node, const string& dataDir, bool o
 	OnMarkerChanged();
 
 	//If we have no waveform data (filter-only session) create a WaveformThread to do rendering,
-	//then refresh the filter graph
+	//then refresh the filter graph. Headless sessions have no waveform thread so refresh synchronously.
 	if(m_history.empty())
 	{
-		StartWaveformThreadIfNeeded();
-		RefreshAllFiltersNonblocking();
+		if(m_mainWindow)
+		{
+			StartWaveformThreadIfNeeded();
+			RefreshAllFiltersNonblocking();
+		}
+		else
+			RefreshAllFilters();
 	}
 
 	return true;
 }
 
-//TODO: this should run in a background thread or something to keep the UI responsive
-bool Session::LoadWaveformData(int version, const string& dataDir)
+/**
+	@brief Parses the waveform metadata for a session, then starts decoding the sample data in a background thread
+
+	@param version	File format version
+	@param dataDir	Path to the _data directory associated with the session
+
+	@return True on success, false on error
+ */
+bool Session::StartWaveformDataLoad(int version, const string& dataDir)
 {
 	LogTrace("Loading waveform data\n");
 
-	//Load filter waveforms *before* scope data
-	//(we don't want any filters to be updated from nonexistent inputs and change state prior to getting output loaded)
+	auto load = make_unique<PendingWaveformLoad>();
+	load->m_tstart = GetTime();
+
+	//Filter waveforms
 	string fname = dataDir + "/filter_metadata.yml";
 	FILE* fp = fopen(fname.c_str(), "r");
 	if(fp)
@@ -373,13 +507,16 @@ bool Session::LoadWaveformData(int version, const string& dataDir)
 
 		auto docs = YAML::LoadAllFromFile(fname);
 		if(docs.size())
-		{
-			if(!LoadWaveformDataForFilters(version, docs[0], dataDir))
-				return false;
-		}
+			ParseWaveformDataForFilters(version, docs[0], dataDir, load->m_filterJobs);
 	}
 
-	//Load data for each scope
+	//Only run the filter graph on every history point if some filter actually needs it
+	load->m_refreshPerPoint = HasHistoryDependentFilters();
+
+	//Lazy loading doesn't work if every point has to go through the filter graph anyway
+	bool lazy = m_preferences.GetBool("Files.lazy_load") && !load->m_refreshPerPoint;
+
+	//Data for each scope
 	for(size_t i=0; i<m_oscilloscopes.size(); i++)
 	{
 		auto scope = m_oscilloscopes[i];
@@ -391,33 +528,79 @@ bool Session::LoadWaveformData(int version, const string& dataDir)
 
 		//Nothing there? No waveforms at all, skip loading
 		if(docs.empty())
-			return true;
+			break;
 
-		if(!LoadWaveformDataForScope(version, docs[0], scope, dataDir))
-		{
-			LogTrace("Waveform data loading failed\n");
-			return false;
-		}
+		PendingScopeLoad sload;
+		sload.m_scope = scope;
+		ParseWaveformDataForScope(version, docs[0], dataDir, lazy, sload);
+		load->m_scopes.push_back(std::move(sload));
 	}
 
-	m_history.SetMaxToCurrentDepth();
+	//Decode everything in the background
+	m_waveformLoadDone = 0;
+	m_waveformLoadTotal = load->m_filterJobs.size();
+	for(auto& sload : load->m_scopes)
+		m_waveformLoadTotal += sload.m_jobs.size();
 
+	m_pendingLoad = std::move(load);
+	m_pendingLoad->m_thread = make_unique<thread>(&Session::WaveformLoadThread, this, m_pendingLoad.get());
 	return true;
 }
 
 /**
-	@brief Loads waveform data for filters that need to be preserved
+	@brief Thread function: decodes all of the waveforms for a session load
+ */
+void Session::WaveformLoadThread(PendingWaveformLoad* load)
+{
+	pthread_setname_np_compat("SessionLoad");
+
+	LoadWaveformsInParallel(load->m_filterJobs);
+	for(auto& sload : load->m_scopes)
+		LoadWaveformsInParallel(sload.m_jobs);
+
+	load->m_done = true;
+}
+
+/**
+	@brief Abandons a session load which hasn't been finished, freeing any waveforms which were decoded
+ */
+void Session::DiscardPendingLoad()
+{
+	if(!m_pendingLoad)
+		return;
+
+	auto load = std::move(m_pendingLoad);
+	if(load->m_thread)
+		load->m_thread->join();
+
+	for(auto& job : load->m_filterJobs)
+		delete job.m_cap;
+	for(auto& sload : load->m_scopes)
+	{
+		for(auto& job : sload.m_jobs)
+			delete job.m_cap;
+	}
+}
+
+/**
+	@brief Parses metadata for filter waveforms that need to be preserved, and creates jobs to load them
+
+	@param version	File format version
+	@param node		Root node of the filter metadata file
+	@param dataDir	Path to the _data directory associated with the session
+	@param jobs		Jobs for each waveform are appended to this
  */
-bool Session::LoadWaveformDataForFilters(
+void Session::ParseWaveformDataForFilters(
 		int /*version*/,		//ignored for now, always 2 since older formats don't support filter waveforms
 		const YAML::Node& node,
-		const string& dataDir)
+		const string& dataDir,
+		vector<WaveformLoadJob>& jobs)
 {
 	if(!node)
-		return true;
+		return;
 	auto waveforms = node["waveforms"];
 	if(!waveforms)
-		return true;
+		return;
 
 	string filtdir = dataDir + "/filter_waveforms";
 
@@ -475,26 +658,29 @@ bool Session::LoadWaveformDataForFilters(
 			cap->m_startFemtoseconds = time_fsec;
 			cap->m_triggerPhase = stag["trigphase"].as<long long>();
 			cap->m_flags = stag["flags"].as<int>();
-			f->SetData(cap, i);
 
-			//Actually load the waveform
-			string fname = datdir + "/stream" + to_string(i) + ".bin";
-			DoLoadWaveformDataForStream(f, i, fmt, fname);
+			jobs.push_back(WaveformLoadJob(f, i, cap, fmt, datdir + "/stream" + to_string(i) + ".bin"));
 		}
 	}
-
-	return true;
 }
 
 /**
-	@brief Loads waveform data for a single scope
+	@brief Parses waveform metadata for a single scope, and creates jobs to load the sample data
+
+	@param version			File format version
+	@param node				Root node of the scope metadata file
+	@param dataDir			Path to the _data directory associated with the session
+	@param lazy				True to only load the most recent point into memory, and leave the rest on disk
+	@param load				Scope to load waveforms for. The history points and jobs are filled in.
  */
-bool Session::LoadWaveformDataForScope(
+void Session::ParseWaveformDataForScope(
 	int version,
 	const YAML::Node& node,
-	shared_ptr<Oscilloscope> scope,
-	const std::string& dataDir)
+	const std::string& dataDir,
+	bool lazy,
+	PendingScopeLoad& load)
 {
+	auto scope = load.m_scope;
 	LogTrace("Loading waveform data for scope \"%s\"\n", scope->m_nickname.c_str());
 	LogIndenter li;
 
@@ -505,7 +691,7 @@ bool Session::LoadWaveformDataForScope(
 	if(!wavenode)
 	{
 		//No waveforms
-		return true;
+		return;
 	}
 	int scope_id = m_idtable[(Instrument*)scope.get()];
 
@@ -522,7 +708,11 @@ bool Session::LoadWaveformDataForScope(
 			chan->SetData(nullptr, j);
 	}
 
-	//Load the data for each waveform
+	//First pass: parse metadata for each history point.
+	//Nothing touches the channels here, so the decoding can run in parallel.
+	auto& points = load.m_points;
+	set<TimePoint> timestamps;
+	char tmp[512];
 	for(auto it : wavenode)
 	{
 		//Top level metadata
@@ -552,20 +742,25 @@ bool Session::LoadWaveformDataForScope(
 		if(wfm["label"])
 			label = wfm["label"].as<string>();
 
-		LogTrace("Loading waveform data at time %s\n", time.PrettyPrint().c_str());
+		LogTrace("Loading waveform metadata at time %s\n", time.PrettyPrint().c_str());
 
 		//If we already have historical data from this timestamp, warn and drop the duplicate data
 		auto hist = m_history.GetHistory(time);
-		if(hist && (hist->m_history.find(scope) != hist->m_history.end()))
+		if( (hist && (hist->m_history.find(scope) != hist->m_history.end())) ||
+			(timestamps.find(time) != timestamps.end()) )
 		{
 			LogWarning("Session contains duplicate data for time %" PRId64 ".%" PRId64 ", discarding\n", static_cast<int64_t>(time.first), time.second);
 			continue;
 		}
+		timestamps.emplace(time);
+
+		PendingHistoryPoint point;
+		point.m_time = time;
+		point.m_pinned = pinned;
+		point.m_label = label;
 
-		//Set up channel metadata first (serialized)
+		//Set up channel metadata
 		auto chans = wfm["channels"];
-		vector<pair<int, int>> channels;	//pair<channel, stream>
-		vector<string> formats;
 		for(auto jt : chans)
 		{
 			auto ch = jt.second;
@@ -574,86 +769,48 @@ bool Session::LoadWaveformDataForScope(
 			if(ch["stream"])
 				stream = ch["stream"].as<int>();
 			auto chan = scope->GetOscilloscopeChannel(channel_index);
-			channels.push_back(pair<int, int>(channel_index, stream));
+
+			SpilledWaveform sw;
 
 			//Waveform format defaults to sparsev1 as that's what was used before
 			//the metadata file contained a format ID at all
-			string format = "sparsev1";
+			sw.m_format = "sparsev1";
 			if(ch["format"])
-				format = ch["format"].as<string>();
-			formats.push_back(format);
-
-			bool dense = (format == "densev1");
-
-			//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
-			WaveformBase* cap = nullptr;
-			SparseAnalogWaveform* sacap = nullptr;
-			UniformAnalogWaveform* uacap = nullptr;
-			SparseDigitalWaveform* sdcap = nullptr;
-			UniformDigitalWaveform* udcap = nullptr;
-			CANWaveform* sccap = nullptr;
+				sw.m_format = ch["format"].as<string>();
 
 			//if datatype is specified, use that
-			if( (format == "sparsev1") && ch["datatype"] )
-			{
-				auto dtype = ch["datatype"].as<string>();
-				if(dtype == "analog")
-					cap = sacap = new SparseAnalogWaveform;
-				else if(dtype == "digital")
-					cap = sdcap = new SparseDigitalWaveform;
-				else if(dtype == "can")
-					cap = sccap = new CANWaveform;
-				else
-					LogError("Unrecognized sparsev1 datatype %s\n", dtype.c_str());
-			}
-
 			//if not guess based on stream type
+			//TODO: support non-analog/digital captures (eyes, spectrograms, etc)
+			if( (sw.m_format != "densev1") && ch["datatype"] )
+				sw.m_datatype = ch["datatype"].as<string>();
 			else if(chan->GetType(0) == Stream::STREAM_TYPE_ANALOG)
-			{
-				if(dense)
-					cap = uacap = new UniformAnalogWaveform;
-				else
-					cap = sacap = new SparseAnalogWaveform;
-			}
+				sw.m_datatype = "analog";
 			else
-			{
-				if(dense)
-					cap = udcap = new UniformDigitalWaveform;
-				else
-					cap = sdcap = new SparseDigitalWaveform;
-			}
+				sw.m_datatype = "digital";
 
 			//Channel waveform metadata
-			cap->m_timescale = ch["timescale"].as<long>();
-			cap->m_startTimestamp = time.first;
-			cap->m_startFemtoseconds = time.second;
+			sw.m_timescale = ch["timescale"].as<long>();
+			sw.m_startTimestamp = time.first;
+			sw.m_startFemtoseconds = time.second;
 			if(timebase_is_ps)
 			{
-				cap->m_timescale *= 1000;
-				cap->m_triggerPhase = ch["trigphase"].as<float>() * 1000;
+				sw.m_timescale *= 1000;
+				sw.m_triggerPhase = ch["trigphase"].as<float>() * 1000;
 			}
 			else
-				cap->m_triggerPhase = ch["trigphase"].as<long long>();
-
-			chan->Detach(stream);
-			chan->SetData(cap, stream);
-		}
-
-		//Actually load the data for each channel
-		size_t nchans = channels.size();
-		char tmp[512];
-		for(size_t i=0; i<nchans; i++)
-		{
-			auto nchan = channels[i].first;
-			auto nstream = channels[i].second;
+				sw.m_triggerPhase = ch["trigphase"].as<long long>();
+			sw.m_flags = 0;
+			if(ch["flags"])
+				sw.m_flags = ch["flags"].as<int>();
 
-			if(nstream == 0)
+			//Figure out where the sample data lives
+			if(stream == 0)
 			{
 				snprintf(tmp, sizeof(tmp), "%s/scope_%d_waveforms/waveform_%d/channel_%d.bin",
 					dataDir.c_str(),
 					scope_id,
 					waveform_id,
-					nchan);
+					channel_index);
 			}
 			else
 			{
@@ -661,36 +818,204 @@ bool Session::LoadWaveformDataForScope(
 					dataDir.c_str(),
 					scope_id,
 					waveform_id,
-					nchan,
-					nstream);
+					channel_index,
+					stream);
 			}
+			sw.m_path = tmp;
+
+			//In-memory size is about the same as the file size for all of our formats
+			error_code ec;
+			sw.m_memoryUsage = filesystem::file_size(sw.m_path, ec);
+			if(ec)
+				sw.m_memoryUsage = 0;
+
+			point.m_waveforms[StreamDescriptor(chan, stream)] = sw;
+		}
+
+		points.push_back(point);
+	}
+
+	//Second pass: create jobs to decode the sample data (this happens in parallel, in the background).
+	//In lazy mode we only load the most recent point (so there's something to display and run filters on),
+	//everything else stays on disk until it's selected in the history view.
+	auto& jobs = load.m_jobs;
+	for(size_t i=0; i<points.size(); i++)
+	{
+		auto& point = points[i];
+		if(lazy && (i+1 < points.size()) )
+		{
+			point.m_leaveOnDisk = true;
+			continue;
+		}
+
+		point.m_firstJob = jobs.size();
+		for(auto& jt : point.m_waveforms)
+		{
+			auto cap = jt.second.CreateWaveform();
+			if(!cap)
+				continue;
+			jobs.push_back(WaveformLoadJob(jt.first.m_channel, jt.first.m_stream, cap, jt.second.m_format, jt.second.m_path));
+		}
+		point.m_numJobs = jobs.size() - point.m_firstJob;
+	}
+}
+
+/**
+	@brief Attaches decoded waveforms for a single scope to its channels, and commits each point to history, in order
+
+	@param load				The scope's waveforms, after they've been decoded
+	@param refreshPerPoint	True to evaluate the filter graph after every history point is loaded
+ */
+void Session::CommitWaveformDataForScope(PendingScopeLoad& load, bool refreshPerPoint)
+{
+	auto scope = load.m_scope;
+	auto& jobs = load.m_jobs;
+
+	//The history manager snapshots whatever is attached to the channels at the time AddHistory() is called.
+	vector<shared_ptr<Oscilloscope>> temp;
+	temp.push_back(scope);
+	for(auto& point : load.m_points)
+	{
+		if(point.m_leaveOnDisk)
+		{
+			m_history.AddSpilledHistory(scope, point.m_time, point.m_waveforms, point.m_pinned, point.m_label);
+			continue;
+		}
 
-			DoLoadWaveformDataForStream(
-				scope->GetOscilloscopeChannel(nchan),
-				nstream,
-				formats[i],
-				tmp);
+		for(size_t j=0; j<point.m_numJobs; j++)
+		{
+			auto& job = jobs[point.m_firstJob + j];
+			job.m_chan->Detach(job.m_stream);
+			job.m_chan->SetData(job.m_cap, job.m_stream);
 		}
 
-		vector<shared_ptr<Oscilloscope>> temp;
-		temp.push_back(scope);
-		m_history.AddHistory(temp, false, pinned, label);
+		m_history.AddHistory(temp, false, point.m_pinned, point.m_label);
 
+		//Remember that this data is already on disk, so we don't have to write it again when saving
+		auto hist = m_history.GetHistory(point.m_time);
+		if(hist)
+			hist->m_saved[scope] = point.m_waveforms;
+
+		//Filters which accumulate state across acquisitions (eye patterns, protocol analyzers, etc)
+		//need to see every point. Otherwise we only evaluate the graph once, after the last point is loaded.
 		//TODO: this is not good for multiscope
 		//TODO: handle eye patterns (need to know window size for it to work right)
-		RefreshAllFilters();
+		if(refreshPerPoint)
+			RefreshAllFilters();
 	}
-	return true;
 }
 
-void Session::DoLoadWaveformDataForStream(
-	OscilloscopeChannel* chan,
-	int stream,
-	string format,
-	string fname
-	)
+/**
+	@brief Decodes a batch of waveforms from disk using a pool of worker threads
+
+	Each job's waveform must be a freshly created object not yet attached to any channel. On return, m_cap in each job
+	points to the loaded waveform (which may be a different object if the file format required conversion).
+
+	@param jobs		The waveforms to load
+ */
+void Session::LoadWaveformsInParallel(vector<WaveformLoadJob>& jobs)
+{
+	if(jobs.empty())
+		return;
+
+	double tstart = GetTime();
+
+	//Each worker grabs the next pending job until there's nothing left
+	atomic<size_t> nextJob(0);
+	auto worker = [&]()
+	{
+		while(true)
+		{
+			size_t i = nextJob ++;
+			if(i >= jobs.size())
+				break;
+
+			auto& job = jobs[i];
+			job.m_cap = LoadWaveformFromFile(job.m_cap, job.m_format, job.m_fname);
+			m_waveformLoadDone ++;
+		}
+	};
+
+	//Spawn one thread per core (minus one, since the calling thread does work too)
+	size_t nthreads = max(1u, thread::hardware_concurrency());
+	nthreads = min(nthreads, jobs.size());
+	vector<thread> threads;
+	for(size_t i=1; i<nthreads; i++)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+
+	LogTrace("Loaded %zu waveforms using %zu threads in %.2f ms\n",
+		jobs.size(), nthreads, (GetTime() - tstart) * 1000);
+}
+
+/**
+	@brief Checks if any filter in the session accumulates state across multiple acquisitions
+
+	If so, the filter graph has to be evaluated once for every history point during session load (rather than only for
+	the most recent one) to get the same results as when the data was originally captured.
+
+	Filters don't report whether they keep state between acquisitions, so this errs on the side of caution: anything
+	which isn't known to be stateless counts. The only cost of a false positive is a slower load.
+ */
+bool Session::HasHistoryDependentFilters()
+{
+	set<Filter*> filters;
+	{
+		lock_guard<mutex> lock(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
+
+	for(auto f : filters)
+	{
+		//Filters known to accumulate data across acquisitions
+		if( dynamic_cast<PacketDecoder*>(f) ||
+			dynamic_cast<AverageFilter*>(f) ||
+			dynamic_cast<ConstellationFilter*>(f) ||
+			dynamic_cast<EnvelopeFilter*>(f) ||
+			dynamic_cast<EyePattern*>(f) ||
+			dynamic_cast<HistogramFilter*>(f) ||
+			dynamic_cast<MaximumFilter*>(f) ||
+			dynamic_cast<MinimumFilter*>(f) ||
+			dynamic_cast<TrendFilter*>(f) ||
+			dynamic_cast<Waterfall*>(f) )
+		{
+			return true;
+		}
+
+		//Anything else is only safe if every output is a pure function of the current inputs.
+		//Measurements, math, and signal generation are; other categories may not be.
+		switch(f->GetCategory())
+		{
+			case Filter::CAT_MATH:
+			case Filter::CAT_MEASUREMENT:
+			case Filter::CAT_GENERATION:
+			case Filter::CAT_CLOCK:
+				break;
+
+			default:
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+	@brief Loads sample data from a file into an existing (empty) waveform object
+
+	Timestamps and other metadata must already have been set by the caller.
+
+	@param cap		The waveform to load into
+	@param format	File format ID ("sparsev1", "sparsev2", or "densev1")
+	@param fname	Path to the file
+
+	@return The loaded waveform. This is normally the same object as cap, however if a sparse waveform turns out to
+			actually be uniformly sampled it will be converted. In this case cap is deleted and the new object returned.
+ */
+WaveformBase* Session::LoadWaveformFromFile(WaveformBase* cap, const string& format, const string& fname)
 {
-	auto cap = chan->GetData(stream);
 	auto sacap = dynamic_cast<SparseAnalogWaveform*>(cap);
 	auto uacap = dynamic_cast<UniformAnalogWaveform*>(cap);
 	auto sdcap = dynamic_cast<SparseDigitalWaveform*>(cap);
@@ -708,7 +1033,7 @@ void Session::DoLoadWaveformDataForStream(
 		if(!fp)
 		{
 			LogError("couldn't open %s\n", fname.c_str());
-			return;
+			return cap;
 		}
 
 		//Read the whole file into a buffer a megabyte at a time
@@ -738,7 +1063,7 @@ void Session::DoLoadWaveformDataForStream(
 		if(fd < 0)
 		{
 			LogError("couldn't open %s\n", fname.c_str());
-			return;
+			return cap;
 		}
 		size_t len = lseek(fd, 0, SEEK_END);
 		buf = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
@@ -796,19 +1121,60 @@ void Session::DoLoadWaveformDataForStream(
 				ccap->m_durations[j] = stime[1];
 			}
 		}
+	}
 
-		//Quickly check if the waveform is dense packed, even if it was stored as sparse.
-		//Since we know samples must be monotonic and non-overlapping, we don't have to check every single one!
-		int64_t nlast = nsamples - 1;
-		if(sacap)
+	//Sparse columnar
+	else if(format == "sparsev2")
+	{
+		//Figure out what the file should contain
+		uint32_t type = SparseWaveformHeader::SAMPLE_ANALOG;
+		uint32_t samplesize = sizeof(float);
+		if(sdcap)
+		{
+			type = SparseWaveformHeader::SAMPLE_DIGITAL;
+			samplesize = sizeof(bool);
+		}
+		else if(ccap)
+		{
+			type = SparseWaveformHeader::SAMPLE_CAN;
+			samplesize = 2*sizeof(uint32_t);
+		}
+
+		//Make sure every array is actually inside the file before we touch anything
+		auto header = reinterpret_cast<const SparseWaveformHeader*>(buf);
+		auto fits = [&](uint64_t start, uint64_t size)
+			{ return (start <= (uint64_t)len) && (size <= (uint64_t)len - start); };
+		if( ((size_t)len < sizeof(SparseWaveformHeader)) || (memcmp(header->m_magic, "sparsev2", 8) != 0) )
+			LogError("%s is not a valid sparsev2 file\n", fname.c_str());
+		else if( (header->m_sampleType != type) || (header->m_sampleSize != samplesize) )
+			LogError("%s contains the wrong sample type for this waveform\n", fname.c_str());
+		else if( (header->m_count > (uint64_t)len) ||
+			!fits(header->m_offsetsStart, header->m_count * sizeof(int64_t)) ||
+			!fits(header->m_durationsStart, header->m_count * sizeof(int64_t)) ||
+			!fits(header->m_samplesStart, header->m_count * samplesize) )
+		{
+			LogError("%s is truncated or corrupted\n", fname.c_str());
+		}
+
+		//Everything checks out, copy the arrays straight out of the file
+		else
 		{
-			if( (sacap->m_offsets[0] == 0) &&
-				(sacap->m_offsets[nlast] == nlast) &&
-				(sacap->m_durations[nlast] == 1) )
+			size_t nsamples = header->m_count;
+			cap->Resize(nsamples);
+
+			auto sparse = dynamic_cast<SparseWaveformBase*>(cap);
+			memcpy(sparse->m_offsets.GetCpuPointer(), buf + header->m_offsetsStart, nsamples*sizeof(int64_t));
+			memcpy(sparse->m_durations.GetCpuPointer(), buf + header->m_durationsStart, nsamples*sizeof(int64_t));
+
+			if(sacap)
+				memcpy(sacap->m_samples.GetCpuPointer(), buf + header->m_samplesStart, nsamples*sizeof(float));
+			else if(sdcap)
+				memcpy(sdcap->m_samples.GetCpuPointer(), buf + header->m_samplesStart, nsamples*sizeof(bool));
+			else if(ccap)
 			{
-				//Waveform was actually uniform, so convert it
-				cap = new UniformAnalogWaveform(*sacap);
-				chan->SetData(cap, stream);
+				auto p = reinterpret_cast<const uint32_t*>(buf + header->m_samplesStart);
+				for(size_t j=0; j<nsamples; j++)
+					ccap->m_samples[j] = CANSymbol((CANSymbol::stype)p[j*2 + 1], p[j*2]);
 			}
 		}
 	}
@@ -838,6 +1204,21 @@ void Session::DoLoadWaveformDataForStream(
 			format.c_str());
 	}
 
+	//Quickly check if the waveform is dense packed, even if it was stored as sparse.
+	//Since we know samples must be monotonic and non-overlapping, we don't have to check every single one!
+	if(sacap && (sacap->size() > 0) )
+	{
+		int64_t nlast = sacap->size() - 1;
+		if( (sacap->m_offsets[0] == 0) &&
+			(sacap->m_offsets[nlast] == nlast) &&
+			(sacap->m_durations[nlast] == 1) )
+		{
+			//Waveform was actually uniform, so convert it
+			cap = new UniformAnalogWaveform(*sacap);
+			delete sacap;
+		}
+	}
+
 	cap->MarkModifiedFromCpu();
 
 	#ifdef _WIN32
@@ -846,6 +1227,8 @@ void Session::DoLoadWaveformDataForStream(
 		munmap(buf, len);
 		::close(fd);
 	#endif
+
+	return cap;
 }
 
 bool Session::PreLoadInstruments(int version, const YAML::Node& node, bool online)
@@ -857,7 +1240,7 @@ bool Session::PreLoadInstruments(int version, const YAML::Node& node, bool onlin
 
 	if(!node)
 	{
-		m_mainWindow->ShowErrorPopup(
+		ShowErrorPopup(
 			"File load error",
 			"The session file is invalid because there is no \"instruments\" section.");
 		return false;
@@ -926,7 +1309,7 @@ bool Session::PreLoadInstruments(int version, const YAML::Node& node, bool onlin
 		//Unknown instrument type - too new file format?
 		else
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"File load error",
 				string("Instrument ") + nick.c_str() + " is of unknown type " + inst["type"].as<string>());
 			return false;
@@ -966,7 +1349,7 @@ SCPITransport* Session::CreateTransportForNode(const YAML::Node& node)
 	//Check if the transport failed to initialize
 	if((transport == nullptr) || !transport->IsConnected())
 	{
-		m_mainWindow->ShowErrorPopup(
+		ShowErrorPopup(
 			"Unable to reconnect",
 			string("Failed to connect to instrument using connection string ") + node["args"].as<string>() +
 			"Loading in offline mode.");
@@ -981,7 +1364,7 @@ bool Session::VerifyInstrument(const YAML::Node& node, shared_ptr<Instrument> in
 	//TODO: preference to enforce serial match?
 	if(node["name"].as<string>() != inst->GetName())
 	{
-		m_mainWindow->ShowErrorPopup(
+		ShowErrorPopup(
 			"Unable to reconnect",
 			string("Unable to connect to oscilloscope: instrument has model name \"") +
 			inst->GetName() + "\", save file has model name \"" + node["name"].as<string>()  + "\"");
@@ -989,7 +1372,7 @@ bool Session::VerifyInstrument(const YAML::Node& node, shared_ptr<Instrument> in
 	}
 	else if(node["vendor"].as<string>() != inst->GetVendor())
 	{
-		m_mainWindow->ShowErrorPopup(
+		ShowErrorPopup(
 			"Unable to reconnect",
 			string("Unable to connect to oscilloscope: instrument has vendor \"") +
 			inst->GetVendor() + "\", save file has vendor \"" + node["vendor"].as<string>()  + "\"");
@@ -997,7 +1380,7 @@ bool Session::VerifyInstrument(const YAML::Node& node, shared_ptr<Instrument> in
 	}
 	else if(node["serial"].as<string>() != inst->GetSerial())
 	{
-		m_mainWindow->ShowErrorPopup(
+		ShowErrorPopup(
 			"Unable to reconnect",
 			string("Unable to connect to oscilloscope: instrument has serial \"") +
 			inst->GetSerial() + "\", save file has serial \"" + node["serial"].as<string>()  + "\"");
@@ -1019,7 +1402,7 @@ bool Session::PreLoadOscilloscope(int version, const YAML::Node& node, bool onli
 	{
 		if( (transtype == "null") && (driver != "demo") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1040,7 +1423,7 @@ bool Session::PreLoadOscilloscope(int version, const YAML::Node& node, bool onli
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to oscilloscope at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1090,7 +1473,7 @@ bool Session::PreLoadLoad(int version, const YAML::Node& node, bool online)
 	{
 		if( (transtype == "null") && (driver != "demoload") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1112,7 +1495,7 @@ bool Session::PreLoadLoad(int version, const YAML::Node& node, bool online)
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to load at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1162,7 +1545,7 @@ bool Session::PreLoadMisc(int version, const YAML::Node& node, bool online)
 	{
 		if( (transtype == "null") && (driver != "demoload") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1184,7 +1567,7 @@ bool Session::PreLoadMisc(int version, const YAML::Node& node, bool online)
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to miscellaneous instrument at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1234,7 +1617,7 @@ bool Session::PreLoadBERT(int version, const YAML::Node& node, bool online)
 	{
 		if(transtype == "null")
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1256,7 +1639,7 @@ bool Session::PreLoadBERT(int version, const YAML::Node& node, bool online)
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to BERT at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1306,7 +1689,7 @@ bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
 	{
 		if( (transtype == "null") && (driver != "demospec") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1328,7 +1711,7 @@ bool Session::PreLoadSDR(int version, const YAML::Node& node, bool online)
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to SDR at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1378,7 +1761,7 @@ bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool onli
 	{
 		if( (transtype == "null") && (driver != "demospec") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1400,7 +1783,7 @@ bool Session::PreLoadSpectrometer(int version, const YAML::Node& node, bool onli
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to spectrometer at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1450,7 +1833,7 @@ bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online
 	{
 		if( (transtype == "null") && (driver != "demometer") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1472,7 +1855,7 @@ bool Session::PreLoadMultimeter(int version, const YAML::Node& node, bool online
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to multimeter at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1522,7 +1905,7 @@ bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool onlin
 	{
 		if( (transtype == "null") && (driver != "demopsu") )
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1544,7 +1927,7 @@ bool Session::PreLoadPowerSupply(int version, const YAML::Node& node, bool onlin
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to power supply at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1594,7 +1977,7 @@ bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool
 	{
 		if(transtype == "null")
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1616,7 +1999,7 @@ bool Session::PreLoadRFSignalGenerator(int version, const YAML::Node& node, bool
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to RF signal generator at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1666,7 +2049,7 @@ bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool
 	{
 		if(transtype == "null")
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Unable to reconnect",
 				"The session file does not contain any connection information.\n\n"
 				"Loading in offline mode.");
@@ -1688,7 +2071,7 @@ bool Session::PreLoadFunctionGenerator(int version, const YAML::Node& node, bool
 			{
 				delete transport;
 
-				m_mainWindow->ShowErrorPopup(
+				ShowErrorPopup(
 					"Unable to reconnect",
 					string("Failed to reconnect to function generator at ") + node["args"].as<string>() + ".\n\n"
 					"Loading this instrument in offline mode.");
@@ -1738,6 +2121,7 @@ bool Session::LoadTriggerGroups(const YAML::Node& node)
 
 	//Clear out any existing trigger groups
 	m_triggerGroups.clear();
+	m_acquisitionPreferencesDirty = true;
 
 	for(auto it : node)
 	{
@@ -1860,7 +2244,7 @@ bool Session::LoadFilters(int /*version*/, const YAML::Node& node)
 		auto filter = Filter::CreateFilter(proto, dnode["color"].as<string>());
 		if(filter == NULL)
 		{
-			m_mainWindow->ShowErrorPopup(
+			ShowErrorPopup(
 				"Filter creation failed",
 				string("Unable to create filter \"") + proto + "\". Skipping...\n");
 			continue;
@@ -1897,6 +2281,7 @@ bool Session::LoadFilters(int /*version*/, const YAML::Node& node)
 		if(filter)
 			filter->LoadInputs(dnode, m_idtable);
 	}
+	OnFilterGraphChanged();
 
 	return true;
 }
@@ -2117,143 +2502,207 @@ YAML::Node Session::SerializeMarkers()
 	return node;
 }
 
-bool Session::SerializeWaveforms(const string& dataDir)
+/**
+	@brief Prepares to save all waveform history in the background
+
+	Must be called from the GUI thread with the waveform data mutex held. This takes a snapshot of the history, so
+	waveforms acquired after this call are not included in the save. The returned task must be started by the caller.
+
+	@param node			Top level YAML for the .scopesession file
+	@param sessionPath	Path to the .scopesession file
+	@param dataDir		Path to the _data directory of the session
+	@param stagingDir	Path to the temporary directory to write into (must already exist)
+ */
+shared_ptr<SessionSaveTask> Session::CreateSaveTask(
+	const YAML::Node& node,
+	const string& sessionPath,
+	const string& dataDir,
+	const string& stagingDir)
 {
-	//Metadata nodes for each scope
-	std::map<std::shared_ptr<Oscilloscope>, YAML::Node> metadataNodes;
+	auto task = make_shared<SessionSaveTask>(*this, node, sessionPath, dataDir, stagingDir);
 
-	//Serialize data from each history point
+	//Snapshot each history point
 	size_t numwfm = 0;
 	for(auto& hpoint : m_history.m_history)
 	{
-		auto timestamp = hpoint->m_time;
-
-		//Save each scope
-		//TODO: Do we want to change the directory hierarchy in a future file format schema?
-		//For now, we stick with scope / waveform.
-		//In the future we might want trigger group / waveform / scope.
-		for(auto it : hpoint->m_history)
-		{
-			auto scope = it.first;
-			auto& hist = it.second;
-
-			//Make the directory for the scope if needed
-			string scopedir = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_waveforms";
-			#ifdef _WIN32
-				mkdir(scopedir.c_str());
-			#else
-				mkdir(scopedir.c_str(), 0755);
-			#endif
-
-			//Make directory for this waveform
-			string datdir = scopedir + "/waveform_" + to_string(numwfm);
-			#ifdef _WIN32
-				mkdir(datdir.c_str());
-			#else
-				mkdir(datdir.c_str(), 0755);
-			#endif
-
-			//Format metadata for this waveform
-			YAML::Node mnode;
-			mnode["timestamp"] = timestamp.first;
-			mnode["time_fsec"] = timestamp.second;
-			mnode["id"] = numwfm;
-			mnode["pinned"] = hpoint->m_pinned;
-			mnode["label"] = hpoint->m_nickname;
-			for(size_t i=0; i<scope->GetChannelCount(); i++)
-			{
-				auto ochan = dynamic_cast<OscilloscopeChannel*>(scope->GetChannel(i));
-				if(!ochan)
-					continue;
-				for(size_t j=0; j<scope->GetChannel(i)->GetStreamCount(); j++)
-				{
-					StreamDescriptor stream(ochan, j);
-					if(hist.find(stream) == hist.end())
-						continue;
-					auto data = hist[stream];
-					if(data == nullptr)
-						continue;
-
-					//Got valid data, save the configuration for the channel
-					YAML::Node chnode;
-					chnode["index"] = i;
-					chnode["stream"] = j;
-					chnode["timescale"] = data->m_timescale;
-					chnode["trigphase"] = data->m_triggerPhase;
-					chnode["flags"] = (int)data->m_flags;
-					//don't serialize revision
-
-					//Save the actual waveform data
-					string datapath = datdir;
-					if(j == 0)
-						datapath += string("/channel_") + to_string(i) + ".bin";
-					else
-						datapath += string("/channel_") + to_string(i) + "_stream" + to_string(j) + ".bin";
-					auto sparse = dynamic_cast<SparseWaveformBase*>(data);
-					auto uniform = dynamic_cast<UniformWaveformBase*>(data);
-					if(sparse)
-					{
-						chnode["format"] = "sparsev1";
-						SerializeSparseWaveform(sparse, datapath);
-
-						//Save type if it's a protocol waveform
-						//so if we do an offline load, we know what type of waveform to make
-						if(dynamic_cast<SparseAnalogWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "analog";
-						else if(dynamic_cast<SparseDigitalWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "digital";
-						else if(dynamic_cast<CANWaveform*>(sparse) != nullptr)
-							chnode["datatype"] = "can";
-					}
-					else
-					{
-						chnode["format"] = "densev1";
-						SerializeUniformWaveform(uniform, datapath);
-					}
-
-					mnode["channels"][string("ch") + to_string(i) + "s" + to_string(j)] = chnode;
-				}
-			}
-
-			metadataNodes[scope]["waveforms"][string("wfm") + to_string(numwfm)] = mnode;
-		}
-
+		CreateSaveJobs(hpoint, numwfm, task->m_jobs, task->m_metadataNodes);
 		numwfm ++;
 	}
 
-	//Write metadata files (by this point, data directories should have been created)
-	for(size_t i=0; i<m_oscilloscopes.size(); i++)
+	//Metadata files for every scope, even if there's no history
+	for(auto scope : m_oscilloscopes)
 	{
-		auto scope = m_oscilloscopes[i];
-		string fname = dataDir + "/scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_metadata.yml";
-
-		ofstream outfs(fname);
-		if(!outfs)
-			return false;
-		outfs << metadataNodes[scope];
-		outfs.close();
+		task->m_metadataFiles[scope] = GetScopeMetadataFileName(scope);
+		task->m_metadataNodes[scope];
 	}
 
-	//Make directory for filters
-	string filtdir = dataDir + "/filter_waveforms";
-	#ifdef _WIN32
-		mkdir(filtdir.c_str());
-	#else
-		mkdir(filtdir.c_str(), 0755);
-	#endif
+	return task;
+}
 
-	//Find filters that need to be serialized
-	YAML::Node filterNode;
-	auto filters = Filter::GetAllInstances();
-	for(auto f : filters)
-	{
-		//If it's not being persisted, drop it
-		if(!f->ShouldPersistWaveform())
-			continue;
+/**
+	@brief Creates the jobs and metadata needed to save a single history point
 
-		//Make directory for this filter
-		auto nfilter = m_idtable.emplace(f);
-		string datdir = filtdir + "/filter_" + to_string(nfilter);
+	Must be called from the GUI thread with the waveform data mutex held.
+
+	@param hpoint		The history point to save
+	@param numwfm		Sequence number of the point within the saved session
+	@param jobs			Jobs for each stream in the point are appended to this
+	@param metadata		Per-scope metadata for the point is added to this (not including per-stream metadata, which
+						is only known once each stream has been written)
+ */
+void Session::CreateSaveJobs(
+	shared_ptr<HistoryPoint> hpoint,
+	size_t numwfm,
+	vector<WaveformSaveJob>& jobs,
+	map<shared_ptr<Oscilloscope>, YAML::Node>& metadata)
+{
+	auto timestamp = hpoint->m_time;
+
+	//The history manager's spill thread may be paging the point out to disk
+	lock_guard<recursive_mutex> lock(hpoint->m_mutex);
+
+	//Save each scope
+	//TODO: Do we want to change the directory hierarchy in a future file format schema?
+	//For now, we stick with scope / waveform.
+	//In the future we might want trigger group / waveform / scope.
+	for(auto it : hpoint->m_history)
+	{
+		auto scope = it.first;
+		auto& hist = it.second;
+
+		//Directory for this waveform (created by the job when the data is written)
+		string scopedir = "scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_waveforms";
+		string datdir = scopedir + "/waveform_" + to_string(numwfm);
+
+		//Format metadata for this waveform (the per-stream metadata is filled in once each stream is saved)
+		string wfmKey = string("wfm") + to_string(numwfm);
+		YAML::Node mnode;
+		mnode["timestamp"] = timestamp.first;
+		mnode["time_fsec"] = timestamp.second;
+		mnode["id"] = numwfm;
+		mnode["pinned"] = hpoint->m_pinned;
+		mnode["label"] = hpoint->m_nickname;
+		metadata[scope]["waveforms"][wfmKey] = mnode;
+
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto ochan = dynamic_cast<OscilloscopeChannel*>(scope->GetChannel(i));
+			if(!ochan)
+				continue;
+			for(size_t j=0; j<scope->GetChannel(i)->GetStreamCount(); j++)
+			{
+				StreamDescriptor stream(ochan, j);
+				auto hit = hist.find(stream);
+				if(hit == hist.end())
+					continue;
+
+				string datapath = datdir;
+				if(j == 0)
+					datapath += string("/channel_") + to_string(i) + ".bin";
+				else
+					datapath += string("/channel_") + to_string(i) + "_stream" + to_string(j) + ".bin";
+
+				//Make sure the data is accessible to the CPU now, rather than doing it from the save thread.
+				//No need if it's already been saved, we'll just link to the old file.
+				auto sit = hpoint->m_saved.find(scope);
+				bool saved = (sit != hpoint->m_saved.end()) && (sit->second.find(stream) != sit->second.end());
+				if(hit->second && !saved)
+					hit->second->PrepareForCpuAccess();
+
+				jobs.push_back(WaveformSaveJob(
+					hpoint,
+					scope,
+					stream,
+					datapath,
+					wfmKey,
+					string("ch") + to_string(i) + "s" + to_string(j),
+					i));
+			}
+		}
+	}
+}
+
+/**
+	@brief Gets the name of the metadata file for a scope's waveforms, relative to the data directory
+ */
+string Session::GetScopeMetadataFileName(shared_ptr<Oscilloscope> scope)
+{
+	return "scope_" + to_string(m_idtable[(Instrument*)scope.get()]) + "_metadata.yml";
+}
+
+/**
+	@brief Starts recording every acquired waveform to disk
+
+	The session configuration must already have been saved to the data directory; the recorder only adds waveforms.
+
+	@param dataDir	Path to the data directory to record into
+
+	@return True on success, false on error
+ */
+bool Session::StartRecording(const string& dataDir)
+{
+	StopRecording();
+
+	auto recorder = make_shared<WaveformRecorder>(
+		*this,
+		dataDir,
+		m_preferences.GetInt("Files.record_queue_depth"),
+		m_preferences.GetInt("Files.record_queue_size"));
+	if(!recorder->Start(GetScopes()))
+		return false;
+
+	LogDebug("Recording waveforms to %s\n", dataDir.c_str());
+	m_recorder = recorder;
+	return true;
+}
+
+/**
+	@brief Stops recording, after finishing writing everything which has already been acquired
+ */
+void Session::StopRecording()
+{
+	if(!m_recorder)
+		return;
+
+	m_recorder->Stop();
+	m_recorder = nullptr;
+
+	if(m_waveformThreadHeld)
+	{
+		m_waveformThreadHeld = false;
+		g_waveformProcessedEvent.Signal();
+	}
+}
+
+/**
+	@brief Saves waveforms from filters which need them preserved (e.g. memory filters)
+
+	This runs synchronously, since there's normally very little of it.
+
+	@param dataDir	Path to the directory to write into
+ */
+bool Session::SerializeFilterWaveforms(const string& dataDir)
+{
+	//Make directory for filters
+	string filtdir = dataDir + "/filter_waveforms";
+	#ifdef _WIN32
+		mkdir(filtdir.c_str());
+	#else
+		mkdir(filtdir.c_str(), 0755);
+	#endif
+
+	//Find filters that need to be serialized
+	YAML::Node filterNode;
+	auto filters = Filter::GetAllInstances();
+	for(auto f : filters)
+	{
+		//If it's not being persisted, drop it
+		if(!f->ShouldPersistWaveform())
+			continue;
+
+		//Make directory for this filter
+		auto nfilter = m_idtable.emplace(f);
+		string datdir = filtdir + "/filter_" + to_string(nfilter);
 		#ifdef _WIN32
 			mkdir(datdir.c_str());
 		#else
@@ -2293,11 +2742,12 @@ bool Session::SerializeWaveforms(const string& dataDir)
 
 			//Save the actual waveform data
 			string datapath = datdir + "/stream" + to_string(j) + ".bin";
+			data->PrepareForCpuAccess();
 			auto sparse = dynamic_cast<SparseWaveformBase*>(data);
 			auto uniform = dynamic_cast<UniformWaveformBase*>(data);
 			if(sparse)
 			{
-				chnode["format"] = "sparsev1";
+				chnode["format"] = "sparsev2";
 				SerializeSparseWaveform(sparse, datapath);
 			}
 			else
@@ -2323,141 +2773,122 @@ bool Session::SerializeWaveforms(const string& dataDir)
 }
 
 /**
-	@brief Saves waveform sample data in the "sparsev1" file format.
+	@brief Writes an array to a file, in blocks, padded with zeroes to a multiple of SPARSEV2_ALIGNMENT bytes
+
+	@return True on success, false on a write error
+ */
+static bool WriteAlignedArray(FILE* fp, const void* data, size_t elemsize, size_t count)
+{
+	auto p = reinterpret_cast<const uint8_t*>(data);
+	const size_t bytes_per_block = 1024*1024;
+	size_t len = elemsize * count;
+	for(size_t i=0; i<len; i += bytes_per_block)
+	{
+		size_t blocklen = min(len-i, bytes_per_block);
+		if(blocklen != fwrite(p + i, 1, blocklen, fp))
+			return false;
+	}
+
+	static const uint8_t padding[SPARSEV2_ALIGNMENT] = {0};
+	size_t padlen = (SPARSEV2_ALIGNMENT - (len % SPARSEV2_ALIGNMENT)) % SPARSEV2_ALIGNMENT;
+	return (padlen == fwrite(padding, 1, padlen, fp));
+}
+
+/**
+	@brief Saves waveform sample data in the "sparsev2" file format.
 
-	Interleaved (slow):
-		int64 offset
-		int64 len
+	Columnar (see SparseWaveformHeader):
+		header
+		int64[] offset
+		int64[] len
 		for analog
-			float voltage
+			float[] voltage
 		for digital
-			bool voltage
+			bool[] voltage
+		for CAN
+			{uint32 data, uint32 type}[] symbol
+
+	Each array is aligned to SPARSEV2_ALIGNMENT bytes.
+
+	The waveform must already be accessible to the CPU. This is called from background threads, which must not call
+	PrepareForCpuAccess() on waveforms the rest of the session may be using at the same time.
  */
 bool Session::SerializeSparseWaveform(SparseWaveformBase* wfm, const string& path)
 {
-	FILE* fp = fopen(path.c_str(), "wb");
-	if(!fp)
-		return false;
-
-	wfm->PrepareForCpuAccess();
 	auto achan = dynamic_cast<SparseAnalogWaveform*>(wfm);
 	auto dchan = dynamic_cast<SparseDigitalWaveform*>(wfm);
 	auto cchan = dynamic_cast<CANWaveform*>(wfm);
 	size_t len = wfm->size();
 
-	//Analog channels
-	const size_t samples_per_block = 10000;
+	//Figure out the sample format
+	SparseWaveformHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, "sparsev2", sizeof(header.m_magic));
+	header.m_headerSize = sizeof(header);
+	header.m_count = len;
 	if(achan)
 	{
-		#pragma pack(push, 1)
-		class asample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			float voltage;
-
-			asample_t(int64_t o=0, int64_t d=0, float v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
-
-		//Copy sample data
-		vector<asample_t,	AlignedAllocator<asample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(asample_t(achan->m_offsets[i], achan->m_durations[i], achan->m_samples[i]));
-
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(asample_t), blocklen, fp))
-			{
-				LogError("file write error\n");
-				fclose(fp);
-				return false;
-			}
-		}
+		header.m_sampleType = SparseWaveformHeader::SAMPLE_ANALOG;
+		header.m_sampleSize = sizeof(float);
 	}
 	else if(dchan)
 	{
-		#pragma pack(push, 1)
-		class dsample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			bool voltage;
-
-			dsample_t(int64_t o=0, int64_t d=0, bool v=0)
-			: off(o), dur(d), voltage(v)
-			{}
-		};
-		#pragma pack(pop)
-
-		//Copy sample data
-		vector<dsample_t,	AlignedAllocator<dsample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(dsample_t(dchan->m_offsets[i], dchan->m_durations[i], dchan->m_samples[i]));
-
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(dsample_t), blocklen, fp))
-			{
-				LogError("file write error\n");
-				fclose(fp);
-			}
-		}
+		header.m_sampleType = SparseWaveformHeader::SAMPLE_DIGITAL;
+		header.m_sampleSize = sizeof(bool);
 	}
 	else if(cchan)
 	{
-		#pragma pack(push, 1)
-		class csample_t
-		{
-		public:
-			int64_t off;
-			int64_t dur;
-			uint32_t data;
-			uint32_t type;
-
-			csample_t(int64_t o=0, int64_t d=0, CANSymbol s = CANSymbol())
-			: off(o), dur(d), data(s.m_data), type(s.m_stype)
-			{}
-		};
-		#pragma pack(pop)
-
-		//Copy sample data
-		vector<csample_t,	AlignedAllocator<csample_t, 64 > > samples;
-		samples.reserve(len);
-		for(size_t i=0; i<len; i++)
-			samples.push_back(csample_t(cchan->m_offsets[i], cchan->m_durations[i], cchan->m_samples[i]));
-
-		//Write it
-		for(size_t i=0; i<len; i+= samples_per_block)
-		{
-			size_t blocklen = min(len-i, samples_per_block);
-			if(blocklen != fwrite(&samples[i], sizeof(csample_t), blocklen, fp))
-			{
-				LogError("file write error\n");
-				fclose(fp);
-				return false;
-			}
-		}
+		header.m_sampleType = SparseWaveformHeader::SAMPLE_CAN;
+		header.m_sampleSize = 2*sizeof(uint32_t);
 	}
 	else
 	{
 		//TODO: support other waveform types (buses, eyes, etc)
 		LogError("unrecognized sample type\n");
-		fclose(fp);
 		return false;
 	}
 
+	//Lay out the arrays
+	auto align = [](uint64_t off) { return (off + SPARSEV2_ALIGNMENT - 1) & ~(uint64_t)(SPARSEV2_ALIGNMENT - 1); };
+	header.m_offsetsStart = align(sizeof(header));
+	header.m_durationsStart = align(header.m_offsetsStart + len*sizeof(int64_t));
+	header.m_samplesStart = align(header.m_durationsStart + len*sizeof(int64_t));
+
+	FILE* fp = fopen(path.c_str(), "wb");
+	if(!fp)
+		return false;
+
+	//Timestamps can be written straight from the waveform buffers
+	bool ok = WriteAlignedArray(fp, &header, 1, sizeof(header));
+	ok &= WriteAlignedArray(fp, wfm->m_offsets.GetCpuPointer(), sizeof(int64_t), len);
+	ok &= WriteAlignedArray(fp, wfm->m_durations.GetCpuPointer(), sizeof(int64_t), len);
+
+	//Analog and digital samples can too
+	if(achan)
+		ok &= WriteAlignedArray(fp, achan->m_samples.GetCpuPointer(), sizeof(float), len);
+	else if(dchan)
+		ok &= WriteAlignedArray(fp, dchan->m_samples.GetCpuPointer(), sizeof(bool), len);
+
+	//CAN symbols need to be converted to a portable format first
+	else
+	{
+		vector<uint32_t> samples;
+		samples.reserve(len*2);
+		for(size_t i=0; i<len; i++)
+		{
+			samples.push_back(cchan->m_samples[i].m_data);
+			samples.push_back(cchan->m_samples[i].m_stype);
+		}
+		ok &= WriteAlignedArray(fp, samples.data(), 2*sizeof(uint32_t), len);
+	}
+
 	fclose(fp);
+
+	if(!ok)
+	{
+		LogError("file write error\n");
+		return false;
+	}
 	return true;
 }
 
@@ -2470,6 +2901,8 @@ bool Session::SerializeSparseWaveform(SparseWaveformBase* wfm, const string& pat
 		bool[] voltage
 
 	Durations are implied {1....1} and offsets are implied {0...n-1}.
+
+	The waveform must already be accessible to the CPU (see SerializeSparseWaveform()).
  */
 bool Session::SerializeUniformWaveform(UniformWaveformBase* wfm, const string& path)
 {
@@ -2477,7 +2910,6 @@ bool Session::SerializeUniformWaveform(UniformWaveformBase* wfm, const string& p
 	if(!fp)
 		return false;
 
-	wfm->PrepareForCpuAccess();
 	auto achan = dynamic_cast<UniformAnalogWaveform*>(wfm);
 	auto dchan = dynamic_cast<UniformDigitalWaveform*>(wfm);
 	size_t len = wfm->size();
@@ -2661,6 +3093,10 @@ void Session::ApplyPreferences(shared_ptr<Oscilloscope> scope)
  */
 void Session::StartWaveformThreadIfNeeded()
 {
+	//Headless sessions run everything from the caller's thread
+	if(!m_mainWindow)
+		return;
+
 	if(m_waveformThread == nullptr)
 		m_waveformThread = make_unique<thread>(WaveformThread, this, &m_shuttingDown);
 }
@@ -2721,12 +3157,27 @@ void Session::AddInstrument(shared_ptr<Instrument> inst, bool createDialogs)
 			m_multiScope = true;
 	}
 
-	//Make the instrument thread
+	//Make the instrument thread, polling at a rate appropriate for the type of instrument
 	if(si)
-		m_instrumentStates[inst] = make_shared<InstrumentConnectionState>(args);
+	{
+		string pollPrefs = "Acquisition.Polling.Other instruments";
+		if(scope && (types & Instrument::INST_OSCILLOSCOPE))
+			pollPrefs = "Acquisition.Polling.Oscilloscopes";
+		else if(meter && (types & Instrument::INST_DMM) )
+			pollPrefs = "Acquisition.Polling.Multimeters";
+		else if(psu && (types & Instrument::INST_PSU) )
+			pollPrefs = "Acquisition.Polling.Power supplies";
+		else if(load && (types & Instrument::INST_LOAD) )
+			pollPrefs = "Acquisition.Polling.Loads";
+
+		auto state = make_shared<InstrumentConnectionState>(args, pollPrefs);
+		ApplyPollPreferences(m_preferences, *state);
+		m_instrumentStates[inst] = state;
+		m_acquisitionPreferencesDirty = true;
+	}
 
 	//Spawn dialogs/views if requested
-	if(createDialogs)
+	if(createDialogs && m_mainWindow)
 	{
 		if(psu && (types & Instrument::INST_PSU) )
 			m_mainWindow->AddDialog(make_shared<PowerSupplyDialog>(psu, args.psustate, this));
@@ -2743,12 +3194,17 @@ void Session::AddInstrument(shared_ptr<Instrument> inst, bool createDialogs)
 	}
 	if(scope)
 	{
-		m_mainWindow->OnScopeAdded(scope, createDialogs);
+		if(m_mainWindow)
+			m_mainWindow->OnScopeAdded(scope, createDialogs);
 		if(!scope->IsOffline())
 			MakeNewTriggerGroup(scope);
 	}
 
-	m_mainWindow->AddToRecentInstrumentList(si);
+	if(m_mainWindow)
+		m_mainWindow->AddToRecentInstrumentList(si);
+
+	//New channels are now available as graph nodes
+	OnFilterGraphChanged();
 
 	StartWaveformThreadIfNeeded();
 }
@@ -2778,6 +3234,8 @@ void Session::RemoveInstrument(shared_ptr<Instrument> inst)
 
 	//Clear worker threads etc
 	m_instrumentStates.erase(inst);
+
+	OnFilterGraphChanged();
 }
 
 /**
@@ -2888,6 +3346,7 @@ void Session::ArmTrigger(TriggerGroup::TriggerType type, bool all)
 	{
 		m_tArm = GetTime();
 		m_triggerArmed = true;
+		g_waveformThreadWakeEvent.Signal();
 		return;
 	}
 
@@ -2902,6 +3361,20 @@ void Session::ArmTrigger(TriggerGroup::TriggerType type, bool all)
 		ensure that the primary doesn't trigger until the secondaries are ready for the event.
 	*/
 
+	//Let the instrument threads know whether a dropped trigger can be made up for, before anything can trigger
+	{
+		lock_guard<mutex> lock(m_scopeMutex);
+		lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
+		for(auto& group : m_triggerGroups)
+		{
+			if(!group->m_primary || !(group->m_default || all))
+				continue;
+			auto it = m_instrumentStates.find(group->m_primary);
+			if(it != m_instrumentStates.end())
+				it->second->m_queuePolicy.m_oneShot = oneshot;
+		}
+	}
+
 	//Arm each trigger group (if it's defaulted)
 	{
 		lock_guard<recursive_mutex> lock(m_triggerGroupMutex);
@@ -2915,6 +3388,24 @@ void Session::ArmTrigger(TriggerGroup::TriggerType type, bool all)
 	LogTrace("All instruments are armed\n");
 	m_tArm = GetTime();
 	m_triggerArmed = true;
+
+	//Start polling the instruments right away, rather than whenever they next wake up
+	lock_guard<mutex> lock(m_scopeMutex);
+	for(auto& it : m_instrumentStates)
+		it.second->m_wakeEvent.Signal();
+}
+
+/**
+	@brief Wakes up an instrument's polling thread, so that commands just queued for it are sent right away
+
+	Without this, queued commands wait until the next poll is due, which may be a long time for a slow instrument.
+ */
+void Session::WakeInstrument(shared_ptr<Instrument> inst)
+{
+	lock_guard<mutex> lock(m_scopeMutex);
+	auto it = m_instrumentStates.find(inst);
+	if(it != m_instrumentStates.end())
+		it->second->m_wakeEvent.Signal();
 }
 
 /**
@@ -2927,7 +3418,8 @@ void Session::StopTrigger(bool all)
 {
 	m_triggerArmed = false;
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	lock_guard<ProfiledSharedMutex> lock(m_waveformDataMutex);
+	lock_guard<ProfiledSharedMutex> lock3(m_filterDataMutex);
 	lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
 	for(auto& group : m_triggerGroups)
 	{
@@ -2969,8 +3461,21 @@ bool Session::CheckForPendingWaveforms()
 	return false;
 }
 
+/**
+	@brief Check if a single trigger group has data available from all of its scopes
+ */
+bool Session::CheckForPendingWaveforms(shared_ptr<TriggerGroup> group)
+{
+	lock_guard<mutex> lock(m_scopeMutex);
+	lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
+	return group->CheckForPendingWaveforms();
+}
+
 /**
 	@brief Pull the waveform data out of the queue and make it current
+
+	Used when there are no online instruments (so the filter graph is re-run with whatever data is present). Trigger
+	groups with online instruments are each downloaded by their own worker thread instead.
  */
 void Session::DownloadWaveforms()
 {
@@ -2979,111 +3484,399 @@ void Session::DownloadWaveforms()
 		m_waveformDownloadRate.Tick();
 	}
 
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	//Only instrument data is touched here, so filters can keep running off the last acquisition in the meantime
+	lock_guard<ProfiledSharedMutex> lock(m_waveformDataMutex);
 	lock_guard<mutex> lock2(m_scopeMutex);
 	lock_guard<recursive_mutex> lock3(m_triggerGroupMutex);
 
 	//Get the data from each  trigger group
+	set<shared_ptr<Oscilloscope>> scopes;
 	for(auto group : m_triggerGroups)
 	{
 		if(!group->CheckForPendingWaveforms())
 			continue;
 
-		group->DownloadWaveforms();
-
-		//This scope has recently triggered and should be added to history
-		{
-			lock_guard<mutex> lock4(m_recentlyTriggeredScopeMutex);
-			m_recentlyTriggeredScopes.emplace(group->m_primary);
-			m_recentlyTriggeredGroups.emplace(group);
-			for(auto scope : group->m_secondaries)
-				m_recentlyTriggeredScopes.emplace(scope);
-		}
+		DownloadTriggerGroup(group, scopes);
+		m_currentAcquisition.m_groups.emplace(group);
 	}
 
+	SnapshotAcquisition(m_currentAcquisition, scopes);
+
 	//If we're in offline one-shot mode, disarm the trigger
 	if( m_triggerGroups.empty() && m_triggerOneShot)
 		m_triggerArmed = false;
 }
 
 /**
-	@brief Check if new waveform data has arrived
-
-	This runs in the main GUI thread.
-
-	TODO: this might be best to move to MainWindow?
-
-	@return True if a new waveform came in, false if not
+	@brief Gets the current waveform (and its revision) in each stream of each of a trigger group's channels
  */
-bool Session::CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf)
+static map<FlowGraphNode*, vector<pair<WaveformBase*, uint64_t>>> GetChannelWaveforms(shared_ptr<TriggerGroup> group)
 {
-	bool hadNewWaveforms = false;
+	vector<shared_ptr<Oscilloscope>> scopes = group->m_secondaries;
+	if(group->m_primary)
+		scopes.push_back(group->m_primary);
 
-	if(g_waveformReadyEvent.Peek())
+	map<FlowGraphNode*, vector<pair<WaveformBase*, uint64_t>>> ret;
+	for(auto scope : scopes)
 	{
-		LogTrace("Waveform is ready\n");
-
-		//Add to history
-		vector<shared_ptr<Oscilloscope>> scopes;
-		set<shared_ptr<TriggerGroup>> groups;
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
 		{
-			shared_lock<shared_mutex> lock2(m_waveformDataMutex);
-			lock_guard<mutex> lock(m_recentlyTriggeredScopeMutex);
-			for(auto scope : m_recentlyTriggeredScopes)
-				scopes.push_back(scope);
-			m_recentlyTriggeredScopes.clear();
-
-			groups = m_recentlyTriggeredGroups;
-			m_recentlyTriggeredGroups.clear();
+			auto chan = scope->GetOscilloscopeChannel(i);
+			if(!chan)
+				continue;
 
-			m_history.AddHistory(scopes);
+			auto& streams = ret[chan];
+			for(size_t j=0; j<chan->GetStreamCount(); j++)
+			{
+				auto data = chan->GetData(j);
+				streams.push_back(pair<WaveformBase*, uint64_t>(data, data ? data->m_revision : 0));
+			}
 		}
+	}
+	return ret;
+}
 
-		//Tone-map all of our waveforms
-		//Generally does not need waveform data locked since it only works on *rendered* data...
-		//but density functions like spectrogram are an exception as those don't have a render step.
-		//TODO: should we "snapshot" the waveform into a render buffer or something to avoid this sync point?
-		hadNewWaveforms = true;
-		{
-			lock_guard<shared_mutex> lock(m_waveformDataMutex);
-			m_mainWindow->ToneMapAllWaveforms(cmdbuf);
-		}
+/**
+	@brief Pull a single trigger group's waveform data out of the queue and make it current
 
-		//Release the waveform processing thread
-		g_waveformProcessedEvent.Signal();
+	Called from the group's worker thread. Only the group's own data is locked exclusively, so other groups can keep
+	processing their own acquisitions in the meantime.
 
-		//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
-		for(auto group : groups)
-			group->RearmIfMultiScope();
+	@param group	The group to download
+	@param acq		Acquisition to store the new waveforms in
+ */
+void Session::DownloadWaveforms(shared_ptr<TriggerGroup> group, PendingAcquisition& acq)
+{
+	{
+		lock_guard<mutex> lock(m_perfClockMutex);
+		m_waveformDownloadRate.Tick();
 	}
 
-	//If a re-render operation completed, tone map everything again
-	if((g_rerenderDoneEvent.Peek() || g_refilterDoneEvent.Peek()) && !hadNewWaveforms)
-		m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+	//Must lock mutexes in this order to avoid deadlock
+	shared_lock<ProfiledSharedMutex> lock(m_waveformDataMutex);
+	lock_guard<ProfiledSharedMutex> lock2(group->GetDataMutex());
+	lock_guard<mutex> lock3(m_scopeMutex);
+	lock_guard<recursive_mutex> lock4(m_triggerGroupMutex);
 
-	return hadNewWaveforms;
+	set<shared_ptr<Oscilloscope>> scopes;
+	acq.m_changedChannels.clear();
+	if(group->CheckForPendingWaveforms())
+	{
+		//Remember what each channel held beforehand, so we only have to re-run filters fed by data that changed
+		auto before = GetChannelWaveforms(group);
+		DownloadTriggerGroup(group, scopes);
+		acq.m_groups.emplace(group);
+
+		for(auto& it : GetChannelWaveforms(group))
+		{
+			if(before[it.first] != it.second)
+				acq.m_changedChannels.emplace(it.first);
+		}
+	}
+
+	SnapshotAcquisition(acq, scopes);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Filter processing
+/**
+	@brief Pops the next waveform off each of a trigger group's instruments
 
-size_t Session::GetFilterCount()
+	Must be called with the waveform data locked, plus the scope and trigger group mutexes.
+
+	@param group	The group to download
+	@param scopes	Set of scopes which got new data, added to
+ */
+void Session::DownloadTriggerGroup(shared_ptr<TriggerGroup> group, set<shared_ptr<Oscilloscope>>& scopes)
 {
-	set<Filter*> filters;
+	//If the primary's queue is over its limit and we're allowed to, throw away the oldest waveforms to catch up
+	auto it = m_instrumentStates.find(group->m_primary);
+	if(it != m_instrumentStates.end())
 	{
-		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		filters = Filter::GetAllInstances();
+		auto& qpolicy = it->second->m_queuePolicy;
+		if(qpolicy.GetPolicy() == WaveformQueuePolicy::POLICY_DROP_OLDEST)
+		{
+			size_t npending = group->m_primary->GetPendingWaveformCount();
+			size_t depth = qpolicy.GetMaxDepth();
+			if(npending > depth)
+				qpolicy.m_droppedOldest += group->DropOldestWaveforms(npending - depth);
+		}
 	}
-	return filters.size();
-}
 
+	group->DownloadWaveforms();
+
+	//These scopes have recently triggered and should be added to history
+	scopes.emplace(group->m_primary);
+	for(auto scope : group->m_secondaries)
+		scopes.emplace(scope);
+}
 
 /**
-	@brief Queues a request to refresh all filters the next time we poll stuff
- */
-void Session::RefreshAllFiltersNonblocking()
+	@brief Snapshots newly downloaded waveforms into an acquisition, so they can be added to history later
+
+	Once they're in the snapshot, the next download can detach them from the channels without losing them.
+
+	Must be called with the waveform data and scope mutexes locked.
+
+	@param acq		The acquisition
+	@param scopes	Scopes which got new data
+ */
+void Session::SnapshotAcquisition(PendingAcquisition& acq, const set<shared_ptr<Oscilloscope>>& scopes)
+{
+	acq.m_point = HistoryManager::CreateHistoryPoint(vector<shared_ptr<Oscilloscope>>(scopes.begin(), scopes.end()));
+	acq.m_tAcquired = m_tLastAcquired;
+
+	//Remember how big each scope's waveforms are, so its queue limit can be converted from bytes to a count.
+	//There's room in the queues now, so let the instrument threads know in case they were waiting for it
+	auto& point = acq.m_point;
+	for(auto scope : scopes)
+	{
+		auto it = m_instrumentStates.find(scope);
+		if(it == m_instrumentStates.end())
+			continue;
+
+		auto jt = point->m_history.find(scope);
+		if(jt != point->m_history.end())
+		{
+			size_t size = 0;
+			for(auto& kt : jt->second)
+				size += HistoryPoint::GetWaveformMemoryUsage(kt.second);
+			it->second->m_queuePolicy.m_waveformSize = size;
+		}
+
+		it->second->m_wakeEvent.Signal();
+	}
+}
+
+/**
+	@brief Called from an instrument thread when a new waveform has been added to the instrument's pending queue
+
+	Wakes up the waveform thread so it can process the data right away.
+ */
+void Session::OnWaveformAcquired()
+{
+	m_tLastAcquired = GetTime();
+	g_waveformThreadWakeEvent.Signal();
+}
+
+/**
+	@brief Called from the waveform thread each time it wakes up to look for work, for performance metrics
+ */
+void Session::OnWaveformThreadWakeup()
+{
+	lock_guard<mutex> lock(m_perfClockMutex);
+	m_waveformThreadWakeupRate.Tick();
+}
+
+/**
+	@brief Hands the acquisition the waveform thread just finished processing off to the GUI thread
+
+	Called from the waveform thread once the filter graph has run and the waveforms have been rendered.
+ */
+void Session::CommitAcquisition()
+{
+	CommitAcquisition(m_currentAcquisition);
+}
+
+/**
+	@brief Hands an acquisition off to the GUI thread, and clears it so it can be reused for the next one
+ */
+void Session::CommitAcquisition(PendingAcquisition& acq)
+{
+	lock_guard<mutex> lock(m_pendingAcquisitionMutex);
+	m_pendingAcquisitions.push_back(acq);
+	acq = PendingAcquisition();
+}
+
+/**
+	@brief Pushes polling limits from the preferences to an instrument's poll scheduler
+ */
+static void ApplyPollPreferences(PreferenceManager& prefs, InstrumentConnectionState& state)
+{
+	auto& prefix = state.m_pollPreferences;
+	state.m_pollScheduler.SetLimits(
+		prefs.GetReal(prefix + ".min_interval") / FS_PER_SECOND,
+		prefs.GetReal(prefix + ".max_interval") / FS_PER_SECOND,
+		prefs.GetReal(prefix + ".max_utilization"));
+	state.m_pollScheduler.SetChangeThreshold(prefs.GetReal("Acquisition.Polling.change_threshold"));
+}
+
+/**
+	@brief Applies acquisition settings from the preferences to every instrument
+
+	Called from the GUI thread, only when the preferences have changed or instruments or trigger groups have been
+	added or removed (see MarkAcquisitionPreferencesDirty()).
+ */
+void Session::ApplyAcquisitionPreferences()
+{
+	m_acquisitionPreferencesDirty = false;
+	m_acquisitionPreferencesVersion = m_preferences.GetChangeCount();
+
+	m_pipelineDepth = max((int64_t)1, m_preferences.GetInt("Acquisition.pipeline_depth"));
+
+	size_t maxCount = max((int64_t)1, m_preferences.GetInt("Acquisition.Queue.max_count"));
+	size_t maxBytes = max((int64_t)1, m_preferences.GetInt("Acquisition.Queue.max_size"));
+	auto policy = static_cast<WaveformQueuePolicy::OverflowPolicy>(
+		m_preferences.GetEnumRaw("Acquisition.Queue.overflow_policy"));
+
+	lock_guard<mutex> lock(m_scopeMutex);
+	lock_guard<recursive_mutex> lock2(m_triggerGroupMutex);
+
+	//Find scopes which share a trigger group with other scopes, since they can't drop waveforms independently
+	set<shared_ptr<Instrument>> multiScope;
+	for(auto group : m_triggerGroups)
+	{
+		if(!group->HasSecondaries())
+			continue;
+		multiScope.emplace(group->m_primary);
+		for(auto scope : group->m_secondaries)
+			multiScope.emplace(scope);
+	}
+
+	for(auto& it : m_instrumentStates)
+	{
+		ApplyPollPreferences(m_preferences, *it.second);
+
+		auto& qpolicy = it.second->m_queuePolicy;
+		qpolicy.m_maxCount = maxCount;
+		qpolicy.m_maxBytes = maxBytes;
+		qpolicy.m_policy = policy;
+		qpolicy.m_multiScope = (multiScope.find(it.first) != multiScope.end());
+	}
+}
+
+/**
+	@brief Gets the connection state (polling thread etc) for an instrument
+
+	@return The state, or nullptr if the instrument has no polling thread
+ */
+shared_ptr<InstrumentConnectionState> Session::GetInstrumentConnectionState(shared_ptr<Instrument> inst)
+{
+	lock_guard<mutex> lock(m_scopeMutex);
+	auto it = m_instrumentStates.find(inst);
+	if(it == m_instrumentStates.end())
+		return nullptr;
+	return it->second;
+}
+
+/**
+	@brief Returns true if the waveform thread has to wait for the GUI before starting on another acquisition
+
+	This is the case if the GUI is pipeline depth acquisitions behind, or if the recorder is holding acquisition off.
+ */
+bool Session::IsPipelineFull()
+{
+	if(m_waveformThreadHeld)
+		return true;
+
+	lock_guard<mutex> lock(m_pendingAcquisitionMutex);
+	return m_pendingAcquisitions.size() >= m_pipelineDepth;
+}
+
+/**
+	@brief Check if new waveform data has arrived
+
+	This runs in the main GUI thread.
+
+	TODO: this might be best to move to MainWindow?
+
+	@return True if a new waveform came in, false if not
+ */
+bool Session::CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf)
+{
+	bool hadNewWaveforms = false;
+
+	if(m_acquisitionPreferencesDirty || (m_preferences.GetChangeCount() != m_acquisitionPreferencesVersion))
+		ApplyAcquisitionPreferences();
+
+	//Clean up after the recorder, and release the waveform thread if we were waiting for the recorder to catch up
+	if(m_recorder)
+		m_recorder->ReleaseCompleted();
+	if(m_waveformThreadHeld && (!m_recorder || !m_recorder->IsFull()) )
+	{
+		m_waveformThreadHeld = false;
+		g_waveformProcessedEvent.Signal();
+	}
+
+	if(g_waveformReadyEvent.Peek())
+	{
+		LogTrace("Waveform is ready\n");
+
+		//Add everything the waveform thread has finished with to history, oldest first
+		list<PendingAcquisition> acquisitions;
+		{
+			lock_guard<mutex> lock(m_pendingAcquisitionMutex);
+			acquisitions.splice(acquisitions.end(), m_pendingAcquisitions);
+		}
+		set<shared_ptr<TriggerGroup>> groups;
+		vector<shared_ptr<HistoryPoint>> pointsToRecord;
+		{
+			shared_lock<ProfiledSharedMutex> lock2(m_waveformDataMutex);
+			for(auto& acq : acquisitions)
+			{
+				if(acq.m_tAcquired > 0)
+					m_displayLatency = (GetTime() - acq.m_tAcquired) * FS_PER_SECOND;
+
+				auto point = m_history.AddHistory(acq.m_point);
+				if(m_recorder && point)
+					pointsToRecord.push_back(point);
+				groups.insert(acq.m_groups.begin(), acq.m_groups.end());
+			}
+		}
+
+		//Recording moves the new waveforms to the CPU, so nobody else can be using them while it does that
+		if(!pointsToRecord.empty())
+		{
+			lock_guard<ProfiledSharedMutex> lock2(m_waveformDataMutex);
+			for(auto& point : pointsToRecord)
+				m_recorder->Record(point);
+		}
+
+		//Tone-map all of our waveforms
+		//This only works on *rendered* data, so it doesn't need waveform data locked. Density functions like
+		//spectrograms don't have a render step, but the waveform thread copies their output when rendering instead,
+		//so we never have to wait for a trigger group which is busy with its next acquisition.
+		hadNewWaveforms = true;
+		m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+
+		//Release the waveform processing thread, unless we're recording and the disk can't keep up.
+		//Holding it back stalls the instrument threads once their queues fill, rather than buffering ever more data.
+		if(m_recorder && m_recorder->IsFull())
+			m_waveformThreadHeld = true;
+		else
+			g_waveformProcessedEvent.Signal();
+
+		//In multi-scope free-run mode, re-arm every instrument's trigger after we've processed all data
+		for(auto group : groups)
+			group->RearmIfMultiScope();
+	}
+
+	//If a re-render operation completed, tone map everything again
+	if((g_rerenderDoneEvent.Peek() || g_refilterDoneEvent.Peek()) && !hadNewWaveforms)
+		m_mainWindow->ToneMapAllWaveforms(cmdbuf);
+
+	return hadNewWaveforms;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Filter processing
+
+size_t Session::GetFilterCount()
+{
+	set<Filter*> filters;
+	{
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
+	return filters.size();
+}
+
+
+/**
+	@brief Queues a request to refresh all filters the next time we poll stuff
+ */
+void Session::RefreshAllFiltersNonblocking()
 {
 	g_refilterRequestedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 }
 
 /**
@@ -3100,50 +3893,517 @@ void Session::RefreshDirtyFiltersNonblocking()
 	}
 
 	g_partialRefilterRequestedEvent.Signal();
+	g_waveformThreadWakeEvent.Signal();
 }
 
 /**
 	@brief Gets all of our graph nodes (filters plus instrument channels)
+
+	The set is cached, and only rebuilt after the graph has changed.
  */
 set<FlowGraphNode*> Session::GetAllGraphNodes()
 {
-	//Start with all filters
-	set<FlowGraphNode*> nodes;
+	lock_guard<mutex> lock(m_graphNodesMutex);
+	UpdateGraphNodes();
+	return m_graphNodes;
+}
+
+/**
+	@brief Rebuilds the cached set of graph nodes, if it's out of date
+
+	Filters are deleted whenever their last reference is released, which can happen from all over the UI without
+	OnFilterGraphChanged() being called. So as well as checking m_filterGraphVersion, we compare the number of live
+	filters against what we saw last time.
+
+	Must be called with m_graphNodesMutex locked.
+ */
+void Session::UpdateGraphNodes()
+{
+	uint64_t version = m_filterGraphVersion;
+	set<Filter*> filters;
 	{
 		lock_guard<mutex> lock2(m_filterUpdatingMutex);
-		auto filters = Filter::GetAllInstances();
-		for(auto f : filters)
-			nodes.emplace(f);
+		size_t count = Filter::GetNumInstances();
+		if(m_graphNodesValid && (version == m_graphNodesVersion) && (count == m_graphNodesFilterCount) )
+			return;
+
+		filters = Filter::GetAllInstances();
 	}
 
+	//Start with all filters
+	m_graphNodes.clear();
+	for(auto f : filters)
+		m_graphNodes.emplace(f);
+
 	//then add instrument channels
 	auto insts = GetInstruments();
 	for(auto inst : insts)
 	{
 		for(size_t i=0; i<inst->GetChannelCount(); i++)
-			nodes.emplace(inst->GetChannel(i));
+			m_graphNodes.emplace(inst->GetChannel(i));
 	}
 
-	return nodes;
+	m_graphNodesValid = true;
+	m_graphNodesVersion = version;
+	m_graphNodesFilterCount = filters.size();
+	m_graphNodesGeneration ++;
 }
 
 void Session::RefreshAllFilters()
 {
 	double tstart = GetTime();
 
-	auto nodes = GetAllGraphNodes();
+	set<FlowGraphNode*> nodes;
+	{
+		lock_guard<mutex> lock(m_filterGraphIndexMutex);
+		UpdateFilterGraphIndex();
+		nodes = m_filterGraphIndexNodes;
+	}
 
 	{
 		//Must lock mutexes in this order to avoid deadlock
-		lock_guard<shared_mutex> lock(m_waveformDataMutex);
+		shared_lock<ProfiledSharedMutex> lock(m_waveformDataMutex);
+		lock_guard<ProfiledSharedMutex> lock2(m_filterDataMutex);
+		TriggerGroupDataLock lock4(*this);
 		//shared_lock<shared_mutex> lock3(g_vulkanActivityMutex);
-		m_graphExecutor.RunBlocking(nodes);
+		RunFilters(m_graphExecutor, nodes);
 		UpdatePacketManagers(nodes);
 	}
 
 	m_lastFilterGraphExecTime = (GetTime() - tstart) * FS_PER_SECOND;
 }
 
+/**
+	@brief Runs the part of the filter graph downstream of a trigger group which just acquired new data
+
+	Called from the group's worker thread. If none of the filters to be run depend on any other trigger group, only
+	the group's own data is locked exclusively, so other groups can run their filters at the same time. Otherwise we
+	fall back to locking all filter data, as RefreshAllFilters() does.
+
+	@param group			The group which triggered
+	@param executor			Executor to run the filters on (each worker has its own)
+	@param changedChannels	Channels of the group whose waveforms changed in the download
+ */
+void Session::RefreshTriggerGroupFilters(
+	shared_ptr<TriggerGroup> group,
+	FilterGraphExecutor& executor,
+	const set<FlowGraphNode*>& changedChannels)
+{
+	double tstart = GetTime();
+
+	//Figure out which nodes get new data from this group, and which from others.
+	//Channels whose waveforms didn't change (disabled, or not part of this download) don't need their consumers run.
+	//Filter-only groups have always been refreshed along with every acquisition, so keep doing that.
+	set<FlowGraphNode*> sources = changedChannels;
+	set<FlowGraphNode*> otherSources;
+	for(auto g : GetTriggerGroups())
+	{
+		if(g == group)
+			sources.insert(g->m_filters.begin(), g->m_filters.end());
+		else
+		{
+			auto nodes = g->GetSourceNodes();
+			if(!g->HasScopes())
+				sources.insert(nodes.begin(), nodes.end());
+			otherSources.insert(nodes.begin(), nodes.end());
+		}
+	}
+
+	//Find everything downstream of this group, and check if any of it is shared with another group
+	auto cone = GetDownstreamNodes(sources, otherSources);
+	auto& nodesToUpdate = cone.m_nodes;
+
+	//Must lock mutexes in this order to avoid deadlock
+	if(cone.m_shared)
+	{
+		shared_lock<ProfiledSharedMutex> lock(m_waveformDataMutex);
+		lock_guard<ProfiledSharedMutex> lock2(m_filterDataMutex);
+		TriggerGroupDataLock lock3(*this);
+		RunFilters(executor, nodesToUpdate);
+		UpdatePacketManagers(nodesToUpdate);
+	}
+
+	//Nothing to do if none of the group's channels got new data and it has no filters of its own
+	else if(!nodesToUpdate.empty())
+	{
+		shared_lock<ProfiledSharedMutex> lock(m_waveformDataMutex);
+		shared_lock<ProfiledSharedMutex> lock2(m_filterDataMutex);
+		lock_guard<ProfiledSharedMutex> lock3(group->GetDataMutex());
+		RunFilters(executor, nodesToUpdate);
+		UpdatePacketManagers(nodesToUpdate);
+	}
+
+	//Other groups may be running their filters at the same time, so keep the timing separate for each
+	group->SetFilterGraphExecTime((GetTime() - tstart) * FS_PER_SECOND);
+}
+
+/**
+	@brief Gets the trigger groups whose filter runs may write to any of a set of nodes
+
+	A group's filters only ever write to the influence cone of its own sources (plus those of filter-only groups, which
+	are refreshed along with everything), so readers of a few nodes only need to lock the groups feeding them.
+
+	Must be called before locking any waveform data, since working out the cones needs the scope and filter mutexes.
+
+	@param nodes	Nodes which are going to be read
+
+	@return The groups, in the same order as GetTriggerGroups()
+ */
+vector<shared_ptr<TriggerGroup>> Session::GetTriggerGroupsFeeding(const set<FlowGraphNode*>& nodes)
+{
+	auto groups = GetTriggerGroups();
+
+	vector<shared_ptr<TriggerGroup>> ret;
+	for(auto group : groups)
+	{
+		auto cone = GetTriggerGroupCone(group, groups);
+		for(auto node : nodes)
+		{
+			if(cone.m_nodes.find(node) != cone.m_nodes.end())
+			{
+				ret.push_back(group);
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+/**
+	@brief Gets every node a set of trigger groups' filter runs may write to
+
+	Used by the waveform thread to avoid reading anything a busy group's worker may be in the middle of writing.
+
+	Must be called before locking any waveform data, for the same reason as GetTriggerGroupsFeeding().
+
+	@param busy		The groups
+ */
+set<FlowGraphNode*> Session::GetNodesFedBy(const vector<shared_ptr<TriggerGroup>>& busy)
+{
+	set<FlowGraphNode*> ret;
+	if(busy.empty())
+		return ret;
+
+	auto groups = GetTriggerGroups();
+	for(auto group : busy)
+	{
+		auto cone = GetTriggerGroupCone(group, groups);
+		ret.insert(cone.m_nodes.begin(), cone.m_nodes.end());
+	}
+	return ret;
+}
+
+/**
+	@brief Gets the influence cone of everything a trigger group's filter runs may write to
+
+	Uses the same sources as RefreshTriggerGroupFilters() with every channel changed, so the cone cache is shared.
+
+	@param group	The group
+	@param groups	All of the session's trigger groups
+ */
+FilterCone Session::GetTriggerGroupCone(shared_ptr<TriggerGroup> group, const vector<shared_ptr<TriggerGroup>>& groups)
+{
+	set<FlowGraphNode*> sources = group->GetSourceNodes();
+	set<FlowGraphNode*> otherSources;
+	for(auto g : groups)
+	{
+		if(g == group)
+			continue;
+
+		auto gnodes = g->GetSourceNodes();
+		if(!g->HasScopes())
+			sources.insert(gnodes.begin(), gnodes.end());
+		otherSources.insert(gnodes.begin(), gnodes.end());
+	}
+
+	return GetDownstreamNodes(sources, otherSources);
+}
+
+/**
+	@brief Sorts a set of nodes so that each one comes after all of its inputs which are also in the set
+
+	Nodes in a feedback loop (which can't be ordered) go at the end.
+ */
+static vector<FlowGraphNode*> GetTopologicalOrder(const set<FlowGraphNode*>& nodes)
+{
+	//Count how many inputs each node has within the set, and who consumes each node
+	map<FlowGraphNode*, size_t> pending;
+	map<FlowGraphNode*, vector<FlowGraphNode*>> consumers;
+	for(auto node : nodes)
+	{
+		auto& count = pending[node];
+		for(size_t i=0; i<node->GetInputCount(); i++)
+		{
+			FlowGraphNode* chan = node->GetInput(i).m_channel;
+			if(nodes.find(chan) == nodes.end())
+				continue;
+			count ++;
+			consumers[chan].push_back(node);
+		}
+	}
+
+	vector<FlowGraphNode*> ret;
+	for(auto it : pending)
+	{
+		if(it.second == 0)
+			ret.push_back(it.first);
+	}
+	for(size_t i=0; i<ret.size(); i++)
+	{
+		for(auto consumer : consumers[ret[i]])
+		{
+			if(--pending[consumer] == 0)
+				ret.push_back(consumer);
+		}
+	}
+
+	for(auto it : pending)
+	{
+		if(it.second != 0)
+			ret.push_back(it.first);
+	}
+	return ret;
+}
+
+/**
+	@brief Rebuilds the reverse edge index of the filter graph, if it's out of date
+
+	The index (and the influence cone cache and topological order built on top of it) is thrown away whenever the
+	cached node set is rebuilt, i.e. when OnFilterGraphChanged() is called or filters or instruments come and go, so
+	stale pointers to deleted filters are never handed out.
+
+	Must be called with m_filterGraphIndexMutex locked, and without holding m_scopeMutex or any waveform data locks.
+ */
+void Session::UpdateFilterGraphIndex()
+{
+	lock_guard<mutex> lock2(m_graphNodesMutex);
+	UpdateGraphNodes();
+	if(m_graphNodesGeneration == m_filterGraphIndexGeneration)
+		return;
+
+	m_filterGraphIndexGeneration = m_graphNodesGeneration;
+	m_filterGraphIndexNodes = m_graphNodes;
+	m_lastFilterGraphSize = m_graphNodes.size();
+	m_filterCones.clear();
+	m_filterProfiler.Prune(m_graphNodes);
+
+	m_filterGraphConsumers.Rebuild(m_graphNodes);
+	m_filterGraphOrder = GetTopologicalOrder(m_graphNodes);
+}
+
+/**
+	@brief Finds the longest chain of dependent filters in the graph, weighted by their profiled execution times
+
+	This is the shortest the whole graph could possibly take to run, no matter how many cores are available.
+
+	@param length	Set to the total (average) execution time of the filters on the path, in seconds
+	@param total	Set to the total (average) execution time of all profiled filters, in seconds
+
+	@return The nodes on the path, in dependency order (empty if nothing has been profiled)
+ */
+vector<FlowGraphNode*> Session::GetFilterCriticalPath(double& length, double& total)
+{
+	auto profiles = m_filterProfiler.GetProfiles();
+
+	length = 0;
+	total = 0;
+	FlowGraphNode* last = nullptr;
+	map<FlowGraphNode*, double> finish;
+	map<FlowGraphNode*, FlowGraphNode*> prev;
+	vector<FlowGraphNode*> order;
+	{
+		lock_guard<mutex> lock(m_filterGraphIndexMutex);
+		UpdateFilterGraphIndex();
+		order = m_filterGraphOrder;
+	}
+	for(auto node : order)
+	{
+		//Can't start until the slowest input is done
+		double start = 0;
+		FlowGraphNode* from = nullptr;
+		for(size_t i=0; i<node->GetInputCount(); i++)
+		{
+			auto it = finish.find(node->GetInput(i).m_channel);
+			if( (it != finish.end()) && (it->second > start) )
+			{
+				start = it->second;
+				from = it->first;
+			}
+		}
+
+		double t = 0;
+		auto it = profiles.find(node);
+		if(it != profiles.end())
+			t = it->second.m_averageTime;
+		total += t;
+
+		finish[node] = start + t;
+		prev[node] = from;
+		if(finish[node] > length)
+		{
+			length = finish[node];
+			last = node;
+		}
+	}
+
+	vector<FlowGraphNode*> path;
+	for(auto node = last; node != nullptr; node = prev[node])
+		path.push_back(node);
+	reverse(path.begin(), path.end());
+	return path;
+}
+
+/**
+	@brief Runs a set of filters, timing each one if the profiler is on
+
+	With profiling off, this just hands the whole set to the executor. With it on, every other call runs the nodes one
+	at a time in dependency order so each can be timed on its own, giving up parallelism between filters.
+
+	Must be called with the same locks held as FilterGraphExecutor::RunBlocking().
+
+	@param executor		The executor to run the filters on
+	@param nodes		The nodes to run
+ */
+void Session::RunFilters(FilterGraphExecutor& executor, const set<FlowGraphNode*>& nodes)
+{
+	if(!m_filterProfiler.IsEnabled())
+	{
+		executor.RunBlocking(nodes);
+		return;
+	}
+
+	//Every other run goes through the executor as normal, so we can see how much it gains from parallelism
+	if(m_filterProfiler.IsParallelPass())
+	{
+		double tstart = GetTime();
+		executor.RunBlocking(nodes);
+		m_filterProfiler.RecordParallelRun(nodes, GetTime() - tstart);
+		return;
+	}
+
+	//Pick our nodes out of the cached order of the whole graph, which the caller brought up to date before locking.
+	//If the graph changed since then and some are missing, sort them from scratch.
+	vector<FlowGraphNode*> order;
+	{
+		lock_guard<mutex> lock(m_filterGraphIndexMutex);
+		for(auto node : m_filterGraphOrder)
+		{
+			if(nodes.find(node) != nodes.end())
+				order.push_back(node);
+		}
+	}
+	if(order.size() != nodes.size())
+		order = GetTopologicalOrder(nodes);
+
+	for(auto node : order)
+	{
+		set<FlowGraphNode*> single;
+		single.emplace(node);
+
+		double tstart = GetTime();
+		executor.RunBlocking(single);
+		double tend = GetTime();
+
+		auto f = dynamic_cast<Filter*>(node);
+		if(f)
+			m_filterProfiler.Record(f, tstart, tend);
+	}
+}
+
+/**
+	@brief Finds every node downstream of a set of nodes, with a single breadth-first walk of the reverse edge index
+
+	Must be called with m_filterGraphIndexMutex locked, and the index up to date.
+
+	@param sources	Nodes to start from
+
+	@return All nodes which directly or indirectly consume one of the sources. The sources themselves are only
+			included if they're downstream of another source.
+ */
+set<FlowGraphNode*> Session::GetConsumersOf(const set<FlowGraphNode*>& sources)
+{
+	return m_filterGraphConsumers.GetConsumersOf(sources);
+}
+
+/**
+	@brief Gets the downstream influence cone of a set of nodes, reusing the previous result if the graph hasn't changed
+
+	@param sources		Nodes with new data
+	@param otherSources	Nodes driven by other trigger groups, to check the cone for overlap with
+
+	@return The sources, plus every node downstream of them
+ */
+FilterCone Session::GetDownstreamNodes(const set<FlowGraphNode*>& sources, const set<FlowGraphNode*>& otherSources)
+{
+	lock_guard<mutex> lock(m_filterGraphIndexMutex);
+	UpdateFilterGraphIndex();
+	auto& nodes = m_filterGraphIndexNodes;
+
+	//Reuse the cached cone if we have one for the same inputs
+	auto it = m_filterCones.find(sources);
+	if( (it != m_filterCones.end()) && (it->second.m_otherSources == otherSources) )
+	{
+		m_filterConeHits ++;
+		m_lastFilterConeSize = it->second.m_nodes.size();
+		return it->second;
+	}
+	m_filterConeMisses ++;
+
+	FilterCone cone;
+	cone.m_otherSources = otherSources;
+	cone.m_nodes = GetConsumersOf(sources);
+	for(auto node : sources)
+	{
+		if(nodes.find(node) != nodes.end())
+			cone.m_nodes.emplace(node);
+	}
+
+	//Check for overlap with everything the other groups feed
+	auto otherCone = GetConsumersOf(otherSources);
+	for(auto node : cone.m_nodes)
+	{
+		if( (otherSources.find(node) != otherSources.end()) || (otherCone.find(node) != otherCone.end()) )
+		{
+			cone.m_shared = true;
+			break;
+		}
+	}
+	m_lastFilterConeSize = cone.m_nodes.size();
+
+	//The number of distinct source sets is normally tiny (one or two per trigger group), but channels can come and
+	//go as they're enabled and disabled. Don't let the cache grow without bound.
+	if(m_filterCones.size() >= 64)
+		m_filterCones.clear();
+	m_filterCones[sources] = cone;
+
+	return cone;
+}
+
+/**
+	@brief Returns true if a channel holds waveform data downloaded from an oscilloscope (rather than a filter output)
+ */
+static bool IsInstrumentWaveform(InstrumentChannel* chan)
+{
+	return (dynamic_cast<OscilloscopeChannel*>(chan) != nullptr) && (dynamic_cast<Filter*>(chan) == nullptr);
+}
+
+/**
+	@brief Returns true if a graph node is, or directly reads from, an oscilloscope channel
+ */
+static bool ReadsInstrumentWaveforms(FlowGraphNode* node)
+{
+	if(IsInstrumentWaveform(dynamic_cast<InstrumentChannel*>(node)))
+		return true;
+
+	for(size_t i=0; i<node->GetInputCount(); i++)
+	{
+		if(IsInstrumentWaveform(node->GetInput(i).m_channel))
+			return true;
+	}
+	return false;
+}
+
 /**
 	@brief Refresh dirty filters (and anything in their downstream influence cone)
 
@@ -3158,15 +4418,16 @@ bool Session::RefreshDirtyFilters()
 		if(m_dirtyChannels.empty())
 			return false;
 
-		//Start with all nodes
-		auto nodes = GetAllGraphNodes();
-
-		//Check each one to see if it needs updating
-		for(auto f : nodes)
+		//Walk the reverse edges from the dirty channels to find everything that needs updating.
+		//Dirty marks arriving between refreshes are coalesced in m_dirtyChannels, so this runs at most once per
+		//refresh no matter how often the instrument threads poll.
+		double tcone = GetTime();
 		{
-			if(f->IsDownstreamOf(m_dirtyChannels))
-				nodesToUpdate.emplace(f);
+			lock_guard<mutex> lock2(m_filterGraphIndexMutex);
+			UpdateFilterGraphIndex();
+			nodesToUpdate = GetConsumersOf(m_dirtyChannels);
 		}
+		m_lastDirtyConeTime = (GetTime() - tcone) * FS_PER_SECOND;
 
 		//The filter itself needs to be updated too
 		for(auto node : m_dirtyChannels)
@@ -3182,14 +4443,32 @@ bool Session::RefreshDirtyFilters()
 	if(nodesToUpdate.empty())
 		return false;
 
+	//Only lock instrument waveform data if one of the filters actually reads it.
+	//Filters fed by e.g. a power supply or multimeter can then update without waiting for a waveform download.
+	bool needWaveformData = false;
+	for(auto node : nodesToUpdate)
+	{
+		if(ReadsInstrumentWaveforms(node))
+		{
+			needWaveformData = true;
+			break;
+		}
+	}
+
 	//Refresh the dirty filters only
 	double tstart = GetTime();
 
 	{
 		//Must lock mutexes in this order to avoid deadlock
-		lock_guard<shared_mutex> lock(m_waveformDataMutex);
+		shared_lock<ProfiledSharedMutex> lock(m_waveformDataMutex, defer_lock);
+		if(needWaveformData)
+			lock.lock();
+		lock_guard<ProfiledSharedMutex> lock2(m_filterDataMutex);
+		unique_ptr<TriggerGroupDataLock> lock4;
+		if(needWaveformData)
+			lock4 = make_unique<TriggerGroupDataLock>(*this);
 		shared_lock<shared_mutex> lock3(g_vulkanActivityMutex);
-		m_graphExecutor.RunBlocking(nodesToUpdate);
+		RunFilters(m_graphExecutor, nodesToUpdate);
 		UpdatePacketManagers(nodesToUpdate);
 	}
 
@@ -3207,12 +4486,23 @@ void Session::MarkChannelDirty(InstrumentChannel* chan)
 	m_dirtyChannels.emplace(chan);
 }
 
+/**
+	@brief Called whenever a filter input is connected, disconnected, or otherwise rerouted, or a filter or instrument
+	is added or removed
+
+	Invalidates the cached node set and any cached graph traversals.
+ */
+void Session::OnFilterGraphChanged()
+{
+	m_filterGraphVersion ++;
+}
+
 /**
 	@brief Clear state on all of our filters
  */
 void Session::ClearSweeps()
 {
-	lock_guard<shared_mutex> lock(m_waveformDataMutex);
+	lock_guard<ProfiledSharedMutex> lock(m_filterDataMutex);
 
 	set<Filter*> filters;
 	{
@@ -3225,21 +4515,30 @@ void Session::ClearSweeps()
 }
 
 /**
-	@brief Update all of the packet managers when new data arrives
+	@brief Update the packet managers of decoders which just ran, and drop any whose decoder has been deleted
+
+	@param nodes	Nodes which were just run (may be only part of the graph)
  */
 void Session::UpdatePacketManagers(const set<FlowGraphNode*>& nodes)
 {
+	//Check against the whole graph, not just what ran, so managers for filters outside the cone survive
+	set<Filter*> filters;
+	{
+		lock_guard<mutex> lock2(m_filterUpdatingMutex);
+		filters = Filter::GetAllInstances();
+	}
+
 	lock_guard<mutex> lock(m_packetMgrMutex);
 
 	set<PacketDecoder*> deletedFilters;
 	for(auto it : m_packetmgrs)
 	{
 		//Remove filters that no longer exist
-		if(nodes.find(it.first) == nodes.end())
+		if(filters.find(it.first) == filters.end())
 			deletedFilters.emplace(it.first);
 
-		//It exists, update it
-		else
+		//It exists and just got new data, update it
+		else if(nodes.find(it.first) != nodes.end())
 			it.second->Update();
 	}
 
@@ -3278,12 +4577,49 @@ void Session::RemovePackets(TimePoint t)
  */
 int64_t Session::GetToneMapTime()
 {
+	if(!m_mainWindow)
+		return 0;
 	return m_mainWindow->GetToneMapTime();
 }
 
-void Session::RenderWaveformTextures(vk::raii::CommandBuffer& cmdbuf, vector<shared_ptr<DisplayedChannel> >& channels)
+/**
+	@brief Rasterizes all displayed waveforms, other than those showing any of the nodes in skip
+
+	@param cmdbuf	Command buffer to record rendering commands into
+	@param channels	Set of channels we rendered into
+	@param skip		Nodes which must not be read (see GetNodesFedBy()), or empty to render everything
+ */
+void Session::RenderWaveformTextures(
+	vk::raii::CommandBuffer& cmdbuf,
+	vector<shared_ptr<DisplayedChannel> >& channels,
+	const set<FlowGraphNode*>& skip)
+{
+	if(m_mainWindow)
+		m_mainWindow->RenderWaveformTextures(cmdbuf, channels, skip);
+}
+
+/**
+	@brief Rebuilds the min/max pyramids used to draw deep waveforms when zoomed out, for any which have changed
+
+	@param skip		Nodes which must not be read (see GetNodesFedBy()), or empty to update everything
+ */
+void Session::UpdateWaveformMipmaps(const set<FlowGraphNode*>& skip)
 {
-	m_mainWindow->RenderWaveformTextures(cmdbuf, channels);
+	if(m_mainWindow)
+		m_mainWindow->UpdateWaveformMipmaps(skip);
+}
+
+/**
+	@brief Reports an error to the user
+
+	Shown as a popup in the GUI, or logged if we're running headless.
+ */
+void Session::ShowErrorPopup(const string& title, const string& msg)
+{
+	if(m_mainWindow)
+		m_mainWindow->ShowErrorPopup(title, msg);
+	else
+		LogError("%s: %s\n", title.c_str(), msg.c_str());
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -3321,3 +4657,25 @@ void Session::DestroyReferenceFilters()
 		delete it.second;
 	m_referenceFilters.clear();
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TriggerGroupDataLock
+
+TriggerGroupDataLock::TriggerGroupDataLock(Session& session)
+	: m_groups(session.GetTriggerGroups())
+{
+	for(auto group : m_groups)
+		m_locks.emplace_back(group->GetDataMutex());
+}
+
+/**
+	@brief Locks a subset of the session's trigger groups, e.g. from Session::GetTriggerGroupsFeeding()
+
+	The groups must be in the same order as Session::GetTriggerGroups(), so this can't deadlock against a full lock.
+ */
+TriggerGroupDataLock::TriggerGroupDataLock(const vector<shared_ptr<TriggerGroup>>& groups)
+	: m_groups(groups)
+{
+	for(auto group : m_groups)
+		m_locks.emplace_back(group->GetDataMutex());
+}
@@ -40,23 +40,83 @@ class WaveformArea;
 class DisplayedChannel;
 
 #include "../xptools/HzClock.h"
+#include "FilterGraphIndex.h"
+#include "FilterGraphProfiler.h"
 #include "HistoryManager.h"
 #include "PacketManager.h"
+#include "PollScheduler.h"
 #include "PreferenceManager.h"
+#include "ProfiledSharedMutex.h"
 #include "Marker.h"
 #include "TriggerGroup.h"
+#include "WaveformQueuePolicy.h"
 
 extern std::atomic<int64_t> g_lastWaveformRenderTime;
 
 class Session;
+class SessionSaveTask;
+class WaveformSaveJob;
+class WaveformRecorder;
+
+/**
+	@brief An acquisition which has been processed by the waveform thread, waiting to be added to history
+
+	The waveforms are snapshotted into a history point as soon as they're downloaded, so the waveform thread can go on
+	to the next acquisition (which detaches them from the channels) before the GUI has caught up.
+ */
+class PendingAcquisition
+{
+public:
+	PendingAcquisition()
+	: m_tAcquired(0)
+	{}
+
+	///@brief Snapshot of the acquired waveforms (owns them until it's added to history)
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief Time the most recent waveform in the acquisition finished downloading from the instrument
+	double m_tAcquired;
+
+	///@brief Trigger groups which contributed to the acquisition
+	std::set<std::shared_ptr<TriggerGroup>> m_groups;
+
+	///@brief Instrument channels whose waveform data actually changed in this acquisition
+	std::set<FlowGraphNode*> m_changedChannels;
+};
+
+/**
+	@brief Cached downstream influence cone of a set of filter graph nodes
+
+	Only valid for the filter graph topology it was computed from; see Session::GetDownstreamNodes().
+ */
+class FilterCone
+{
+public:
+	FilterCone()
+	: m_shared(false)
+	{}
+
+	///@brief Nodes driven by some other trigger group, which the cone was checked for overlap with
+	std::set<FlowGraphNode*> m_otherSources;
+
+	///@brief The source nodes plus everything downstream of them
+	std::set<FlowGraphNode*> m_nodes;
+
+	///@brief True if any node in the cone is also downstream of m_otherSources
+	bool m_shared;
+};
 
 class InstrumentConnectionState
 {
 public:
-	InstrumentConnectionState(InstrumentThreadArgs args)
+	InstrumentConnectionState(InstrumentThreadArgs args, const std::string& pollPreferences)
+	: m_pollPreferences(pollPreferences)
 	{
 		m_shuttingDown = false;
 		args.shuttingDown = &m_shuttingDown;
+		args.wakeEvent = &m_wakeEvent;
+		args.pollScheduler = &m_pollScheduler;
+		args.queuePolicy = &m_queuePolicy;
 		m_thread = std::make_unique<std::thread>(InstrumentThread, args);
 	}
 
@@ -69,6 +129,7 @@ public:
 		{
 			//Terminate the thread
 			m_shuttingDown = true;
+			m_wakeEvent.Signal();
 			m_thread->join();
 		}
 		m_thread = nullptr;
@@ -77,10 +138,146 @@ public:
 	///@brief Termination flag for shutting down the polling thread
 	std::atomic<bool> m_shuttingDown;
 
+	///@brief Signaled to wake the polling thread early (trigger armed, queue drained, shutting down, etc)
+	Event m_wakeEvent;
+
+	///@brief Decides how often the polling thread polls the instrument
+	PollScheduler m_pollScheduler;
+
+	///@brief Preference category holding the polling limits for this type of instrument
+	std::string m_pollPreferences;
+
+	///@brief Limits on the pending waveform queue (only used for oscilloscopes)
+	WaveformQueuePolicy m_queuePolicy;
+
 	///@brief Thread for polling the instrument
 	std::unique_ptr<std::thread> m_thread;
 };
 
+/**
+	@brief A single waveform stream queued for decoding while loading a session
+ */
+class WaveformLoadJob
+{
+public:
+	WaveformLoadJob(
+		OscilloscopeChannel* chan,
+		size_t stream,
+		WaveformBase* cap,
+		const std::string& format,
+		const std::string& fname)
+	: m_chan(chan)
+	, m_stream(stream)
+	, m_cap(cap)
+	, m_format(format)
+	, m_fname(fname)
+	{}
+
+	///@brief The channel the waveform will be attached to
+	OscilloscopeChannel* m_chan;
+
+	///@brief Stream index within m_chan
+	size_t m_stream;
+
+	///@brief The waveform being loaded (may be replaced during loading if the format requires conversion)
+	WaveformBase* m_cap;
+
+	///@brief File format ID
+	std::string m_format;
+
+	///@brief Path to the sample data file
+	std::string m_fname;
+};
+
+/**
+	@brief A history point parsed from session metadata, waiting for its waveforms to be loaded
+ */
+class PendingHistoryPoint
+{
+public:
+	PendingHistoryPoint()
+	: m_time(0, 0)
+	, m_pinned(false)
+	, m_leaveOnDisk(false)
+	, m_firstJob(0)
+	, m_numJobs(0)
+	{}
+
+	///@brief Timestamp of the point
+	TimePoint m_time;
+
+	///@brief True if the point is pinned
+	bool m_pinned;
+
+	///@brief Nickname of the point
+	std::string m_label;
+
+	///@brief Location and metadata of each waveform in the point
+	SpilledWaveformHistory m_waveforms;
+
+	///@brief True to leave the waveforms on disk until the point is selected (lazy loading), rather than loading now
+	bool m_leaveOnDisk;
+
+	///@brief Index of the first WaveformLoadJob belonging to this point (if it's being loaded now)
+	size_t m_firstJob;
+
+	///@brief Number of WaveformLoadJobs belonging to this point (if it's being loaded now)
+	size_t m_numJobs;
+};
+
+/**
+	@brief Waveform data for a single scope, parsed from session metadata and waiting to be loaded
+ */
+class PendingScopeLoad
+{
+public:
+	///@brief The scope the waveforms belong to
+	std::shared_ptr<Oscilloscope> m_scope;
+
+	///@brief History points, in the order they should be added to history
+	std::vector<PendingHistoryPoint> m_points;
+
+	///@brief Waveforms being decoded now (with lazy loading, all other points stay on disk until selected)
+	std::vector<WaveformLoadJob> m_jobs;
+};
+
+/**
+	@brief Waveform data from a saved session which is being decoded in the background
+
+	Everything which touches the session itself (channels, history, filters) happens in the GUI thread, before and
+	after the decoding. The background thread only fills in waveform objects nobody else can see yet.
+ */
+class PendingWaveformLoad
+{
+public:
+	PendingWaveformLoad()
+	: m_refreshPerPoint(false)
+	, m_tstart(0)
+	, m_done(false)
+	{}
+
+	///@brief Waveforms to be attached to filters
+	std::vector<WaveformLoadJob> m_filterJobs;
+
+	///@brief Waveforms to be added to history, for each scope
+	std::vector<PendingScopeLoad> m_scopes;
+
+	///@brief True to evaluate the filter graph after every history point is loaded
+	bool m_refreshPerPoint;
+
+	///@brief Root node of the session file (the rest of it is loaded once the waveforms are done)
+	YAML::Node m_node;
+
+	///@brief Time the load was started
+	double m_tstart;
+
+	///@brief Thread decoding the waveforms
+	std::unique_ptr<std::thread> m_thread;
+
+	///@brief Set by the decoding thread once it's done
+	std::atomic<bool> m_done;
+};
+
 /**
 	@brief A Session stores all of the instrument configuration and other state the user has open.
 
@@ -95,35 +292,87 @@ public:
 
 	void ArmTrigger(TriggerGroup::TriggerType type, bool all=false);
 	void StopTrigger(bool all=false);
+	void WakeInstrument(std::shared_ptr<Instrument> inst);
 	bool HasOnlineScopes();
 	void DownloadWaveforms();
+	void DownloadWaveforms(std::shared_ptr<TriggerGroup> group, PendingAcquisition& acq);
+	void CommitAcquisition();
+	void CommitAcquisition(PendingAcquisition& acq);
+	bool IsPipelineFull();
+	void ApplyAcquisitionPreferences();
+
+	///@brief Makes the next frame re-apply acquisition preferences, since instruments or trigger groups changed
+	void MarkAcquisitionPreferencesDirty()
+	{ m_acquisitionPreferencesDirty = true; }
+
 	bool CheckForWaveforms(vk::raii::CommandBuffer& cmdbuf);
 	void RefreshAllFilters();
 	void RefreshAllFiltersNonblocking();
+	void RefreshTriggerGroupFilters(
+		std::shared_ptr<TriggerGroup> group,
+		FilterGraphExecutor& executor,
+		const std::set<FlowGraphNode*>& changedChannels);
 	void RefreshDirtyFiltersNonblocking();
 	bool RefreshDirtyFilters();
 	void FlushConfigCache();
 
 	void MarkChannelDirty(InstrumentChannel* chan);
+	void OnFilterGraphChanged();
+	std::vector<FlowGraphNode*> GetFilterCriticalPath(double& length, double& total);
 
 	void RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
-		std::vector<std::shared_ptr<DisplayedChannel> >& channels);
+		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
+		const std::set<FlowGraphNode*>& skip);
+	void UpdateWaveformMipmaps(const std::set<FlowGraphNode*>& skip);
 
 	void Clear();
 	void ClearBackgroundThreads();
 
 	bool PreLoadFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
 	bool LoadFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
+	bool StartLoadFromYaml(const YAML::Node& node, const std::string& dataDir, bool online);
+	bool FinishLoadFromYaml();
+
+	///@brief Returns true if a session load has been started, but FinishLoadFromYaml() has not yet been called
+	bool IsLoadInProgress()
+	{ return m_pendingLoad != nullptr; }
+
+	///@brief Returns true if the waveforms for a session load are done decoding, and it's ready to be finished
+	bool IsWaveformLoadDone()
+	{ return m_pendingLoad && m_pendingLoad->m_done; }
+
 	YAML::Node SerializeInstrumentConfiguration();
 	YAML::Node SerializeMetadata();
 	YAML::Node SerializeTriggerGroups();
 	bool LoadTriggerGroups(const YAML::Node& node);
 	YAML::Node SerializeFilterConfiguration();
 	YAML::Node SerializeMarkers();
-	bool SerializeWaveforms(const std::string& dataDir);
+	std::shared_ptr<SessionSaveTask> CreateSaveTask(
+		const YAML::Node& node,
+		const std::string& sessionPath,
+		const std::string& dataDir,
+		const std::string& stagingDir);
+	void CreateSaveJobs(
+		std::shared_ptr<HistoryPoint> hpoint,
+		size_t numwfm,
+		std::vector<WaveformSaveJob>& jobs,
+		std::map<std::shared_ptr<Oscilloscope>, YAML::Node>& metadata);
+	std::string GetScopeMetadataFileName(std::shared_ptr<Oscilloscope> scope);
+	bool SerializeFilterWaveforms(const std::string& dataDir);
+	bool StartRecording(const std::string& dataDir);
+	void StopRecording();
+
+	///@brief Returns true if every acquired waveform is being recorded to disk
+	bool IsRecording()
+	{ return m_recorder != nullptr; }
+
+	///@brief Returns the active recorder, if any
+	std::shared_ptr<WaveformRecorder> GetRecorder()
+	{ return m_recorder; }
 	bool SerializeSparseWaveform(SparseWaveformBase* wfm, const std::string& path);
 	bool SerializeUniformWaveform(UniformWaveformBase* wfm, const std::string& path);
+	WaveformBase* LoadWaveformFromFile(WaveformBase* cap, const std::string& format, const std::string& fname);
 
 	void AddMultimeterDialog(std::shared_ptr<SCPIMultimeter> meter);
 	std::shared_ptr<PacketManager> AddPacketFilter(PacketDecoder* filter);
@@ -175,6 +424,77 @@ public:
 	int64_t GetFilterGraphExecTime()
 	{ return m_lastFilterGraphExecTime.load(); }
 
+	/**
+		@brief Gets the number of nodes run by the most recent trigger group refresh
+	 */
+	size_t GetLastFilterConeSize()
+	{ return m_lastFilterConeSize.load(); }
+
+	/**
+		@brief Gets the total number of nodes in the filter graph as of the most recent trigger group refresh
+	 */
+	size_t GetLastFilterGraphSize()
+	{ return m_lastFilterGraphSize.load(); }
+
+	/**
+		@brief Gets the per-filter execution profiler
+	 */
+	FilterGraphProfiler& GetFilterProfiler()
+	{ return m_filterProfiler; }
+
+	/**
+		@brief Gets the time spent finding the nodes to update in the most recent dirty filter refresh
+	 */
+	int64_t GetDirtyConeTime()
+	{ return m_lastDirtyConeTime.load(); }
+
+	/**
+		@brief Gets the number of trigger group refreshes which reused a cached influence cone
+	 */
+	int64_t GetFilterConeCacheHits()
+	{ return m_filterConeHits.load(); }
+
+	/**
+		@brief Gets the number of trigger group refreshes which had to compute their influence cone from scratch
+	 */
+	int64_t GetFilterConeCacheMisses()
+	{ return m_filterConeMisses.load(); }
+
+	/**
+		@brief Records whether rasterizing a waveform was skipped because nothing had changed since the last time
+	 */
+	void OnRasterizeCacheLookup(bool hit)
+	{
+		if(hit)
+			m_rasterizeCacheHits ++;
+		else
+			m_rasterizeCacheMisses ++;
+	}
+
+	/**
+		@brief Gets the number of waveform rasterizations skipped because the previous output was still valid
+	 */
+	int64_t GetRasterizeCacheHits()
+	{ return m_rasterizeCacheHits.load(); }
+
+	/**
+		@brief Gets the number of waveform rasterizations actually performed
+	 */
+	int64_t GetRasterizeCacheMisses()
+	{ return m_rasterizeCacheMisses.load(); }
+
+	/**
+		@brief Gets the number of waveform streams decoded so far while loading a session
+	 */
+	size_t GetWaveformLoadDone()
+	{ return m_waveformLoadDone.load(); }
+
+	/**
+		@brief Gets the total number of waveform streams to be decoded while loading a session
+	 */
+	size_t GetWaveformLoadTotal()
+	{ return m_waveformLoadTotal.load(); }
+
 	/**
 		@brief Gets the last run time of the waveform rendering shaders
 	 */
@@ -190,6 +510,25 @@ public:
 		return m_waveformDownloadRate.GetAverageHz();
 	}
 
+	/**
+		@brief Gets the average rate at which the waveform thread is waking up, in Hz
+	 */
+	double GetWaveformThreadWakeupRate()
+	{
+		std::lock_guard<std::mutex> lock(m_perfClockMutex);
+		return m_waveformThreadWakeupRate.GetAverageHz();
+	}
+
+	/**
+		@brief Gets the time from the most recent waveform being downloaded to it reaching the display, in fs
+	 */
+	int64_t GetDisplayLatency()
+	{ return m_displayLatency.load(); }
+
+	void OnWaveformAcquired();
+	void OnWaveformThreadWakeup();
+	std::shared_ptr<InstrumentConnectionState> GetInstrumentConnectionState(std::shared_ptr<Instrument> inst);
+
 	/**
 		@brief Get the set of scopes we're currently connected to
 	 */
@@ -225,13 +564,20 @@ public:
 		@brief Check if we have data available from all of our scopes
 	 */
 	bool CheckForPendingWaveforms();
+	bool CheckForPendingWaveforms(std::shared_ptr<TriggerGroup> group);
 
 	/**
-		@brief Get the mutex controlling access to waveform data
+		@brief Get the mutex controlling access to instrument waveform data
 	 */
-	std::shared_mutex& GetWaveformDataMutex()
+	ProfiledSharedMutex& GetWaveformDataMutex()
 	{ return m_waveformDataMutex; }
 
+	/**
+		@brief Get the mutex controlling access to filter outputs
+	 */
+	ProfiledSharedMutex& GetFilterDataMutex()
+	{ return m_filterDataMutex; }
+
 	/**
 		@brief Get our history manager
 	 */
@@ -275,6 +621,8 @@ public:
 	}
 
 	void GarbageCollectTriggerGroups();
+	std::vector<std::shared_ptr<TriggerGroup> > GetTriggerGroupsFeeding(const std::set<FlowGraphNode*>& nodes);
+	std::set<FlowGraphNode*> GetNodesFedBy(const std::vector<std::shared_ptr<TriggerGroup> >& busy);
 
 	void MakeNewTriggerGroup(std::shared_ptr<Oscilloscope> scope);
 	void MakeNewTriggerGroup(PausableFilter* filter);
@@ -310,6 +658,16 @@ public:
 
 protected:
 	void UpdatePacketManagers(const std::set<FlowGraphNode*>& nodes);
+	void DownloadTriggerGroup(std::shared_ptr<TriggerGroup> group, std::set<std::shared_ptr<Oscilloscope>>& scopes);
+	void SnapshotAcquisition(PendingAcquisition& acq, const std::set<std::shared_ptr<Oscilloscope>>& scopes);
+	FilterCone GetDownstreamNodes(const std::set<FlowGraphNode*>& sources, const std::set<FlowGraphNode*>& otherSources);
+	FilterCone GetTriggerGroupCone(
+		std::shared_ptr<TriggerGroup> group,
+		const std::vector<std::shared_ptr<TriggerGroup> >& groups);
+	void UpdateGraphNodes();
+	void UpdateFilterGraphIndex();
+	void RunFilters(FilterGraphExecutor& executor, const std::set<FlowGraphNode*>& nodes);
+	std::set<FlowGraphNode*> GetConsumersOf(const std::set<FlowGraphNode*>& sources);
 
 	bool LoadInstruments(int version, const YAML::Node& node, bool online);
 	bool PreLoadInstruments(int version, const YAML::Node& node, bool online);
@@ -327,21 +685,24 @@ protected:
 	bool PreLoadMisc(int version, const YAML::Node& node, bool online);
 	bool LoadFilters(int version, const YAML::Node& node);
 	bool LoadInstrumentInputs(int version, const YAML::Node& node);
-	bool LoadWaveformData(int version, const std::string& dataDir);
-	bool LoadWaveformDataForScope(
+	bool StartWaveformDataLoad(int version, const std::string& dataDir);
+	void ParseWaveformDataForScope(
 		int version,
 		const YAML::Node& node,
-		std::shared_ptr<Oscilloscope> scope,
-		const std::string& dataDir);
-	bool LoadWaveformDataForFilters(
+		const std::string& dataDir,
+		bool lazy,
+		PendingScopeLoad& load);
+	void CommitWaveformDataForScope(PendingScopeLoad& load, bool refreshPerPoint);
+	void ParseWaveformDataForFilters(
 		int version,
 		const YAML::Node& node,
-		const std::string& dataDir);
-	void DoLoadWaveformDataForStream(
-		OscilloscopeChannel* chan,
-		int stream,
-		std::string format,
-		std::string fname);
+		const std::string& dataDir,
+		std::vector<WaveformLoadJob>& jobs);
+	void WaveformLoadThread(PendingWaveformLoad* load);
+	void DiscardPendingLoad();
+	void LoadWaveformsInParallel(std::vector<WaveformLoadJob>& jobs);
+	bool HasHistoryDependentFilters();
+	void ShowErrorPopup(const std::string& title, const std::string& msg);
 
 	///@brief Version of the file being loaded
 	int m_fileLoadVersion;
@@ -355,8 +716,22 @@ protected:
 	///@brief Mutex for controlling access to scope vectors
 	std::mutex m_scopeMutex;
 
-	///@brief Mutex for controlling access to waveform data
-	std::shared_mutex m_waveformDataMutex;
+	/**
+		@brief Mutex for controlling access to instrument waveform data
+
+		Held exclusively while downloading new waveforms into instrument channels, and shared by anything reading them
+		(including filters). If both this and m_filterDataMutex are needed, this one must be locked first.
+	 */
+	ProfiledSharedMutex m_waveformDataMutex;
+
+	/**
+		@brief Mutex for controlling access to filter outputs and state
+
+		Held exclusively while running the filter graph or clearing filter state, and shared by anything reading
+		filter outputs. Kept separate from m_waveformDataMutex so that refreshing filters which don't depend on any
+		oscilloscope (e.g. ones fed by a multimeter) doesn't stall waveform downloads, and vice versa.
+	 */
+	ProfiledSharedMutex m_filterDataMutex;
 
 	///@brief Mutex for controlling access to filter graph
 	std::mutex m_filterUpdatingMutex;
@@ -400,14 +775,23 @@ protected:
 	///@brief Processing thread for waveform data
 	std::unique_ptr<std::thread> m_waveformThread;
 
-	///@brief Scopes whose data is currently being processed for history
-	std::set<std::shared_ptr<Oscilloscope> > m_recentlyTriggeredScopes;
+	///@brief Acquisition currently being processed by the waveform thread (only accessed from that thread)
+	PendingAcquisition m_currentAcquisition;
+
+	///@brief Acquisitions the waveform thread has finished processing, waiting for the GUI to add them to history
+	std::list<PendingAcquisition> m_pendingAcquisitions;
+
+	///@brief Mutex to synchronize access to m_pendingAcquisitions
+	std::mutex m_pendingAcquisitionMutex;
 
-	///@brief Groups whose data is currently being processed
-	std::set<std::shared_ptr<TriggerGroup>> m_recentlyTriggeredGroups;
+	///@brief Maximum number of acquisitions the waveform thread may have finished ahead of the GUI
+	std::atomic<size_t> m_pipelineDepth;
 
-	///@brief Mutex to synchronize access to m_recentlyTriggeredScopes
-	std::mutex m_recentlyTriggeredScopeMutex;
+	///@brief Set when instruments or trigger groups change, so acquisition preferences have to be applied again
+	std::atomic<bool> m_acquisitionPreferencesDirty;
+
+	///@brief Preference change count as of the last time acquisition preferences were applied
+	uint64_t m_acquisitionPreferencesVersion;
 
 	///@brief Time we last armed the global trigger
 	double m_tArm;
@@ -427,15 +811,102 @@ protected:
 	///@brief Time spent on the last filter graph execution
 	std::atomic<int64_t> m_lastFilterGraphExecTime;
 
+	///@brief Incremented every time a filter input is changed, so cached graph traversals can tell they're stale
+	std::atomic<uint64_t> m_filterGraphVersion;
+
+	///@brief Mutex controlling access to the cached set of graph nodes
+	std::mutex m_graphNodesMutex;
+
+	///@brief Cached set of all graph nodes (filters plus instrument channels)
+	std::set<FlowGraphNode*> m_graphNodes;
+
+	///@brief True if m_graphNodes has been built at least once
+	bool m_graphNodesValid;
+
+	///@brief Value of m_filterGraphVersion when m_graphNodes was last rebuilt
+	uint64_t m_graphNodesVersion;
+
+	///@brief Number of live filters when m_graphNodes was last rebuilt (catches filters deleted by a Release() call)
+	size_t m_graphNodesFilterCount;
+
+	///@brief Incremented every time m_graphNodes is rebuilt
+	uint64_t m_graphNodesGeneration;
+
+	///@brief Mutex controlling access to the filter graph index and influence cone cache
+	std::mutex m_filterGraphIndexMutex;
+
+	///@brief Value of m_graphNodesGeneration when the index was last rebuilt
+	uint64_t m_filterGraphIndexGeneration;
+
+	///@brief Set of all graph nodes when the index was last rebuilt
+	std::set<FlowGraphNode*> m_filterGraphIndexNodes;
+
+	///@brief All graph nodes when the index was last rebuilt, sorted so each comes after its inputs
+	std::vector<FlowGraphNode*> m_filterGraphOrder;
+
+	///@brief Reverse edges of the filter graph: every node which has a given node as one of its inputs
+	FilterGraphIndex<FlowGraphNode> m_filterGraphConsumers;
+
+	///@brief Cached influence cones, indexed by source node set
+	std::map<std::set<FlowGraphNode*>, FilterCone> m_filterCones;
+
+	///@brief Number of trigger group refreshes which reused a cached cone
+	std::atomic<int64_t> m_filterConeHits;
+
+	///@brief Number of trigger group refreshes which had to compute their cone
+	std::atomic<int64_t> m_filterConeMisses;
+
+	///@brief Number of nodes run by the last trigger group refresh
+	std::atomic<size_t> m_lastFilterConeSize;
+
+	///@brief Total number of graph nodes as of the last trigger group refresh
+	std::atomic<size_t> m_lastFilterGraphSize;
+
+	///@brief Time spent finding the downstream cone of dirty channels in the last RefreshDirtyFilters() call
+	std::atomic<int64_t> m_lastDirtyConeTime;
+
+	///@brief Number of waveform rasterizations skipped since nothing had changed
+	std::atomic<int64_t> m_rasterizeCacheHits;
+
+	///@brief Number of waveform rasterizations performed
+	std::atomic<int64_t> m_rasterizeCacheMisses;
+
+	///@brief Per-filter execution statistics
+	FilterGraphProfiler m_filterProfiler;
+
+	///@brief Number of waveform streams decoded so far during the current session load
+	std::atomic<size_t> m_waveformLoadDone;
+
+	///@brief Total number of waveform streams queued for decoding during the current session load
+	std::atomic<size_t> m_waveformLoadTotal;
+
+	///@brief Session load waiting for its waveforms to be decoded (null if not loading)
+	std::unique_ptr<PendingWaveformLoad> m_pendingLoad;
+
 	///@brief Mutex for controlling access to performance counters
 	std::mutex m_perfClockMutex;
 
 	///@brief Frequency at which we are pulling waveforms off of scopes
 	HzClock m_waveformDownloadRate;
 
+	///@brief Frequency at which the waveform thread wakes up to look for work
+	HzClock m_waveformThreadWakeupRate;
+
+	///@brief Time the most recent waveform finished downloading from an instrument
+	std::atomic<double> m_tLastAcquired;
+
+	///@brief Time from the most recent waveform being downloaded to it reaching the display, in fs
+	std::atomic<int64_t> m_displayLatency;
+
 	///@brief Historical waveform data
 	HistoryManager m_history;
 
+	///@brief Records every acquired waveform to disk, if active
+	std::shared_ptr<WaveformRecorder> m_recorder;
+
+	///@brief True if the recorder's queue was full, so we're holding off on releasing the waveform thread
+	std::atomic<bool> m_waveformThreadHeld;
+
 	///@brief Mutex for controlling access to m_packetmgrs
 	std::mutex m_packetMgrMutex;
 
@@ -527,4 +998,25 @@ protected:
 	std::map<std::string, Filter*> m_referenceFilters;
 };
 
+/**
+	@brief Shared lock on the data of every trigger group in a session
+
+	Trigger groups process their acquisitions holding the session's waveform and filter data mutexes shared, and their
+	own data mutex exclusively. Anything reading waveforms which might belong to any group needs to hold this (after
+	the session-wide mutexes) as well. Readers which know which nodes they need can lock just the groups feeding them.
+ */
+class TriggerGroupDataLock
+{
+public:
+	TriggerGroupDataLock(Session& session);
+	TriggerGroupDataLock(const std::vector<std::shared_ptr<TriggerGroup> >& groups);
+
+protected:
+	///@brief The groups we've locked (kept alive until we unlock them)
+	std::vector<std::shared_ptr<TriggerGroup>> m_groups;
+
+	///@brief Our locks on each group
+	std::vector<std::shared_lock<ProfiledSharedMutex>> m_locks;
+};
+
 #endif
@@ -0,0 +1,441 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SessionSaveTask
+ */
+#include "ngscopeclient.h"
+#include "SessionSaveTask.h"
+#include "Session.h"
+#include "pthread_compat.h"
+
+#include <fstream>
+#include <filesystem>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a save task
+
+	The caller is responsible for filling out the jobs and metadata, then calling Start().
+
+	@param session		The session being saved
+	@param node			Top level YAML for the .scopesession file
+	@param sessionPath	Path to the .scopesession file
+	@param dataDir		Path to the _data directory of the session
+	@param stagingDir	Path to a temporary directory to write waveforms into (must already exist)
+ */
+SessionSaveTask::SessionSaveTask(
+	Session& session,
+	const YAML::Node& node,
+	const string& sessionPath,
+	const string& dataDir,
+	const string& stagingDir)
+	: m_session(session)
+	, m_node(node)
+	, m_sessionPath(sessionPath)
+	, m_dataDir(dataDir)
+	, m_stagingDir(stagingDir)
+	, m_cancel(false)
+	, m_done(false)
+	, m_jobsDone(0)
+	, m_ok(false)
+{
+}
+
+SessionSaveTask::~SessionSaveTask()
+{
+	Cancel();
+	Wait();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Thread control
+
+/**
+	@brief Starts saving in the background
+ */
+void SessionSaveTask::Start()
+{
+	m_thread = make_unique<thread>(&SessionSaveTask::Run, this);
+}
+
+/**
+	@brief Blocks until the background thread has finished
+ */
+void SessionSaveTask::Wait()
+{
+	if(m_thread)
+	{
+		m_thread->join();
+		m_thread = nullptr;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Saving
+
+/**
+	@brief Thread function: writes all of the waveforms and metadata to the staging directory
+ */
+void SessionSaveTask::Run()
+{
+	pthread_setname_np_compat("SaveThread");
+
+	double tstart = GetTime();
+
+	//Each worker grabs the next pending job until there's nothing left
+	atomic<size_t> nextJob(0);
+	atomic<bool> failed(false);
+	auto worker = [&]()
+	{
+		while(!m_cancel && !failed)
+		{
+			size_t i = nextJob ++;
+			if(i >= m_jobs.size())
+				break;
+
+			auto& job = m_jobs[i];
+			if(!job.Write(m_session, m_stagingDir + "/" + job.m_relpath))
+				failed = true;
+			m_jobsDone ++;
+		}
+	};
+
+	//Spawn one thread per core (minus one, since this thread does work too)
+	size_t nthreads = max(1u, thread::hardware_concurrency());
+	nthreads = min(nthreads, m_jobs.size());
+	vector<thread> threads;
+	for(size_t i=1; i<nthreads; i++)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+
+	if(failed)
+		m_error = "Failed to write waveform data to " + m_stagingDir;
+
+	//Add per-stream metadata and write the scope metadata files
+	if(!m_cancel && !failed)
+	{
+		for(auto& job : m_jobs)
+		{
+			if(!job.m_written)
+				continue;
+
+			m_metadataNodes[job.m_scope]["waveforms"][job.m_wfmKey]["channels"][job.m_chanKey] = job.GetMetadata();
+		}
+
+		for(auto it : m_metadataFiles)
+		{
+			ofstream outfs(m_stagingDir + "/" + it.second);
+			outfs << m_metadataNodes[it.first];
+			outfs.close();
+			if(!outfs)
+			{
+				m_error = "Failed to write " + it.second;
+				failed = true;
+				break;
+			}
+		}
+	}
+
+	//Write the session file last, to a temporary name so we don't clobber the old one until we commit
+	if(!m_cancel && !failed)
+	{
+		ofstream outfs(m_sessionPath + ".tmp");
+		outfs << m_node;
+		outfs.close();
+		if(!outfs)
+		{
+			m_error = "Failed to write session file \"" + m_sessionPath + "\"";
+			failed = true;
+		}
+	}
+
+	m_ok = !m_cancel && !failed;
+	LogTrace("Background save of %zu waveforms %s in %.2f ms\n",
+		m_jobs.size(), m_ok ? "finished" : "aborted", (GetTime() - tstart) * 1000);
+
+	m_done = true;
+}
+
+/**
+	@brief Makes a file available at a second path, without copying the data if possible
+
+	A hard link is created if the filesystem supports it, otherwise the file is copied.
+
+	@return True on success, false on error
+ */
+static bool LinkOrCopyFile(const string& from, const string& to)
+{
+	error_code ec;
+	filesystem::create_hard_link(from, to, ec);
+	if(!ec)
+		return true;
+
+	filesystem::copy_file(from, to, filesystem::copy_options::overwrite_existing, ec);
+	return !ec;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WaveformSaveJob
+
+/**
+	@brief Saves a single waveform (runs in a worker thread)
+
+	@param session	The session the waveform belongs to
+	@param datapath	Path to the output file
+
+	@return True on success, false on error
+ */
+bool WaveformSaveJob::Write(Session& session, const string& datapath)
+{
+	//Don't let the GUI thread compress, spill, or page in the point while we're reading it
+	auto& point = *m_point;
+	lock_guard<recursive_mutex> lock(point.m_mutex);
+
+	//Make the directory for the waveform if needed
+	error_code ec;
+	filesystem::create_directories(filesystem::path(datapath).parent_path(), ec);
+
+	//If the waveform is already in a file in the right format (because it was saved previously, or paged out to disk),
+	//just link to that rather than writing it all out again.
+	//(use find() rather than operator[] everywhere, the maps must not be modified from this thread)
+	for(auto pmap : {&point.m_saved, &point.m_spilled})
+	{
+		auto spit = pmap->find(m_scope);
+		if(spit == pmap->end())
+			continue;
+		auto sit = spit->second.find(m_stream);
+		if(sit == spit->second.end())
+			continue;
+
+		//If this fails (e.g. the previously saved copy was deleted), fall back to something else
+		auto& sw = sit->second;
+		if(!LinkOrCopyFile(sw.m_path, datapath))
+		{
+			LogWarning("Failed to link or copy waveform %s, saving from memory instead\n", sw.m_path.c_str());
+			continue;
+		}
+
+		m_record = sw;
+		m_sourcePath = sw.m_path;
+		m_written = true;
+		return true;
+	}
+
+	//Nope, we have to write it from memory.
+	//Buffers were made accessible to the CPU by Session::CreateSaveJobs() on the GUI thread, don't touch them here.
+	//Compressed waveforms have to be temporarily expanded to save them
+	WaveformBase* data = nullptr;
+	auto hit = point.m_history.find(m_scope);
+	if(hit != point.m_history.end())
+	{
+		auto wit = hit->second.find(m_stream);
+		if(wit != hit->second.end())
+			data = wit->second;
+	}
+	unique_ptr<WaveformBase> expanded;
+	auto cit = point.m_compressed.find(m_scope);
+	if( (cit != point.m_compressed.end()) && (cit->second.find(m_stream) != cit->second.end()) )
+	{
+		expanded.reset(cit->second.find(m_stream)->second->Decompress());
+		data = expanded.get();
+	}
+	if(data == nullptr)
+		return true;
+
+	auto& rec = m_record;
+	rec.m_timescale = data->m_timescale;
+	rec.m_triggerPhase = data->m_triggerPhase;
+	rec.m_flags = data->m_flags;
+	rec.m_startTimestamp = data->m_startTimestamp;
+	rec.m_startFemtoseconds = data->m_startFemtoseconds;
+	rec.m_memoryUsage = HistoryPoint::GetWaveformMemoryUsage(data);
+
+	//Save the actual waveform data
+	auto sparse = dynamic_cast<SparseWaveformBase*>(data);
+	auto uniform = dynamic_cast<UniformWaveformBase*>(data);
+	bool ok;
+	if(sparse)
+	{
+		//Save type if it's a protocol waveform
+		//so if we do an offline load, we know what type of waveform to make
+		if(dynamic_cast<SparseAnalogWaveform*>(sparse) != nullptr)
+			rec.m_datatype = "analog";
+		else if(dynamic_cast<SparseDigitalWaveform*>(sparse) != nullptr)
+			rec.m_datatype = "digital";
+		else if(dynamic_cast<CANWaveform*>(sparse) != nullptr)
+			rec.m_datatype = "can";
+
+		//Other protocol decodes don't have a file format yet. Leave this stream out rather than failing the whole save.
+		else
+		{
+			LogWarning("Skipping waveform for %s, saving this waveform type is not supported\n",
+				m_stream.GetName().c_str());
+			return true;
+		}
+
+		rec.m_format = "sparsev2";
+		ok = session.SerializeSparseWaveform(sparse, datapath);
+	}
+	else
+	{
+		rec.m_format = "densev1";
+		if(dynamic_cast<UniformAnalogWaveform*>(uniform) != nullptr)
+			rec.m_datatype = "analog";
+		else
+			rec.m_datatype = "digital";
+		ok = session.SerializeUniformWaveform(uniform, datapath);
+	}
+
+	m_written = ok;
+	return ok;
+}
+
+/**
+	@brief Gets the per-stream metadata for the saved waveform, as stored in the scope metadata file
+ */
+YAML::Node WaveformSaveJob::GetMetadata() const
+{
+	YAML::Node chnode;
+	chnode["index"] = m_chanIndex;
+	chnode["stream"] = m_stream.m_stream;
+	chnode["timescale"] = m_record.m_timescale;
+	chnode["trigphase"] = m_record.m_triggerPhase;
+	chnode["flags"] = (int)m_record.m_flags;
+	chnode["format"] = m_record.m_format;
+	if(m_record.m_format != "densev1")
+		chnode["datatype"] = m_record.m_datatype;
+	//don't serialize revision
+	return chnode;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Completion
+
+/**
+	@brief Replaces the previous copy of the session on disk with the newly saved one
+
+	Must be called from the GUI thread, after the background thread has finished successfully.
+
+	@return True on success, false on error (in which case the previous copy is left intact where possible)
+ */
+bool SessionSaveTask::Commit()
+{
+	if(!m_ok)
+	{
+		Discard();
+		return false;
+	}
+
+	//Move the old data directory out of the way (but keep it until we're done, lazily loaded points may need it)
+	error_code ec;
+	string olddir = m_dataDir + ".old";
+	filesystem::remove_all(olddir, ec);
+	bool hadOld = filesystem::exists(m_dataDir, ec);
+	if(hadOld)
+	{
+		filesystem::rename(m_dataDir, olddir, ec);
+		if(ec)
+		{
+			m_error = "Failed to replace data directory \"" + m_dataDir + "\"";
+			Discard();
+			return false;
+		}
+	}
+
+	//Put the new data and session file in place
+	filesystem::rename(m_stagingDir, m_dataDir, ec);
+	if(ec)
+	{
+		m_error = "Failed to replace data directory \"" + m_dataDir + "\"";
+		if(hadOld)
+			filesystem::rename(olddir, m_dataDir, ec);
+		Discard();
+		return false;
+	}
+	filesystem::rename(m_sessionPath + ".tmp", m_sessionPath, ec);
+	if(ec)
+	{
+		m_error = "Failed to replace session file \"" + m_sessionPath + "\"";
+
+		//Put the old data directory back so it still matches the old session file
+		error_code ec2;
+		filesystem::rename(m_dataDir, m_stagingDir, ec2);
+		if(hadOld)
+			filesystem::rename(olddir, m_dataDir, ec2);
+		Discard();
+		return false;
+	}
+
+	//Remember where everything was saved, so the next save doesn't have to write it again
+	for(auto& job : m_jobs)
+	{
+		if(!job.m_written)
+			continue;
+
+		auto& point = *job.m_point;
+		lock_guard<recursive_mutex> lock(point.m_mutex);
+
+		string path = m_dataDir + "/" + job.m_relpath;
+		job.m_record.m_path = path;
+		point.m_saved[job.m_scope][job.m_stream] = job.m_record;
+
+		//Point lazily loaded history at the new copies of the files, since the old ones are about to go away
+		auto spit = point.m_spilled.find(job.m_scope);
+		if(spit == point.m_spilled.end())
+			continue;
+		auto sit = spit->second.find(job.m_stream);
+		if( (sit != spit->second.end()) && (sit->second.m_path == job.m_sourcePath) && point.IsBackedBySession() )
+			sit->second.m_path = path;
+	}
+
+	//Done with the old copy
+	if(hadOld)
+		filesystem::remove_all(olddir, ec);
+
+	return true;
+}
+
+/**
+	@brief Deletes everything written by this task, leaving the previous copy of the session untouched
+ */
+void SessionSaveTask::Discard()
+{
+	error_code ec;
+	filesystem::remove_all(m_stagingDir, ec);
+	filesystem::remove(m_sessionPath + ".tmp", ec);
+}
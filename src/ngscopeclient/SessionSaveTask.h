@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SessionSaveTask
+ */
+#ifndef SessionSaveTask_h
+#define SessionSaveTask_h
+
+#include "HistoryManager.h"
+
+/**
+	@brief A single waveform stream from history, queued for saving
+ */
+class WaveformSaveJob
+{
+public:
+	WaveformSaveJob(
+		std::shared_ptr<HistoryPoint> point,
+		std::shared_ptr<Oscilloscope> scope,
+		StreamDescriptor stream,
+		const std::string& relpath,
+		const std::string& wfmKey,
+		const std::string& chanKey,
+		size_t chanIndex)
+	: m_point(point)
+	, m_scope(scope)
+	, m_stream(stream)
+	, m_relpath(relpath)
+	, m_wfmKey(wfmKey)
+	, m_chanKey(chanKey)
+	, m_chanIndex(chanIndex)
+	, m_written(false)
+	{}
+
+	bool Write(Session& session, const std::string& datapath);
+	YAML::Node GetMetadata() const;
+
+	///@brief The history point being saved (holding a reference keeps it alive even if it's evicted mid-save)
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief The instrument the waveform came from
+	std::shared_ptr<Oscilloscope> m_scope;
+
+	///@brief The stream being saved
+	StreamDescriptor m_stream;
+
+	///@brief Path to the output file, relative to the data directory
+	std::string m_relpath;
+
+	///@brief Key of the history point in the scope metadata
+	std::string m_wfmKey;
+
+	///@brief Key of the stream within the history point metadata
+	std::string m_chanKey;
+
+	///@brief Index of the channel within the instrument
+	size_t m_chanIndex;
+
+	///@brief True if waveform data was actually written (false if there was nothing to save)
+	bool m_written;
+
+	///@brief Format and metadata of the saved waveform (the path is only filled in once the save is committed)
+	SpilledWaveform m_record;
+
+	///@brief If the waveform was copied from an existing file rather than written from memory, path to that file
+	std::string m_sourcePath;
+};
+
+/**
+	@brief Saves waveform history to disk in the background
+
+	All waveforms are written into a staging directory. The staging directory only replaces the real data directory
+	(and the new .scopesession file only replaces the old one) once everything has been written successfully, so a
+	failed or canceled save leaves the previous copy of the session intact.
+ */
+class SessionSaveTask
+{
+public:
+	SessionSaveTask(
+		Session& session,
+		const YAML::Node& node,
+		const std::string& sessionPath,
+		const std::string& dataDir,
+		const std::string& stagingDir);
+	~SessionSaveTask();
+
+	void Start();
+	void Wait();
+	bool Commit();
+	void Discard();
+
+	///@brief Requests that the save be aborted
+	void Cancel()
+	{ m_cancel = true; }
+
+	///@brief Returns true if the save was canceled
+	bool IsCanceled()
+	{ return m_cancel; }
+
+	///@brief Returns true if the background thread has finished (successfully or not)
+	bool IsDone()
+	{ return m_done; }
+
+	///@brief Returns the fraction of waveforms saved so far
+	float GetProgress()
+	{
+		if(m_jobs.empty())
+			return 1;
+		return m_jobsDone * 1.0f / m_jobs.size();
+	}
+
+	///@brief Returns the number of waveforms saved so far
+	size_t GetJobsDone()
+	{ return m_jobsDone; }
+
+	///@brief Returns the total number of waveforms to be saved
+	size_t GetJobCount()
+	{ return m_jobs.size(); }
+
+	///@brief Returns a description of the error if the save failed
+	const std::string& GetError()
+	{ return m_error; }
+
+	///@brief Path to the .scopesession file being saved
+	const std::string& GetSessionPath()
+	{ return m_sessionPath; }
+
+	///@brief Path to the final data directory of the session
+	const std::string& GetDataDir()
+	{ return m_dataDir; }
+
+	///@brief Waveforms to be saved
+	std::vector<WaveformSaveJob> m_jobs;
+
+	///@brief Metadata nodes for each scope's history, not including per-stream metadata which is added as we go
+	std::map<std::shared_ptr<Oscilloscope>, YAML::Node> m_metadataNodes;
+
+	///@brief Scope metadata file names, relative to the data directory
+	std::map<std::shared_ptr<Oscilloscope>, std::string> m_metadataFiles;
+
+protected:
+	void Run();
+
+	///@brief The session being saved
+	Session& m_session;
+
+	///@brief Top level session YAML
+	YAML::Node m_node;
+
+	///@brief Path to the .scopesession file
+	std::string m_sessionPath;
+
+	///@brief Path to the final data directory
+	std::string m_dataDir;
+
+	///@brief Path to the staging directory we write into
+	std::string m_stagingDir;
+
+	///@brief The thread doing the save
+	std::unique_ptr<std::thread> m_thread;
+
+	///@brief Set to abort the save
+	std::atomic<bool> m_cancel;
+
+	///@brief Set when the background thread has finished
+	std::atomic<bool> m_done;
+
+	///@brief Number of jobs completed
+	std::atomic<size_t> m_jobsDone;
+
+	///@brief True if everything was written successfully
+	bool m_ok;
+
+	///@brief Description of the error, if the save failed
+	std::string m_error;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SparseWaveformHeader
+ */
+#ifndef SparseWaveformFormat_h
+#define SparseWaveformFormat_h
+
+/**
+	@brief File header for the "sparsev2" waveform file format
+
+	A sparsev2 file consists of this header, followed by three arrays:
+		int64 offset[count]
+		int64 duration[count]
+		sample[count]
+
+	Each array starts at the file offset given in the header, which is always a multiple of SPARSEV2_ALIGNMENT, so the
+	whole thing can be memory mapped and copied directly into waveform buffers with no per-sample processing.
+
+	All fields are little endian.
+ */
+#pragma pack(push, 1)
+class SparseWaveformHeader
+{
+public:
+
+	enum SampleType
+	{
+		///@brief IEEE754 32-bit float
+		SAMPLE_ANALOG	= 0,
+
+		///@brief 8-bit boolean
+		SAMPLE_DIGITAL	= 1,
+
+		///@brief CAN bus symbol (uint32 data, uint32 type)
+		SAMPLE_CAN		= 2
+	};
+
+	///@brief Magic number, always "sparsev2"
+	char m_magic[8];
+
+	///@brief Size of this header, in bytes
+	uint32_t m_headerSize;
+
+	///@brief Sample type (a SampleType)
+	uint32_t m_sampleType;
+
+	///@brief Size of a single sample, in bytes
+	uint32_t m_sampleSize;
+
+	///@brief Reserved for future use, must be zero
+	uint32_t m_flags;
+
+	///@brief Number of samples in the waveform
+	uint64_t m_count;
+
+	///@brief File offset of the offset array
+	uint64_t m_offsetsStart;
+
+	///@brief File offset of the duration array
+	uint64_t m_durationsStart;
+
+	///@brief File offset of the sample array
+	uint64_t m_samplesStart;
+};
+#pragma pack(pop)
+
+///@brief Alignment of each array within a sparsev2 file
+#define SPARSEV2_ALIGNMENT 64
+
+#endif
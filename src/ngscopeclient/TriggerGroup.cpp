@@ -41,6 +41,8 @@ TriggerGroup::TriggerGroup(shared_ptr<Oscilloscope> primary, Session* session)
 	, m_default(true)
 	, m_session(session)
 	, m_multiScopeFreeRun(false)
+	, m_dataMutex("Trigger group data")
+	, m_lastFilterGraphExecTime(0)
 {
 }
 
@@ -91,10 +93,15 @@ void TriggerGroup::AddSecondary(shared_ptr<Oscilloscope> scope)
 		m_primary->EnableTriggerOutput();
 
 	m_secondaries.push_back(scope);
+
+	//The new scope can no longer drop waveforms independently
+	m_session->MarkAcquisitionPreferencesDirty();
 }
 
 void TriggerGroup::RemoveScope(shared_ptr<Oscilloscope> scope)
 {
+	m_session->MarkAcquisitionPreferencesDirty();
+
 	if(m_primary == scope)
 	{
 		//If we have any secondaries, promote the first secondary to primary
@@ -154,7 +161,7 @@ void TriggerGroup::Arm(TriggerType type)
 	//In multi-scope mode, make sure all scopes are stopped with no pending waveforms
 	if(!m_secondaries.empty())
 	{
-		lock_guard<shared_mutex> lock(m_session->GetWaveformDataMutex());
+		lock_guard<ProfiledSharedMutex> lock(m_session->GetWaveformDataMutex());
 
 		for(auto scope : m_secondaries)
 		{
@@ -265,6 +272,33 @@ string TriggerGroup::GetDescription()
 		return "(empty)";
 }
 
+/**
+	@brief Returns the graph nodes which produce new data when this group triggers
+
+	This is every channel of every instrument in the group, plus the group's filters.
+ */
+set<FlowGraphNode*> TriggerGroup::GetSourceNodes()
+{
+	vector<shared_ptr<Oscilloscope>> scopes = m_secondaries;
+	if(m_primary)
+		scopes.push_back(m_primary);
+
+	set<FlowGraphNode*> nodes;
+	for(auto scope : scopes)
+	{
+		for(size_t i=0; i<scope->GetChannelCount(); i++)
+		{
+			auto chan = scope->GetChannel(i);
+			if(chan)
+				nodes.emplace(chan);
+		}
+	}
+	for(auto f : m_filters)
+		nodes.emplace(f);
+
+	return nodes;
+}
+
 /**
 	@brief Stop the trigger for the group
 
@@ -415,6 +449,48 @@ void TriggerGroup::DownloadWaveforms()
 	}
 }
 
+/**
+	@brief Discards the oldest waveforms from the primary's pending queue
+
+	Each popped waveform is left attached to the channels (so it's freed when the next one replaces it) and the last
+	one is freed explicitly, leaving the channels empty for DownloadWaveforms() to fill.
+
+	Must be called with the waveform data mutex held. Only single-scope groups are supported, since the queues of
+	multiple scopes would have to be kept in lock-step.
+
+	@param n	Number of waveforms to drop (at least one is always left in the queue)
+
+	@return Number of waveforms actually dropped
+ */
+size_t TriggerGroup::DropOldestWaveforms(size_t n)
+{
+	if(!m_secondaries.empty() || m_primary->IsAppendingToWaveform())
+		return 0;
+
+	size_t npending = m_primary->GetPendingWaveformCount();
+	if(npending < 2)
+		return 0;
+	n = min(n, npending - 1);
+	if(n == 0)
+		return 0;
+
+	DetachAllWaveforms(m_primary);
+	for(size_t i=0; i<n; i++)
+		m_primary->PopPendingWaveform();
+
+	for(size_t i=0; i<m_primary->GetChannelCount(); i++)
+	{
+		auto chan = m_primary->GetOscilloscopeChannel(i);
+		if(!chan)
+			continue;
+
+		for(size_t j=0; j<chan->GetStreamCount(); j++)
+			chan->SetData(nullptr, j);
+	}
+
+	return n;
+}
+
 void TriggerGroup::DetachAllWaveforms(shared_ptr<Oscilloscope> scope)
 {
 	//Detach old waveforms since they're now owned by history manager
@@ -36,6 +36,7 @@
 #define TriggerGroup_h
 
 #include "../../lib/scopehal/PausableFilter.h"
+#include "ProfiledSharedMutex.h"
 
 /**
 	@brief A trigger group is a set of oscilloscopes that all trigger in lock-step
@@ -76,6 +77,7 @@ public:
 	void Stop();
 	bool CheckForPendingWaveforms();
 	void DownloadWaveforms();
+	size_t DropOldestWaveforms(size_t n);
 	void RearmIfMultiScope();
 
 	bool empty()
@@ -94,6 +96,26 @@ public:
 
 	std::string GetDescription();
 
+	std::set<FlowGraphNode*> GetSourceNodes();
+
+	/**
+		@brief Get the mutex controlling access to this group's waveform data
+
+		This covers the channels of the group's instruments, plus any filters which only depend on this group. While
+		the group is processing an acquisition, it holds the session's waveform and filter data mutexes shared and
+		this one exclusively.
+	 */
+	ProfiledSharedMutex& GetDataMutex()
+	{ return m_dataMutex; }
+
+	///@brief Gets the time taken by the last run of the filters downstream of this group, in fs
+	int64_t GetFilterGraphExecTime()
+	{ return m_lastFilterGraphExecTime.load(); }
+
+	///@brief Sets the time taken by the last run of the filters downstream of this group, in fs
+	void SetFilterGraphExecTime(int64_t t)
+	{ m_lastFilterGraphExecTime = t; }
+
 	///@brief True if we should be activated when the start/stop toolbar button is clicked
 	bool m_default;
 
@@ -104,6 +126,12 @@ protected:
 
 	///@brief True if we have multiple scopes and are in normal trigger mode
 	bool m_multiScopeFreeRun;
+
+	///@brief Mutex controlling access to our waveform data
+	ProfiledSharedMutex m_dataMutex;
+
+	///@brief Time taken by the last run of the filters downstream of this group (groups can run concurrently)
+	std::atomic<int64_t> m_lastFilterGraphExecTime;
 };
 
 #endif
@@ -0,0 +1,116 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of TriggerGroupWorker
+ */
+#include "ngscopeclient.h"
+#include "pthread_compat.h"
+#include "TriggerGroupWorker.h"
+
+using namespace std;
+
+extern Event g_waveformThreadWakeEvent;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+TriggerGroupWorker::TriggerGroupWorker(Session* session, shared_ptr<TriggerGroup> group)
+	: m_session(session)
+	, m_group(group)
+	, m_shuttingDown(false)
+	, m_busy(false)
+	, m_done(false)
+{
+	m_thread = make_unique<thread>(&TriggerGroupWorker::Run, this);
+}
+
+TriggerGroupWorker::~TriggerGroupWorker()
+{
+	//Let any job in progress finish, then exit
+	m_shuttingDown = true;
+	m_startEvent.Signal();
+	m_thread->join();
+	m_thread = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Job control
+
+/**
+	@brief Starts processing the group's next acquisition
+
+	Must only be called from the waveform thread, while the worker isn't busy.
+ */
+void TriggerGroupWorker::Start()
+{
+	m_done = false;
+	m_busy = true;
+	m_startEvent.Signal();
+}
+
+/**
+	@brief Gets the acquisition from a finished job, leaving the worker ready to start another
+
+	Must only be called from the waveform thread, once IsDone() returns true.
+ */
+PendingAcquisition TriggerGroupWorker::TakeAcquisition()
+{
+	PendingAcquisition ret = m_acquisition;
+	m_acquisition = PendingAcquisition();
+
+	m_done = false;
+	m_busy = false;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker thread
+
+void TriggerGroupWorker::Run()
+{
+	pthread_setname_np_compat("GroupThread");
+
+	while(true)
+	{
+		m_startEvent.Block();
+		if(m_shuttingDown)
+			break;
+
+		//Grab the data, then run everything downstream of it
+		m_session->DownloadWaveforms(m_group, m_acquisition);
+		m_session->RefreshTriggerGroupFilters(m_group, m_executor, m_acquisition.m_changedChannels);
+
+		//Let the waveform thread know it can render and hand the acquisition off
+		m_done = true;
+		g_waveformThreadWakeEvent.Signal();
+	}
+}
@@ -0,0 +1,98 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of TriggerGroupWorker
+ */
+#ifndef TriggerGroupWorker_h
+#define TriggerGroupWorker_h
+
+#include "Session.h"
+
+/**
+	@brief Downloads and processes acquisitions from a single trigger group, in its own thread
+
+	The waveform thread keeps one worker per trigger group, so that each group's download and filter graph run happen
+	in parallel with the others'. A fast trigger group is then no longer held back to the rate of a slow, deep memory
+	one in the same session.
+
+	Each job is started by the waveform thread with Start(). Once IsDone() returns true, the waveform thread collects
+	the acquisition with TakeAcquisition(), renders, and hands the acquisition off to the GUI.
+ */
+class TriggerGroupWorker
+{
+public:
+	TriggerGroupWorker(Session* session, std::shared_ptr<TriggerGroup> group);
+	~TriggerGroupWorker();
+
+	void Start();
+	PendingAcquisition TakeAcquisition();
+
+	///@brief Returns true if a job has been started and not yet collected
+	bool IsBusy()
+	{ return m_busy; }
+
+	///@brief Returns true if the current job has finished and is waiting to be collected
+	bool IsDone()
+	{ return m_done; }
+
+protected:
+	void Run();
+
+	///@brief The session we're part of
+	Session* m_session;
+
+	///@brief The group we're processing acquisitions for
+	std::shared_ptr<TriggerGroup> m_group;
+
+	///@brief Executor for our part of the filter graph
+	FilterGraphExecutor m_executor;
+
+	///@brief The acquisition being processed
+	PendingAcquisition m_acquisition;
+
+	///@brief Signaled when a job is started, or we're shutting down
+	Event m_startEvent;
+
+	///@brief Set to make the thread exit
+	std::atomic<bool> m_shuttingDown;
+
+	///@brief True from Start() until TakeAcquisition()
+	std::atomic<bool> m_busy;
+
+	///@brief True once the current job has finished
+	std::atomic<bool> m_done;
+
+	///@brief The worker thread
+	std::unique_ptr<std::thread> m_thread;
+};
+
+#endif
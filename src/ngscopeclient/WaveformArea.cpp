@@ -35,6 +35,7 @@
 #include "ngscopeclient.h"
 #include "WaveformArea.h"
 #include "MainWindow.h"
+#include "CpuRasterizer.h"
 #include "../../scopehal/TwoLevelTrigger.h"
 #include "../../scopeprotocols/ConstellationFilter.h"
 #include "../../scopeprotocols/EyePattern.h"
@@ -71,9 +72,18 @@ DisplayedChannel::DisplayedChannel(StreamDescriptor stream, Session& session)
 	m_rasterizedWaveform.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
 	m_rasterizedWaveform.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
 
-	//Use pinned memory for index buffer since it should only be read once
-	m_indexBuffer.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
-	m_indexBuffer.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_UNLIKELY);
+	//If we can, the index buffer is generated on the GPU and never leaves it.
+	//Otherwise, use pinned memory for it since it's filled by the CPU and only read once.
+	if(g_hasShaderInt64)
+	{
+		m_indexBuffer.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_NEVER);
+		m_indexBuffer.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+	}
+	else
+	{
+		m_indexBuffer.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY);
+		m_indexBuffer.SetGpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_UNLIKELY);
+	}
 
 	//Create tone map pipeline depending on waveform type
 	switch(m_stream.GetType())
@@ -316,6 +326,45 @@ YAML::Node DisplayedChannel::Serialize(IDTable& table) const
 	return node;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DensitySnapshot
+
+/**
+	@brief Copies a density function waveform's output, if it's changed since the last snapshot
+
+	Called from the waveform thread with the waveform data and rasterized waveform mutexes locked.
+
+	@param data	The waveform (may be null, in which case the snapshot is emptied)
+ */
+void DensitySnapshot::Update(DensityFunctionWaveform* data)
+{
+	if(data == nullptr)
+	{
+		m_data = nullptr;
+		m_width = 0;
+		m_height = 0;
+		return;
+	}
+
+	if( (data == m_data) && (data->m_revision == m_revision) )
+		return;
+
+	m_outData.CopyFrom(data->GetOutData());
+	m_data = data;
+	m_revision = data->m_revision;
+	m_width = data->GetWidth();
+	m_height = data->GetHeight();
+	m_timescale = data->m_timescale;
+	m_triggerPhase = data->m_triggerPhase;
+
+	auto spec = dynamic_cast<SpectrogramWaveform*>(data);
+	if(spec)
+	{
+		m_binSize = spec->GetBinSize();
+		m_bottomEdgeFrequency = spec->GetBottomEdgeFrequency();
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -1700,11 +1749,14 @@ void WaveformArea::ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf)
 	@param chans				Set of channels we rendered into
 								Used to keep references active until rendering completes if we close them this frame
 	@param clearPersistence		True if persistence maps should be erased before rendering
+	@param skip					Nodes whose trigger group is still busy, so their data can't be read yet.
+								Channels showing them keep their previous image.
  */
 void WaveformArea::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
 	vector<shared_ptr<DisplayedChannel> >& chans,
-	bool clearPersistence)
+	bool clearPersistence,
+	const set<FlowGraphNode*>& skip)
 {
 	chans = m_displayedChannels;
 
@@ -1714,6 +1766,9 @@ void WaveformArea::RenderWaveformTextures(
 	for(auto& chan : chans)
 	{
 		auto stream = chan->GetStream();
+		if(skip.find(stream.m_channel) != skip.end())
+			continue;
+
 		switch(stream.GetType())
 		{
 			case Stream::STREAM_TYPE_ANALOG:
@@ -1722,10 +1777,12 @@ void WaveformArea::RenderWaveformTextures(
 				break;
 
 			//no background rendering required, we do everything in Refresh()
+			//but take a copy of the output for tone mapping, so that doesn't need the waveform data locked
 			case Stream::STREAM_TYPE_EYE:
 			case Stream::STREAM_TYPE_CONSTELLATION:
 			case Stream::STREAM_TYPE_WATERFALL:
 			case Stream::STREAM_TYPE_SPECTROGRAM:
+				chan->GetDensitySnapshot().Update(dynamic_cast<DensityFunctionWaveform*>(stream.GetData()));
 				break;
 
 			//no background rendering required, we draw everything live
@@ -1743,6 +1800,79 @@ void WaveformArea::RenderWaveformTextures(
 	}
 }
 
+/**
+	@brief Fills a sparse waveform's pixel column index buffer using a compute shader
+
+	Everything stays in GPU memory, so if the waveform was generated on the GPU its timestamps never have to be copied
+	back to the CPU.
+
+	@param channel			The channel being rasterized
+	@param sdata			The channel's waveform
+	@param cmdbuf			Command buffer to record the dispatch into
+	@param w				Width of the rasterized image, in pixels
+	@param xscale			Pixels per sample tick
+	@param offset_samples	Timestamp of the left edge of the window, in sample ticks
+ */
+void WaveformArea::CalculateSparseIndexes(
+	shared_ptr<DisplayedChannel> channel,
+	SparseWaveformBase* sdata,
+	vk::raii::CommandBuffer& cmdbuf,
+	size_t w,
+	double xscale,
+	int64_t offset_samples)
+{
+	auto& ibuf = channel->GetIndexBuffer();
+	auto comp = channel->GetSparseIndexPipeline();
+
+	//Ticks per pixel, as 32.32 fixed point so the shader doesn't need fp64.
+	//The fractional part can round up to 2^32 when the step is just under an integer, so carry it into the integer part
+	double step = 1.0 / xscale;
+	double stepInt = floor(step);
+	uint64_t stepFrac = llround((step - stepInt) * 4294967296.0);
+	if(stepFrac > 0xffffffff)
+	{
+		stepInt += 1;
+		stepFrac = 0;
+	}
+
+	SparseIndexPushConstants args;
+	args.base = offset_samples;
+	args.stepInt = stepInt;
+	args.stepFrac = stepFrac;
+	args.memDepth = sdata->m_offsets.size();
+	args.windowWidth = w;
+
+	comp->BindBufferNonblocking(0, sdata->m_offsets, cmdbuf);
+	comp->BindBufferNonblocking(1, ibuf, cmdbuf, true);
+	comp->Dispatch(cmdbuf, args, GetComputeBlockCount(w, 64), 1, 1);
+	comp->AddComputeMemoryBarrier(cmdbuf);
+	ibuf.MarkModifiedFromGpu();
+}
+
+/**
+	@brief Rebuilds the min/max pyramids of any deep uniform analog waveforms in this area which have changed
+
+	Runs on the waveform thread ahead of rasterization so that drawing a deep waveform zoomed out never has to wait for
+	its pyramid to be built.
+
+	@param skip	Nodes whose trigger group is still busy, so their data can't be read yet
+ */
+void WaveformArea::UpdateWaveformMipmaps(const set<FlowGraphNode*>& skip)
+{
+	auto chans = m_displayedChannels;
+	for(auto& chan : chans)
+	{
+		auto stream = chan->GetStream();
+		if(skip.find(stream.m_channel) != skip.end())
+			continue;
+
+		if(chan->ShouldFillUnder() || (stream.GetType() != Stream::STREAM_TYPE_ANALOG) )
+			chan->GetMipmap().Update(nullptr);
+		else
+			chan->GetMipmap().Update(dynamic_cast<UniformAnalogWaveform*>(stream.GetData()));
+	}
+}
+
 void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 	shared_ptr<DisplayedChannel> channel,
 	vk::raii::CommandBuffer& cmdbuf,
@@ -1763,6 +1893,7 @@ void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 	if( (data == nullptr) || data->empty() )
 	{
 		channel->PrepareToRasterize(0, 0);
+		channel->GetRenderCacheKey() = RenderCacheKey();
 		return;
 	}
 	size_t w = m_width;
@@ -1771,122 +1902,164 @@ void WaveformArea::RasterizeAnalogOrDigitalWaveform(
 		h = m_channelButtonHeight;
 	channel->PrepareToRasterize(w, h);
 
+	//If nothing that affects the output has changed since last time, the existing image is still good
+	RenderCacheKey key;
+	key.m_data = data;
+	key.m_revision = data->m_revision;
+	key.m_startTimestamp = data->m_startTimestamp;
+	key.m_startFemtoseconds = data->m_startFemtoseconds;
+	key.m_triggerPhase = data->m_triggerPhase;
+	key.m_timescale = data->m_timescale;
+	key.m_depth = data->size();
+	key.m_xAxisOffset = m_group->GetXAxisOffset();
+	key.m_pixelsPerXUnit = m_group->GetPixelsPerXUnit();
+	key.m_pixelsPerYAxisUnit = m_pixelsPerYAxisUnit;
+	key.m_yAxisOffset = stream.GetOffset();
+	key.m_width = w;
+	key.m_height = h;
+	key.m_alpha = m_parent->GetTraceAlpha();
+	key.m_persistence = channel->IsPersistenceEnabled();
+	key.m_persistDecay = m_parent->GetPersistDecay();
+	key.m_fillUnder = channel->ShouldFillUnder();
+	auto& session = m_parent->GetSession();
+	if(!clearPersistence && (key == channel->GetRenderCacheKey()))
+	{
+		session.OnRasterizeCacheLookup(true);
+		return;
+	}
+	session.OnRasterizeCacheLookup(false);
+	channel->GetRenderCacheKey() = key;
+
 	shared_ptr<ComputePipeline> comp;
 
+	//If we're zoomed out a long way on a deep waveform, draw a min/max decimated copy of it instead.
+	//This covers the same pixels, but at a cost independent of the capture depth.
+	//The pyramid itself is built ahead of time by UpdateWaveformMipmaps().
+	double pixelsPerX = m_group->GetPixelsPerXUnit();
+	auto fulldata = data;
+	auto uafulldata = dynamic_cast<UniformAnalogWaveform*>(data);
+	if(uafulldata && !channel->ShouldFillUnder())
+	{
+		auto level = channel->GetMipmap().GetLevel(uafulldata, 1.0 / (uafulldata->m_timescale * pixelsPerX));
+		if(level)
+			data = level;
+	}
+
 	//Calculate a bunch of constants
 	int64_t offset = m_group->GetXAxisOffset();
-	int64_t innerxoff = offset / data->m_timescale;
-	int64_t fractional_offset = offset % data->m_timescale;
 	int64_t offset_samples = (offset - data->m_triggerPhase) / data->m_timescale;
-	double pixelsPerX = m_group->GetPixelsPerXUnit();
 	double xscale = data->m_timescale * pixelsPerX;
 
 	//Figure out which shader to use
-	auto udata = dynamic_cast<UniformWaveformBase*>(data);
 	auto sdata = dynamic_cast<SparseWaveformBase*>(data);
 	auto uadata = dynamic_cast<UniformAnalogWaveform*>(data);
 	auto sadata = dynamic_cast<SparseAnalogWaveform*>(data);
 	auto uddata = dynamic_cast<UniformDigitalWaveform*>(data);
 	auto sddata = dynamic_cast<SparseDigitalWaveform*>(data);
-	if(uadata)
-	{
-		if(channel->ShouldFillUnder())
-			comp = channel->GetHistogramPipeline();
-		else
-			comp = channel->GetUniformAnalogPipeline();
-	}
-	else if(uddata)
-		comp = channel->GetUniformDigitalPipeline();
-	else if(sadata)
-		comp = channel->GetSparseAnalogPipeline();
-	else if(sddata)
-		comp = channel->GetSparseDigitalPipeline();
-	if(!comp)
+	if(!uadata && !uddata && !sadata && !sddata)
 	{
 		LogWarning("no pipeline found\n");
 		return;
 	}
 
-	//Bind input buffers
-	if(uadata)
-		comp->BindBufferNonblocking(1, uadata->m_samples, cmdbuf);
-	if(uddata)
-		comp->BindBufferNonblocking(1, uddata->m_samples, cmdbuf);
-	if(sdata)
+	//Software rendering skips all of the shader setup and just needs the X axis indexes
+	bool cpuRender = session.GetPreferences().GetBool("Appearance.Rendering.cpu_rasterizer");
+	if(!cpuRender)
 	{
+		if(uadata)
+		{
+			if(channel->ShouldFillUnder())
+				comp = channel->GetHistogramPipeline();
+			else
+				comp = channel->GetUniformAnalogPipeline();
+		}
+		else if(uddata)
+			comp = channel->GetUniformDigitalPipeline();
+		else if(sadata)
+			comp = channel->GetSparseAnalogPipeline();
+		else if(sddata)
+			comp = channel->GetSparseDigitalPipeline();
+
+		//Bind input buffers
+		if(uadata)
+			comp->BindBufferNonblocking(1, uadata->m_samples, cmdbuf);
+		if(uddata)
+			comp->BindBufferNonblocking(1, uddata->m_samples, cmdbuf);
 		if(sadata)
 			comp->BindBufferNonblocking(1, sadata->m_samples, cmdbuf);
 		if(sddata)
 			comp->BindBufferNonblocking(1, sddata->m_samples, cmdbuf);
 
 		//Map offsets and, if requested, durations
-		comp->BindBufferNonblocking(2, sdata->m_offsets, cmdbuf);
-		if(channel->ShouldMapDurations())
-			comp->BindBufferNonblocking(4, sdata->m_durations, cmdbuf);
+		if(sdata)
+		{
+			comp->BindBufferNonblocking(2, sdata->m_offsets, cmdbuf);
+			if(channel->ShouldMapDurations())
+				comp->BindBufferNonblocking(4, sdata->m_durations, cmdbuf);
+		}
+	}
 
+	if(sdata)
+	{
 		//Calculate indexes for X axis
 		auto& ibuf = channel->GetIndexBuffer();
-		ibuf.PrepareForCpuAccess();
-		sdata->m_offsets.PrepareForCpuAccess();
-		for(size_t i=0; i<w; i++)
+		if(g_hasShaderInt64 && !cpuRender)
+			CalculateSparseIndexes(channel, sdata, cmdbuf, w, xscale, offset_samples);
+		else
 		{
-			int64_t target = floor(i / xscale) + offset_samples;
-			ibuf[i] = BinarySearchForGequal(
-				sdata->m_offsets.GetCpuPointer(),
-				data->size(),
-				target);
+			//The buffer is normally GPU-only if we have int64, but the software rasterizer reads it directly
+			if(g_hasShaderInt64)
+				ibuf.SetCpuAccessHint(AcceleratorBuffer<uint32_t>::HINT_LIKELY, true);
+
+			ibuf.PrepareForCpuAccess();
+			CpuRasterizer::GetSparseIndexes(sdata, offset, pixelsPerX, ibuf.GetCpuPointer(), w);
+			ibuf.MarkModifiedFromCpu();
 		}
-		ibuf.MarkModifiedFromCpu();
-		comp->BindBufferNonblocking(3, ibuf, cmdbuf);
+		if(comp)
+			comp->BindBufferNonblocking(3, ibuf, cmdbuf);
 	}
 
 	//Bind output texture and bail if there's nothing there
 	auto& imgOut = channel->GetRasterizedWaveform();
 	if(imgOut.empty())
 		return;
-	comp->BindBufferNonblocking(0, imgOut, cmdbuf);
+	if(comp)
+		comp->BindBufferNonblocking(0, imgOut, cmdbuf);
 
 	//Scale alpha by zoom.
 	//As we zoom out more, reduce alpha to get proper intensity grading
 	//TODO: make this constant, then apply a second alpha pass in tone mapping?
 	//This will eliminate the need for a (potentially heavy) re-render when adjusting the slider.
-	float alpha = m_parent->GetTraceAlpha();
-	auto end = data->size() - 1;
-	int64_t firstOff = GetOffsetScaled(sdata, udata, 0);
-	int64_t lastOff = GetOffsetScaled(sdata, udata, end);
-	float capture_len = lastOff - firstOff;
-	float avg_sample_len = capture_len / data->size();
-	float samplesPerPixel = 1.0 / (pixelsPerX * avg_sample_len);
-	float alpha_scaled = alpha / sqrt(samplesPerPixel);
-	alpha_scaled = min(1.0f, alpha_scaled) * 2;
+	//Always based on the full waveform, so switching to a pyramid level doesn't change the brightness.
+	float alpha = CpuRasterizer::GetScaledAlpha(fulldata, pixelsPerX, m_parent->GetTraceAlpha());
 
 	//Fill shader configuration
-	ConfigPushConstants config;
-	config.innerXoff = -innerxoff;
-	config.windowHeight = h;
-	config.windowWidth = w;
-	config.memDepth = data->size();
-	config.offset_samples = offset_samples - 2;
-	config.alpha = alpha_scaled;
-	config.xoff = (data->m_triggerPhase - fractional_offset) * pixelsPerX;
-	config.xscale = xscale;
-	if(sadata || uadata)	//analog
-	{
-		config.yscale = m_pixelsPerYAxisUnit;
-		config.yoff = stream.GetOffset();
-		config.ybase = h * 0.5f;
-	}
-	else					//digital
-	{
-		config.yoff = 0;
-		config.yscale = m_channelButtonHeight - 1;
-		config.ybase = 0;
-	}
+	auto config = CpuRasterizer::GetConfig(
+		data, offset, pixelsPerX, m_pixelsPerYAxisUnit, stream.GetOffset(), w, h, alpha);
 	if(channel->IsPersistenceEnabled() && !clearPersistence)
 		config.persistScale = m_parent->GetPersistDecay();
 	else
 		config.persistScale = 0;
 
+	if(cpuRender)
+	{
+		CpuRasterizer raster;
+		raster.m_histogram = uadata && channel->ShouldFillUnder();
+		raster.m_zeroHold = (uadata || sadata) && !raster.m_histogram && channel->ZeroHoldFlagSet();
+		raster.SetWaveform(data);
+
+		//indexes were already calculated on the CPU above
+		if(sdata)
+			raster.m_indexes = channel->GetIndexBuffer().GetCpuPointer();
+
+		//Previous frame is only needed if we're doing persistence
+		if(config.persistScale != 0)
+			imgOut.PrepareForCpuAccess();
+		raster.Rasterize(config, imgOut.GetCpuPointer());
+		imgOut.MarkModifiedFromCpu();
+		return;
+	}
+
 	//Dispatch the shader
 	comp->Dispatch(cmdbuf, config, w, 1, 1);
 	comp->AddComputeMemoryBarrier(cmdbuf);
@@ -1949,20 +2122,19 @@ void WaveformArea::ToneMapWaterfallWaveform(std::shared_ptr<DisplayedChannel> ch
 	if(tex == nullptr)
 		return;
 
-	auto data = dynamic_cast<DensityFunctionWaveform*>(channel->GetStream().GetData());
-	if(data == nullptr)
-		return;
+	//Use the copy taken when the waveform was rendered, rather than the live filter output
+	auto data = &channel->GetDensitySnapshot();
 
 	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
-	auto width = data->GetWidth();
-	auto height = data->GetHeight();
+	auto width = data->m_width;
+	auto height = data->m_height;
 	if( (width == 0) || (height == 0) )
 		return;
 
 	//Run the actual compute shader
 	auto pipe = channel->GetToneMapPipeline();
 	const auto& texmgr = m_parent->GetTextureManager();
-	pipe->BindBufferNonblocking(0, data->GetOutData(), cmdbuf);
+	pipe->BindBufferNonblocking(0, data->m_outData, cmdbuf);
 	pipe->BindStorageImage(
 		1,
 		**texmgr->GetSampler(),
@@ -2012,20 +2184,19 @@ void WaveformArea::ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel>
 	if(tex == nullptr)
 		return;
 
-	auto data = dynamic_cast<SpectrogramWaveform*>(channel->GetStream().GetData());
-	if(data == nullptr)
-		return;
+	//Use the copy taken when the waveform was rendered, rather than the live filter output
+	auto data = &channel->GetDensitySnapshot();
 
 	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
-	auto width = data->GetWidth();
-	auto height = data->GetHeight();
+	auto width = data->m_width;
+	auto height = data->m_height;
 	if( (width == 0) || (height == 0) )
 		return;
 
 	//Run the actual compute shader
 	auto pipe = channel->GetToneMapPipeline();
 	const auto& texmgr = m_parent->GetTextureManager();
-	pipe->BindBufferNonblocking(0, data->GetOutData(), cmdbuf);
+	pipe->BindBufferNonblocking(0, data->m_outData, cmdbuf);
 	pipe->BindStorageImage(
 		1,
 		**texmgr->GetSampler(),
@@ -2048,10 +2219,10 @@ void WaveformArea::ToneMapSpectrogramWaveform(std::shared_ptr<DisplayedChannel>
 	int32_t yoff = YAxisUnitsToPixels(-channel->GetStream().GetOffset()) - m_height/2;
 
 	//Spectrograms aren't necessarily centered at zero so there's an extra offset based on our center frequency
-	yoff -= YAxisUnitsToPixels(data->GetBottomEdgeFrequency());
+	yoff -= YAxisUnitsToPixels(data->m_bottomEdgeFrequency);
 
 	//Rescale Y to "spectrogram bins per pixel" vs "Hz per pixel"
-	float yscale = 1.0 / (m_pixelsPerYAxisUnit * data->GetBinSize());
+	float yscale = 1.0 / (m_pixelsPerYAxisUnit * data->m_binSize);
 
 	SpectrogramToneMapArgs args(width, height, m_width, m_height, offset_samples, xscale, yoff, yscale);
 	pipe->Dispatch(cmdbuf, args, GetComputeBlockCount(m_width, 64), m_height);
@@ -2085,20 +2256,19 @@ void WaveformArea::ToneMapEyeWaveform(std::shared_ptr<DisplayedChannel> channel,
 	if(tex == nullptr)
 		return;
 
-	auto data = dynamic_cast<DensityFunctionWaveform*>(channel->GetStream().GetData());
-	if(data == nullptr)
-		return;
+	//Use the copy taken when the waveform was rendered, rather than the live filter output
+	auto data = &channel->GetDensitySnapshot();
 
 	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
-	auto width = data->GetWidth();
-	auto height = data->GetHeight();
+	auto width = data->m_width;
+	auto height = data->m_height;
 	if( (width == 0) || (height == 0) )
 		return;
 
 	//Run the actual compute shader
 	auto pipe = channel->GetToneMapPipeline();
 	const auto& texmgr = m_parent->GetTextureManager();
-	pipe->BindBufferNonblocking(0, data->GetOutData(), cmdbuf);
+	pipe->BindBufferNonblocking(0, data->m_outData, cmdbuf);
 	pipe->BindStorageImage(
 		1,
 		**texmgr->GetSampler(),
@@ -2142,20 +2312,19 @@ void WaveformArea::ToneMapConstellationWaveform(std::shared_ptr<DisplayedChannel
 	if(tex == nullptr)
 		return;
 
-	auto data = dynamic_cast<DensityFunctionWaveform*>(channel->GetStream().GetData());
-	if(data == nullptr)
-		return;
+	//Use the copy taken when the waveform was rendered, rather than the live filter output
+	auto data = &channel->GetDensitySnapshot();
 
 	//Nothing to draw? Early out if we haven't processed the window resize yet or there's no data
-	auto width = data->GetWidth();
-	auto height = data->GetHeight();
+	auto width = data->m_width;
+	auto height = data->m_height;
 	if( (width == 0) || (height == 0) )
 		return;
 
 	//Run the actual compute shader
 	auto pipe = channel->GetToneMapPipeline();
 	const auto& texmgr = m_parent->GetTextureManager();
-	pipe->BindBufferNonblocking(0, data->GetOutData(), cmdbuf);
+	pipe->BindBufferNonblocking(0, data->m_outData, cmdbuf);
 	pipe->BindStorageImage(
 		1,
 		**texmgr->GetSampler(),
@@ -41,6 +41,8 @@ class MainWindow;
 
 #include "TextureManager.h"
 #include "Marker.h"
+#include "WaveformMipmap.h"
+#include "CpuRasterizer.h"
 
 class WaveformToneMapArgs
 {
@@ -129,20 +131,16 @@ public:
 	float m_yscale;
 };
 
-struct ConfigPushConstants
+/**
+	@brief Push constants for SparseIndexSearch.glsl
+ */
+struct SparseIndexPushConstants
 {
-	int64_t innerXoff;
-	uint32_t windowHeight;
-	uint32_t windowWidth;
+	int64_t base;
+	int64_t stepInt;
+	uint32_t stepFrac;
 	uint32_t memDepth;
-	uint32_t offset_samples;
-	float alpha;
-	float xoff;
-	float xscale;
-	float ybase;
-	float yscale;
-	float yoff;
-	float persistScale;
+	uint32_t windowWidth;
 };
 
 /**
@@ -183,6 +181,170 @@ struct PeakLabel
 	float m_fwhm;
 };
 
+/**
+	@brief Everything that affects the rasterized image of an analog or digital waveform
+
+	If none of this has changed since a channel was last rasterized, the previous output is still valid and the
+	dispatch can be skipped.
+
+	The waveform is identified by its address and revision. The timestamp, depth and timebase are included too, since
+	a freshly allocated waveform may reuse the address of one that was just freed, and start over at the same revision.
+ */
+class RenderCacheKey
+{
+public:
+	RenderCacheKey()
+	: m_data(nullptr)
+	, m_revision(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+	, m_triggerPhase(0)
+	, m_timescale(0)
+	, m_depth(0)
+	, m_xAxisOffset(0)
+	, m_pixelsPerXUnit(0)
+	, m_pixelsPerYAxisUnit(0)
+	, m_yAxisOffset(0)
+	, m_width(0)
+	, m_height(0)
+	, m_alpha(0)
+	, m_persistence(false)
+	, m_persistDecay(0)
+	, m_fillUnder(false)
+	{}
+
+	bool operator==(const RenderCacheKey& rhs) const
+	{
+		return
+			(m_data == rhs.m_data) &&
+			(m_revision == rhs.m_revision) &&
+			(m_startTimestamp == rhs.m_startTimestamp) &&
+			(m_startFemtoseconds == rhs.m_startFemtoseconds) &&
+			(m_triggerPhase == rhs.m_triggerPhase) &&
+			(m_timescale == rhs.m_timescale) &&
+			(m_depth == rhs.m_depth) &&
+			(m_xAxisOffset == rhs.m_xAxisOffset) &&
+			(m_pixelsPerXUnit == rhs.m_pixelsPerXUnit) &&
+			(m_pixelsPerYAxisUnit == rhs.m_pixelsPerYAxisUnit) &&
+			(m_yAxisOffset == rhs.m_yAxisOffset) &&
+			(m_width == rhs.m_width) &&
+			(m_height == rhs.m_height) &&
+			(m_alpha == rhs.m_alpha) &&
+			(m_persistence == rhs.m_persistence) &&
+			(m_persistDecay == rhs.m_persistDecay) &&
+			(m_fillUnder == rhs.m_fillUnder);
+	}
+
+	bool operator!=(const RenderCacheKey& rhs) const
+	{ return !(*this == rhs); }
+
+	///@brief The waveform that was drawn
+	WaveformBase* m_data;
+
+	///@brief Revision of the waveform when it was drawn
+	uint64_t m_revision;
+
+	///@brief Start time of the waveform
+	time_t m_startTimestamp;
+
+	///@brief Fractional start time of the waveform
+	int64_t m_startFemtoseconds;
+
+	///@brief Trigger phase of the waveform
+	int64_t m_triggerPhase;
+
+	///@brief Timebase of the waveform
+	int64_t m_timescale;
+
+	///@brief Number of samples in the waveform
+	size_t m_depth;
+
+	///@brief X axis offset of the group
+	int64_t m_xAxisOffset;
+
+	///@brief X axis scale of the group
+	double m_pixelsPerXUnit;
+
+	///@brief Y axis scale of the area
+	float m_pixelsPerYAxisUnit;
+
+	///@brief Vertical offset of the stream
+	float m_yAxisOffset;
+
+	///@brief Width of the rasterized image
+	size_t m_width;
+
+	///@brief Height of the rasterized image
+	size_t m_height;
+
+	///@brief Trace intensity
+	float m_alpha;
+
+	///@brief True if persistence was enabled
+	bool m_persistence;
+
+	///@brief Persistence decay factor
+	float m_persistDecay;
+
+	///@brief True if the area under the waveform was filled
+	bool m_fillUnder;
+};
+
+/**
+	@brief Copy of a density function waveform (eye, constellation, waterfall or spectrogram) to tone map from
+
+	Density functions don't have a rasterization step, so tone mapping used to read the filter output directly, which
+	meant holding off every trigger group while it ran. Instead, the waveform thread copies the output here when it
+	renders the waveform, and tone mapping only needs the rasterized waveform mutex like any other channel.
+ */
+class DensitySnapshot
+{
+public:
+	DensitySnapshot()
+	: m_outData("DensitySnapshot.m_outData")
+	, m_data(nullptr)
+	, m_revision(0)
+	, m_width(0)
+	, m_height(0)
+	, m_timescale(1)
+	, m_triggerPhase(0)
+	, m_binSize(0)
+	, m_bottomEdgeFrequency(0)
+	{
+		m_outData.SetCpuAccessHint(AcceleratorBuffer<float>::HINT_UNLIKELY);
+		m_outData.SetGpuAccessHint(AcceleratorBuffer<float>::HINT_LIKELY);
+	}
+
+	void Update(DensityFunctionWaveform* data);
+
+	///@brief Copy of the waveform's output buffer
+	AcceleratorBuffer<float> m_outData;
+
+	///@brief The waveform the snapshot was taken from (only used to skip copying it again if it hasn't changed)
+	WaveformBase* m_data;
+
+	///@brief Revision of the waveform when the snapshot was taken
+	uint64_t m_revision;
+
+	///@brief Width of the output buffer, in bins (zero if there's nothing to draw)
+	size_t m_width;
+
+	///@brief Height of the output buffer, in bins
+	size_t m_height;
+
+	///@brief Timebase of the waveform
+	int64_t m_timescale;
+
+	///@brief Trigger phase of the waveform
+	int64_t m_triggerPhase;
+
+	///@brief Frequency span of one spectrogram bin (spectrograms only)
+	double m_binSize;
+
+	///@brief Frequency of the bottom edge of the spectrogram (spectrograms only)
+	double m_bottomEdgeFrequency;
+};
+
 /**
 	@brief Context data for a single channel being displayed within a WaveformArea
  */
@@ -330,6 +492,22 @@ public:
 		return m_sparseDigitalComputePipeline;
 	}
 
+	/**
+		@brief Gets the pipeline for finding pixel column boundaries in sparse waveforms, creating it if necessary
+
+		Only available if the GPU supports int64.
+	*/
+	std::shared_ptr<ComputePipeline> GetSparseIndexPipeline()
+	{
+		if(m_sparseIndexComputePipeline == nullptr)
+		{
+			m_sparseIndexComputePipeline = std::make_shared<ComputePipeline>(
+				"shaders/SparseIndexSearch.spv", 2, sizeof(SparseIndexPushConstants));
+		}
+
+		return m_sparseIndexComputePipeline;
+	}
+
 	std::shared_ptr<ComputePipeline> GetToneMapPipeline()
 	{ return m_toneMapPipe; }
 
@@ -371,6 +549,18 @@ public:
 	AcceleratorBuffer<uint32_t>& GetIndexBuffer()
 	{ return m_indexBuffer; }
 
+	///@brief Gets the min/max pyramid used to draw deep uniform waveforms when zoomed out
+	WaveformMipmap& GetMipmap()
+	{ return m_mipmap; }
+
+	///@brief Gets the state the rasterized waveform was last drawn with
+	RenderCacheKey& GetRenderCacheKey()
+	{ return m_renderCacheKey; }
+
+	///@brief Gets the copy of our waveform to tone map from (only used for density functions)
+	DensitySnapshot& GetDensitySnapshot()
+	{ return m_densitySnapshot; }
+
 	void SetYButtonPos(float y)
 	{ m_yButtonPos = y; }
 
@@ -394,6 +584,15 @@ protected:
 	///@brief Buffer for X axis indexes (only used for sparse waveforms)
 	AcceleratorBuffer<uint32_t> m_indexBuffer;
 
+	///@brief Min/max pyramid of the waveform (only used for deep uniform analog waveforms)
+	WaveformMipmap m_mipmap;
+
+	///@brief Everything the current contents of m_rasterizedWaveform depend on
+	RenderCacheKey m_renderCacheKey;
+
+	///@brief Copy of our waveform to tone map from (only used for density functions)
+	DensitySnapshot m_densitySnapshot;
+
 	///@brief X axis size of rasterized waveform
 	size_t m_rasterizedX;
 
@@ -430,6 +629,9 @@ protected:
 	///@brief Compute pipeline for rendering sparse digital waveforms
 	std::shared_ptr<ComputePipeline> m_sparseDigitalComputePipeline;
 
+	///@brief Compute pipeline for finding pixel column boundaries in sparse waveforms
+	std::shared_ptr<ComputePipeline> m_sparseIndexComputePipeline;
+
 	///@brief Y axis position of our button within the view
 	float m_yButtonPos;
 };
@@ -449,7 +651,9 @@ public:
 	void RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
 		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
-		bool clearPersistence);
+		bool clearPersistence,
+		const std::set<FlowGraphNode*>& skip);
+	void UpdateWaveformMipmaps(const std::set<FlowGraphNode*>& skip);
 	void ReferenceWaveformTextures();
 	void ToneMapAllWaveforms(vk::raii::CommandBuffer& cmdbuf);
 
@@ -521,6 +725,13 @@ protected:
 		std::shared_ptr<DisplayedChannel> channel,
 		vk::raii::CommandBuffer& cmdbuf,
 		bool clearPersistence);
+	void CalculateSparseIndexes(
+		std::shared_ptr<DisplayedChannel> channel,
+		SparseWaveformBase* sdata,
+		vk::raii::CommandBuffer& cmdbuf,
+		size_t w,
+		double xscale,
+		int64_t offset_samples);
 	void PlotContextMenu();
 
 	void DrawDropRangeMismatchMessage(
@@ -157,13 +157,14 @@ void WaveformGroup::ReferenceWaveformTextures()
 void WaveformGroup::RenderWaveformTextures(
 	vk::raii::CommandBuffer& cmdbuf,
 	vector<shared_ptr<DisplayedChannel> >& channels,
-	bool clearPersistence)
+	bool clearPersistence,
+	const set<FlowGraphNode*>& skip)
 {
 	bool clearThisGroupOnly = m_clearPersistence.exchange(false);
 
 	auto areas = GetWaveformAreas();
 	for(auto a : areas)
-		a->RenderWaveformTextures(cmdbuf, channels, clearThisGroupOnly || clearPersistence);
+		a->RenderWaveformTextures(cmdbuf, channels, clearThisGroupOnly || clearPersistence, skip);
 }
 
 bool WaveformGroup::Render()
@@ -55,7 +55,8 @@ public:
 	void RenderWaveformTextures(
 		vk::raii::CommandBuffer& cmdbuf,
 		std::vector<std::shared_ptr<DisplayedChannel> >& channels,
-		bool clearPersistence);
+		bool clearPersistence,
+		const std::set<FlowGraphNode*>& skip);
 
 	const std::string GetID()
 	{ return m_title + "###" + m_id; }
@@ -0,0 +1,215 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformMipmap
+ */
+#include "../scopehal/scopehal.h"
+#include "WaveformMipmap.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformMipmap::WaveformMipmap()
+	: m_source(nullptr)
+	, m_revision(0)
+	, m_size(0)
+	, m_startTimestamp(0)
+	, m_startFemtoseconds(0)
+{
+}
+
+/**
+	@brief Frees all levels of the pyramid
+ */
+void WaveformMipmap::Clear()
+{
+	m_source = nullptr;
+	m_levels.clear();
+	m_blockSizes.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Level selection
+
+/**
+	@brief Brings the pyramid up to date with the waveform currently being displayed
+
+	Called from the waveform thread whenever there may be new data, with the waveform data locked. Does nothing if the
+	pyramid was already built from this waveform.
+
+	@param wfm	The waveform being displayed, or nullptr if it isn't a uniform analog waveform (or shouldn't be drawn
+				from the pyramid)
+ */
+void WaveformMipmap::Update(UniformAnalogWaveform* wfm)
+{
+	//Not worth it for small waveforms, just free whatever we had before
+	if( (wfm == nullptr) || (wfm->size() < MIPMAP_MIN_DEPTH) )
+	{
+		Clear();
+		return;
+	}
+
+	if(!IsCurrent(wfm))
+		Build(wfm);
+}
+
+/**
+	@brief Gets the coarsest level of the pyramid which still has enough resolution for the current zoom
+
+	Never builds anything: if the pyramid isn't current (because Update() hasn't seen this waveform yet), the waveform
+	is drawn directly.
+
+	@param wfm				The waveform being drawn
+	@param samplesPerPixel	Number of samples of the waveform in each pixel column at the current zoom
+
+	@return The level to draw instead of the waveform, or nullptr if the waveform should be drawn directly
+ */
+UniformAnalogWaveform* WaveformMipmap::GetLevel(UniformAnalogWaveform* wfm, double samplesPerPixel)
+{
+	//Not worth it if we're zoomed in
+	if(samplesPerPixel < MIPMAP_MIN_BLOCK * MIPMAP_MIN_OVERSAMPLE / 2)
+		return nullptr;
+	if(!IsCurrent(wfm))
+		return nullptr;
+
+	//Each level has two samples per block
+	UniformAnalogWaveform* ret = nullptr;
+	for(size_t i=0; i<m_levels.size(); i++)
+	{
+		if(samplesPerPixel * 2 / m_blockSizes[i] < MIPMAP_MIN_OVERSAMPLE)
+			break;
+		ret = m_levels[i].get();
+	}
+	return ret;
+}
+
+/**
+	@brief Checks if the pyramid was built from the current contents of a waveform
+ */
+bool WaveformMipmap::IsCurrent(UniformAnalogWaveform* wfm)
+{
+	return
+		(m_source == wfm) &&
+		(m_revision == wfm->m_revision) &&
+		(m_size == wfm->size()) &&
+		(m_startTimestamp == wfm->m_startTimestamp) &&
+		(m_startFemtoseconds == wfm->m_startFemtoseconds);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction of the pyramid
+
+/**
+	@brief Builds every level of the pyramid for a waveform, replacing any existing levels
+
+	The finest level is built from the waveform itself, and each coarser level from the one before it, so this is O(n)
+	overall.
+ */
+void WaveformMipmap::Build(UniformAnalogWaveform* wfm)
+{
+	LogTrace("Building min/max pyramid for %zu-sample waveform\n", wfm->size());
+
+	Clear();
+	m_source = wfm;
+	m_revision = wfm->m_revision;
+	m_size = wfm->size();
+	m_startTimestamp = wfm->m_startTimestamp;
+	m_startFemtoseconds = wfm->m_startFemtoseconds;
+
+	wfm->PrepareForCpuAccess();
+	const float* samples = wfm->m_samples.GetCpuPointer();
+
+	size_t blocksize = MIPMAP_MIN_BLOCK;
+	size_t nblocks = (m_size + blocksize - 1) / blocksize;
+	while(nblocks > 1)
+	{
+		auto level = make_unique<UniformAnalogWaveform>();
+		level->m_timescale = wfm->m_timescale * blocksize / 2;
+		level->m_triggerPhase = wfm->m_triggerPhase;
+		level->m_startTimestamp = wfm->m_startTimestamp;
+		level->m_startFemtoseconds = wfm->m_startFemtoseconds;
+		level->Resize(nblocks * 2);
+		level->PrepareForCpuAccess();
+		float* out = level->m_samples.GetCpuPointer();
+
+		//First level comes from the waveform itself
+		if(m_levels.empty())
+		{
+			#pragma omp parallel for
+			for(size_t i=0; i<nblocks; i++)
+			{
+				size_t start = i * blocksize;
+				size_t end = min(start + blocksize, m_size);
+				float vmin = samples[start];
+				float vmax = samples[start];
+				for(size_t j=start+1; j<end; j++)
+				{
+					vmin = min(vmin, samples[j]);
+					vmax = max(vmax, samples[j]);
+				}
+				out[i*2] = vmin;
+				out[i*2 + 1] = vmax;
+			}
+		}
+
+		//Later levels merge pairs of blocks from the one before
+		else
+		{
+			auto& prev = m_levels.back();
+			const float* in = prev->m_samples.GetCpuPointer();
+			size_t nprev = prev->size() / 2;
+
+			#pragma omp parallel for
+			for(size_t i=0; i<nblocks; i++)
+			{
+				float vmin = in[i*4];
+				float vmax = in[i*4 + 1];
+				if(i*2 + 1 < nprev)
+				{
+					vmin = min(vmin, in[i*4 + 2]);
+					vmax = max(vmax, in[i*4 + 3]);
+				}
+				out[i*2] = vmin;
+				out[i*2 + 1] = vmax;
+			}
+		}
+
+		level->MarkModifiedFromCpu();
+		m_levels.push_back(move(level));
+		m_blockSizes.push_back(blocksize);
+
+		blocksize *= 2;
+		nblocks = (nblocks + 1) / 2;
+	}
+}
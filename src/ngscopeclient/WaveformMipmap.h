@@ -0,0 +1,102 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformMipmap
+ */
+#ifndef WaveformMipmap_h
+#define WaveformMipmap_h
+
+///@brief Don't bother building a pyramid for waveforms shallower than this
+#define MIPMAP_MIN_DEPTH (1024 * 1024)
+
+///@brief Number of samples per block in the finest level of the pyramid
+#define MIPMAP_MIN_BLOCK 16
+
+///@brief Only use a level if there will still be at least this many of its samples per pixel
+#define MIPMAP_MIN_OVERSAMPLE 4
+
+/**
+	@brief A multi-resolution min/max pyramid of a deep uniform analog waveform, for fast zoomed-out rendering
+
+	Each level splits the waveform into blocks of 2^n samples (starting at MIPMAP_MIN_BLOCK) and stores the minimum
+	then the maximum of each block, as a uniform waveform with two samples per block. When there are many blocks per
+	pixel, drawing lines through these covers exactly the same vertical span in each pixel column as drawing the full
+	waveform, so the rasterizer can use the level in place of the original and its cost no longer depends on the
+	capture depth.
+
+	The pyramid is built by Update() on the waveform thread as soon as a new waveform arrives, so that rendering never
+	has to wait for it. GetLevel() only ever returns levels built from the current waveform.
+ */
+class WaveformMipmap
+{
+public:
+	WaveformMipmap();
+
+	void Update(UniformAnalogWaveform* wfm);
+	UniformAnalogWaveform* GetLevel(UniformAnalogWaveform* wfm, double samplesPerPixel);
+	void Clear();
+
+	///@brief Gets the number of levels in the pyramid
+	size_t GetLevelCount()
+	{ return m_levels.size(); }
+
+	///@brief Gets the number of original samples per block in a given level
+	size_t GetBlockSize(size_t level)
+	{ return m_blockSizes[level]; }
+
+protected:
+	bool IsCurrent(UniformAnalogWaveform* wfm);
+	void Build(UniformAnalogWaveform* wfm);
+
+	///@brief The waveform the pyramid was built from
+	WaveformBase* m_source;
+
+	///@brief Revision of m_source when the pyramid was built
+	uint64_t m_revision;
+
+	///@brief Size of m_source when the pyramid was built
+	size_t m_size;
+
+	///@brief Start timestamp of m_source when the pyramid was built
+	int64_t m_startTimestamp;
+
+	///@brief Start timestamp fractional part of m_source when the pyramid was built
+	int64_t m_startFemtoseconds;
+
+	///@brief The levels, finest first
+	std::vector<std::unique_ptr<UniformAnalogWaveform>> m_levels;
+
+	///@brief Number of original samples per block in each level
+	std::vector<size_t> m_blockSizes;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformQueuePolicy
+ */
+#ifndef WaveformQueuePolicy_h
+#define WaveformQueuePolicy_h
+
+/**
+	@brief Limits on how many waveforms may be waiting in an oscilloscope's pending queue, and what to do once it's full
+
+	The limit is expressed both as a count and in bytes. The byte limit is converted to a count using the size of the
+	most recent waveform downloaded from the instrument, since deep captures can be several orders of magnitude larger
+	than shallow ones and a fixed count is either far too shallow for one or far too deep for the other.
+
+	Limits are set from the GUI thread, the waveform size from the waveform thread, and the policy is applied by the
+	instrument thread (and the waveform thread, for POLICY_DROP_OLDEST).
+ */
+class WaveformQueuePolicy
+{
+public:
+	enum OverflowPolicy
+	{
+		///@brief Stop acquiring until the queue drains (the instrument holds off triggering)
+		POLICY_BLOCK,
+
+		///@brief Keep acquiring, and discard the oldest waveforms in the queue to make room
+		POLICY_DROP_OLDEST,
+
+		///@brief Keep the instrument triggering, but discard new waveforms without downloading them
+		POLICY_DROP_NEWEST
+	};
+
+	WaveformQueuePolicy()
+	: m_maxCount(16)
+	, m_maxBytes(1024LL * 1024LL * 1024LL)
+	, m_policy(POLICY_BLOCK)
+	, m_multiScope(false)
+	, m_waveformSize(0)
+	, m_oneShot(false)
+	, m_droppedOldest(0)
+	, m_droppedNewest(0)
+	{}
+
+	/**
+		@brief Returns the number of waveforms allowed in the queue, given the current waveform size
+
+		At least one waveform is always allowed, even if it's larger than the byte limit.
+	 */
+	size_t GetMaxDepth()
+	{
+		size_t depth = m_maxCount;
+		size_t size = m_waveformSize;
+		if(size > 0)
+			depth = std::min(depth, m_maxBytes / size);
+		return std::max(depth, (size_t)1);
+	}
+
+	///@brief Returns true if a queue holding npending waveforms is full
+	bool IsFull(size_t npending)
+	{ return npending >= GetMaxDepth(); }
+
+	/**
+		@brief Returns the overflow policy in effect
+
+		Scopes in a multi-instrument trigger group always block, since dropping a waveform on one instrument but not
+		the others would pair up waveforms from different triggers.
+	 */
+	OverflowPolicy GetPolicy()
+	{
+		if(m_multiScope)
+			return POLICY_BLOCK;
+		return m_policy;
+	}
+
+	///@brief Maximum number of waveforms in the queue
+	std::atomic<size_t> m_maxCount;
+
+	///@brief Maximum total size of waveforms in the queue, in bytes
+	std::atomic<size_t> m_maxBytes;
+
+	///@brief What to do when the queue is full
+	std::atomic<OverflowPolicy> m_policy;
+
+	///@brief True if the scope is part of a trigger group with other scopes
+	std::atomic<bool> m_multiScope;
+
+	///@brief Size of the most recently downloaded waveform (all channels), in bytes
+	std::atomic<size_t> m_waveformSize;
+
+	///@brief True if the instrument was armed for a single acquisition, which must never be dropped
+	std::atomic<bool> m_oneShot;
+
+	///@brief Number of queued waveforms discarded by POLICY_DROP_OLDEST
+	std::atomic<int64_t> m_droppedOldest;
+
+	///@brief Number of triggers discarded by POLICY_DROP_NEWEST
+	std::atomic<int64_t> m_droppedNewest;
+};
+
+#endif
@@ -0,0 +1,353 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformRecorder
+ */
+#include "ngscopeclient.h"
+#include "WaveformRecorder.h"
+#include "Session.h"
+#include "pthread_compat.h"
+
+#include <filesystem>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a recorder
+
+	@param session	The session to record
+	@param dataDir	Path to the data directory to write into (must already exist)
+	@param maxDepth	Maximum number of history points waiting to be written before we stall acquisition
+	@param maxBytes	Maximum size of history points waiting to be written before we stall acquisition
+ */
+WaveformRecorder::WaveformRecorder(Session& session, const string& dataDir, size_t maxDepth, size_t maxBytes)
+	: m_session(session)
+	, m_dataDir(dataDir)
+	, m_maxDepth(max(maxDepth, (size_t)1))
+	, m_maxBytes(maxBytes)
+	, m_queuedBytes(0)
+	, m_stopping(false)
+	, m_failed(false)
+	, m_nextPointID(0)
+	, m_pointsWritten(0)
+	, m_bytesWritten(0)
+	, m_writeTime(0)
+	, m_startTime(0)
+{
+}
+
+WaveformRecorder::~WaveformRecorder()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Thread control
+
+/**
+	@brief Creates the metadata files and starts the I/O thread
+
+	@param scopes	The instruments to record
+
+	@return True on success, false on error
+ */
+bool WaveformRecorder::Start(const vector<shared_ptr<Oscilloscope>>& scopes)
+{
+	//Metadata file for every scope, even if it never triggers, so the session loads cleanly
+	for(auto scope : scopes)
+	{
+		string fname = m_dataDir + "/" + m_session.GetScopeMetadataFileName(scope);
+		FILE* fp = fopen(fname.c_str(), "w");
+		if(!fp)
+		{
+			LogError("Failed to create recording metadata file %s\n", fname.c_str());
+			for(auto it : m_metadataFiles)
+				fclose(it.second);
+			m_metadataFiles.clear();
+			return false;
+		}
+
+		//Waveforms are appended to this map as they're written
+		fputs("waveforms:\n", fp);
+		fflush(fp);
+		m_metadataFiles[scope] = fp;
+	}
+
+	m_startTime = GetTime();
+	m_thread = make_unique<thread>(&WaveformRecorder::Run, this);
+	return true;
+}
+
+/**
+	@brief Finishes writing everything in the queue, then stops the I/O thread
+
+	Must be called from the GUI thread.
+ */
+void WaveformRecorder::Stop()
+{
+	if(!m_thread)
+		return;
+
+	m_stopping = true;
+	m_workEvent.Signal();
+	m_thread->join();
+	m_thread = nullptr;
+
+	for(auto it : m_metadataFiles)
+		fclose(it.second);
+	m_metadataFiles.clear();
+
+	ReleaseCompleted();
+
+	Unit bytes(Unit::UNIT_BYTES);
+	LogDebug("Recorded %zu waveforms (%s) in %.2f s: %s/s average, %s/s sustained disk throughput\n",
+		m_pointsWritten.load(),
+		bytes.PrettyPrint(m_bytesWritten).c_str(),
+		GetTime() - m_startTime,
+		bytes.PrettyPrint(GetAverageRate()).c_str(),
+		bytes.PrettyPrint(GetThroughput()).c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queueing
+
+/**
+	@brief Queues a newly acquired history point to be written
+
+	Must be called from the GUI thread, with the waveform data mutex held exclusively, right after the point is added
+	to history. The waveforms are made accessible to the CPU here, since the I/O thread can't safely do that itself.
+ */
+void WaveformRecorder::Record(shared_ptr<HistoryPoint> point)
+{
+	if(m_failed || !m_thread)
+		return;
+
+	RecordedPoint item;
+	item.m_point = point;
+	item.m_bytes = point->GetMemoryUsage();
+	m_session.CreateSaveJobs(point, m_nextPointID ++, item.m_jobs, item.m_metadata);
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_queuedBytes += item.m_bytes;
+		m_queue.push_back(std::move(item));
+	}
+	m_workEvent.Signal();
+}
+
+/**
+	@brief Returns true if the queue is full, and acquisition should be held off until it drains
+
+	A single point is always accepted into an empty queue, even if it's bigger than the byte limit.
+ */
+bool WaveformRecorder::IsFull()
+{
+	if(m_failed)
+		return false;
+
+	lock_guard<mutex> lock(m_mutex);
+	if(m_queue.empty())
+		return false;
+	return (m_queue.size() >= m_maxDepth) || (m_queuedBytes >= m_maxBytes);
+}
+
+/**
+	@brief Drops our references to points which have been written
+
+	This must happen in the GUI thread, since destroying a history point returns its waveforms to the instrument's
+	waveform pool. While we're at it, remember where each waveform was written so saving the session later can link
+	to the recorded copy rather than writing it out again.
+ */
+void WaveformRecorder::ReleaseCompleted()
+{
+	list<RecordedPoint> done;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		done.splice(done.end(), m_completed);
+	}
+
+	for(auto& item : done)
+	{
+		auto& point = *item.m_point;
+		lock_guard<recursive_mutex> lock(point.m_mutex);
+		for(auto& job : item.m_jobs)
+		{
+			if(!job.m_written)
+				continue;
+			job.m_record.m_path = m_dataDir + "/" + job.m_relpath;
+			point.m_saved[job.m_scope][job.m_stream] = job.m_record;
+		}
+	}
+}
+
+/**
+	@brief Returns the number of points waiting to be written
+ */
+size_t WaveformRecorder::GetQueueDepth()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_queue.size();
+}
+
+/**
+	@brief Returns the total size of the points waiting to be written, in bytes
+ */
+size_t WaveformRecorder::GetQueuedBytes()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_queuedBytes;
+}
+
+/**
+	@brief Returns the sustained write throughput, in bytes per second
+
+	This only counts time the I/O thread spent actually writing, so it's a measure of how fast the disk can absorb
+	data regardless of how often the instrument triggers.
+ */
+double WaveformRecorder::GetThroughput()
+{
+	double t = m_writeTime;
+	if(t <= 0)
+		return 0;
+	return m_bytesWritten / t;
+}
+
+/**
+	@brief Returns the average rate data has been recorded since the start of the recording, in bytes per second
+ */
+double WaveformRecorder::GetAverageRate()
+{
+	double t = GetTime() - m_startTime;
+	if(t <= 0)
+		return 0;
+	return m_bytesWritten / t;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Writing
+
+/**
+	@brief Thread function: writes queued points until told to stop
+ */
+void WaveformRecorder::Run()
+{
+	pthread_setname_np_compat("RecordThread");
+
+	while(true)
+	{
+		m_workEvent.Block();
+
+		//Write everything in the queue.
+		//The point stays in the queue while it's being written, so its memory is still counted against the limit.
+		while(true)
+		{
+			RecordedPoint* item;
+			{
+				lock_guard<mutex> lock(m_mutex);
+				if(m_queue.empty())
+					break;
+				item = &m_queue.front();
+			}
+
+			if(!m_failed)
+			{
+				double tstart = GetTime();
+				if(!WritePoint(*item))
+				{
+					LogError("Failed to write recorded waveform to %s, recording stopped\n", m_dataDir.c_str());
+					m_failed = true;
+				}
+				m_writeTime = m_writeTime + (GetTime() - tstart);
+			}
+
+			lock_guard<mutex> lock(m_mutex);
+			m_queuedBytes -= item->m_bytes;
+			m_completed.splice(m_completed.end(), m_queue, m_queue.begin());
+		}
+
+		if(m_stopping)
+			break;
+	}
+}
+
+/**
+	@brief Writes a single point's waveforms, then appends its metadata to the scope metadata files
+
+	@return True on success, false on error
+ */
+bool WaveformRecorder::WritePoint(RecordedPoint& item)
+{
+	for(auto& job : item.m_jobs)
+	{
+		string path = m_dataDir + "/" + job.m_relpath;
+		if(!job.Write(m_session, path))
+			return false;
+
+		if(job.m_written)
+		{
+			error_code ec;
+			auto size = filesystem::file_size(path, ec);
+			if(!ec)
+				m_bytesWritten += size;
+
+			item.m_metadata[job.m_scope]["waveforms"][job.m_wfmKey]["channels"][job.m_chanKey] = job.GetMetadata();
+		}
+	}
+
+	//Append to the metadata files, indented to go under the top level "waveforms" key
+	for(auto& it : item.m_metadata)
+	{
+		auto fit = m_metadataFiles.find(it.first);
+		if(fit == m_metadataFiles.end())
+			continue;
+
+		YAML::Emitter out;
+		out << it.second["waveforms"];
+		string text = "  ";
+		for(const char* p = out.c_str(); *p; p++)
+		{
+			text += *p;
+			if( (*p == '\n') && (p[1] != '\0') )
+				text += "  ";
+		}
+		text += "\n";
+
+		if( (fputs(text.c_str(), fit->second) < 0) || (fflush(fit->second) != 0) )
+			return false;
+	}
+
+	m_pointsWritten ++;
+	return true;
+}
@@ -0,0 +1,168 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformRecorder
+ */
+#ifndef WaveformRecorder_h
+#define WaveformRecorder_h
+
+#include "SessionSaveTask.h"
+#include "Event.h"
+
+/**
+	@brief A single history point waiting to be written by the recorder
+ */
+class RecordedPoint
+{
+public:
+	RecordedPoint()
+	: m_bytes(0)
+	{}
+
+	///@brief The history point being recorded
+	std::shared_ptr<HistoryPoint> m_point;
+
+	///@brief Waveforms to be written
+	std::vector<WaveformSaveJob> m_jobs;
+
+	///@brief Metadata for the point, for each scope
+	std::map<std::shared_ptr<Oscilloscope>, YAML::Node> m_metadata;
+
+	///@brief Size of the point's waveform data in memory, in bytes
+	size_t m_bytes;
+};
+
+/**
+	@brief Writes every acquired waveform to disk as it arrives, for long unattended captures
+
+	The output uses the same layout as a saved session's data directory, so the recording can be opened later as a
+	normal session. Waveforms are appended as they're acquired, and the scope metadata files are flushed after each
+	one, so a recording which is interrupted (crash, power loss, etc) is still readable up to the last waveform.
+
+	All disk I/O happens in a dedicated thread. The queue between the GUI thread and the I/O thread is bounded both in
+	number of points and in bytes; once it's full, IsFull() returns true and the session stops releasing the waveform
+	thread until the disk catches up. This stalls acquisition rather than buffering an unbounded amount of data.
+ */
+class WaveformRecorder
+{
+public:
+	WaveformRecorder(Session& session, const std::string& dataDir, size_t maxDepth, size_t maxBytes);
+	~WaveformRecorder();
+
+	bool Start(const std::vector<std::shared_ptr<Oscilloscope>>& scopes);
+	void Stop();
+
+	void Record(std::shared_ptr<HistoryPoint> point);
+	bool IsFull();
+	void ReleaseCompleted();
+
+	///@brief Returns true if writing to disk has failed (no further waveforms will be recorded)
+	bool HasFailed()
+	{ return m_failed; }
+
+	///@brief Path to the data directory being recorded to
+	const std::string& GetDataDir()
+	{ return m_dataDir; }
+
+	///@brief Returns the number of history points written to disk so far
+	size_t GetPointsWritten()
+	{ return m_pointsWritten; }
+
+	///@brief Returns the number of bytes of waveform data written to disk so far
+	size_t GetBytesWritten()
+	{ return m_bytesWritten; }
+
+	size_t GetQueueDepth();
+	size_t GetQueuedBytes();
+	double GetThroughput();
+	double GetAverageRate();
+
+protected:
+	void Run();
+	bool WritePoint(RecordedPoint& item);
+
+	///@brief The session being recorded
+	Session& m_session;
+
+	///@brief Path to the data directory we're writing to
+	std::string m_dataDir;
+
+	///@brief Maximum number of points waiting to be written
+	size_t m_maxDepth;
+
+	///@brief Maximum total size of points waiting to be written, in bytes
+	size_t m_maxBytes;
+
+	///@brief The I/O thread
+	std::unique_ptr<std::thread> m_thread;
+
+	///@brief Mutex controlling access to the queues
+	std::mutex m_mutex;
+
+	///@brief Points waiting to be written
+	std::list<RecordedPoint> m_queue;
+
+	///@brief Total size of points in m_queue, plus the one currently being written
+	size_t m_queuedBytes;
+
+	///@brief Points which have been written, waiting for the GUI thread to release them
+	std::list<RecordedPoint> m_completed;
+
+	///@brief Signaled when a point is added to the queue, or we're stopping
+	Event m_workEvent;
+
+	///@brief Set to make the I/O thread exit once the queue is empty
+	std::atomic<bool> m_stopping;
+
+	///@brief Set if a write failed
+	std::atomic<bool> m_failed;
+
+	///@brief Open metadata file for each scope
+	std::map<std::shared_ptr<Oscilloscope>, FILE*> m_metadataFiles;
+
+	///@brief Sequence number of the next point to be recorded
+	size_t m_nextPointID;
+
+	///@brief Number of points written so far
+	std::atomic<size_t> m_pointsWritten;
+
+	///@brief Number of bytes of waveform data written so far
+	std::atomic<size_t> m_bytesWritten;
+
+	///@brief Total time the I/O thread has spent writing, in seconds
+	std::atomic<double> m_writeTime;
+
+	///@brief Time the recording was started
+	double m_startTime;
+};
+
+#endif
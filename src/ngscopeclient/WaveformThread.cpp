@@ -35,6 +35,7 @@
 #include "ngscopeclient.h"
 #include "pthread_compat.h"
 #include "Session.h"
+#include "TriggerGroupWorker.h"
 #include "WaveformArea.h"
 
 using namespace std;
@@ -49,10 +50,22 @@ Event g_refilterDoneEvent;
 Event g_waveformReadyEvent;
 Event g_waveformProcessedEvent;
 
+///@brief Signaled whenever there might be work for the waveform thread (new data, refilter/rerender requests, etc)
+Event g_waveformThreadWakeEvent;
+
 ///@brief Time spent on the last cycle of waveform rendering shaders
 atomic<int64_t> g_lastWaveformRenderTime;
 
-void RenderAllWaveforms(vk::raii::CommandBuffer& cmdbuf, Session* session, shared_ptr<QueueHandle> queue);
+void RenderAllWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	const vector<shared_ptr<TriggerGroup>>& busyGroups);
+static vector<shared_ptr<TriggerGroup>> GetBusyTriggerGroups(
+	map<shared_ptr<TriggerGroup>, unique_ptr<TriggerGroupWorker>>& workers);
+static void DispatchTriggerGroups(
+	Session* session,
+	map<shared_ptr<TriggerGroup>, unique_ptr<TriggerGroupWorker>>& workers);
 
 /**
 	@brief Mutex for controlling access to background Vulkan activity
@@ -96,6 +109,9 @@ void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 				bufname.c_str()));
 	}
 
+	//Worker threads processing each trigger group's acquisitions in parallel
+	map<shared_ptr<TriggerGroup>, unique_ptr<TriggerGroupWorker>> workers;
+
 	while(!*shuttingDown)
 	{
 		//If re-running the filter graph was requested, do that (and re-render)
@@ -106,7 +122,7 @@ void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 
 			LogTrace("WaveformThread: re-running filter graph and re-rendering\n");
 			session->RefreshAllFilters();
-			RenderAllWaveforms(cmdbuf, session, queue);
+			RenderAllWaveforms(cmdbuf, session, queue, {});
 			g_refilterDoneEvent.Signal();
 			continue;
 		}
@@ -115,7 +131,7 @@ void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 		{
 			LogTrace("WaveformThread: re-running partial filter graph and re-rendering\n");
 			if(session->RefreshDirtyFilters())
-				RenderAllWaveforms(cmdbuf, session, queue);
+				RenderAllWaveforms(cmdbuf, session, queue, {});
 			g_refilterDoneEvent.Signal();
 			continue;
 		}
@@ -124,47 +140,169 @@ void WaveformThread(Session* session, atomic<bool>* shuttingDown)
 		if(g_rerenderRequestedEvent.Peek())
 		{
 			LogTrace("WaveformThread: re-rendering\n");
-			RenderAllWaveforms(cmdbuf, session, queue);
+			RenderAllWaveforms(cmdbuf, session, queue, {});
 			g_rerenderDoneEvent.Signal();
 			continue;
 		}
 
-		//Wait for data to be available from all scopes
-		if(!session->CheckForPendingWaveforms())
+		//With no online instruments, just re-run the whole filter graph each time we're armed
+		if(!session->HasOnlineScopes())
 		{
-			this_thread::sleep_for(chrono::milliseconds(1));
+			//Anything which might give us work to do signals the wake event, so sleep until then.
+			//The timeout is only a backstop in case something changes state without signaling us.
+			if(!session->CheckForPendingWaveforms())
+			{
+				g_waveformThreadWakeEvent.BlockWithTimeout(chrono::milliseconds(100));
+				session->OnWaveformThreadWakeup();
+				continue;
+			}
+
+			session->DownloadWaveforms();
+			session->RefreshAllFilters();
+			RenderAllWaveforms(cmdbuf, session, queue, {});
+
+			session->CommitAcquisition();
+			g_waveformReadyEvent.Signal();
+			while(!*shuttingDown && session->IsPipelineFull())
+				g_waveformProcessedEvent.Block();
 			continue;
 		}
 
-		//We've got data. Download it, then run the filter graph
-		session->DownloadWaveforms();
-		session->RefreshAllFilters();
+		//Start each trigger group with new data on its own worker, then collect whatever has finished
+		DispatchTriggerGroups(session, workers);
+		list<PendingAcquisition> acquisitions;
+		for(auto& it : workers)
+		{
+			if(it.second->IsDone())
+				acquisitions.push_back(it.second->TakeAcquisition());
+		}
+
+		//Nothing finished yet? Sleep until a worker or instrument wakes us
+		if(acquisitions.empty())
+		{
+			g_waveformThreadWakeEvent.BlockWithTimeout(chrono::milliseconds(100));
+			session->OnWaveformThreadWakeup();
+			continue;
+		}
 
-		//Rerun the heavyweight rendering shaders
-		RenderAllWaveforms(cmdbuf, session, queue);
+		//Rerun the heavyweight rendering shaders.
+		//Groups which are still busy with their next acquisition are skipped, rather than holding up the ones which
+		//just finished. Their waveforms are rendered once their own acquisition comes in.
+		RenderAllWaveforms(cmdbuf, session, queue, GetBusyTriggerGroups(workers));
 
-		//Unblock the UI threads, then wait for acknowledgement that it's processed
+		//Hand the acquisitions off to the UI thread.
+		//Rather than waiting for the UI to add them to history before we move on, keep going with the next acquisition
+		//as long as we're less than the pipeline depth ahead. The instrument threads keep downloading in parallel.
+		for(auto& acq : acquisitions)
+			session->CommitAcquisition(acq);
 		g_waveformReadyEvent.Signal();
-		g_waveformProcessedEvent.Block();
+		while(!*shuttingDown && session->IsPipelineFull())
+			g_waveformProcessedEvent.Block();
 	}
 
+	//Let any groups still processing finish up before we go
+	workers.clear();
+
 	LogTrace("Shutting down\n");
 }
 
-void RenderAllWaveforms(vk::raii::CommandBuffer& cmdbuf, Session* session, shared_ptr<QueueHandle> queue)
+/**
+	@brief Starts a worker on each trigger group which has new data, and isn't still busy with its last acquisition
+
+	Workers are created the first time their group triggers, and destroyed once their group no longer exists.
+ */
+static void DispatchTriggerGroups(
+	Session* session,
+	map<shared_ptr<TriggerGroup>, unique_ptr<TriggerGroupWorker>>& workers)
+{
+	auto groups = session->GetTriggerGroups();
+
+	//Get rid of workers for groups which have gone away (once they've finished whatever they were doing)
+	for(auto it = workers.begin(); it != workers.end(); )
+	{
+		if(!it->second->IsBusy() && (find(groups.begin(), groups.end(), it->first) == groups.end()) )
+			it = workers.erase(it);
+		else
+			it ++;
+	}
+
+	//Don't start anything new if the GUI is too far behind
+	if(session->IsPipelineFull())
+		return;
+
+	for(auto group : groups)
+	{
+		auto it = workers.find(group);
+		if( (it != workers.end()) && it->second->IsBusy() )
+			continue;
+		if(!session->CheckForPendingWaveforms(group))
+			continue;
+
+		if(it == workers.end())
+			it = workers.emplace(group, make_unique<TriggerGroupWorker>(session, group)).first;
+		it->second->Start();
+	}
+}
+
+/**
+	@brief Gets the trigger groups whose workers are still processing an acquisition
+ */
+static vector<shared_ptr<TriggerGroup>> GetBusyTriggerGroups(
+	map<shared_ptr<TriggerGroup>, unique_ptr<TriggerGroupWorker>>& workers)
+{
+	vector<shared_ptr<TriggerGroup>> ret;
+	for(auto& it : workers)
+	{
+		if(it.second->IsBusy())
+			ret.push_back(it.first);
+	}
+	return ret;
+}
+
+/**
+	@brief Rasterizes every displayed waveform, other than those fed by any of the specified trigger groups
+
+	Busy groups hold their data locked exclusively while they run their filters. Rather than waiting for them, we
+	only lock the other groups, and leave the channels a busy group may be writing to showing their previous image.
+
+	@param cmdbuf		Command buffer to record rendering commands into
+	@param session		The session
+	@param queue		Queue to submit the commands to
+	@param busyGroups	Trigger groups which are still processing an acquisition (empty to render everything)
+ */
+void RenderAllWaveforms(
+	vk::raii::CommandBuffer& cmdbuf,
+	Session* session,
+	shared_ptr<QueueHandle> queue,
+	const vector<shared_ptr<TriggerGroup>>& busyGroups)
 {
 	double tstart = GetTime();
 
+	//Has to be done before locking any waveform data
+	auto skip = session->GetNodesFedBy(busyGroups);
+	vector<shared_ptr<TriggerGroup>> idleGroups;
+	for(auto group : session->GetTriggerGroups())
+	{
+		if(find(busyGroups.begin(), busyGroups.end(), group) == busyGroups.end())
+			idleGroups.push_back(group);
+	}
+
 	//Must lock mutexes in this order to avoid deadlock
-	shared_lock<shared_mutex> lock1(session->GetWaveformDataMutex());
+	shared_lock<ProfiledSharedMutex> lock1(session->GetWaveformDataMutex());
+	shared_lock<ProfiledSharedMutex> lock4(session->GetFilterDataMutex());
+	TriggerGroupDataLock lock5(idleGroups);
 	shared_lock<shared_mutex> lock2(g_vulkanActivityMutex);
 	lock_guard<mutex> lock3(session->GetRasterizedWaveformMutex());
 
+	//Bring the min/max pyramids of any deep waveforms up to date first, so rasterization never has to build them.
+	//This is a no-op for waveforms which haven't changed (e.g. when re-rendering after zooming).
+	session->UpdateWaveformMipmaps(skip);
+
 	//Keep references to all displayed channels open until the rendering finishes
 	//This prevents problems if we close a WaveformArea or remove a channel from it before the shader completes
 	vector< shared_ptr<DisplayedChannel> > channels;
 	cmdbuf.begin({});
-	session->RenderWaveformTextures(cmdbuf, channels);
+	session->RenderWaveformTextures(cmdbuf, channels, skip);
 	cmdbuf.end();
 	queue->SubmitAndBlock(cmdbuf);
 
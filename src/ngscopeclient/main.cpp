@@ -35,6 +35,7 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "ngscopeclient.h"
 #include "MainWindow.h"
+#include "HeadlessRenderer.h"
 #include "../scopeprotocols/scopeprotocols.h"
 #include "imgui_internal.h"
 
@@ -53,6 +54,13 @@ int main(int argc, char* argv[])
 	//Global settings
 	Severity console_verbosity = Severity::NOTICE;
 
+	//Headless rendering settings
+	bool headless = false;
+	string outDir = ".";
+	size_t width = 1920;
+	size_t height = 400;
+	vector<string> sessionFiles;
+
 	for(int i=1; i<argc; i++)
 	{
 		string s(argv[i]);
@@ -61,8 +69,29 @@ int main(int argc, char* argv[])
 		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
 			continue;
 
-		//TODO: other arguments
-
+		if(s == "--headless")
+			headless = true;
+		else if( (s == "--outdir") && (i+1 < argc) )
+			outDir = argv[++i];
+		else if( (s == "--size") && (i+1 < argc) )
+		{
+			//Height is limited by the rasterizer's working buffer (MAX_HEIGHT in waveform-compute.glsl)
+			if( (2 != sscanf(argv[++i], "%zux%zu", &width, &height)) ||
+				(width == 0) || (height == 0) || (height > 2048) )
+			{
+				fprintf(stderr, "Expected --size WIDTHxHEIGHT, with nonzero width and height of at most 2048\n");
+				return 1;
+			}
+		}
+		else if( (s.length() > 13) && (s.substr(s.length() - 13) == ".scopesession") )
+			sessionFiles.push_back(s);
+		else
+			fprintf(stderr, "Ignoring unrecognized argument \"%s\"\n", s.c_str());
+	}
+	if(headless && sessionFiles.empty())
+	{
+		fprintf(stderr, "Usage: ngscopeclient --headless [--outdir dir] [--size WxH] file.scopesession ...\n");
+		return 1;
 	}
 
 	//Set up logging
@@ -70,6 +99,9 @@ int main(int argc, char* argv[])
 	g_log_sinks.push_back(make_unique<ColoredSTDLogSink>(console_verbosity));
 	g_log_sinks.push_back(unique_ptr<GuiLogSink>(g_guiLog));
 
+	if(!headless && !sessionFiles.empty())
+		LogWarning("Session files on the command line are only used in --headless mode\n");
+
 	//Complain if the OpenMP wait policy isn't set right
 	const char* policy = getenv("OMP_WAIT_POLICY");
 	#ifndef _WIN32
@@ -101,13 +133,31 @@ int main(int argc, char* argv[])
 	#endif
 
 	//Initialize object creation tables for predefined libraries
-	if(!VulkanInit())
+	//Headless mode has no display, so don't touch GLFW at all
+	if(!VulkanInit(headless))
 		return 1;
 	TransportStaticInit();
 	DriverStaticInit();
 	ScopeProtocolStaticInit();
 	InitializePlugins();
 
+	//Render each session to files and quit
+	if(headless)
+	{
+		int ret = 0;
+		{
+			HeadlessRenderer renderer(width, height);
+			for(auto& path : sessionFiles)
+			{
+				if(!renderer.Render(path, outDir))
+					ret = 1;
+			}
+		}
+
+		ScopehalStaticCleanup();
+		return ret;
+	}
+
 	{
 		//Make the top level window
 		shared_ptr<QueueHandle> queue(g_vkQueueManager->GetRenderQueue("g_mainWindow.render"));
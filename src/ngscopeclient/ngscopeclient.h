@@ -56,6 +56,8 @@
 #include "Event.h"
 
 class Session;
+class PollScheduler;
+class WaveformQueuePolicy;
 
 class InstrumentThreadArgs
 {
@@ -67,6 +69,9 @@ public:
 
 	std::shared_ptr<SCPIInstrument> inst;
 	std::atomic<bool>* shuttingDown;
+	Event* wakeEvent;
+	PollScheduler* pollScheduler;
+	WaveformQueuePolicy* queuePolicy;
 	Session* session;
 
 	//Additional per-instrument-type state we can add
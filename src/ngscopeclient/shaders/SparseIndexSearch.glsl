@@ -0,0 +1,97 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2022 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Finds the first sample of a sparse waveform in each pixel column of the display
+ */
+
+#version 430
+#pragma shader_stage(compute)
+
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_storage_buffer_object : require
+
+//for now, no fallback for no-int64 (the CPU does the search instead)
+#extension GL_ARB_gpu_shader_int64 : require
+
+#define X_BLOCK_SIZE 64
+
+layout(local_size_x=X_BLOCK_SIZE, local_size_y=1, local_size_z=1) in;
+
+//Global configuration for the run
+layout(std430, push_constant) uniform constants
+{
+	//Timestamp at the left edge of the window, in sample ticks
+	int64_t base;
+
+	//Integer part of the number of sample ticks per pixel
+	int64_t stepInt;
+
+	//Fractional part of the number of sample ticks per pixel (32.32 fixed point)
+	uint stepFrac;
+
+	uint memDepth;
+	uint windowWidth;
+};
+
+//Sample timestamps, in sample ticks
+layout(std430, binding=0) restrict readonly buffer buf_offsets
+{
+	int64_t offsets[];
+};
+
+//Index of the first sample at or after the left edge of each column
+layout(std430, binding=1) restrict writeonly buffer buf_index
+{
+	uint xind[];
+};
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if(i >= windowWidth)
+		return;
+
+	int64_t target = base + int64_t(i)*stepInt + int64_t( (uint64_t(i) * uint64_t(stepFrac)) >> 32 );
+
+	//Binary search for the first sample >= target
+	uint lo = 0;
+	uint hi = memDepth;
+	while(lo < hi)
+	{
+		uint mid = lo + (hi - lo) / 2;
+		if(offsets[mid] < target)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	xind[i] = lo;
+}
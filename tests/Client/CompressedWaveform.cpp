@@ -0,0 +1,222 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test and benchmark for CompressedWaveform
+ */
+#ifdef _CATCH2_V3
+#include <catch2/catch_all.hpp>
+#else
+#include <catch2/catch.hpp>
+#endif
+
+#include "Client.h"
+#include "../../src/ngscopeclient/CompressedWaveform.h"
+
+using namespace std;
+
+/**
+	@brief Fills a waveform with a noisy sine wave, quantized and then converted to volts the same way a driver would
+ */
+static void MakeAdcWaveform(UniformAnalogWaveform& wfm, size_t wavelen, int bits)
+{
+	uniform_real_distribution<float> gaindesc(0.001, 0.1);
+	uniform_real_distribution<float> offdesc(-1, 1);
+	normal_distribution<float> noisedesc(0, 2);
+
+	int maxcode = (1 << (bits - 1)) - 1;
+	float gain = gaindesc(g_rng);
+	float off = offdesc(g_rng);
+	wfm.m_timescale = 1000;
+	wfm.PrepareForCpuAccess();
+	wfm.Resize(wavelen);
+	for(size_t i=0; i<wavelen; i++)
+	{
+		int code = lrintf(0.75f * maxcode * sinf(i * 0.001f) + noisedesc(g_rng));
+		code = max(-maxcode - 1, min(maxcode, code));
+		wfm.m_samples[i] = code * gain - off;
+	}
+	wfm.MarkModifiedFromCpu();
+}
+
+/**
+	@brief Fills a sparse waveform with irregular sample spacing and a handful of distinct levels
+ */
+static void MakeSparseWaveform(SparseAnalogWaveform& wfm, size_t wavelen)
+{
+	uniform_int_distribution<int> durdesc(1, 8);
+	uniform_int_distribution<int> codedesc(0, 15);
+
+	wfm.PrepareForCpuAccess();
+	wfm.Resize(wavelen);
+	int64_t t = 0;
+	for(size_t i=0; i<wavelen; i++)
+	{
+		int64_t dur = durdesc(g_rng);
+		wfm.m_offsets[i] = t;
+		wfm.m_durations[i] = dur;
+		wfm.m_samples[i] = codedesc(g_rng) * 0.125f;
+		t += dur;
+	}
+	wfm.MarkModifiedFromCpu();
+}
+
+TEST_CASE("CompressedWaveform_UniformAnalog")
+{
+	const size_t wavelen = 1000000;
+
+	//Test both 8 and 10 bit ADCs
+	for(int bits = 8; bits <= 10; bits += 2)
+	{
+		SECTION(to_string(bits) + " bit ADC")
+		{
+			UniformAnalogWaveform wfm;
+			MakeAdcWaveform(wfm, wavelen, bits);
+
+			unique_ptr<CompressedWaveform> cw(CompressedWaveform::Compress(&wfm));
+			REQUIRE(cw != nullptr);
+
+			size_t rawsize = wavelen * sizeof(float);
+			REQUIRE(rawsize > 3 * cw->GetMemoryUsage());
+
+			//Must be bit-exact
+			unique_ptr<WaveformBase> out(cw->Decompress());
+			auto uout = dynamic_cast<UniformAnalogWaveform*>(out.get());
+			REQUIRE(uout != nullptr);
+			REQUIRE(uout->size() == wavelen);
+			REQUIRE(uout->m_timescale == wfm.m_timescale);
+			uout->PrepareForCpuAccess();
+			REQUIRE(0 == memcmp(uout->m_samples.GetCpuPointer(), wfm.m_samples.GetCpuPointer(), rawsize));
+		}
+	}
+}
+
+TEST_CASE("CompressedWaveform_SparseAnalog")
+{
+	const size_t wavelen = 1000000;
+
+	SparseAnalogWaveform wfm;
+	MakeSparseWaveform(wfm, wavelen);
+
+	unique_ptr<CompressedWaveform> cw(CompressedWaveform::Compress(&wfm));
+	REQUIRE(cw != nullptr);
+
+	unique_ptr<WaveformBase> out(cw->Decompress());
+	auto sout = dynamic_cast<SparseAnalogWaveform*>(out.get());
+	REQUIRE(sout != nullptr);
+	REQUIRE(sout->size() == wavelen);
+	sout->PrepareForCpuAccess();
+	for(size_t i=0; i<wavelen; i++)
+	{
+		REQUIRE(sout->m_offsets[i] == wfm.m_offsets[i]);
+		REQUIRE(sout->m_durations[i] == wfm.m_durations[i]);
+		REQUIRE(sout->m_samples[i] == wfm.m_samples[i]);
+	}
+}
+
+/**
+	@brief Times compression and decompression of a large waveform, logging the speed and ratio achieved
+ */
+static void BenchmarkCompression(WaveformBase* wfm, size_t rawsize)
+{
+	double start = GetTime();
+	unique_ptr<CompressedWaveform> cw(CompressedWaveform::Compress(wfm));
+	double dt = GetTime() - start;
+	REQUIRE(cw != nullptr);
+	LogVerbose("Compression   : %6.2f ms, ratio %.2f\n", dt * 1000, rawsize * 1.0f / cw->GetMemoryUsage());
+
+	start = GetTime();
+	unique_ptr<WaveformBase> out(cw->Decompress());
+	dt = GetTime() - start;
+	LogVerbose("Decompression : %6.2f ms, %.2f GB/s\n", dt * 1000, rawsize * 1e-9 / dt);
+}
+
+TEST_CASE("CompressedWaveform_Benchmark", "[.][benchmark]")
+{
+	const size_t wavelen = 10000000;
+
+	for(int bits = 8; bits <= 10; bits += 2)
+	{
+		LogVerbose("%d bit ADC, uniform\n", bits);
+		LogIndenter li;
+
+		UniformAnalogWaveform wfm;
+		MakeAdcWaveform(wfm, wavelen, bits);
+		BenchmarkCompression(&wfm, wavelen * sizeof(float));
+	}
+
+	LogVerbose("Sparse\n");
+	LogIndenter li;
+
+	SparseAnalogWaveform wfm;
+	MakeSparseWaveform(wfm, wavelen);
+	BenchmarkCompression(&wfm, wavelen * (sizeof(float) + 2*sizeof(int64_t)));
+}
+
+TEST_CASE("CompressedWaveform_Incompressible")
+{
+	//Full-precision random floats have far too many distinct values to palettize
+	const size_t wavelen = 100000;
+	uniform_real_distribution<float> desc(-1, 1);
+
+	UniformAnalogWaveform wfm;
+	wfm.PrepareForCpuAccess();
+	wfm.Resize(wavelen);
+	for(size_t i=0; i<wavelen; i++)
+		wfm.m_samples[i] = desc(g_rng);
+	wfm.MarkModifiedFromCpu();
+
+	unique_ptr<CompressedWaveform> cw(CompressedWaveform::Compress(&wfm));
+	REQUIRE(cw == nullptr);
+}
+
+TEST_CASE("CompressedWaveform_NaN")
+{
+	//NaNs can't be palettized, wherever they show up in the waveform (including the very first sample)
+	const size_t wavelen = 1000;
+
+	for(size_t pos : {(size_t)0, (size_t)1, wavelen - 1})
+	{
+		SECTION("NaN at sample " + to_string(pos))
+		{
+			UniformAnalogWaveform wfm;
+			wfm.PrepareForCpuAccess();
+			wfm.Resize(wavelen);
+			for(size_t i=0; i<wavelen; i++)
+				wfm.m_samples[i] = (i % 4) * 0.25f;
+			wfm.m_samples[pos] = NAN;
+			wfm.MarkModifiedFromCpu();
+
+			unique_ptr<CompressedWaveform> cw(CompressedWaveform::Compress(&wfm));
+			REQUIRE(cw == nullptr);
+		}
+	}
+}
@@ -0,0 +1,325 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Checks CpuRasterizer against every variant of the waveform rendering shader
+ */
+#ifdef _CATCH2_V3
+#include <catch2/catch_all.hpp>
+#else
+#include <catch2/catch.hpp>
+#endif
+
+#include "Client.h"
+#include "../../src/ngscopeclient/CpuRasterizer.h"
+
+using namespace std;
+
+/**
+	@brief Inputs for one rasterization, in the same buffers the shader is bound to
+ */
+struct RasterizerTestData
+{
+	AcceleratorBuffer<float> m_analog;
+	AcceleratorBuffer<bool> m_digital;
+	AcceleratorBuffer<int64_t> m_offsets;
+	AcceleratorBuffer<int64_t> m_durations;
+	AcceleratorBuffer<uint32_t> m_indexes;
+};
+
+/**
+	@brief Generates a noisy sine wave (or its sign, for digital) with either uniform or random sample spacing
+ */
+static void MakeWaveform(RasterizerTestData& data, size_t len, bool digital, bool sparse)
+{
+	normal_distribution<float> noisedist(0, 0.05);
+	uniform_int_distribution<int64_t> gapdist(1, 5);
+
+	data.m_analog.resize(len);
+	data.m_digital.resize(len);
+	data.m_offsets.resize(len);
+	data.m_durations.resize(len);
+	data.m_analog.PrepareForCpuAccess();
+	data.m_digital.PrepareForCpuAccess();
+	data.m_offsets.PrepareForCpuAccess();
+	data.m_durations.PrepareForCpuAccess();
+
+	int64_t t = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		float v = sinf(t * 0.002f) + noisedist(g_rng);
+		data.m_analog[i] = v;
+		data.m_digital[i] = (v > 0);
+		data.m_offsets[i] = t;
+		t += sparse ? gapdist(g_rng) : 1;
+	}
+	for(size_t i=0; i+1<len; i++)
+		data.m_durations[i] = data.m_offsets[i+1] - data.m_offsets[i];
+	data.m_durations[len-1] = 1;
+
+	data.m_analog.MarkModifiedFromCpu();
+	data.m_digital.MarkModifiedFromCpu();
+	data.m_offsets.MarkModifiedFromCpu();
+	data.m_durations.MarkModifiedFromCpu();
+}
+
+/**
+	@brief Fills in the push constants the same way WaveformArea::RasterizeAnalogOrDigitalWaveform() does
+
+	@param xscale	Pixels per sample
+	@param offset	X axis offset, in samples
+ */
+static ConfigPushConstants MakeConfig(size_t len, uint32_t w, uint32_t h, double xscale, int64_t offset, bool digital)
+{
+	ConfigPushConstants config;
+	config.innerXoff = -offset;
+	config.windowHeight = h;
+	config.windowWidth = w;
+	config.memDepth = len;
+	config.offset_samples = offset - 2;
+	config.alpha = 0.05;
+	config.xoff = 0;
+	config.xscale = xscale;
+	if(digital)
+	{
+		config.yoff = 0;
+		config.yscale = h - 1;
+		config.ybase = 0;
+	}
+	else
+	{
+		//Slightly more than full scale so some of the noise gets clipped
+		config.yoff = 0;
+		config.yscale = h * 0.45f;
+		config.ybase = h * 0.5f;
+	}
+	config.persistScale = 0;
+	return config;
+}
+
+/**
+	@brief Finds the first sample in each pixel column of a sparse waveform, like the non-int64 path in WaveformArea
+ */
+static void MakeIndexes(RasterizerTestData& data, uint32_t w, double xscale, int64_t offset)
+{
+	data.m_indexes.resize(w);
+	data.m_indexes.PrepareForCpuAccess();
+	data.m_offsets.PrepareForCpuAccess();
+	auto begin = data.m_offsets.GetCpuPointer();
+	auto end = begin + data.m_offsets.size();
+	for(uint32_t i=0; i<w; i++)
+	{
+		int64_t target = floor(i / xscale) + offset;
+		data.m_indexes[i] = lower_bound(begin, end, target) - begin;
+	}
+	data.m_indexes.MarkModifiedFromCpu();
+}
+
+/**
+	@brief Runs one variant of the shader and the CPU rasterizer with the same inputs, and compares the results
+
+	The two do the same math, in the same order, but the GPU may round differently (e.g. fused multiply-adds), which
+	can move the end of a span by a pixel. So rather than requiring bit-exact output, require that almost every pixel
+	matches and the total intensity is essentially the same.
+
+	@param variant	Shader variant, e.g. "analog.zerohold" (int64 and dense suffixes are added automatically)
+ */
+static void CompareRasterizers(
+	const string& variant,
+	CpuRasterizer& raster,
+	RasterizerTestData& data,
+	const ConfigPushConstants& config)
+{
+	LogVerbose("%s: %u samples, %.3f pixels/sample\n", variant.c_str(), config.memDepth, config.xscale);
+	LogIndenter li;
+
+	size_t npixels = config.windowWidth * config.windowHeight;
+
+	//Reference
+	vector<float> expected(npixels, 0);
+	data.m_analog.PrepareForCpuAccess();
+	data.m_digital.PrepareForCpuAccess();
+	data.m_offsets.PrepareForCpuAccess();
+	data.m_durations.PrepareForCpuAccess();
+	data.m_indexes.PrepareForCpuAccess();
+	raster.m_analogSamples = data.m_analog.GetCpuPointer();
+	raster.m_digitalSamples = data.m_digital.GetCpuPointer();
+	raster.m_offsets = data.m_offsets.GetCpuPointer();
+	raster.m_durations = data.m_durations.GetCpuPointer();
+	raster.m_indexes = data.m_indexes.GetCpuPointer();
+	double start = GetTime();
+	raster.Rasterize(config, expected.data());
+	double dtcpu = GetTime() - start;
+
+	//Same bindings as DisplayedChannel sets up for this variant
+	string path = "shaders/waveform-compute." + variant;
+	if(g_hasShaderInt64)
+		path += ".int64";
+	if(raster.m_dense)
+		path += ".dense";
+	path += ".spv";
+	size_t nbindings = 2;
+	if(!raster.m_dense)
+		nbindings = (raster.m_zeroHold && !raster.m_digital) ? 5 : 4;
+	ComputePipeline pipe(path, nbindings, sizeof(ConfigPushConstants));
+
+	shared_ptr<QueueHandle> queue(g_vkQueueManager->GetComputeQueue("CpuRasterizer.queue"));
+	vk::CommandPoolCreateInfo poolInfo(
+		vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		queue->m_family );
+	vk::raii::CommandPool pool(*g_vkComputeDevice, poolInfo);
+	vk::CommandBufferAllocateInfo bufinfo(*pool, vk::CommandBufferLevel::ePrimary, 1);
+	vk::raii::CommandBuffer cmdbuf(std::move(vk::raii::CommandBuffers(*g_vkComputeDevice, bufinfo).front()));
+
+	AcceleratorBuffer<float> actual;
+	actual.resize(npixels);
+
+	start = GetTime();
+	cmdbuf.begin({});
+	pipe.BindBufferNonblocking(0, actual, cmdbuf, true);
+	if(raster.m_digital)
+		pipe.BindBufferNonblocking(1, data.m_digital, cmdbuf);
+	else
+		pipe.BindBufferNonblocking(1, data.m_analog, cmdbuf);
+	if(!raster.m_dense)
+	{
+		pipe.BindBufferNonblocking(2, data.m_offsets, cmdbuf);
+		pipe.BindBufferNonblocking(3, data.m_indexes, cmdbuf);
+		if(nbindings == 5)
+			pipe.BindBufferNonblocking(4, data.m_durations, cmdbuf);
+	}
+	pipe.Dispatch(cmdbuf, config, config.windowWidth, 1, 1);
+	cmdbuf.end();
+	queue->SubmitAndBlock(cmdbuf);
+	double dtgpu = GetTime() - start;
+	actual.MarkModifiedFromGpu();
+	actual.PrepareForCpuAccess();
+
+	LogVerbose("CPU : %6.2f ms\n", dtcpu * 1000);
+	LogVerbose("GPU : %6.2f ms\n", dtgpu * 1000);
+
+	size_t mismatches = 0;
+	double sumExpected = 0;
+	double sumActual = 0;
+	for(size_t i=0; i<npixels; i++)
+	{
+		if(fabs(expected[i] - actual[i]) > 1e-4f * max(1.0f, expected[i]))
+			mismatches ++;
+		sumExpected += expected[i];
+		sumActual += actual[i];
+	}
+	LogVerbose("%zu of %zu pixels differ\n", mismatches, npixels);
+
+	REQUIRE(sumExpected > 0);
+	REQUIRE(mismatches <= npixels / 200);
+	REQUIRE(fabs(sumActual - sumExpected) <= 0.01 * sumExpected);
+}
+
+TEST_CASE("CpuRasterizer_Shaders")
+{
+	const size_t len = 100000;
+	const uint32_t w = 512;
+	const uint32_t h = 256;
+	const uint32_t hdigital = 32;
+	const int64_t offset = 1000;
+
+	//Zoomed out (many samples per pixel) and zoomed in (many pixels per sample)
+	vector<double> scales = { w * 1.0 / len, 4 };
+
+	CpuRasterizer raster;
+	RasterizerTestData data;
+
+	SECTION("Uniform analog")
+	{
+		MakeWaveform(data, len, false, false);
+		for(auto xscale : scales)
+			CompareRasterizers("analog", raster, data, MakeConfig(len, w, h, xscale, offset, false));
+	}
+
+	SECTION("Uniform analog zero-hold")
+	{
+		raster.m_zeroHold = true;
+		MakeWaveform(data, len, false, false);
+		for(auto xscale : scales)
+			CompareRasterizers("analog.zerohold", raster, data, MakeConfig(len, w, h, xscale, offset, false));
+	}
+
+	SECTION("Uniform histogram")
+	{
+		raster.m_histogram = true;
+		MakeWaveform(data, len, false, false);
+		for(auto xscale : scales)
+			CompareRasterizers("histogram", raster, data, MakeConfig(len, w, h, xscale, offset, false));
+	}
+
+	SECTION("Uniform digital")
+	{
+		raster.m_digital = true;
+		MakeWaveform(data, len, true, false);
+		for(auto xscale : scales)
+			CompareRasterizers("digital", raster, data, MakeConfig(len, w, hdigital, xscale, offset, true));
+	}
+
+	SECTION("Sparse analog")
+	{
+		raster.m_dense = false;
+		MakeWaveform(data, len, false, true);
+		for(auto xscale : scales)
+		{
+			MakeIndexes(data, w, xscale, offset);
+			CompareRasterizers("analog", raster, data, MakeConfig(len, w, h, xscale, offset, false));
+		}
+	}
+
+	SECTION("Sparse analog zero-hold")
+	{
+		raster.m_dense = false;
+		raster.m_zeroHold = true;
+		MakeWaveform(data, len, false, true);
+		for(auto xscale : scales)
+		{
+			MakeIndexes(data, w, xscale, offset);
+			CompareRasterizers("analog.zerohold", raster, data, MakeConfig(len, w, h, xscale, offset, false));
+		}
+	}
+
+	SECTION("Sparse digital")
+	{
+		raster.m_dense = false;
+		raster.m_digital = true;
+		MakeWaveform(data, len, true, true);
+		for(auto xscale : scales)
+		{
+			MakeIndexes(data, w, xscale, offset);
+			CompareRasterizers("digital", raster, data, MakeConfig(len, w, hdigital, xscale, offset, true));
+		}
+	}
+}
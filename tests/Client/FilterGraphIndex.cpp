@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test and benchmark for FilterGraphIndex
+ */
+#ifdef _CATCH2_V3
+#include <catch2/catch_all.hpp>
+#else
+#include <catch2/catch.hpp>
+#endif
+
+#include "Client.h"
+#include "../../src/ngscopeclient/FilterGraphIndex.h"
+
+using namespace std;
+
+/**
+	@brief Minimal stand-in for a flow graph node, with just enough API for FilterGraphIndex
+ */
+class TestNode
+{
+public:
+	struct Input
+	{
+		TestNode* m_channel;
+	};
+
+	size_t GetInputCount()
+	{ return m_inputs.size(); }
+
+	Input GetInput(size_t i)
+	{ return Input{m_inputs[i]}; }
+
+	vector<TestNode*> m_inputs;
+};
+
+/**
+	@brief Reference implementation: checks a node against the sources by walking its inputs upstream
+
+	This is how dirty filters used to be found before the reverse edge index, once per node in the graph. Results are
+	cached for the duration of one search, otherwise shared upstream paths make it exponential.
+ */
+static bool IsDownstreamOf(TestNode* node, const set<TestNode*>& sources, map<TestNode*, bool>& cache)
+{
+	auto it = cache.find(node);
+	if(it != cache.end())
+		return it->second;
+
+	bool ret = false;
+	for(auto in : node->m_inputs)
+	{
+		if( (sources.find(in) != sources.end()) || IsDownstreamOf(in, sources, cache) )
+		{
+			ret = true;
+			break;
+		}
+	}
+	cache[node] = ret;
+	return ret;
+}
+
+/**
+	@brief Builds a random acyclic graph: the first nsources nodes have no inputs, every later node has 1-3 inputs
+	chosen from the nodes before it
+ */
+static void MakeGraph(vector<unique_ptr<TestNode>>& storage, set<TestNode*>& nodes, size_t nnodes, size_t nsources)
+{
+	storage.clear();
+	nodes.clear();
+	for(size_t i=0; i<nnodes; i++)
+	{
+		auto node = make_unique<TestNode>();
+		if(i >= nsources)
+		{
+			//Mostly connect to recent nodes, so the graph is deep rather than a wide fan out of the sources
+			size_t ninputs = 1 + (g_rng() % 3);
+			for(size_t j=0; j<ninputs; j++)
+			{
+				size_t window = min(i, (size_t)50);
+				node->m_inputs.push_back(storage[i - 1 - (g_rng() % window)].get());
+			}
+		}
+		nodes.emplace(node.get());
+		storage.push_back(std::move(node));
+	}
+}
+
+TEST_CASE("FilterGraphIndex_Basic")
+{
+	//a -> b -> d
+	//a -> c -> d
+	//e (unconnected)
+	TestNode a, b, c, d, e;
+	b.m_inputs = {&a};
+	c.m_inputs = {&a};
+	d.m_inputs = {&b, &c};
+
+	FilterGraphIndex<TestNode> index;
+	index.Rebuild({&a, &b, &c, &d, &e});
+
+	REQUIRE(index.GetConsumersOf({&a}) == set<TestNode*>({&b, &c, &d}));
+	REQUIRE(index.GetConsumersOf({&c}) == set<TestNode*>({&d}));
+	REQUIRE(index.GetConsumersOf({&d}).empty());
+	REQUIRE(index.GetConsumersOf({&e}).empty());
+
+	//Sources are only included if they're downstream of another source
+	REQUIRE(index.GetConsumersOf({&a, &b}) == set<TestNode*>({&b, &c, &d}));
+
+	//Changing the topology needs a rebuild
+	e.m_inputs = {&d};
+	REQUIRE(index.GetConsumersOf({&a}).count(&e) == 0);
+	index.Rebuild({&a, &b, &c, &d, &e});
+	REQUIRE(index.GetConsumersOf({&a}).count(&e) == 1);
+
+	index.clear();
+	REQUIRE(index.GetConsumersOf({&a}).empty());
+}
+
+TEST_CASE("FilterGraphIndex_Benchmark", "[.][benchmark]")
+{
+	const size_t nnodes = 1000;
+	const size_t nsources = 50;
+	const size_t nrefresh = 100;
+	const size_t marksPerRefresh = 200;
+
+	vector<unique_ptr<TestNode>> storage;
+	set<TestNode*> nodes;
+	MakeGraph(storage, nodes, nnodes, nsources);
+
+	double start = GetTime();
+	FilterGraphIndex<TestNode> index;
+	index.Rebuild(nodes);
+	double dt = GetTime() - start;
+	LogVerbose("Rebuild       : %6.2f ms\n", dt * 1000);
+
+	//Instruments mark channels dirty much faster than the filter graph refreshes.
+	//Marks between refreshes are coalesced into a set, so each refresh does one cone search no matter how many arrived.
+	vector<set<TestNode*>> dirtySets;
+	size_t nmarks = 0;
+	for(size_t i=0; i<nrefresh; i++)
+	{
+		set<TestNode*> dirty;
+		size_t nsrc = 1 + (g_rng() % 5);
+		for(size_t j=0; j<marksPerRefresh; j++)
+		{
+			dirty.emplace(storage[g_rng() % nsrc].get());
+			nmarks ++;
+		}
+		dirtySets.push_back(dirty);
+	}
+
+	vector<set<TestNode*>> cones;
+	start = GetTime();
+	for(auto& dirty : dirtySets)
+		cones.push_back(index.GetConsumersOf(dirty));
+	dt = GetTime() - start;
+	LogVerbose("Indexed cone  : %6.2f ms (%.2f us/refresh, %.1f ns/mark)\n",
+		dt * 1000, dt * 1e6 / nrefresh, dt * 1e9 / nmarks);
+
+	//Old approach: walk upstream from every node in the graph
+	vector<set<TestNode*>> refCones;
+	start = GetTime();
+	for(auto& dirty : dirtySets)
+	{
+		set<TestNode*> cone;
+		map<TestNode*, bool> cache;
+		for(auto node : nodes)
+		{
+			if(IsDownstreamOf(node, dirty, cache))
+				cone.emplace(node);
+		}
+		refCones.push_back(cone);
+	}
+	double dtref = GetTime() - start;
+	LogVerbose("Upstream walk : %6.2f ms (%.2f us/refresh)\n", dtref * 1000, dtref * 1e6 / nrefresh);
+
+	REQUIRE(cones == refCones);
+}
@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test and benchmark for HistoryIndex
+ */
+#ifdef _CATCH2_V3
+#include <catch2/catch_all.hpp>
+#else
+#include <catch2/catch.hpp>
+#endif
+
+#include "Client.h"
+#include "../../src/ngscopeclient/HistoryIndex.h"
+
+using namespace std;
+
+TEST_CASE("HistoryIndex_Basic")
+{
+	HistoryIndex<int> index;
+
+	//Timestamps deliberately out of order, iteration must follow insertion order
+	REQUIRE(index.push_back(TimePoint(3, 0), 30, 300));
+	REQUIRE(index.push_back(TimePoint(1, 0), 10, 100));
+	REQUIRE(index.push_back(TimePoint(2, 500), 20, 200));
+	REQUIRE(index.size() == 3);
+	REQUIRE(index.GetTotalBytes() == 600);
+
+	SECTION("Duplicates")
+	{
+		REQUIRE_FALSE(index.push_back(TimePoint(1, 0), 99, 999));
+		REQUIRE(index.size() == 3);
+		REQUIRE(index.GetTotalBytes() == 600);
+		REQUIRE(*index.find(TimePoint(1, 0)) == 10);
+	}
+
+	SECTION("Order")
+	{
+		vector<int> values(index.begin(), index.end());
+		REQUIRE(values == vector<int>({30, 10, 20}));
+		REQUIRE(*index.rbegin() == 20);
+		REQUIRE(index.GetSequence(TimePoint(3, 0)) < index.GetSequence(TimePoint(1, 0)));
+		REQUIRE(index.GetSequence(TimePoint(1, 0)) < index.GetSequence(TimePoint(2, 500)));
+	}
+
+	SECTION("Lookup")
+	{
+		REQUIRE(index.contains(TimePoint(2, 500)));
+		REQUIRE_FALSE(index.contains(TimePoint(2, 0)));
+		REQUIRE(index.find(TimePoint(2, 0)) == index.end());
+		REQUIRE(index.GetSequence(TimePoint(2, 0)) == UINT64_MAX);
+	}
+
+	SECTION("Erase")
+	{
+		auto it = index.erase(TimePoint(1, 0));
+		REQUIRE(*it == 20);
+		REQUIRE(index.size() == 2);
+		REQUIRE(index.GetTotalBytes() == 500);
+		REQUIRE_FALSE(index.contains(TimePoint(1, 0)));
+
+		//Erasing something that isn't there does nothing
+		REQUIRE(index.erase(TimePoint(1, 0)) == index.end());
+		REQUIRE(index.GetTotalBytes() == 500);
+
+		//Sequence numbers aren't reused
+		auto seq = index.GetSequence(TimePoint(2, 500));
+		REQUIRE(index.push_back(TimePoint(1, 0), 11, 0));
+		REQUIRE(index.GetSequence(TimePoint(1, 0)) > seq);
+	}
+
+	SECTION("Resize")
+	{
+		index.SetBytes(TimePoint(3, 0), 50);
+		REQUIRE(index.GetBytes(TimePoint(3, 0)) == 50);
+		REQUIRE(index.GetTotalBytes() == 350);
+
+		index.clear();
+		REQUIRE(index.empty());
+		REQUIRE(index.GetTotalBytes() == 0);
+	}
+}
+
+TEST_CASE("HistoryIndex_Benchmark", "[.][benchmark]")
+{
+	const size_t npoints = 100000;
+
+	//Random, unique timestamps so insertion order and timestamp order don't match
+	vector<TimePoint> stamps;
+	stamps.reserve(npoints);
+	for(size_t i=0; i<npoints; i++)
+		stamps.push_back(TimePoint(i / 1000, (i % 1000) * 1000000000LL));
+	shuffle(stamps.begin(), stamps.end(), g_rng);
+
+	//Each value is its position in insertion order, so we can find the oldest point's timestamp when evicting
+	HistoryIndex<size_t> index;
+	double start = GetTime();
+	for(size_t i=0; i<npoints; i++)
+		REQUIRE(index.push_back(stamps[i], i, 1));
+	double dt = GetTime() - start;
+	LogVerbose("Insert        : %6.2f ms (%.1f ns/point)\n", dt * 1000, dt * 1e9 / npoints);
+
+	vector<TimePoint> lookups = stamps;
+	shuffle(lookups.begin(), lookups.end(), g_rng);
+	size_t found = 0;
+	start = GetTime();
+	for(auto& t : lookups)
+	{
+		if(index.contains(t))
+			found ++;
+	}
+	dt = GetTime() - start;
+	LogVerbose("Lookup        : %6.2f ms (%.1f ns/point)\n", dt * 1000, dt * 1e9 / npoints);
+	REQUIRE(found == npoints);
+
+	//Evict the oldest half, the way the history manager does when over the depth limit
+	start = GetTime();
+	while(index.size() > npoints/2)
+		index.erase(stamps[*index.begin()]);
+	dt = GetTime() - start;
+	LogVerbose("Evict         : %6.2f ms (%.1f ns/point)\n", dt * 1000, dt * 1e9 / (npoints/2));
+
+	REQUIRE(*index.begin() == npoints/2);
+	REQUIRE(index.GetTotalBytes() == npoints/2);
+}
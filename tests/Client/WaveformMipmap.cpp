@@ -0,0 +1,174 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ngscopeclient                                                                                                        *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit test and benchmark for WaveformMipmap
+ */
+#ifdef _CATCH2_V3
+#include <catch2/catch_all.hpp>
+#else
+#include <catch2/catch.hpp>
+#endif
+
+#include "Client.h"
+#include "../../src/ngscopeclient/WaveformMipmap.h"
+
+using namespace std;
+
+/**
+	@brief Fills a waveform with a cheap pseudorandom pattern, fast enough for billions of samples
+ */
+static void FillWaveform(UniformAnalogWaveform& wfm, size_t len)
+{
+	wfm.m_timescale = 1000;
+	wfm.PrepareForCpuAccess();
+	wfm.Resize(len);
+	float* samples = wfm.m_samples.GetCpuPointer();
+
+	uint32_t seed = g_rng();
+	#pragma omp parallel for
+	for(size_t i=0; i<len; i++)
+	{
+		uint32_t h = (i + seed) * 2654435761u;
+		samples[i] = sinf(i * 0.0001f) + ((h >> 16) & 0xff) * 0.001f;
+	}
+	wfm.MarkModifiedFromCpu();
+}
+
+TEST_CASE("WaveformMipmap_Levels")
+{
+	const size_t wavelen = 3 * MIPMAP_MIN_DEPTH + 5;
+
+	UniformAnalogWaveform wfm;
+	FillWaveform(wfm, wavelen);
+	const float* samples = wfm.m_samples.GetCpuPointer();
+
+	WaveformMipmap mip;
+
+	//Nothing to draw from until Update() has seen the waveform
+	REQUIRE(mip.GetLevel(&wfm, 1e6) == nullptr);
+
+	mip.Update(&wfm);
+	REQUIRE(mip.GetLevelCount() > 0);
+
+	//Every block of every level must hold the exact min and max of the samples it covers
+	for(size_t i=0; i<mip.GetLevelCount(); i++)
+	{
+		size_t blocksize = mip.GetBlockSize(i);
+		size_t nblocks = (wavelen + blocksize - 1) / blocksize;
+
+		//Find the level by asking for a zoom which selects exactly it
+		auto level = mip.GetLevel(&wfm, blocksize * MIPMAP_MIN_OVERSAMPLE / 2);
+		REQUIRE(level != nullptr);
+		REQUIRE(level->size() == nblocks * 2);
+		REQUIRE(level->m_timescale == wfm.m_timescale * (int64_t)blocksize / 2);
+		level->PrepareForCpuAccess();
+
+		for(size_t j=0; j<nblocks; j++)
+		{
+			size_t start = j * blocksize;
+			size_t end = min(start + blocksize, wavelen);
+			float vmin = *min_element(samples + start, samples + end);
+			float vmax = *max_element(samples + start, samples + end);
+			REQUIRE(level->m_samples[j*2] == vmin);
+			REQUIRE(level->m_samples[j*2 + 1] == vmax);
+		}
+	}
+
+	//Zoomed in: draw the waveform itself
+	REQUIRE(mip.GetLevel(&wfm, 1) == nullptr);
+
+	//Once the waveform changes, the old pyramid must not be used until it's rebuilt
+	wfm.m_revision ++;
+	REQUIRE(mip.GetLevel(&wfm, 1e6) == nullptr);
+	mip.Update(&wfm);
+	REQUIRE(mip.GetLevel(&wfm, 1e6) != nullptr);
+
+	//Shallow waveforms don't get a pyramid at all
+	UniformAnalogWaveform small;
+	FillWaveform(small, MIPMAP_MIN_DEPTH / 2);
+	mip.Update(&small);
+	REQUIRE(mip.GetLevelCount() == 0);
+	REQUIRE(mip.GetLevel(&small, 1e6) == nullptr);
+}
+
+/**
+	@brief Build time and drawn sample count, fully zoomed out, from 1K to 1G points
+
+	Hidden by default since the deepest point needs about 5 GB of RAM. Run with the [benchmark] tag.
+ */
+TEST_CASE("WaveformMipmap_DepthSweep", "[.][benchmark]")
+{
+	const size_t width = 2000;
+
+	for(size_t depth = 1000; depth <= 1000000000; depth *= 10)
+	{
+		LogVerbose("Depth %zu\n", depth);
+		LogIndenter li;
+
+		UniformAnalogWaveform wfm;
+		FillWaveform(wfm, depth);
+		double samplesPerPixel = depth * 1.0 / width;
+
+		WaveformMipmap mip;
+		double start = GetTime();
+		mip.Update(&wfm);
+		double dt = GetTime() - start;
+
+		//Second update of the same waveform must be free
+		start = GetTime();
+		mip.Update(&wfm);
+		double dtcached = GetTime() - start;
+
+		auto level = mip.GetLevel(&wfm, samplesPerPixel);
+		size_t drawn = level ? level->size() : depth;
+		LogVerbose("Build         : %8.2f ms (cached %.3f ms), %zu levels\n", dt * 1000, dtcached * 1000,
+			mip.GetLevelCount());
+		LogVerbose("Drawn samples : %zu (%.1f per pixel)\n", drawn, drawn * 1.0 / width);
+
+		//Once there's a pyramid, rasterization cost no longer depends on depth
+		if(depth >= MIPMAP_MIN_DEPTH)
+		{
+			REQUIRE(level != nullptr);
+			REQUIRE(drawn <= 2 * MIPMAP_MIN_OVERSAMPLE * width + 2);
+
+			//and the coarse level still covers the full vertical extent of the waveform
+			wfm.PrepareForCpuAccess();
+			level->PrepareForCpuAccess();
+			auto wbegin = wfm.m_samples.GetCpuPointer();
+			auto lbegin = level->m_samples.GetCpuPointer();
+			REQUIRE(*min_element(lbegin, lbegin + drawn) == *min_element(wbegin, wbegin + depth));
+			REQUIRE(*max_element(lbegin, lbegin + drawn) == *max_element(wbegin, wbegin + depth));
+		}
+		else
+			REQUIRE(level == nullptr);
+	}
+}